@@ -0,0 +1,181 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Small memory allocator microbenchmark.
+ *
+ * Threads allocate and free collection element sized slots (40..200 bytes)
+ * like the worker threads do, once with the slab allocator under a global
+ * lock standing in for the cache lock, and once through the per-thread
+ * magazines, which take the lock only for refills and drains:
+ *
+ *   gcc -O2 -pthread -DHAVE_CONFIG_H -I. -Iinclude -Iengines/default \
+ *       -o bench_alloc devtools/bench_alloc.c engines/default/slabs.c util.c
+ *
+ *   ./bench_alloc [threads] [magazine size]
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "default_engine.h"
+
+#define BENCH_LIVE_SLOTS 1024               /* live slots of each thread */
+#define BENCH_OPS        (4 * 1000 * 1000)  /* alloc/free pairs of each thread */
+
+static struct default_engine engine;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool use_magazine;
+
+/* called by the small memory allocator when the space is short */
+void coll_del_thread_wakeup(void)
+{
+}
+
+static const char *get_logger_name(void)
+{
+    return "bench_alloc";
+}
+
+static void logger_log(EXTENSION_LOG_LEVEL severity, const void* client_cookie,
+                       const char *fmt, ...)
+{
+    (void)severity;
+    (void)client_cookie;
+    (void)fmt;
+}
+
+static EXTENSION_LOGGER_DESCRIPTOR bench_logger = {
+    .get_name = get_logger_name,
+    .log = logger_log
+};
+
+static EXTENSION_LOGGER_DESCRIPTOR *get_logger(void)
+{
+    return &bench_logger;
+}
+
+static SERVER_LOG_API bench_log_api = {
+    .get_logger = get_logger
+};
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void *bench_alloc(size_t size)
+{
+    void *ptr = NULL;
+    if (use_magazine) {
+        ptr = slabs_tcache_alloc(&engine, size);
+    }
+    if (ptr == NULL) {
+        pthread_mutex_lock(&cache_lock);
+        ptr = slabs_alloc(&engine, size, slabs_clsid(&engine, size));
+        pthread_mutex_unlock(&cache_lock);
+    }
+    return ptr;
+}
+
+static void bench_free(void *ptr, size_t size)
+{
+    if (use_magazine && slabs_tcache_free(&engine, ptr, size)) {
+        return;
+    }
+    pthread_mutex_lock(&cache_lock);
+    slabs_free(&engine, ptr, size, slabs_clsid(&engine, size));
+    pthread_mutex_unlock(&cache_lock);
+}
+
+static void *bench_thread(void *arg)
+{
+    void *slots[BENCH_LIVE_SLOTS];
+    size_t sizes[BENCH_LIVE_SLOTS];
+    uint64_t state = 88172645463325252ULL + (uintptr_t)arg;
+    uint64_t i;
+    int n;
+
+    for (n = 0; n < BENCH_LIVE_SLOTS; n++) {
+        sizes[n] = 40 + (next_random(&state) % 161);
+        if ((slots[n] = bench_alloc(sizes[n])) == NULL) {
+            fprintf(stderr, "Can't allocate a slot.\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < BENCH_OPS; i++) {
+        n = next_random(&state) % BENCH_LIVE_SLOTS;
+        bench_free(slots[n], sizes[n]);
+        sizes[n] = 40 + (next_random(&state) % 161);
+        if ((slots[n] = bench_alloc(sizes[n])) == NULL) {
+            fprintf(stderr, "Can't allocate a slot.\n");
+            exit(1);
+        }
+        ((char *)slots[n])[sizes[n] - 1] = 1; /* the head is used by the allocator */
+    }
+    for (n = 0; n < BENCH_LIVE_SLOTS; n++) {
+        bench_free(slots[n], sizes[n]);
+    }
+    return NULL;
+}
+
+static void bench_run(int nthreads)
+{
+    pthread_t tids[nthreads];
+    struct timeval start, end;
+    uint64_t acquired = engine.slabs.lock_acquired;
+    uint64_t contended = engine.slabs.lock_contended;
+    double usec;
+    int t;
+
+    gettimeofday(&start, NULL);
+    for (t = 0; t < nthreads; t++) {
+        pthread_create(&tids[t], NULL, bench_thread, (void *)(uintptr_t)(t + 1));
+    }
+    for (t = 0; t < nthreads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    gettimeofday(&end, NULL);
+    usec = (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec);
+
+    printf("  %-9s: %7.2f M alloc+free/s, slabs lock %llu acquired, %llu contended\n",
+           use_magazine ? "magazine" : "locked",
+           (double)nthreads * BENCH_OPS / usec,
+           (unsigned long long)(engine.slabs.lock_acquired - acquired),
+           (unsigned long long)(engine.slabs.lock_contended - contended));
+}
+
+int main(int argc, char **argv)
+{
+    int nthreads = (argc > 1) ? atoi(argv[1]) : 4;
+    size_t magazine_size = (argc > 2) ? strtoul(argv[2], NULL, 10) : 64;
+
+    if (nthreads < 1 || magazine_size < 1) {
+        fprintf(stderr, "usage: %s [threads(1..)] [magazine size(1..)]\n", argv[0]);
+        return 1;
+    }
+
+    engine.server.log = &bench_log_api;
+    engine.config.chunk_size = 48;
+    engine.config.item_size_max = 1024 * 1024;
+    engine.config.magazine_size = magazine_size;
+    if (slabs_init(&engine, 1024 * 1024 * 1024, 1.25, false) != ENGINE_SUCCESS) {
+        fprintf(stderr, "Can't initialize the slab allocator.\n");
+        return 1;
+    }
+
+    printf("threads: %d, magazine size: %zu, %d alloc+free per thread\n",
+           nthreads, magazine_size, BENCH_OPS);
+    use_magazine = false;
+    bench_run(nthreads);
+    use_magazine = true;
+    bench_run(nthreads);
+
+    slabs_final(&engine);
+    return 0;
+}
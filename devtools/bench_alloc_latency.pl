@@ -0,0 +1,83 @@
+#! /usr/bin/perl
+#
+# Allocation latency benchmark.
+#
+# Loads each server with sets from several clients over its memory limit,
+# and prints the allocation latency percentiles reported by the server.
+# Compare the inline eviction with the LRU maintainer, for example:
+#   ./memcached -E .libs/default_engine.so -m 64 -p 11211 -e "alloc_latency=true"
+#   ./memcached -E .libs/default_engine.so -m 64 -p 11212 -e "lru_maintainer=true"
+#   devtools/bench_alloc_latency.pl 127.0.0.1:11211 127.0.0.1:11212
+#
+use warnings;
+use strict;
+
+use IO::Socket::INET;
+use Time::HiRes qw(gettimeofday tv_interval);
+
+use FindBin;
+
+@ARGV >= 1
+    or die "Usage: $FindBin::Script HOST:PORT [HOST:PORT ...]\n";
+
+my $nclients = 4;
+my $nrequests = 200_000; # sets per client
+my $value = "x" x 500;
+
+sub connect_server {
+    my $addr = shift;
+    my $sock = IO::Socket::INET->new(PeerAddr => $addr, Timeout  => 3);
+    die "$addr: $!\n" unless $sock;
+    return $sock;
+}
+
+sub server_stats {
+    my $sock = shift;
+    my %stats;
+    print $sock "stats\r\n";
+    while (my $line = <$sock>) {
+        last if $line =~ /^END/;
+        $stats{$1} = $2 if $line =~ /^STAT (\S+) (\S+)/;
+    }
+    return \%stats;
+}
+
+sub load {
+    my ($addr, $client) = @_;
+    my $sock = connect_server($addr);
+    for (my $i = 0; $i < $nrequests; $i++) {
+        print $sock "set key:$client:$i 0 0 " . length($value) . "\r\n$value\r\n";
+        scalar <$sock>;
+    }
+    close($sock);
+}
+
+printf("%-24s%12s%12s%12s%12s%12s\n", "server", "allocs",
+       "p50(us)", "p99(us)", "p999(us)", "seconds");
+foreach my $addr (@ARGV) {
+    my $sock = connect_server($addr);
+    print $sock "flush_all\r\n";
+    scalar <$sock>;
+    print $sock "stats reset\r\n";
+    scalar <$sock>;
+
+    my $start = [gettimeofday];
+    my @pids;
+    for (my $client = 0; $client < $nclients; $client++) {
+        my $pid = fork();
+        die "fork: $!\n" unless defined $pid;
+        if ($pid == 0) {
+            load($addr, $client);
+            exit(0);
+        }
+        push(@pids, $pid);
+    }
+    waitpid($_, 0) foreach @pids;
+    my $elapsed = tv_interval($start);
+
+    my $stats = server_stats($sock);
+    printf("%-24s%12s%12s%12s%12s%12.1f\n", $addr,
+           $stats->{"alloc_latency_count"}, $stats->{"alloc_latency_p50"},
+           $stats->{"alloc_latency_p99"}, $stats->{"alloc_latency_p999"}, $elapsed);
+    close($sock);
+}
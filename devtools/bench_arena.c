@@ -0,0 +1,258 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Slab arena microbenchmark.
+ *
+ * Compares the ways the item cache memory can be backed: a malloc per
+ * 1MB slab page (the default), one mmap of small pages, one mmap with
+ * transparent huge pages (large_pages without reserved huge pages) and
+ * one mmap of explicit huge pages (large_pages with vm.nr_hugepages set).
+ * For each arena it measures random item access latency (a pointer chase
+ * over item slots) and throughput (independent random reads), and the
+ * dTLB load misses if perf events are permitted:
+ *
+ *   gcc -O2 -o bench_arena devtools/bench_arena.c
+ *
+ *   ./bench_arena [arena MB] [item size]
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#define BENCH_PAGE_SIZE     (1024 * 1024)
+#define BENCH_HUGEPAGE_SIZE (2 * 1024 * 1024)
+#define BENCH_ACCESSES      (20 * 1000 * 1000)
+
+enum arena_kind { ARENA_MALLOC = 0, ARENA_MMAP, ARENA_THP, ARENA_HUGETLB };
+static const char *arena_names[] = { "malloc", "mmap", "thp", "hugetlb" };
+
+/* keeps the access loops from being optimized away */
+static volatile uint64_t access_sink;
+
+static double elapsed_ns(struct timeval *start, struct timeval *end, uint64_t count)
+{
+    double usec = (end->tv_sec - start->tv_sec) * 1000000.0 + (end->tv_usec - start->tv_usec);
+    return usec * 1000.0 / count;
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/* opens a dTLB load miss counter of this thread, -1 if not permitted */
+static int dtlb_open(void)
+{
+#if defined(__linux__) && defined(SYS_perf_event_open)
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void dtlb_start(int fd)
+{
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+static void dtlb_print(int fd, uint64_t count)
+{
+    uint64_t misses;
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+    if (fd >= 0 && read(fd, &misses, sizeof(misses)) == sizeof(misses)) {
+        printf(", dTLB misses %.3f/access", (double)misses / count);
+    } else {
+        printf(", dTLB misses n/a");
+    }
+}
+
+/* maps the arena, or the array of slab pages with malloc */
+static char **arena_create(enum arena_kind kind, size_t size, char **base)
+{
+    size_t npages = size / BENCH_PAGE_SIZE;
+    char **pages = malloc(npages * sizeof(char *));
+    char *arena = NULL;
+    size_t i;
+
+    if (pages == NULL) {
+        return NULL;
+    }
+    if (kind == ARENA_MALLOC) {
+        for (i = 0; i < npages; i++) {
+            if ((pages[i] = malloc(BENCH_PAGE_SIZE)) == NULL) {
+                return NULL;
+            }
+        }
+        *base = NULL;
+        return pages;
+    }
+    if (kind == ARENA_HUGETLB) {
+#ifdef MAP_HUGETLB
+        arena = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#else
+        arena = MAP_FAILED;
+#endif
+    } else {
+        /* aligned to huge pages like the slab arena of the engine */
+        char *raw = mmap(NULL, size + BENCH_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw != MAP_FAILED) {
+            arena = raw + (BENCH_HUGEPAGE_SIZE - ((uintptr_t)raw % BENCH_HUGEPAGE_SIZE)) % BENCH_HUGEPAGE_SIZE;
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+            madvise(arena, size, kind == ARENA_THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+        } else {
+            arena = MAP_FAILED;
+        }
+    }
+    if (arena == MAP_FAILED) {
+        free(pages);
+        return NULL;
+    }
+    for (i = 0; i < npages; i++) {
+        pages[i] = arena + i * BENCH_PAGE_SIZE;
+    }
+    *base = arena;
+    return pages;
+}
+
+static void arena_destroy(enum arena_kind kind, char **pages, char *base, size_t size)
+{
+    size_t npages = size / BENCH_PAGE_SIZE;
+    size_t i;
+
+    if (kind == ARENA_MALLOC) {
+        for (i = 0; i < npages; i++) {
+            free(pages[i]);
+        }
+    } else {
+        /* the unaligned head of a small page mapping stays until exit */
+        munmap(base, size);
+    }
+    free(pages);
+}
+
+static void bench_arena(enum arena_kind kind, size_t size, uint32_t item_size)
+{
+    uint32_t per_page = BENCH_PAGE_SIZE / item_size;
+    uint64_t nitems = (uint64_t)(size / BENCH_PAGE_SIZE) * per_page;
+    uint64_t i, sum = 0, state = 88172645463325252ULL;
+    uint64_t *order;
+    struct timeval start, end;
+    char **pages, *base;
+    void **p;
+    int fd;
+
+    pages = arena_create(kind, size, &base);
+    if (pages == NULL) {
+        printf("  %-8s: not available\n", arena_names[kind]);
+        return;
+    }
+#define ITEM_AT(n) ((void **)(pages[(n) / per_page] + ((n) % per_page) * item_size))
+
+    /* a random cyclic order of all items, as a hash chain walk would visit them */
+    order = malloc(nitems * sizeof(uint64_t));
+    if (order == NULL) {
+        fprintf(stderr, "Can't allocate the item order.\n");
+        exit(1);
+    }
+    for (i = 0; i < nitems; i++) {
+        order[i] = i;
+    }
+    for (i = nitems - 1; i > 0; i--) {
+        uint64_t j = xorshift(&state) % (i + 1);
+        uint64_t t = order[i]; order[i] = order[j]; order[j] = t;
+    }
+    for (i = 0; i < nitems; i++) {
+        *ITEM_AT(order[i]) = ITEM_AT(order[(i + 1) % nitems]);
+    }
+    free(order);
+
+    fd = dtlb_open();
+
+    /* latency: dependent loads */
+    p = ITEM_AT(0);
+    dtlb_start(fd);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < BENCH_ACCESSES; i++) {
+        p = (void **)*p;
+    }
+    gettimeofday(&end, NULL);
+    access_sink = (uintptr_t)p;
+    printf("  %-8s: chase %6.1f ns/access", arena_names[kind],
+           elapsed_ns(&start, &end, BENCH_ACCESSES));
+    dtlb_print(fd, BENCH_ACCESSES);
+
+    /* throughput: independent loads */
+    dtlb_start(fd);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < BENCH_ACCESSES; i++) {
+        sum += (uintptr_t)*ITEM_AT(xorshift(&state) % nitems);
+    }
+    gettimeofday(&end, NULL);
+    access_sink = sum;
+    printf(" | random %6.1f M access/s",
+           1000.0 / elapsed_ns(&start, &end, BENCH_ACCESSES));
+    dtlb_print(fd, BENCH_ACCESSES);
+    printf("\n");
+#undef ITEM_AT
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    arena_destroy(kind, pages, base, size);
+}
+
+int main(int argc, char **argv)
+{
+    size_t size_mb = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1024;
+    uint32_t item_size = (argc > 2) ? strtoul(argv[2], NULL, 10) : 128;
+    size_t size;
+
+    if (size_mb < 2 || item_size < sizeof(void *) || item_size > BENCH_PAGE_SIZE) {
+        fprintf(stderr, "usage: %s [arena MB(2..)] [item size(8..1048576)]\n", argv[0]);
+        return 1;
+    }
+    /* whole huge pages, so that a MAP_HUGETLB arena can be mapped */
+    size = (size_mb * 1024 * 1024 + BENCH_HUGEPAGE_SIZE - 1) / BENCH_HUGEPAGE_SIZE * BENCH_HUGEPAGE_SIZE;
+
+    printf("arena: %zu MB, item size: %u bytes, %d accesses\n",
+           size / (1024 * 1024), item_size, BENCH_ACCESSES);
+    for (int k = ARENA_MALLOC; k <= ARENA_HUGETLB; k++) {
+        bench_arena(k, size, item_size);
+    }
+    return 0;
+}
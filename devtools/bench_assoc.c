@@ -0,0 +1,183 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Hash index microbenchmark.
+ *
+ * Measures insert, lookup (hit and miss) and delete of the default engine
+ * hash index. Build it once with the chained hash table and once with the
+ * bucketized hash index, and compare the results:
+ *
+ *   gcc -O2 -pthread -DHAVE_CONFIG_H -I. -Iinclude -Iengines/default \
+ *       -o bench_assoc_chain devtools/bench_assoc.c engines/default/assoc.c hash.c util.c
+ *   gcc -O2 -pthread -DHAVE_CONFIG_H -DENABLE_BUCKET_ASSOC -I. -Iinclude -Iengines/default \
+ *       -o bench_assoc_bucket devtools/bench_assoc.c engines/default/assoc.c hash.c util.c
+ *
+ *   ./bench_assoc_chain 10000000
+ *   ./bench_assoc_bucket 10000000
+ *
+ * Each item takes about 64 bytes, so 200M items need about 13GB of memory.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/time.h>
+
+#include "default_engine.h"
+#include "hash.h"
+
+#define BENCH_KEY_LEN 16
+/* "key:" and 12 digits, the missed keys are numbered up to 2 * nitems */
+#define BENCH_MAX_ITEMS 500000000000ULL
+
+static struct default_engine engine;
+
+/* the item layout of the default engine without cas */
+const void* item_get_key(const hash_item* item)
+{
+    return (const void *)(item + 1);
+}
+
+/* the benchmark runs in a single thread without the cache lock */
+void cache_lock_exclusive(struct default_engine *engine)
+{
+    (void)engine;
+}
+
+void cache_unlock_exclusive(struct default_engine *engine)
+{
+    (void)engine;
+}
+
+static const char *get_logger_name(void)
+{
+    return "bench_assoc";
+}
+
+static void logger_log(EXTENSION_LOG_LEVEL severity, const void* client_cookie,
+                       const char *fmt, ...)
+{
+    (void)severity;
+    (void)client_cookie;
+    (void)fmt;
+}
+
+static EXTENSION_LOGGER_DESCRIPTOR bench_logger = {
+    .get_name = get_logger_name,
+    .log = logger_log
+};
+
+static EXTENSION_LOGGER_DESCRIPTOR *get_logger(void)
+{
+    return &bench_logger;
+}
+
+static SERVER_LOG_API bench_log_api = {
+    .get_logger = get_logger
+};
+
+static double elapsed_ns(struct timeval *start, struct timeval *end, uint64_t count)
+{
+    double usec = (end->tv_sec - start->tv_sec) * 1000000.0 + (end->tv_usec - start->tv_usec);
+    return usec * 1000.0 / count;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t nitems = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t isize = sizeof(hash_item) + BENCH_KEY_LEN;
+    char *items;
+    char key[32]; /* room for any uint64_t, only BENCH_KEY_LEN bytes are used */
+    uint64_t i, found = 0, seed = 88172645463325252ULL;
+    struct timeval start, end;
+    hash_item *it;
+
+    if (nitems == 0 || nitems > BENCH_MAX_ITEMS) {
+        fprintf(stderr, "The number of items must be 1 ~ %llu.\n", BENCH_MAX_ITEMS);
+        return 1;
+    }
+    isize = (isize + 7) & ~(size_t)7;
+    items = calloc(nitems, isize);
+    if (items == NULL) {
+        fprintf(stderr, "Can't allocate %llu items.\n", (unsigned long long)nitems);
+        return 1;
+    }
+
+    engine.server.log = &bench_log_api;
+    engine.assoc.hashpower = 17;
+    if (assoc_init(&engine) != ENGINE_SUCCESS) {
+        fprintf(stderr, "Can't initialize the hash index.\n");
+        return 1;
+    }
+
+    for (i = 0; i < nitems; i++) {
+        it = (hash_item *)(items + i * isize);
+        snprintf(key, sizeof(key), "key:%012llu", (unsigned long long)i);
+        memcpy((char *)item_get_key(it), key, BENCH_KEY_LEN);
+        it->nkey = BENCH_KEY_LEN;
+        it->khash = mc_hash(key, BENCH_KEY_LEN, 0);
+    }
+
+#ifdef ENABLE_BUCKET_ASSOC
+    printf("index: bucketized hash index (%d slots per bucket)\n", ASSOC_BUCKET_SLOTS);
+#else
+    printf("index: chained hash table\n");
+#endif
+    printf("items: %llu, sizeof(hash_item): %d\n",
+           (unsigned long long)nitems, (int)sizeof(hash_item));
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nitems; i++) {
+        it = (hash_item *)(items + i * isize);
+        if (assoc_insert(&engine, it->khash, it) == 0) {
+            fprintf(stderr, "Can't insert an item.\n");
+            return 1;
+        }
+    }
+    gettimeofday(&end, NULL);
+    printf("insert      : %8.1f ns/op\n", elapsed_ns(&start, &end, nitems));
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nitems; i++) {
+        it = (hash_item *)(items + (next_random(&seed) % nitems) * isize);
+        if (assoc_find(&engine, it->khash, item_get_key(it), it->nkey) == it) {
+            found++;
+        }
+    }
+    gettimeofday(&end, NULL);
+    printf("lookup hit  : %8.1f ns/op (%llu found)\n",
+           elapsed_ns(&start, &end, nitems), (unsigned long long)found);
+
+    found = 0;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nitems; i++) {
+        uint64_t n = nitems + (next_random(&seed) % nitems);
+        snprintf(key, sizeof(key), "key:%012llu", (unsigned long long)n);
+        if (assoc_find(&engine, mc_hash(key, BENCH_KEY_LEN, 0), key, BENCH_KEY_LEN) != NULL) {
+            found++;
+        }
+    }
+    gettimeofday(&end, NULL);
+    printf("lookup miss : %8.1f ns/op (%llu found, including key hashing)\n",
+           elapsed_ns(&start, &end, nitems), (unsigned long long)found);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nitems; i++) {
+        it = (hash_item *)(items + i * isize);
+        assoc_delete(&engine, it->khash, item_get_key(it), it->nkey);
+    }
+    gettimeofday(&end, NULL);
+    printf("delete      : %8.1f ns/op\n", elapsed_ns(&start, &end, nitems));
+
+    assoc_final(&engine);
+    free(items);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#! /usr/bin/perl
+#
+# Mixed workload latency benchmark.
+#
+# Runs large bop get and bop insert clients in the background and
+# measures the latency percentiles of small key-value gets meanwhile.
+# Compare the result with and without collection locks, for example:
+#   ./memcached -E .libs/default_engine.so -t 8
+#   ./memcached -E .libs/default_engine.so -t 8 -e "coll_lock_stripes=64"
+#
+use warnings;
+use strict;
+
+use IO::Socket::INET;
+use Time::HiRes qw(gettimeofday tv_interval);
+
+use FindBin;
+
+@ARGV >= 1 and @ARGV <= 4
+    or die "Usage: $FindBin::Script HOST:PORT [COLL_CLIENTS] [SECONDS] [ELEMENTS]\n";
+
+my $addr = $ARGV[0];
+my $coll_clients = $ARGV[1] || 8;
+my $seconds = $ARGV[2] || 10;
+my $nelems = $ARGV[3] || 10_000;
+my $nkeys = 1000;
+my $ncolls = 16;
+my $value = "x" x 100;
+
+sub connect_server {
+    my $sock = IO::Socket::INET->new(PeerAddr => $addr, Timeout  => 3);
+    die "$!\n" unless $sock;
+    return $sock;
+}
+
+sub read_response {
+    my ($sock, $tail) = @_;
+    while (my $line = <$sock>) {
+        return if $line =~ $tail;
+    }
+    die "connection closed\n";
+}
+
+sub preload {
+    my $sock = connect_server();
+    foreach my $i (0 .. $nkeys - 1) {
+        print $sock "set kv:$i 0 0 " . length($value) . " noreply\r\n$value\r\n";
+    }
+    foreach my $i (0 .. $ncolls - 1) {
+        print $sock "bop create big:$i 0 0 $nelems noreply\r\n";
+        foreach my $b (0 .. $nelems - 1) {
+            print $sock "bop insert big:$i $b " . length($value) . " noreply\r\n$value\r\n";
+        }
+    }
+    print $sock "get kv:0\r\n";
+    read_response($sock, qr/^END\r\n$/);
+    close($sock);
+}
+
+# background collection client: 3 large reads per 1 insert
+sub coll_client {
+    my $sock = connect_server();
+    my $start = [gettimeofday];
+    my $n = 0;
+    while (tv_interval($start) < $seconds) {
+        my $key = "big:" . int(rand($ncolls));
+        if (++$n % 4 == 0) {
+            my $bkey = int(rand($nelems));
+            print $sock "bop upsert $key $bkey " . length($value) . "\r\n$value\r\n";
+            read_response($sock, qr/^(STORED|REPLACED|.*ERROR.*|NOT_FOUND|OVERFLOWED)\r\n$/);
+        } else {
+            my $from = int(rand($nelems - 1000));
+            my $to = $from + 999;
+            print $sock "bop get $key $from..$to 0 1000\r\n";
+            read_response($sock, qr/^(END|TRIMMED|NOT_FOUND|NOT_FOUND_ELEMENT|.*ERROR.*)\r\n$/);
+        }
+    }
+    exit 0;
+}
+
+preload();
+
+my @pids;
+foreach my $c (1 .. $coll_clients) {
+    my $pid = fork();
+    die "fork: $!\n" unless defined $pid;
+    coll_client() if $pid == 0;
+    push(@pids, $pid);
+}
+
+my $sock = connect_server();
+my @latencies;
+my $start = [gettimeofday];
+while (tv_interval($start) < $seconds) {
+    my $t0 = [gettimeofday];
+    print $sock "get kv:" . int(rand($nkeys)) . "\r\n";
+    read_response($sock, qr/^END\r\n$/);
+    push(@latencies, tv_interval($t0) * 1_000_000);
+}
+waitpid($_, 0) foreach @pids;
+
+@latencies = sort { $a <=> $b } @latencies;
+my $count = scalar @latencies;
+printf("small gets: %d, background collection clients: %d\n", $count, $coll_clients);
+foreach my $p (50, 90, 99, 99.9) {
+    my $idx = int($count * $p / 100);
+    $idx = $count - 1 if $idx >= $count;
+    printf("p%-5s %10.0f us\n", $p, $latencies[$idx]);
+}
+printf("max    %10.0f us\n", $latencies[-1]);
@@ -0,0 +1,118 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Key hash function microbenchmark.
+ *
+ * Measures the hashing speed of the key hash functions selectable with -H,
+ * and the chain length distribution they give in a hash table of the given
+ * size, on ARCUS style "prefix:subkey" keys:
+ *
+ *   gcc -O2 -pthread -DHAVE_CONFIG_H -I. -Iinclude \
+ *       -o bench_hash devtools/bench_hash.c hash.c
+ *
+ *   ./bench_hash [nkeys] [hashpower]
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "memcached.h"
+
+#define BENCH_MAX_KEY   64
+#define BENCH_MAX_CHAIN 8
+
+static const char *key_formats[] = {
+    "user%u:item%u",                            /* short keys */
+    "arcus:service%u:b+tree:element:%012u",     /* medium keys */
+    "arcus:application%u:collection:user:%016u"  /* long keys */
+};
+
+/* keeps the hashing loop from being optimized away */
+static volatile uint32_t hash_sink;
+
+static double elapsed_ns(struct timeval *start, struct timeval *end, uint64_t count)
+{
+    double usec = (end->tv_sec - start->tv_sec) * 1000000.0 + (end->tv_usec - start->tv_usec);
+    return usec * 1000.0 / count;
+}
+
+static void bench_hash(const char *name, hash_func hash, const char *keys,
+                       uint32_t nkeys, uint32_t hashpower)
+{
+    uint32_t hashsize = 1U << hashpower;
+    uint32_t *chains = calloc(hashsize, sizeof(uint32_t));
+    uint32_t hist[BENCH_MAX_CHAIN + 1];
+    uint32_t i, max_chain = 0, used = 0, sum = 0;
+    struct timeval start, end;
+    const char *key;
+
+    if (chains == NULL) {
+        fprintf(stderr, "Can't allocate the hash table.\n");
+        exit(1);
+    }
+
+    /* hashing speed: several rounds over the keys */
+    gettimeofday(&start, NULL);
+    for (int round = 0; round < 4; round++) {
+        for (i = 0, key = keys; i < nkeys; i++, key += BENCH_MAX_KEY) {
+            sum += hash(key, strlen(key), 0);
+        }
+    }
+    gettimeofday(&end, NULL);
+    hash_sink = sum;
+
+    /* chain length distribution */
+    for (i = 0, key = keys; i < nkeys; i++, key += BENCH_MAX_KEY) {
+        chains[hash(key, strlen(key), 0) & (hashsize - 1)] += 1;
+    }
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i < hashsize; i++) {
+        if (chains[i] > 0) {
+            used++;
+        }
+        if (chains[i] > max_chain) {
+            max_chain = chains[i];
+        }
+        hist[chains[i] < BENCH_MAX_CHAIN ? chains[i] : BENCH_MAX_CHAIN]++;
+    }
+
+    printf("  %-8s: %6.1f ns/hash, max chain %u, avg chain %.2f (used buckets) |",
+           name, elapsed_ns(&start, &end, (uint64_t)nkeys * 4), max_chain,
+           used > 0 ? (double)nkeys / used : 0.0);
+    for (i = 0; i <= BENCH_MAX_CHAIN; i++) {
+        printf(" %u%s:%u", i, i == BENCH_MAX_CHAIN ? "+" : "", hist[i]);
+    }
+    printf("\n");
+    free(chains);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t nkeys = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    uint32_t hashpower = (argc > 2) ? strtoul(argv[2], NULL, 10) : 20;
+    char *keys = malloc((size_t)nkeys * BENCH_MAX_KEY);
+    uint32_t i;
+
+    if (keys == NULL || hashpower < 1 || hashpower > 30) {
+        fprintf(stderr, "usage: %s [nkeys] [hashpower(1..30)]\n", argv[0]);
+        return 1;
+    }
+
+    printf("keys: %u, hash table: 2^%u buckets, chain histogram as length:buckets\n",
+           nkeys, hashpower);
+    for (int f = 0; f < sizeof(key_formats) / sizeof(key_formats[0]); f++) {
+        size_t total = 0;
+        for (i = 0; i < nkeys; i++) {
+            char *key = keys + (size_t)i * BENCH_MAX_KEY;
+            /* a few hundred prefixes with sequential subkeys */
+            snprintf(key, BENCH_MAX_KEY, key_formats[f], i % 317, i / 317);
+            total += strlen(key);
+        }
+        printf("%s (avg key length %.1f)\n", key_formats[f], (double)total / nkeys);
+        bench_hash("jenkins", mc_hash_lookup("jenkins"), keys, nkeys, hashpower);
+        bench_hash("wyhash", mc_hash_lookup("wyhash"), keys, nkeys, hashpower);
+    }
+    free(keys);
+    return 0;
+}
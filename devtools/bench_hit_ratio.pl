@@ -0,0 +1,91 @@
+#! /usr/bin/perl
+#
+# Trace-driven hit ratio benchmark.
+#
+# Replays a key stream against each server with get and set-on-miss,
+# and prints the hit ratio of each server. The key stream is read from
+# a trace file of one key per line, or generated: a skewed hot set mixed
+# with batch scans of keys accessed only once. Compare the current LRU
+# with the LFU admission on the same stream, for example:
+#   ./memcached -E .libs/default_engine.so -m 64 -p 11211
+#   ./memcached -E .libs/default_engine.so -m 64 -p 11212 -e "lfu_admission=true"
+#   devtools/bench_hit_ratio.pl localhost:11211 localhost:11212
+#
+use warnings;
+use strict;
+
+use IO::Socket::INET;
+use Time::HiRes qw(gettimeofday tv_interval);
+
+use FindBin;
+
+my @addrs = grep { /:\d+$/ } @ARGV;
+my @traces = grep { !/:\d+$/ } @ARGV;
+@addrs >= 1 and @traces <= 1
+    or die "Usage: $FindBin::Script [TRACE_FILE] HOST:PORT [HOST:PORT ...]\n";
+
+my $nrequests = 500_000;
+my $nhotkeys = 20_000;
+my $scan_interval = 100_000; # requests between batch scans
+my $scan_keys = 40_000;      # keys of a batch scan
+my $value = "x" x 1000;
+
+# the generated stream: 2 of 5 requests are batch scan keys
+sub generate_stream {
+    my @stream;
+    my $scan = 0;
+    while (@stream < $nrequests) {
+        if (@stream % $scan_interval == 0) {
+            foreach (1 .. $scan_keys) {
+                push(@stream, "scan:" . $scan++);
+            }
+        }
+        # skewed to the low key numbers
+        push(@stream, "hot:" . int($nhotkeys * rand() ** 3));
+    }
+    return \@stream;
+}
+
+sub read_stream {
+    my $file = shift;
+    my @stream;
+    open(my $fh, "<", $file) or die "$file: $!\n";
+    while (my $key = <$fh>) {
+        chomp($key);
+        push(@stream, $key) if length($key) > 0;
+    }
+    close($fh);
+    return \@stream;
+}
+
+sub replay {
+    my ($addr, $stream) = @_;
+    my $sock = IO::Socket::INET->new(PeerAddr => $addr, Timeout  => 3);
+    die "$addr: $!\n" unless $sock;
+    print $sock "flush_all\r\n";
+    scalar <$sock>;
+
+    my $hits = 0;
+    my $start = [gettimeofday];
+    foreach my $key (@$stream) {
+        print $sock "get $key\r\n";
+        my $line = <$sock>;
+        die "connection closed\n" unless defined $line;
+        if ($line =~ /^VALUE /) {
+            scalar <$sock>; scalar <$sock>;
+            $hits++;
+        } else {
+            print $sock "set $key 0 0 " . length($value) . "\r\n$value\r\n";
+            scalar <$sock>;
+        }
+    }
+    close($sock);
+    return ($hits / @$stream, tv_interval($start));
+}
+
+my $stream = @traces ? read_stream($traces[0]) : generate_stream();
+printf("%-24s%12s%12s\n", "server", "hit ratio", "seconds");
+foreach my $addr (@addrs) {
+    my ($ratio, $elapsed) = replay($addr, $stream);
+    printf("%-24s%11.2f%%%12.1f\n", $addr, $ratio * 100, $elapsed);
+}
@@ -0,0 +1,161 @@
+#! /usr/bin/perl
+#
+# Thread scaling benchmark.
+#
+# Runs get/set and bop insert/get workloads with 1, 2, 4, ... clients
+# in parallel and prints the aggregate throughput of each step.
+# Start the server with enough worker threads (-t), for example:
+#   ./memcached -E .libs/default_engine.so -t 32 -e "lockfree_get=true"
+# and compare with a server without it for the scaling of the read path.
+# Run it on a host with more cores than clients and worker threads;
+# otherwise the clients compete with the server and it measures
+# the overhead rather than the scaling.
+# The "bop mixed" workload runs 95% bop get/count and 5% bop insert,
+# for example with -e "shared_coll_read=true".
+# The "mget 100" workload gets 100 random keys per request.
+#
+use warnings;
+use strict;
+
+use IO::Socket::INET;
+use Time::HiRes qw(gettimeofday tv_interval);
+
+use FindBin;
+
+@ARGV >= 1 and @ARGV <= 4
+    or die "Usage: $FindBin::Script HOST:PORT [MAX_CLIENTS] [SECONDS] [KEYS]\n";
+
+my $addr = $ARGV[0];
+my $max_clients = $ARGV[1] || 64;
+my $seconds = $ARGV[2] || 5;
+my $nkeys = $ARGV[3] || 10_000;
+my $value = "x" x 100;
+
+sub connect_server {
+    my $sock = IO::Socket::INET->new(PeerAddr => $addr, Timeout  => 3);
+    die "$!\n" unless $sock;
+    return $sock;
+}
+
+# preload keys so that the get workloads hit
+sub preload {
+    my $sock = connect_server();
+    foreach my $i (0 .. $nkeys - 1) {
+        print $sock "set kv:$i 0 0 " . length($value) . " noreply\r\n$value\r\n";
+        print $sock "bop create bt:$i 0 0 4000 noreply\r\n";
+        foreach my $b (0 .. 9) {
+            print $sock "bop insert bt:$i $b " . length($value) . " noreply\r\n$value\r\n";
+        }
+    }
+    print $sock "get kv:0\r\n";
+    while (my $line = <$sock>) {
+        last if $line eq "END\r\n";
+    }
+    close($sock);
+}
+
+sub read_response {
+    my ($sock, $tail) = @_;
+    while (my $line = <$sock>) {
+        return if $line =~ $tail;
+    }
+    die "connection closed\n";
+}
+
+my %workloads = (
+    "get" => sub {
+        my $sock = shift;
+        print $sock "get kv:" . int(rand($nkeys)) . "\r\n";
+        read_response($sock, qr/^END\r\n$/);
+    },
+    "set" => sub {
+        my $sock = shift;
+        print $sock "set kv:" . int(rand($nkeys)) . " 0 0 " . length($value) . "\r\n$value\r\n";
+        read_response($sock, qr/^(STORED|NOT_STORED|SERVER_ERROR.*)\r\n$/);
+    },
+    "mget 100" => sub {
+        my $sock = shift;
+        my $keys = join(" ", map { "kv:" . int(rand($nkeys)) } (1 .. 100));
+        print $sock "mget " . length($keys) . " 100\r\n$keys\r\n";
+        read_response($sock, qr/^(END|.*ERROR.*)\r\n$/);
+    },
+    "bop insert" => sub {
+        my $sock = shift;
+        my $bkey = 10 + int(rand(1_000_000));
+        print $sock "bop insert bt:" . int(rand($nkeys)) . " $bkey " . length($value) . "\r\n$value\r\n";
+        read_response($sock, qr/^(STORED|ELEMENT_EXISTS|OVERFLOWED|NOT_FOUND|.*ERROR.*)\r\n$/);
+    },
+    "bop get" => sub {
+        my $sock = shift;
+        print $sock "bop get bt:" . int(rand($nkeys)) . " 0..9\r\n";
+        read_response($sock, qr/^(END|TRIMMED|NOT_FOUND|NOT_FOUND_ELEMENT|.*ERROR.*)\r\n$/);
+    },
+    "bop mixed" => sub {
+        my $sock = shift;
+        my $key = "bt:" . int(rand($nkeys));
+        my $dice = int(rand(100));
+        if ($dice < 5) {
+            my $bkey = 10 + int(rand(1_000_000));
+            print $sock "bop insert $key $bkey " . length($value) . "\r\n$value\r\n";
+            read_response($sock, qr/^(STORED|ELEMENT_EXISTS|OVERFLOWED|NOT_FOUND|.*ERROR.*)\r\n$/);
+        } elsif ($dice < 50) {
+            print $sock "bop count $key 0..9\r\n";
+            read_response($sock, qr/^(COUNT=\d+|NOT_FOUND|.*ERROR.*)\r\n$/);
+        } else {
+            print $sock "bop get $key 0..9\r\n";
+            read_response($sock, qr/^(END|TRIMMED|NOT_FOUND|NOT_FOUND_ELEMENT|.*ERROR.*)\r\n$/);
+        }
+    },
+);
+
+# run one workload with the given number of clients and
+# return the aggregate operations per second.
+sub run_step {
+    my ($workload, $clients) = @_;
+    my @pipes;
+    foreach my $c (1 .. $clients) {
+        pipe(my $reader, my $writer) or die "pipe: $!\n";
+        my $pid = fork();
+        die "fork: $!\n" unless defined $pid;
+        if ($pid == 0) {
+            close($reader);
+            my $sock = connect_server();
+            my $ops = 0;
+            my $start = [gettimeofday];
+            while (tv_interval($start) < $seconds) {
+                foreach (1 .. 100) {
+                    $workloads{$workload}->($sock);
+                }
+                $ops += 100;
+            }
+            print $writer "$ops " . tv_interval($start) . "\n";
+            close($writer);
+            exit 0;
+        }
+        close($writer);
+        push(@pipes, $reader);
+    }
+    my $total = 0;
+    foreach my $reader (@pipes) {
+        my ($ops, $elapsed) = split(/ /, scalar <$reader>);
+        $total += $ops / $elapsed;
+        close($reader);
+    }
+    while (wait() != -1) {}
+    return $total;
+}
+
+preload();
+
+printf("%-12s", "clients");
+foreach my $workload (sort keys %workloads) {
+    printf("%14s", $workload);
+}
+print "\n";
+for (my $clients = 1; $clients <= $max_clients; $clients *= 2) {
+    printf("%-12d", $clients);
+    foreach my $workload (sort keys %workloads) {
+        printf("%14.0f", run_step($workload, $clients));
+    }
+    print "\n";
+}
@@ -24,6 +24,9 @@
 #include <string.h>
 #include <assert.h>
 #include <pthread.h>
+#if defined(ENABLE_BUCKET_ASSOC) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "default_engine.h"
 
@@ -33,7 +36,27 @@
 #define GET_HASH_BUCKET(hash, mask)        ((hash) & (mask))
 #define GET_HASH_TABIDX(hash, shift, mask) (((hash) >> (shift)) & (mask))
 
+#ifdef ENABLE_BUCKET_ASSOC
+/* A bucket holds several items. So, the bucketized index starts with
+ * fewer hash buckets, and expands when a bucket has ASSOC_BUCKET_LOAD items
+ * on average.
+ */
+#define ASSOC_BUCKET_POWER_SHIFT 2
+#define ASSOC_BUCKET_LOAD        4
+#define ASSOC_EXPAND_THRESHOLD(assoc) \
+        (hashsize((assoc)->hashpower + (assoc)->rootpower) * ASSOC_BUCKET_LOAD)
+#else
+#define ASSOC_EXPAND_THRESHOLD(assoc) \
+        ((hashsize((assoc)->hashpower + (assoc)->rootpower) * 3) / 2)
+#endif
+
+/* the range of the hashpower given at startup */
+#define MIN_ASSOC_HASHPOWER 12
+#define MAX_ASSOC_HASHPOWER 30
+
 #define DEFAULT_PREFIX_HASHPOWER 10
+#define MAX_PREFIX_HASHPOWER     26
+#define PREFIX_EXPAND_STEP       2 /* old buckets moved per prefix insert/delete */
 #define DEFAULT_PREFIX_MAX_DEPTH 1
 
 typedef struct {
@@ -45,6 +68,223 @@ typedef struct {
 static EXTENSION_LOGGER_DESCRIPTOR *logger;
 static prefix_t *root_pt = NULL; /* root prefix info */
 
+#ifdef ENABLE_COMPACT_ITEM
+/*
+ * Prefix index
+ *
+ * Compact items refer to their prefix by a 32-bit index instead of a pointer.
+ * The index is made of fixed-size chunks that are allocated on demand and
+ * never moved, so that it can be read without the cache lock.
+ * Index 0 means NULL and index 1 is the root prefix.
+ */
+#define PREFIX_INDEX_MAX_CHUNKS 4096 /* up to 16M prefixes */
+
+prefix_t **prefix_index[PREFIX_INDEX_MAX_CHUNKS];
+static uint32_t  prefix_index_next = 0;  /* the lowest index never used */
+static uint32_t *prefix_free_ids = NULL; /* released indexes */
+static uint32_t  prefix_free_count = 0;
+static uint32_t  prefix_free_size = 0;
+
+static int _prefix_index_add(prefix_t *pt)
+{
+    uint32_t id;
+
+    if (prefix_free_count > 0) {
+        id = prefix_free_ids[--prefix_free_count];
+    } else {
+        id = prefix_index_next;
+        if ((id >> PREFIX_INDEX_CHUNK_BITS) >= PREFIX_INDEX_MAX_CHUNKS) {
+            return -1;
+        }
+        if (prefix_index[id >> PREFIX_INDEX_CHUNK_BITS] == NULL) {
+            prefix_index[id >> PREFIX_INDEX_CHUNK_BITS] =
+                calloc(PREFIX_INDEX_CHUNK_SIZE, sizeof(prefix_t *));
+            if (prefix_index[id >> PREFIX_INDEX_CHUNK_BITS] == NULL) {
+                return -1;
+            }
+        }
+        prefix_index_next++;
+    }
+    prefix_index[id >> PREFIX_INDEX_CHUNK_BITS][id & (PREFIX_INDEX_CHUNK_SIZE - 1)] = pt;
+    pt->pfxid = id;
+    return 0;
+}
+
+static void _prefix_index_del(prefix_t *pt)
+{
+    uint32_t id = pt->pfxid;
+
+    prefix_index[id >> PREFIX_INDEX_CHUNK_BITS][id & (PREFIX_INDEX_CHUNK_SIZE - 1)] = NULL;
+    if (prefix_free_count == prefix_free_size) {
+        uint32_t new_size = (prefix_free_size > 0) ? prefix_free_size * 2 : 1024;
+        uint32_t *new_ids = realloc(prefix_free_ids, new_size * sizeof(uint32_t));
+        if (new_ids == NULL) {
+            return; /* the index is not reused */
+        }
+        prefix_free_ids = new_ids;
+        prefix_free_size = new_size;
+    }
+    prefix_free_ids[prefix_free_count++] = id;
+}
+
+static int _prefix_index_init(void)
+{
+    prefix_index[0] = calloc(PREFIX_INDEX_CHUNK_SIZE, sizeof(prefix_t *));
+    if (prefix_index[0] == NULL) {
+        return -1;
+    }
+    prefix_index[0][0] = NULL;
+    prefix_index[0][1] = root_pt;
+    root_pt->pfxid = 1;
+    prefix_index_next = 2;
+    prefix_free_count = 0;
+    return 0;
+}
+
+static void _prefix_index_final(void)
+{
+    for (int i = 0; i < PREFIX_INDEX_MAX_CHUNKS && prefix_index[i] != NULL; i++) {
+        free(prefix_index[i]);
+        prefix_index[i] = NULL;
+    }
+    free(prefix_free_ids);
+    prefix_free_ids = NULL;
+    prefix_free_count = prefix_free_size = 0;
+    prefix_index_next = 0;
+}
+#endif
+
+
+#ifdef ENABLE_BUCKET_ASSOC
+/*
+ * Bucketized hash index
+ *
+ * Each hash bucket is a cache line holding 8-bit hash tags and item pointers.
+ * A lookup compares the tags of a bucket at once and touches only the items
+ * whose tag matches. If a bucket is full, an overflow bucket is chained.
+ */
+static struct assoc_bucket *bucket_table_alloc(uint32_t count)
+{
+    void *table;
+    if (posix_memalign(&table, sizeof(struct assoc_bucket),
+                       count * sizeof(struct assoc_bucket)) != 0) {
+        return NULL;
+    }
+    memset(table, 0, count * sizeof(struct assoc_bucket));
+    return table;
+}
+
+static inline uint8_t bucket_tag(uint32_t hash)
+{
+    /* mix all hash bits, since the low bits are the same in a bucket */
+    uint8_t tag = (uint8_t)((hash * 0x9E3779B1U) >> 24);
+    return (tag != 0) ? tag : 1;
+}
+
+/* returns the bitmask of the slots having the given tag */
+static inline uint32_t bucket_match(const struct assoc_bucket *b, uint8_t tag)
+{
+    uint32_t mask;
+#ifdef __SSE2__
+    __m128i tags = _mm_loadl_epi64((const __m128i *)b->tags);
+    mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8((char)tag)));
+#else
+    uint64_t tags;
+    memcpy(&tags, b->tags, sizeof(tags));
+    tags ^= 0x0101010101010101ULL * tag;
+    /* the high bit of each zero byte, gathered into the low 8 bits */
+    tags = ~(((tags & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | tags | 0x7F7F7F7F7F7F7F7FULL);
+    mask = (uint32_t)(((tags >> 7) * 0x0102040810204080ULL) >> 56);
+#endif
+    return mask & ((1U << ASSOC_BUCKET_SLOTS) - 1);
+}
+
+static inline bool bucket_empty(const struct assoc_bucket *b)
+{
+    return bucket_match(b, 0) == ((1U << ASSOC_BUCKET_SLOTS) - 1);
+}
+
+/* Note: returns 0 if an overflow bucket can't be allocated */
+static int bucket_insert(struct assoc_bucket *b, uint8_t tag, hash_item *it)
+{
+    struct assoc_bucket *nb;
+    uint32_t empty;
+
+    while (1) {
+        if ((empty = bucket_match(b, 0)) != 0) {
+            int slot = __builtin_ctz(empty);
+            b->tags[slot] = tag;
+            b->items[slot] = it;
+            return 1;
+        }
+        if (b->next == NULL) break;
+        b = b->next;
+    }
+    if ((nb = bucket_table_alloc(1)) == NULL) {
+        return 0;
+    }
+    nb->tags[0] = tag;
+    nb->items[0] = it;
+    b->next = nb;
+    return 1;
+}
+
+/* removes the item from the bucket chain.
+ * An empty overflow bucket is freed unless a scan holds the bucket.
+ */
+static void bucket_remove(struct assoc_bucket *head, hash_item *it, bool can_free)
+{
+    struct assoc_bucket *prev = NULL;
+    struct assoc_bucket *b = head;
+    uint32_t mask;
+    int slot;
+
+    while (b != NULL) {
+        mask = bucket_match(b, bucket_tag(it->khash));
+        while (mask != 0) {
+            slot = __builtin_ctz(mask);
+            if (b->items[slot] == it) {
+                b->tags[slot] = 0;
+                b->items[slot] = NULL;
+                if (can_free && prev != NULL && bucket_empty(b)) {
+                    prev->next = b->next;
+                    free(b);
+                }
+                return;
+            }
+            mask &= mask - 1;
+        }
+        prev = b;
+        b = b->next;
+    }
+}
+
+static void bucket_free_chain(struct assoc_bucket *head)
+{
+    struct assoc_bucket *b = head->next;
+    while (b != NULL) {
+        struct assoc_bucket *next = b->next;
+        free(b);
+        b = next;
+    }
+    head->next = NULL;
+}
+
+static void bucket_shrink_chain(struct assoc_bucket *head)
+{
+    struct assoc_bucket *prev = head;
+    struct assoc_bucket *b = head->next;
+    while (b != NULL) {
+        if (bucket_empty(b)) {
+            prev->next = b->next;
+            free(b);
+        } else {
+            prev = b;
+        }
+        b = prev->next;
+    }
+}
+#endif
 
 ENGINE_ERROR_CODE assoc_init(struct default_engine *engine)
 {
@@ -52,24 +292,60 @@ ENGINE_ERROR_CODE assoc_init(struct default_engine *engine)
 
     logger = engine->server.log->get_logger();
 
+    if (engine->config.hashpower != 0) {
+        if (engine->config.hashpower < MIN_ASSOC_HASHPOWER ||
+            engine->config.hashpower > MAX_ASSOC_HASHPOWER) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "hashpower must be between %d and %d.\n",
+                        MIN_ASSOC_HASHPOWER, MAX_ASSOC_HASHPOWER);
+            return ENGINE_EINVAL;
+        }
+        assoc->hashpower = engine->config.hashpower;
+    }
+#ifdef ENABLE_BUCKET_ASSOC
+    if (assoc->hashpower > ASSOC_BUCKET_POWER_SHIFT) {
+        assoc->hashpower -= ASSOC_BUCKET_POWER_SHIFT;
+    }
+#endif
     assoc->hashsize = hashsize(assoc->hashpower);
     assoc->hashmask = hashmask(assoc->hashpower);
     assoc->rootpower = 0;
 
+#ifdef ENABLE_BUCKET_ASSOC
+    assoc->roottable = calloc(assoc->hashsize, sizeof(struct table));
+    if (assoc->roottable == NULL) {
+        return ENGINE_ENOMEM;
+    }
+    assoc->roottable[0].hashtable = bucket_table_alloc(assoc->hashsize);
+    if (assoc->roottable[0].hashtable == NULL) {
+        free(assoc->roottable);
+        return ENGINE_ENOMEM;
+    }
+#else
     assoc->roottable = calloc(assoc->hashsize * 2, sizeof(void *));
     if (assoc->roottable == NULL) {
         return ENGINE_ENOMEM;
     }
     assoc->roottable[0].hashtable = (hash_item**)&assoc->roottable[assoc->hashsize];
+#endif
 
     assoc->infotable = calloc(assoc->hashsize, sizeof(struct bucket_info));
     if (assoc->infotable == NULL) {
+#ifdef ENABLE_BUCKET_ASSOC
+        free(assoc->roottable[0].hashtable);
+#endif
         free(assoc->roottable);
         return ENGINE_ENOMEM;
     }
 
-    assoc->prefix_hashtable = calloc(hashsize(DEFAULT_PREFIX_HASHPOWER), sizeof(void *));
+    assoc->prefix_hashpower = DEFAULT_PREFIX_HASHPOWER;
+    assoc->prefix_old_hashtable = NULL;
+    assoc->prefix_expand_bucket = 0;
+    assoc->prefix_hashtable = calloc(hashsize(assoc->prefix_hashpower), sizeof(void *));
     if (assoc->prefix_hashtable == NULL) {
+#ifdef ENABLE_BUCKET_ASSOC
+        free(assoc->roottable[0].hashtable);
+#endif
         free(assoc->roottable);
         free(assoc->infotable);
         return ENGINE_ENOMEM;
@@ -78,8 +354,25 @@ ENGINE_ERROR_CODE assoc_init(struct default_engine *engine)
     // initialize noprefix stats info
     memset(&assoc->noprefix_stats, 0, sizeof(prefix_t));
     root_pt = &assoc->noprefix_stats;
+#ifdef ENABLE_COMPACT_ITEM
+    if (_prefix_index_init() != 0) {
+        free(assoc->prefix_hashtable);
+#ifdef ENABLE_BUCKET_ASSOC
+        free(assoc->roottable[0].hashtable);
+#endif
+        free(assoc->roottable);
+        free(assoc->infotable);
+        return ENGINE_ENOMEM;
+    }
+#endif
 
-    logger->log(EXTENSION_LOG_INFO, NULL, "ASSOC module initialized.\n");
+    assoc->expand_bg = false;
+    assoc->expand_bucket = 0;
+    assoc->expand_pending = 0;
+
+    logger->log(EXTENSION_LOG_INFO, NULL,
+                "ASSOC module initialized: hash buckets=%u, expands over %u items.\n",
+                assoc->hashsize, ASSOC_EXPAND_THRESHOLD(assoc));
     return ENGINE_SUCCESS;
 }
 
@@ -88,6 +381,15 @@ void assoc_final(struct default_engine *engine)
     struct assoc *assoc = &engine->assoc;
     int ii, table_count;
 
+#ifdef ENABLE_BUCKET_ASSOC
+    table_count = hashsize(assoc->rootpower);
+    for (ii=0; ii < table_count; ++ii) {
+        for (uint32_t bucket = 0; bucket < assoc->hashsize; ++bucket) {
+            bucket_free_chain(&assoc->roottable[ii].hashtable[bucket]);
+        }
+    }
+    free(assoc->roottable[0].hashtable);
+#endif
     for (ii=0; ii < assoc->rootpower; ++ii) {
          table_count = hashsize(ii); //2 ^ n
          free(assoc->roottable[table_count].hashtable);
@@ -95,9 +397,141 @@ void assoc_final(struct default_engine *engine)
     free(assoc->roottable);
     free(assoc->infotable);
     free(assoc->prefix_hashtable);
+    free(assoc->prefix_old_hashtable);
+#ifdef ENABLE_COMPACT_ITEM
+    _prefix_index_final();
+#endif
     logger->log(EXTENSION_LOG_INFO, NULL, "ASSOC module destroyed.\n");
 }
 
+#ifdef ENABLE_BUCKET_ASSOC
+static void redistribute(struct default_engine *engine, unsigned int bucket)
+{
+    struct assoc *assoc = &engine->assoc;
+    struct assoc_bucket *b;
+    hash_item *it;
+    uint32_t tabidx, slot;
+    uint32_t ii, table_count = hashsize(assoc->infotable[bucket].curpower);
+
+    /* copy the items to their new tables first.
+     * If an overflow bucket can't be allocated, undo the copies
+     * and keep the current hash power of the bucket.
+     */
+    for (ii=0; ii < table_count; ++ii) {
+        for (b = &assoc->roottable[ii].hashtable[bucket]; b != NULL; b = b->next) {
+            for (slot = 0; slot < ASSOC_BUCKET_SLOTS; slot++) {
+                if ((it = b->items[slot]) == NULL) continue;
+                tabidx = GET_HASH_TABIDX(it->khash, assoc->hashpower, hashmask(assoc->rootpower));
+                if (tabidx == ii) continue;
+                if (bucket_insert(&assoc->roottable[tabidx].hashtable[bucket],
+                                  b->tags[slot], it) == 0) {
+                    goto undo;
+                }
+            }
+        }
+    }
+    /* then, remove the copied items from their old tables */
+    for (ii=0; ii < table_count; ++ii) {
+        for (b = &assoc->roottable[ii].hashtable[bucket]; b != NULL; b = b->next) {
+            for (slot = 0; slot < ASSOC_BUCKET_SLOTS; slot++) {
+                if ((it = b->items[slot]) == NULL) continue;
+                tabidx = GET_HASH_TABIDX(it->khash, assoc->hashpower, hashmask(assoc->rootpower));
+                if (tabidx == ii) continue;
+                b->tags[slot] = 0;
+                b->items[slot] = NULL;
+            }
+        }
+        bucket_shrink_chain(&assoc->roottable[ii].hashtable[bucket]);
+    }
+    assoc->infotable[bucket].curpower = assoc->rootpower;
+    assoc->expand_pending--;
+    return;
+
+undo:
+    /* the new tables of this bucket had no items before */
+    for (ii=table_count; ii < hashsize(assoc->rootpower); ++ii) {
+        b = &assoc->roottable[ii].hashtable[bucket];
+        bucket_free_chain(b);
+        memset(b, 0, sizeof(struct assoc_bucket));
+    }
+}
+
+hash_item *assoc_find(struct default_engine *engine, uint32_t hash,
+                      const char *key, const size_t nkey)
+{
+    struct assoc *assoc = &engine->assoc;
+    struct assoc_bucket *b;
+    hash_item *it = NULL;
+    uint32_t mask;
+    uint8_t tag = bucket_tag(hash);
+    int depth = 0;
+    uint32_t bucket = GET_HASH_BUCKET(hash, assoc->hashmask);
+    uint32_t tabidx = GET_HASH_TABIDX(hash, assoc->hashpower,
+                                      hashmask(assoc->infotable[bucket].curpower));
+
+    for (b = &assoc->roottable[tabidx].hashtable[bucket]; b != NULL; b = b->next) {
+        mask = bucket_match(b, tag);
+        while (mask != 0) {
+            it = b->items[__builtin_ctz(mask)];
+            if ((hash == it->khash) && (nkey == it->nkey) &&
+                (memcmp(key, item_get_key(it), nkey) == 0)) {
+                goto found;
+            }
+            mask &= mask - 1;
+            ++depth;
+        }
+    }
+    it = NULL;
+found:
+    MEMCACHED_ASSOC_FIND(key, nkey, depth);
+    return it;
+}
+
+/* finds up to array_size items of the hash value, whatever their keys are */
+int assoc_find_hashed(struct default_engine *engine, uint32_t hash,
+                      hash_item **item_array, int array_size)
+{
+    struct assoc *assoc = &engine->assoc;
+    struct assoc_bucket *b;
+    hash_item *it;
+    uint32_t mask;
+    uint8_t tag = bucket_tag(hash);
+    int count = 0;
+    uint32_t bucket = GET_HASH_BUCKET(hash, assoc->hashmask);
+    uint32_t tabidx = GET_HASH_TABIDX(hash, assoc->hashpower,
+                                      hashmask(assoc->infotable[bucket].curpower));
+
+    for (b = &assoc->roottable[tabidx].hashtable[bucket]; b != NULL; b = b->next) {
+        mask = bucket_match(b, tag);
+        while (mask != 0) {
+            it = b->items[__builtin_ctz(mask)];
+            if (hash == it->khash) {
+                item_array[count++] = it;
+                if (count >= array_size) return count;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return count;
+}
+
+void assoc_prefetch_item(struct default_engine *engine, uint32_t hash)
+{
+    struct assoc *assoc = &engine->assoc;
+    struct assoc_bucket *b;
+    uint32_t mask;
+    uint32_t bucket = GET_HASH_BUCKET(hash, assoc->hashmask);
+    uint32_t tabidx = GET_HASH_TABIDX(hash, assoc->hashpower,
+                                      hashmask(assoc->infotable[bucket].curpower));
+
+    b = &assoc->roottable[tabidx].hashtable[bucket];
+    mask = bucket_match(b, bucket_tag(hash));
+    while (mask != 0) {
+        __builtin_prefetch(b->items[__builtin_ctz(mask)]);
+        mask &= mask - 1;
+    }
+}
+#else
 static void redistribute(struct default_engine *engine, unsigned int bucket)
 {
     struct assoc *assoc = &engine->assoc;
@@ -120,6 +554,7 @@ static void redistribute(struct default_engine *engine, unsigned int bucket)
          }
     }
     assoc->infotable[bucket].curpower = assoc->rootpower;
+    assoc->expand_pending--;
 }
 
 hash_item *assoc_find(struct default_engine *engine, uint32_t hash,
@@ -145,6 +580,36 @@ hash_item *assoc_find(struct default_engine *engine, uint32_t hash,
     return it;
 }
 
+/* finds up to array_size items of the hash value, whatever their keys are */
+int assoc_find_hashed(struct default_engine *engine, uint32_t hash,
+                      hash_item **item_array, int array_size)
+{
+    struct assoc *assoc = &engine->assoc;
+    hash_item *it;
+    int count = 0;
+    uint32_t bucket = GET_HASH_BUCKET(hash, assoc->hashmask);
+    uint32_t tabidx = GET_HASH_TABIDX(hash, assoc->hashpower,
+                                      hashmask(assoc->infotable[bucket].curpower));
+
+    for (it = assoc->roottable[tabidx].hashtable[bucket]; it != NULL; it = it->h_next) {
+        if (hash == it->khash) {
+            item_array[count++] = it;
+            if (count >= array_size) break;
+        }
+    }
+    return count;
+}
+
+void assoc_prefetch_item(struct default_engine *engine, uint32_t hash)
+{
+    struct assoc *assoc = &engine->assoc;
+    uint32_t bucket = GET_HASH_BUCKET(hash, assoc->hashmask);
+    uint32_t tabidx = GET_HASH_TABIDX(hash, assoc->hashpower,
+                                      hashmask(assoc->infotable[bucket].curpower));
+
+    __builtin_prefetch(assoc->roottable[tabidx].hashtable[bucket]);
+}
+
 /* returns the address of the item pointer before the key.  if *item == 0,
    the item wasn't found */
 static hash_item** _hashitem_before(struct default_engine *engine, uint32_t hash,
@@ -162,20 +627,103 @@ static hash_item** _hashitem_before(struct default_engine *engine, uint32_t hash
     }
     return pos;
 }
+#endif
 
-/* grows the hashtable to the next power of 2. */
-static void assoc_expand(struct default_engine *engine)
+/* prefetches the hash bucket of the hash value, and then assoc_prefetch_item()
+ * prefetches the first candidate items in the bucket. Both are hints only:
+ * they read the hash index but never dereference the items.
+ */
+void assoc_prefetch_bucket(struct default_engine *engine, uint32_t hash)
+{
+    struct assoc *assoc = &engine->assoc;
+    uint32_t bucket = GET_HASH_BUCKET(hash, assoc->hashmask);
+    uint32_t tabidx = GET_HASH_TABIDX(hash, assoc->hashpower,
+                                      hashmask(assoc->infotable[bucket].curpower));
+
+    __builtin_prefetch(&assoc->roottable[tabidx].hashtable[bucket]);
+}
+
+/*
+ * Hash table expansion
+ *
+ * The expansion adds as many hash tables as the current ones, and then
+ * redistributes the items of each bucket to the new hash tables.
+ * If the assoc maintainer thread runs (expand_bg), it allocates the new
+ * hash tables outside the cache lock and redistributes the buckets in
+ * bounded batches. Otherwise, the expansion is done inline by assoc_insert()
+ * and each bucket is redistributed lazily on the next insert into it.
+ */
+bool assoc_expand_needed(struct default_engine *engine)
+{
+    struct assoc *assoc = &engine->assoc;
+
+    /* the root table has room for hashsize hash tables */
+    return (assoc->expand_pending == 0 &&
+            assoc->hash_items > ASSOC_EXPAND_THRESHOLD(assoc) &&
+            assoc->rootpower < assoc->hashpower);
+}
+
+void *assoc_expand_alloc(struct default_engine *engine)
+{
+    struct assoc *assoc = &engine->assoc;
+    uint32_t table_count = hashsize(assoc->rootpower); // 2 ^ n
+
+#ifdef ENABLE_BUCKET_ASSOC
+    return bucket_table_alloc(assoc->hashsize * table_count);
+#else
+    return calloc(assoc->hashsize * table_count, sizeof(void *));
+#endif
+}
+
+void assoc_expand_start(struct default_engine *engine, void *hashtable)
 {
     struct assoc *assoc = &engine->assoc;
-    hash_item** new_hashtable;
     uint32_t ii, table_count = hashsize(assoc->rootpower); // 2 ^ n
+#ifdef ENABLE_BUCKET_ASSOC
+    struct assoc_bucket *new_hashtable = hashtable;
+#else
+    hash_item** new_hashtable = hashtable;
+#endif
 
-    new_hashtable = calloc(assoc->hashsize * table_count, sizeof(void *));
-    if (new_hashtable) {
-        for (ii=0; ii < table_count; ++ii) {
-            assoc->roottable[table_count+ii].hashtable = &new_hashtable[assoc->hashsize*ii];
+    for (ii=0; ii < table_count; ++ii) {
+        assoc->roottable[table_count+ii].hashtable = &new_hashtable[assoc->hashsize*ii];
+    }
+    assoc->rootpower++;
+    assoc->expand_bucket = 0;
+    assoc->expand_pending = assoc->hashsize;
+}
+
+/* redistributes at most max_buckets buckets, and returns the count of
+ * buckets not redistributed yet. The buckets being scanned are skipped.
+ */
+uint32_t assoc_expand_step(struct default_engine *engine, uint32_t max_buckets)
+{
+    struct assoc *assoc = &engine->assoc;
+    uint32_t bucket;
+
+    while (max_buckets > 0 && assoc->expand_pending > 0) {
+        bucket = assoc->expand_bucket;
+        if (assoc->infotable[bucket].curpower != assoc->rootpower &&
+            assoc->infotable[bucket].refcount == 0) {
+            redistribute(engine, bucket);
         }
-        assoc->rootpower++;
+        assoc->expand_bucket = (bucket + 1) & assoc->hashmask;
+        max_buckets--;
+    }
+    return assoc->expand_pending;
+}
+
+/* grows the hashtable to the next power of 2. */
+static void assoc_expand(struct default_engine *engine)
+{
+    void *new_hashtable;
+
+    if (engine->assoc.rootpower >= engine->assoc.hashpower) {
+        return; /* the root table is full */
+    }
+    new_hashtable = assoc_expand_alloc(engine);
+    if (new_hashtable) {
+        assoc_expand_start(engine, new_hashtable);
     }
 }
 
@@ -189,24 +737,53 @@ int assoc_insert(struct default_engine *engine, uint32_t hash, hash_item *it)
     assert(assoc_find(engine, hash, item_get_key(it), it->nkey) == 0); /* shouldn't have duplicately named things defined */
 
     if (assoc->infotable[bucket].curpower != assoc->rootpower &&
-        assoc->infotable[bucket].refcount == 0) {
+        assoc->infotable[bucket].refcount == 0 && !assoc->expand_bg) {
         redistribute(engine, bucket);
     }
     tabidx = GET_HASH_TABIDX(hash, assoc->hashpower,
                              hashmask(assoc->infotable[bucket].curpower));
 
+#ifdef ENABLE_BUCKET_ASSOC
+    if (bucket_insert(&assoc->roottable[tabidx].hashtable[bucket], bucket_tag(hash), it) == 0) {
+        return 0;
+    }
+#else
     // inserting actual hash_item to appropriate assoc_t
     it->h_next = assoc->roottable[tabidx].hashtable[bucket];
     assoc->roottable[tabidx].hashtable[bucket] = it;
+#endif
 
     assoc->hash_items++;
-    if (assoc->hash_items > (hashsize(assoc->hashpower + assoc->rootpower) * 3) / 2) {
+    if (assoc->hash_items > ASSOC_EXPAND_THRESHOLD(assoc) && !assoc->expand_bg) {
         assoc_expand(engine);
     }
     MEMCACHED_ASSOC_INSERT(item_get_key(it), it->nkey, assoc->hash_items);
     return 1;
 }
 
+#ifdef ENABLE_BUCKET_ASSOC
+void assoc_delete(struct default_engine *engine, uint32_t hash,
+                  const char *key, const size_t nkey)
+{
+    struct assoc *assoc = &engine->assoc;
+    uint32_t bucket = GET_HASH_BUCKET(hash, assoc->hashmask);
+    uint32_t tabidx = GET_HASH_TABIDX(hash, assoc->hashpower,
+                                      hashmask(assoc->infotable[bucket].curpower));
+    hash_item *it = assoc_find(engine, hash, key, nkey);
+
+    if (it != NULL) {
+        assoc->hash_items--;
+        MEMCACHED_ASSOC_DELETE(key, nkey, assoc->hash_items);
+        /* overflow buckets are kept while a scan is on the bucket */
+        bucket_remove(&assoc->roottable[tabidx].hashtable[bucket], it,
+                      assoc->infotable[bucket].refcount == 0);
+        return;
+    }
+    /* Note:  we never actually get here.  the callers don't delete things
+       they can't find. */
+    assert(it != NULL);
+}
+#else
 void assoc_delete(struct default_engine *engine, uint32_t hash,
                   const char *key, const size_t nkey)
 {
@@ -230,10 +807,107 @@ void assoc_delete(struct default_engine *engine, uint32_t hash,
        they can't find. */
     assert(*before != 0);
 }
+#endif
 
 /*
  * Assoc scan functions
  */
+#ifdef ENABLE_BUCKET_ASSOC
+void assoc_scan_init(struct default_engine *engine, struct assoc_scan *scan)
+{
+    /* initialize assoc_scan structure */
+    scan->engine = engine;
+    scan->hashsz = engine->assoc.hashsize;
+    scan->bucket = 0;
+    scan->tabcnt = 0; /* 0 means the scan on the current
+                       * bucket chain has not yet started.
+                       */
+    scan->initialized = true;
+}
+
+int assoc_scan_next(struct assoc_scan *scan, hash_item **item_array, int array_size)
+{
+    assert(scan->initialized && array_size > 0);
+    struct assoc *assoc = &scan->engine->assoc;
+    struct assoc_bucket *b;
+    int item_count = 0;
+    int scan_cost = 0;
+    int scan_done = false;
+    int ii;
+
+    while (scan->bucket < scan->hashsz)
+    {
+        if (scan->tabcnt == 0) {
+            /* start the scan on the current bucket */
+            scan->tabcnt = hashsize(assoc->infotable[scan->bucket].curpower);
+            scan->tabidx = 0;
+            scan->nodeidx = 0;
+            scan->slotidx = 0;
+            assert(scan->tabcnt > 0);
+            /* increment bucket's reference count */
+            assoc->infotable[scan->bucket].refcount += 1;
+        }
+
+        while (scan->tabidx < scan->tabcnt) {
+            if (scan_cost > (2*array_size) && item_count > 0) {
+                /* too large scan cost, stop the scan */
+                scan_done = true;  break;
+            }
+            /* overflow buckets are not freed while the scan is on the bucket */
+            b = &assoc->roottable[scan->tabidx].hashtable[scan->bucket];
+            for (ii = 0; ii < scan->nodeidx && b != NULL; ii++) {
+                b = b->next;
+            }
+            scan_cost++;
+            while (b != NULL) {
+                while (scan->slotidx < ASSOC_BUCKET_SLOTS) {
+                    if (b->items[scan->slotidx] != NULL) {
+                        item_array[item_count] = b->items[scan->slotidx];
+                        if (++item_count >= array_size)
+                            break;
+                        scan_cost++;
+                    }
+                    scan->slotidx += 1;
+                }
+                if (item_count >= array_size) {
+                    scan->slotidx += 1;
+                    break;
+                }
+                b = b->next;
+                scan->nodeidx += 1;
+                scan->slotidx = 0;
+            }
+            if (b != NULL) {
+                /* the array is full of items. stop the scan. */
+                scan_done = true;  break;
+            }
+            scan->tabidx += 1;
+            scan->nodeidx = 0;
+            scan->slotidx = 0;
+        }
+        if (scan_done) break;
+
+        /* finish the scan on the current bucket */
+        /* decrement bucket's reference count */
+        assoc->infotable[scan->bucket].refcount -= 1;
+        /* goto the next bucket */
+        scan->bucket += 1;
+        scan->tabcnt = 0;
+    }
+    return item_count;
+}
+
+void assoc_scan_final(struct assoc_scan *scan)
+{
+    assert(scan->initialized);
+
+    if (scan->bucket < scan->hashsz) {
+        /* decrement bucket's reference count */
+        scan->engine->assoc.infotable[scan->bucket].refcount -= 1;
+    }
+    scan->initialized = false;
+}
+#else
 void assoc_scan_init(struct default_engine *engine, struct assoc_scan *scan)
 {
     /* initialize assoc_scan structure */
@@ -347,6 +1021,7 @@ void assoc_scan_final(struct assoc_scan *scan)
     }
     scan->initialized = false;
 }
+#endif
 
 /*
  * Prefix Management
@@ -356,10 +1031,96 @@ static inline void *_get_prefix(prefix_t *prefix)
     return (void*)(prefix + 1);
 }
 
+/*
+ * Prefix hash table expansion
+ *
+ * When the prefix count passes 1.5 times the bucket count, the prefix
+ * hash table is doubled. The old buckets are moved to the new table
+ * PREFIX_EXPAND_STEP buckets at a time on each prefix insert and delete,
+ * so the expansion finishes well before the next one is needed.
+ * The old buckets below prefix_expand_bucket have been moved already.
+ */
+static prefix_t **_prefix_bucket(struct assoc *assoc, uint32_t hash)
+{
+    if (assoc->prefix_old_hashtable != NULL) {
+        uint32_t oldbucket = hash & hashmask(assoc->prefix_hashpower - 1);
+        if (oldbucket >= assoc->prefix_expand_bucket) {
+            return &assoc->prefix_old_hashtable[oldbucket];
+        }
+    }
+    return &assoc->prefix_hashtable[hash & hashmask(assoc->prefix_hashpower)];
+}
+
+/* the prefix hash chains of the new table followed by the old table */
+static inline uint32_t _prefix_chain_count(struct assoc *assoc)
+{
+    uint32_t count = hashsize(assoc->prefix_hashpower);
+    if (assoc->prefix_old_hashtable != NULL) {
+        count += hashsize(assoc->prefix_hashpower - 1);
+    }
+    return count;
+}
+
+static inline prefix_t *_prefix_chain(struct assoc *assoc, uint32_t index)
+{
+    uint32_t size = hashsize(assoc->prefix_hashpower);
+    if (index < size) {
+        return assoc->prefix_hashtable[index];
+    }
+    return assoc->prefix_old_hashtable[index - size];
+}
+
+static void _prefix_expand_step(struct default_engine *engine)
+{
+    struct assoc *assoc = &engine->assoc;
+    uint32_t oldsize = hashsize(assoc->prefix_hashpower - 1);
+    prefix_t *pt, **bucket;
+
+    for (int i = 0; i < PREFIX_EXPAND_STEP && assoc->prefix_expand_bucket < oldsize; i++) {
+        while ((pt = assoc->prefix_old_hashtable[assoc->prefix_expand_bucket]) != NULL) {
+            assoc->prefix_old_hashtable[assoc->prefix_expand_bucket] = pt->h_next;
+            bucket = &assoc->prefix_hashtable[engine->server.core->hash(_get_prefix(pt), pt->nprefix, 0)
+                                              & hashmask(assoc->prefix_hashpower)];
+            pt->h_next = *bucket;
+            *bucket = pt;
+        }
+        assoc->prefix_expand_bucket++;
+    }
+    if (assoc->prefix_expand_bucket >= oldsize) {
+        free(assoc->prefix_old_hashtable);
+        assoc->prefix_old_hashtable = NULL;
+        if (engine->config.verbose > 1) {
+            logger->log(EXTENSION_LOG_INFO, NULL, "prefix hash table expansion: end\n");
+        }
+    }
+}
+
+static void _prefix_expand(struct default_engine *engine)
+{
+    struct assoc *assoc = &engine->assoc;
+    prefix_t **new_hashtable;
+
+    if (assoc->prefix_hashpower >= MAX_PREFIX_HASHPOWER) {
+        return;
+    }
+    new_hashtable = calloc(hashsize(assoc->prefix_hashpower + 1), sizeof(void *));
+    if (new_hashtable == NULL) {
+        return; /* try again on the next prefix insert */
+    }
+    assoc->prefix_old_hashtable = assoc->prefix_hashtable;
+    assoc->prefix_hashtable = new_hashtable;
+    assoc->prefix_hashpower++;
+    assoc->prefix_expand_bucket = 0;
+    if (engine->config.verbose > 1) {
+        logger->log(EXTENSION_LOG_INFO, NULL, "prefix hash table expansion: start power=%u\n",
+                    assoc->prefix_hashpower);
+    }
+}
+
 prefix_t *assoc_prefix_find(struct default_engine *engine, uint32_t hash,
                             const char *prefix, const int nprefix)
 {
-    prefix_t *pt = engine->assoc.prefix_hashtable[hash & hashmask(DEFAULT_PREFIX_HASHPOWER)];
+    prefix_t *pt = *_prefix_bucket(&engine->assoc, hash);
     while (pt) {
         if ((nprefix == pt->nprefix) && (memcmp(prefix, _get_prefix(pt), nprefix) == 0)) {
             return pt;
@@ -371,7 +1132,7 @@ prefix_t *assoc_prefix_find(struct default_engine *engine, uint32_t hash,
 
 bool assoc_prefix_isvalid(struct default_engine *engine, hash_item *it, rel_time_t current_time)
 {
-    prefix_t *pt = it->pfxptr;
+    prefix_t *pt = ITEM_PREFIX(it);
     do {
         if (pt->oldest_live != 0 &&
             pt->oldest_live <= current_time &&
@@ -419,24 +1180,35 @@ void assoc_prefix_update_size(prefix_t *pt, ENGINE_ITEM_TYPE item_type,
 
 static int _prefix_insert(struct default_engine *engine, uint32_t hash, prefix_t *pt)
 {
+    struct assoc *assoc = &engine->assoc;
     assert(assoc_prefix_find(engine, hash, _get_prefix(pt), pt->nprefix) == NULL);
 
-    int bucket = hash & hashmask(DEFAULT_PREFIX_HASHPOWER);
-    pt->h_next = engine->assoc.prefix_hashtable[bucket];
-    engine->assoc.prefix_hashtable[bucket] = pt;
+    if (assoc->prefix_old_hashtable != NULL) {
+        _prefix_expand_step(engine);
+    }
+    prefix_t **bucket = _prefix_bucket(assoc, hash);
+    pt->h_next = *bucket;
+    *bucket = pt;
 
     assert(pt->parent_prefix != NULL);
     pt->parent_prefix->prefix_items++;
-    engine->assoc.tot_prefix_items++;
+    assoc->tot_prefix_items++;
+    if (assoc->prefix_old_hashtable == NULL &&
+        assoc->tot_prefix_items > (hashsize(assoc->prefix_hashpower) * 3) / 2) {
+        _prefix_expand(engine);
+    }
     return 1;
 }
 
 static void _prefix_delete(struct default_engine *engine, uint32_t hash,
                            const char *prefix, const int nprefix)
 {
-    int bucket = hash & hashmask(DEFAULT_PREFIX_HASHPOWER);
+    if (engine->assoc.prefix_old_hashtable != NULL) {
+        _prefix_expand_step(engine);
+    }
+    prefix_t **bucket = _prefix_bucket(&engine->assoc, hash);
     prefix_t *prev_pt = NULL;
-    prefix_t *pt = engine->assoc.prefix_hashtable[bucket];
+    prefix_t *pt = *bucket;
     while (pt) {
         if ((nprefix == pt->nprefix) && (memcmp(prefix, _get_prefix(pt), nprefix) == 0))
             break; /* found */
@@ -449,7 +1221,10 @@ static void _prefix_delete(struct default_engine *engine, uint32_t hash,
 
         /* unlink and free the prefix structure */
         if (prev_pt) prev_pt->h_next = pt->h_next;
-        else         engine->assoc.prefix_hashtable[bucket] = pt->h_next;
+        else         *bucket = pt->h_next;
+#ifdef ENABLE_COMPACT_ITEM
+        _prefix_index_del(pt);
+#endif
         free(pt);
     }
 }
@@ -480,7 +1255,7 @@ ENGINE_ERROR_CODE assoc_prefix_link(struct default_engine *engine, hash_item *it
         pt = root_pt;
         time(&pt->create_time);
         /* save prefix pointer in hash_item */
-        it->pfxptr = pt;
+        ITEM_SET_PREFIX(it, pt);
     } else {
         for (i = prefix_depth - 1; i >= 0; i--) {
             prefix_list[i].hash = engine->server.core->hash(key, prefix_list[i].nprefix, 0);
@@ -502,6 +1277,15 @@ ENGINE_ERROR_CODE assoc_prefix_link(struct default_engine *engine, hash_item *it
 
             for (int j = i + 1; j < prefix_depth; j++) {
                 pt = (prefix_t*)malloc(sizeof(prefix_t) + prefix_list[j].nprefix + 1);
+                if (pt != NULL) {
+                    memset(pt, 0, sizeof(prefix_t));
+#ifdef ENABLE_COMPACT_ITEM
+                    if (_prefix_index_add(pt) != 0) {
+                        free(pt);
+                        pt = NULL;
+                    }
+#endif
+                }
                 if (pt == NULL) {
                     for (j = j - 1; j >= i + 1; j--) {
                         assert(prefix_list[j].pt != NULL);
@@ -511,7 +1295,6 @@ ENGINE_ERROR_CODE assoc_prefix_link(struct default_engine *engine, hash_item *it
                 }
 
                 // building a prefix_t
-                memset(pt, 0, sizeof(prefix_t));
                 memcpy(pt + 1, key, prefix_list[j].nprefix);
                 memcpy((char*)pt+sizeof(prefix_t)+prefix_list[j].nprefix, "\0", 1);
                 pt->nprefix = prefix_list[j].nprefix;
@@ -527,7 +1310,7 @@ ENGINE_ERROR_CODE assoc_prefix_link(struct default_engine *engine, hash_item *it
             }
         }
         /* save prefix pointer in hash_item */
-        it->pfxptr = pt;
+        ITEM_SET_PREFIX(it, pt);
     }
     assert(pt != NULL);
 
@@ -554,8 +1337,8 @@ ENGINE_ERROR_CODE assoc_prefix_link(struct default_engine *engine, hash_item *it
 void assoc_prefix_unlink(struct default_engine *engine, hash_item *it,
                          const size_t item_size, bool drop_if_empty)
 {
-    prefix_t *pt = it->pfxptr;
-    it->pfxptr = NULL;
+    prefix_t *pt = ITEM_PREFIX(it);
+    ITEM_SET_PREFIX(it, NULL);
     assert(pt != NULL);
 
     /* update prefix information */
@@ -594,11 +1377,11 @@ void assoc_prefix_unlink(struct default_engine *engine, hash_item *it,
 static uint32_t do_assoc_count_invalid_prefix(struct default_engine *engine)
 {
     prefix_t *pt;
-    uint32_t i, size = hashsize(DEFAULT_PREFIX_HASHPOWER);
+    uint32_t i, size = _prefix_chain_count(&engine->assoc);
     uint32_t invalid_prefix = 0;
 
     for (i = 0; i < size; i++) {
-        pt = engine->assoc.prefix_hashtable[i];
+        pt = _prefix_chain(&engine->assoc, i);
         while (pt) {
             if (pt->prefix_items == 0 && pt->total_count_exclusive == 0)
                 invalid_prefix++;
@@ -625,7 +1408,7 @@ do_assoc_get_prefix_stats(struct default_engine *engine,
                              "time %04d%02d%02d%02d%02d%02d\r\n"; /* create time */
         char *buffer;
         struct tm *t;
-        uint32_t prefix_hsize = hashsize(DEFAULT_PREFIX_HASHPOWER);
+        uint32_t prefix_hsize = _prefix_chain_count(assoc);
         uint32_t num_prefixes = assoc->tot_prefix_items;
         uint32_t sum_nameleng = 0; /* sum of prefix name length */
         uint32_t i, buflen, pos;
@@ -638,7 +1421,7 @@ do_assoc_get_prefix_stats(struct default_engine *engine,
             sum_nameleng += strlen("<null>");
         }
         for (i = 0; i < prefix_hsize; i++) {
-            pt = assoc->prefix_hashtable[i];
+            pt = _prefix_chain(assoc, i);
             while (pt) {
                 sum_nameleng += pt->nprefix;
                 pt = pt->h_next;
@@ -684,7 +1467,7 @@ do_assoc_get_prefix_stats(struct default_engine *engine,
             assert(pos < buflen);
         }
         for (i = 0; i < prefix_hsize; i++) {
-            pt = assoc->prefix_hashtable[i];
+            pt = _prefix_chain(assoc, i);
             while (pt) {
                 t = localtime(&pt->create_time);
                 pos += snprintf(buffer+pos, buflen-pos, format, _get_prefix(pt),
@@ -741,8 +1524,46 @@ ENGINE_ERROR_CODE assoc_get_prefix_stats(struct default_engine *engine,
                                          void *prefix_data)
 {
     ENGINE_ERROR_CODE ret;
-    pthread_mutex_lock(&engine->cache_lock);
+    cache_lock_exclusive(engine);
     ret = do_assoc_get_prefix_stats(engine, prefix, nprefix, prefix_data);
-    pthread_mutex_unlock(&engine->cache_lock);
+    cache_unlock_exclusive(engine);
     return ret;
 }
+
+void assoc_stats_hash(struct default_engine *engine,
+                      ADD_STAT add_stat, const void *cookie)
+{
+    struct assoc *assoc = &engine->assoc;
+    char val[128];
+    int len;
+    uint32_t i, count, depth, max_depth = 0, used_buckets = 0;
+    uint64_t sum_depth = 0;
+    prefix_t *pt;
+
+    pthread_rwlock_rdlock(&engine->cache_lock);
+    count = _prefix_chain_count(assoc);
+    for (i = 0; i < count; i++) {
+        depth = 0;
+        for (pt = _prefix_chain(assoc, i); pt != NULL; pt = pt->h_next) {
+            depth++;
+        }
+        if (depth > 0) {
+            used_buckets++;
+            sum_depth += depth;
+            if (depth > max_depth) max_depth = depth;
+        }
+    }
+    len = sprintf(val, "%u", assoc->prefix_hashpower);
+    add_stat("prefix_hash:power_level", 23, val, len, cookie);
+    len = sprintf(val, "%d", assoc->prefix_old_hashtable != NULL ? 1 : 0);
+    add_stat("prefix_hash:is_expanding", 24, val, len, cookie);
+    len = sprintf(val, "%u", assoc->tot_prefix_items);
+    add_stat("prefix_hash:prefixes", 20, val, len, cookie);
+    len = sprintf(val, "%u", used_buckets);
+    add_stat("prefix_hash:used_buckets", 24, val, len, cookie);
+    len = sprintf(val, "%u", max_depth);
+    add_stat("prefix_hash:max_depth", 21, val, len, cookie);
+    len = sprintf(val, "%.2f", used_buckets > 0 ? (double)sum_depth / used_buckets : 0.0);
+    add_stat("prefix_hash:avg_depth", 21, val, len, cookie);
+    pthread_rwlock_unlock(&engine->cache_lock);
+}
@@ -33,6 +33,9 @@ struct _prefix_t {
 
     /* lower prefix count */
     uint32_t prefix_items;
+#ifdef ENABLE_COMPACT_ITEM
+    uint32_t pfxid;    /* index in the prefix index */
+#endif
 
     /* the count and bytes of cache items per item type */
     uint64_t items_count[ITEM_TYPE_MAX];
@@ -53,6 +56,16 @@ struct bucket_info {
                         */
 };
 
+#ifdef ENABLE_BUCKET_ASSOC
+/* bucketized hash index: a cache line sized bucket with 8-bit hash tags */
+#define ASSOC_BUCKET_SLOTS 6
+struct assoc_bucket {
+    uint8_t    tags[8];  /* hash tags of the slots: 0 if empty */
+    hash_item *items[ASSOC_BUCKET_SLOTS];
+    struct assoc_bucket *next; /* overflow bucket */
+};
+#endif
+
 struct assoc {
     uint32_t hashpower; /* how many hash buckets in a hash table ? (power of 2) */
     uint32_t hashsize;  /* hash table size */
@@ -61,19 +74,32 @@ struct assoc {
 
     /* cache item hash table : an array of hash tables */
     struct table {
+#ifdef ENABLE_BUCKET_ASSOC
+       struct assoc_bucket *hashtable;
+#else
        hash_item** hashtable;
+#endif
     } *roottable;
 
     /* bucket info table */
     struct bucket_info *infotable;
 
-    /* prefix hash table : single hash table */
+    /* prefix hash table : single hash table,
+     * and the old one being moved to it while expanding */
     prefix_t**  prefix_hashtable;
+    prefix_t**  prefix_old_hashtable;
+    uint32_t    prefix_hashpower;
+    uint32_t    prefix_expand_bucket; /* next old bucket to move */
     prefix_t    noprefix_stats;
 
     /* Number of items in the hash table. */
     unsigned int hash_items;
     unsigned int tot_prefix_items;
+
+    /* hash table expansion */
+    bool     expand_bg;      /* expanded by the assoc maintainer thread ? */
+    uint32_t expand_bucket;  /* next bucket to redistribute */
+    uint32_t expand_pending; /* count of buckets not redistributed yet */
 };
 
 /* assoc scan structure */
@@ -83,8 +109,13 @@ struct assoc_scan {
     int        bucket;    /* current bucket index */
     int        tabcnt;    /* table count in the bucket */
     int        tabidx;    /* table index in the bucket */
+#ifdef ENABLE_BUCKET_ASSOC
+    int        nodeidx;   /* overflow bucket index in the table */
+    int        slotidx;   /* slot index in the overflow bucket */
+#else
     hash_item  ph_item;   /* placeholder item itself */
     bool       ph_linked; /* placeholder item linked */
+#endif
     bool       initialized;
 };
 
@@ -94,9 +125,18 @@ void              assoc_final(struct default_engine *engine);
 
 hash_item *       assoc_find(struct default_engine *engine, uint32_t hash,
                              const char *key, const size_t nkey);
+int               assoc_find_hashed(struct default_engine *engine, uint32_t hash,
+                                    hash_item **item_array, int array_size);
+void              assoc_prefetch_bucket(struct default_engine *engine, uint32_t hash);
+void              assoc_prefetch_item(struct default_engine *engine, uint32_t hash);
 int               assoc_insert(struct default_engine *engine, uint32_t hash, hash_item *item);
 void              assoc_delete(struct default_engine *engine, uint32_t hash,
                                const char *key, const size_t nkey);
+/* hash table expansion functions */
+bool              assoc_expand_needed(struct default_engine *engine);
+void *            assoc_expand_alloc(struct default_engine *engine);
+void              assoc_expand_start(struct default_engine *engine, void *hashtable);
+uint32_t          assoc_expand_step(struct default_engine *engine, uint32_t max_buckets);
 /* assoc scan functions */
 void              assoc_scan_init(struct default_engine *engine, struct assoc_scan *scan);
 int               assoc_scan_next(struct assoc_scan *scan,
@@ -117,4 +157,6 @@ void              assoc_prefix_unlink(struct default_engine *engine, hash_item *
 ENGINE_ERROR_CODE assoc_get_prefix_stats(struct default_engine *engine,
                                     const char *prefix, const int nprefix,
                                     void *prefix_data);
+void              assoc_stats_hash(struct default_engine *engine,
+                                   ADD_STAT add_stat, const void *cookie);
 #endif
@@ -115,12 +115,33 @@ initialize_configuration(struct default_engine *se, const char *cfg_str)
             { .key = "eviction",
               .datatype = DT_BOOL,
               .value.dt_bool = &se->config.evict_to_free },
+            { .key = "lru_segmented",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.lru_segmented },
+            { .key = "lfu_admission",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.lfu_admission },
+            { .key = "eviction_policy",
+              .datatype = DT_STRING,
+              .value.dt_string = &se->config.eviction_policy },
+            { .key = "lru_maintainer",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.lru_maintainer },
+            { .key = "alloc_latency",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.alloc_latency },
             { .key = "num_threads",
               .datatype = DT_SIZE,
               .value.dt_size = &se->config.num_threads },
             { .key = "cache_size",
               .datatype = DT_SIZE,
               .value.dt_size = &se->config.maxbytes },
+            { .key = "memlimit_shrink_rate",
+              .datatype = DT_SIZE,
+              .value.dt_size = &se->config.memlimit_shrink_rate },
+            { .key = "expiry_reap_rate",
+              .datatype = DT_SIZE,
+              .value.dt_size = &se->config.expiry_reap_rate },
 #ifdef ENABLE_STICKY_ITEM
             { .key = "sticky_limit",
               .datatype = DT_SIZE,
@@ -129,15 +150,36 @@ initialize_configuration(struct default_engine *se, const char *cfg_str)
             { .key = "preallocate",
               .datatype = DT_BOOL,
               .value.dt_bool = &se->config.preallocate },
+            { .key = "large_pages",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.large_pages },
+            { .key = "prefault",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.prefault },
+            { .key = "numa",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.numa },
+            { .key = "magazine_size",
+              .datatype = DT_SIZE,
+              .value.dt_size = &se->config.magazine_size },
             { .key = "factor",
               .datatype = DT_FLOAT,
               .value.dt_float = &se->config.factor },
+            { .key = "slab_sizes",
+              .datatype = DT_STRING,
+              .value.dt_string = &se->config.slab_sizes },
+            { .key = "slab_sizes_sample",
+              .datatype = DT_SIZE,
+              .value.dt_size = &se->config.slab_sizes_sample },
             { .key = "chunk_size",
               .datatype = DT_SIZE,
               .value.dt_size = &se->config.chunk_size },
             { .key = "item_size_max",
               .datatype = DT_SIZE,
               .value.dt_size = &se->config.item_size_max },
+            { .key = "item_chunk_size",
+              .datatype = DT_SIZE,
+              .value.dt_size = &se->config.item_chunk_size },
             { .key = "max_list_size",
               .datatype = DT_SIZE,
               .value.dt_size = &se->config.max_list_size },
@@ -159,6 +201,27 @@ initialize_configuration(struct default_engine *se, const char *cfg_str)
             { .key = "vb0",
               .datatype = DT_BOOL,
               .value.dt_bool = &se->config.vb0 },
+            { .key = "lockfree_get",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.lockfree_get },
+            { .key = "coll_lock_stripes",
+              .datatype = DT_SIZE,
+              .value.dt_size = &se->config.coll_lock_stripes },
+            { .key = "shared_coll_read",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.shared_coll_read },
+            { .key = "hashpower",
+              .datatype = DT_SIZE,
+              .value.dt_size = &se->config.hashpower },
+            { .key = "slab_reassign",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.slab_reassign },
+            { .key = "slab_automove",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.slab_automove },
+            { .key = "sm_compact",
+              .datatype = DT_BOOL,
+              .value.dt_bool = &se->config.sm_compact },
             { .key = "config_file",
               .datatype = DT_CONFIGFILE },
             { .key = NULL}
@@ -168,6 +231,14 @@ initialize_configuration(struct default_engine *se, const char *cfg_str)
         }
     }
 
+    if (se->config.slab_automove) {
+        /* the automover reassigns slab pages */
+        se->config.slab_reassign = true;
+    }
+    if (se->config.large_pages || se->config.numa) {
+        /* huge pages or node arenas back the preallocated cache memory */
+        se->config.preallocate = true;
+    }
     if (se->config.vb0) {
         set_vbucket_state(se, 0, VBUCKET_STATE_ACTIVE);
     }
@@ -213,9 +284,11 @@ default_destroy(ENGINE_HANDLE* handle)
         item_final(se);
         slabs_final(se);
         assoc_final(se);
-        pthread_mutex_destroy(&se->cache_lock);
+        pthread_rwlock_destroy(&se->cache_lock);
         pthread_mutex_destroy(&se->stats.lock);
         pthread_mutex_destroy(&se->slabs.lock);
+        free(se->config.slab_sizes);
+        free(se->config.eviction_policy);
         free(se);
     }
 }
@@ -301,6 +374,25 @@ default_get(ENGINE_HANDLE* handle, const void* cookie,
     }
 }
 
+static ENGINE_ERROR_CODE
+default_get_multi(ENGINE_HANDLE* handle, const void* cookie,
+                  item** items, token_t *karray, const int kcount,
+                  uint16_t vbucket)
+{
+    struct default_engine *engine = get_handle(handle);
+    VBUCKET_GUARD(engine, vbucket);
+
+    item_get_multi(engine, karray, kcount, (hash_item **)items);
+    for (int i = 0; i < kcount; i++) {
+        if (items[i] != NULL && IS_COLL_ITEM(get_real_item(items[i]))) {
+            /* collection item: treated as a miss */
+            item_release(engine, get_real_item(items[i]));
+            items[i] = NULL;
+        }
+    }
+    return ENGINE_SUCCESS;
+}
+
 static ENGINE_ERROR_CODE
 default_store(ENGINE_HANDLE* handle, const void *cookie,
               item* item, uint64_t *cas, ENGINE_STORE_OPERATION operation,
@@ -1003,6 +1095,8 @@ static void stats_engine(struct default_engine *engine,
     pthread_mutex_lock(&engine->stats.lock);
     len = sprintf(val, "%"PRIu64, (uint64_t)engine->stats.evictions);
     add_stat("evictions", 9, val, len, cookie);
+    len = sprintf(val, "%"PRIu64, engine->stats.evicted_bytes);
+    add_stat("evicted_bytes", 13, val, len, cookie);
     len = sprintf(val, "%"PRIu64, (uint64_t)engine->assoc.tot_prefix_items);
     add_stat("curr_prefixes", 13, val, len, cookie);
     len = sprintf(val, "%"PRIu64, (uint64_t)engine->stats.sticky_items);
@@ -1021,7 +1115,19 @@ static void stats_engine(struct default_engine *engine,
     add_stat("sticky_limit", 12, val, len, cookie);
     len = sprintf(val, "%"PRIu64, (uint64_t)engine->config.maxbytes);
     add_stat("engine_maxbytes", 15, val, len, cookie);
+    len = sprintf(val, "%u", engine->assoc.hashpower + engine->assoc.rootpower);
+    add_stat("hash_power_level", 16, val, len, cookie);
+    len = sprintf(val, "%"PRIu64, ((uint64_t)engine->assoc.hashsize << engine->assoc.rootpower)
+                                  * sizeof(engine->assoc.roottable[0].hashtable[0]));
+    add_stat("hash_bytes", 10, val, len, cookie);
+    len = sprintf(val, "%d", engine->assoc.expand_pending > 0 ? 1 : 0);
+    add_stat("hash_is_expanding", 17, val, len, cookie);
+    len = sprintf(val, "%u", engine->assoc.expand_pending);
+    add_stat("hash_expand_pending", 19, val, len, cookie);
     pthread_mutex_unlock(&engine->stats.lock);
+    slabs_shrink_stats(engine, add_stat, cookie);
+    item_expiry_stats(engine, add_stat, cookie);
+    item_alloc_stats(engine, add_stat, cookie);
 }
 
 static void stats_vbucket(struct default_engine *engine,
@@ -1054,6 +1160,10 @@ default_get_stats(ENGINE_HANDLE* handle, const void* cookie,
     else if (strncmp(stat_key, "items", 5) == 0) {
         item_stats(engine, add_stat, cookie);
     }
+    else if (strncmp(stat_key, "memory", 6) == 0) {
+        slabs_memory_stats(engine, add_stat, cookie);
+        item_memory_stats(engine, add_stat, cookie);
+    }
     else if (strncmp(stat_key, "sizes", 5) == 0) {
         item_stats_sizes(engine, add_stat, cookie);
     }
@@ -1066,6 +1176,9 @@ default_get_stats(ENGINE_HANDLE* handle, const void* cookie,
     else if (strncmp(stat_key, "dump", 4) == 0) {
         item_stats_dump(engine, add_stat, cookie);
     }
+    else if (strncmp(stat_key, "hash", 4) == 0) {
+        assoc_stats_hash(engine, add_stat, cookie);
+    }
     else {
         ret = ENGINE_KEY_ENOENT;
     }
@@ -1080,6 +1193,7 @@ default_reset_stats(ENGINE_HANDLE* handle, const void *cookie)
 
     pthread_mutex_lock(&engine->stats.lock);
     engine->stats.evictions = 0;
+    engine->stats.evicted_bytes = 0;
     engine->stats.reclaimed = 0;
     engine->stats.total_items = 0;
     pthread_mutex_unlock(&engine->stats.lock);
@@ -1133,6 +1247,17 @@ default_dump(ENGINE_HANDLE* handle, const void* cookie,
     return ENGINE_SUCCESS;
 }
 
+/*
+ * Slab page mover API
+ */
+static ENGINE_ERROR_CODE
+default_slabs_reassign(ENGINE_HANDLE* handle, const void* cookie,
+                       const int src, const int dst)
+{
+    struct default_engine* engine = get_handle(handle);
+    return item_slabs_reassign(engine, src, dst);
+}
+
 /*
  * Config API
  */
@@ -1145,7 +1270,7 @@ default_set_config(ENGINE_HANDLE* handle, const void* cookie,
 
     if (strcmp(config_key, "memlimit") == 0) {
         size_t new_maxbytes = *(size_t*)config_value;
-        pthread_mutex_lock(&engine->cache_lock);
+        cache_lock_exclusive(engine);
         if (new_maxbytes >= engine->config.sticky_limit) {
             ret = slabs_set_memlimit(engine, new_maxbytes);
             if (ret == ENGINE_SUCCESS) {
@@ -1154,19 +1279,19 @@ default_set_config(ENGINE_HANDLE* handle, const void* cookie,
         } else {
             ret = ENGINE_EBADVALUE;
         }
-        pthread_mutex_unlock(&engine->cache_lock);
+        cache_unlock_exclusive(engine);
     }
 #ifdef ENABLE_STICKY_ITEM
     else if (strcmp(config_key, "sticky_limit") == 0) {
         size_t new_sticky_limit = *(size_t*)config_value;
-        pthread_mutex_lock(&engine->cache_lock);
+        cache_lock_exclusive(engine);
         if (new_sticky_limit >= engine->stats.sticky_bytes &&
             new_sticky_limit <= engine->config.maxbytes) {
             engine->config.sticky_limit = new_sticky_limit;
         } else {
             ret = ENGINE_EBADVALUE;
         }
-        pthread_mutex_unlock(&engine->cache_lock);
+        cache_unlock_exclusive(engine);
     }
 #endif
     else if (strcmp(config_key, "max_list_size") == 0) {
@@ -1181,10 +1306,19 @@ default_set_config(ENGINE_HANDLE* handle, const void* cookie,
     else if (strcmp(config_key, "max_btree_size") == 0) {
         ret = item_conf_set_maxcollsize(engine, ITEM_TYPE_BTREE, (int*)config_value);
     }
+    else if (strcmp(config_key, "slab_automove") == 0) {
+        cache_lock_exclusive(engine);
+        if (engine->config.slab_reassign) {
+            engine->config.slab_automove = *(bool*)config_value;
+        } else {
+            ret = ENGINE_ENOTSUP;
+        }
+        cache_unlock_exclusive(engine);
+    }
     else if (strcmp(config_key, "verbosity") == 0) {
-        pthread_mutex_lock(&engine->cache_lock);
+        cache_lock_exclusive(engine);
         engine->config.verbose = *(size_t*)config_value;
-        pthread_mutex_unlock(&engine->cache_lock);
+        cache_unlock_exclusive(engine);
     }
     else {
         ret = ENGINE_ENOTSUP;
@@ -1394,8 +1528,10 @@ static bool
 get_item_info(ENGINE_HANDLE *handle, const void *cookie,
               const item* item, item_info *item_info)
 {
+    struct default_engine* engine = get_handle(handle);
     hash_item* it = (hash_item*)item;
-    if (item_info->nvalue < 1) {
+    int nvalue = item_get_value_iovs(engine, it, item_info->value, item_info->nvalue);
+    if (nvalue < 1) {
         return false;
     }
     item_info->cas = item_get_cas(it);
@@ -1404,10 +1540,8 @@ get_item_info(ENGINE_HANDLE *handle, const void *cookie,
     item_info->flags = it->flags;
     item_info->clsid = it->slabs_clsid;
     item_info->nkey = it->nkey;
-    item_info->nvalue = 1;
+    item_info->nvalue = nvalue;
     item_info->key = item_get_key(it);
-    item_info->value[0].iov_base = item_get_data(it);
-    item_info->value[0].iov_len = it->nbytes;
     return true;
 }
 
@@ -1479,6 +1613,7 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
          .remove            = default_item_delete,
          .release           = default_item_release,
          .get               = default_get,
+         .get_multi         = default_get_multi,
          .store             = default_store,
          .arithmetic        = default_arithmetic,
          .flush             = default_flush,
@@ -1534,6 +1669,8 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
          /* Dump API */
          .cachedump        = default_cachedump,
          .dump             = default_dump,
+         /* Slab page mover API */
+         .slabs_reassign   = default_slabs_reassign,
          /* Config API */
          .set_config       = default_set_config,
          /* Unknown Command API */
@@ -1552,7 +1689,12 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
       .slabs = {
          .lock = PTHREAD_MUTEX_INITIALIZER
       },
-      .cache_lock = PTHREAD_MUTEX_INITIALIZER,
+#ifdef PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+      /* prefer writers so that updates are not starved by shared readers */
+      .cache_lock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP,
+#else
+      .cache_lock = PTHREAD_RWLOCK_INITIALIZER,
+#endif
       .stats = {
          .lock = PTHREAD_MUTEX_INITIALIZER,
       },
@@ -1561,18 +1703,39 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
          .verbose = 0,
          .oldest_live = 0,
          .evict_to_free = true,
+         .lru_segmented = false,
+         .lfu_admission = false,
+         .eviction_policy = NULL,
+         .lru_maintainer = false,
+         .alloc_latency = false,
          .num_threads = 0,
          .maxbytes = 64 * 1024 * 1024,
+         .memlimit_shrink_rate = 64 * 1024 * 1024,
+         .expiry_reap_rate = 0,
          .sticky_limit = 0,
          .preallocate = false,
+         .large_pages = false,
+         .prefault = false,
+         .numa = false,
+         .magazine_size = 0,
          .factor = 1.25,
+         .slab_sizes = NULL,
+         .slab_sizes_sample = 0,
          .chunk_size = 48,
          .item_size_max= 1024 * 1024,
+         .item_chunk_size = 0,
          .max_list_size = 50000,
          .max_set_size = 50000,
          .max_map_size = 50000,
          .max_btree_size = 50000,
          .prefix_delimiter = ':',
+         .lockfree_get = false,
+         .coll_lock_stripes = 0,
+         .shared_coll_read = false,
+         .hashpower = 0, /* use the default hashpower of assoc */
+         .slab_reassign = false,
+         .slab_automove = false,
+         .sm_compact = false,
        },
       .scrubber = {
          .lock = PTHREAD_MUTEX_INITIALIZER,
@@ -48,13 +48,27 @@ struct engine_config {
    size_t verbose;
    rel_time_t oldest_live;
    bool   evict_to_free;
+   bool   lru_segmented;
+   bool   lfu_admission;
+   char  *eviction_policy;
+   bool   lru_maintainer;
+   bool   alloc_latency;
    size_t num_threads;
    size_t maxbytes;
+   size_t memlimit_shrink_rate;
+   size_t expiry_reap_rate;
    size_t sticky_limit;
    bool   preallocate;
+   bool   large_pages;
+   bool   prefault;
+   bool   numa;
+   size_t magazine_size;
    float  factor;
+   char  *slab_sizes;
+   size_t slab_sizes_sample;
    size_t chunk_size;
    size_t item_size_max;
+   size_t item_chunk_size;
    size_t max_list_size;
    size_t max_set_size;
    size_t max_map_size;
@@ -62,6 +76,13 @@ struct engine_config {
    bool   ignore_vbucket;
    char   prefix_delimiter;
    bool   vb0;
+   bool   lockfree_get;
+   size_t coll_lock_stripes;
+   bool   shared_coll_read;
+   size_t hashpower;
+   bool   slab_reassign;
+   bool   slab_automove;
+   bool   sm_compact;
 };
 
 /**
@@ -70,12 +91,17 @@ struct engine_config {
 struct engine_stats {
    pthread_mutex_t lock;
    uint64_t evictions;
+   uint64_t evicted_bytes;
    uint64_t reclaimed;
    uint64_t sticky_bytes;
    uint64_t sticky_items;
    uint64_t curr_bytes;
    uint64_t curr_items;
    uint64_t total_items;
+   uint64_t type_items[ITEM_TYPE_MAX]; /* # of linked items of each type */
+   uint64_t type_bytes[ITEM_TYPE_MAX]; /* space of linked items of each type */
+   uint64_t coll_meta_bytes;           /* space of collection item headers with meta info */
+   uint64_t coll_node_bytes[ITEM_TYPE_MAX]; /* space of set/map hash nodes and b+tree nodes */
 };
 
 /**
@@ -117,6 +143,23 @@ struct engine_dumper {
    int             nprefix;
 };
 
+/**
+ * lock-free reader slot (one cache line per thread)
+ */
+struct reader_slot {
+   volatile bool active;
+   char          padding[63];
+};
+
+/**
+ * per-thread buffer of LRU repositions deferred by shared readers
+ */
+#define LRU_BUFFER_SIZE 64
+struct lru_buffer {
+   uint32_t   count;
+   hash_item *items[LRU_BUFFER_SIZE];
+};
+
 /**
  * Definition of the private instance data used by the default engine.
  *
@@ -137,10 +180,36 @@ struct default_engine {
    struct items items;
 
    /**
-    * The cache layer (item_* and assoc_*) is currently protected by
-    * this single mutex
+    * The cache layer (item_* and assoc_*) is protected by this lock.
+    * Every operation that changes the cache holds it exclusively.
+    * If shared collection read is enabled, collection reads hold it shared.
+    */
+   pthread_rwlock_t cache_lock;
+
+   /**
+    * Lock-free get announces itself in a per-thread reader slot.
+    * The exclusive lock holder blocks new readers and waits
+    * until the reader slots are inactive.
+    */
+   struct reader_slot *reader_slots;   /* NULL if disabled */
+   volatile uint32_t   reader_count;   /* # of assigned reader slots */
+   volatile bool       readers_blocked;
+
+   /**
+    * Collection locks chosen by the key hash.
+    * A collection read holds it shared without the cache lock,
+    * and a collection update holds it exclusively before the cache lock.
+    */
+   pthread_rwlock_t *coll_locks;     /* NULL if disabled */
+   uint32_t          coll_lock_mask; /* collection lock mask */
+
+   /**
+    * Shared collection read defers LRU repositions to per-thread
+    * LRU buffers. They are applied by the exclusive lock holder.
     */
-   pthread_mutex_t cache_lock;
+   struct lru_buffer *lru_buffers;      /* NULL if disabled */
+   volatile uint32_t  lru_buffer_count; /* # of assigned LRU buffers */
+   volatile uint32_t  lru_deferred;     /* # of deferred LRU repositions */
 
    struct engine_config config;
    struct engine_stats stats;
@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <sys/time.h> /* gettimeofday() */
+#include <sched.h>
 
 #include "default_engine.h"
 
@@ -51,8 +52,20 @@ enum elem_delete_cause {
 /* Forward Declarations */
 static void item_link_q(struct default_engine *engine, hash_item *it);
 static void item_unlink_q(struct default_engine *engine, hash_item *it);
+static bool do_item_lru_rescue(struct default_engine *engine, hash_item *it, int lruid);
+static int  do_item_lfu_access(struct default_engine *engine, uint32_t hash);
+static bool do_item_lfu_admit(struct default_engine *engine, hash_item *victim,
+                              int lruid, int freq);
+static hash_item *do_item_evict_victim(struct default_engine *engine, hash_item *search,
+                                       rel_time_t current_time);
+static inline uint32_t item_key_hash(struct default_engine *engine,
+                                     const char *key, const size_t nkey);
 static ENGINE_ERROR_CODE do_item_link(struct default_engine *engine, hash_item *it);
+static void do_item_expiry_add(struct default_engine *engine, hash_item *it);
+static void do_item_expiry_remove(struct default_engine *engine, hash_item *it);
+static void lru_maint_thread_wakeup(void);
 static void do_item_unlink(struct default_engine *engine, hash_item *it, enum item_unlink_cause cause);
+static void do_item_update(struct default_engine *engine, hash_item *it);
 static void do_coll_all_elem_delete(struct default_engine *engine, hash_item *it);
 static uint32_t do_map_elem_delete(struct default_engine *engine, map_meta_info *info,
                                    const uint32_t count, enum elem_delete_cause cause);
@@ -131,6 +144,12 @@ extern int genhash_string_hash(const void* p, size_t nkey);
 /* max hash key length for calculation hash value */
 #define MAX_HKEY_LEN 250
 
+/* max number of collection locks */
+#define MAX_LOCK_STRIPES 65536
+
+/* max number of lock-free reader threads */
+#define MAX_READER_SLOTS 1024
+
 /* btree position debugging */
 static bool btree_position_debug = false;
 
@@ -166,6 +185,53 @@ static pthread_cond_t  coll_del_cond;
 static bool            coll_del_sleep;
 static pthread_t       coll_del_tid; /* thread id */
 
+/* assoc maintainer: background hash table expansion */
+#define ASSOC_EXPAND_BATCH   1024 /* buckets redistributed per cache lock */
+#define ASSOC_MAINT_SLEEP_MS 10
+static pthread_mutex_t assoc_maint_lock;
+static pthread_cond_t  assoc_maint_cond;
+static pthread_t       assoc_maint_tid; /* thread id */
+
+/* slab automover: background slab page reassignment */
+#define SLAB_AUTOMOVE_INTERVAL_MS 1000 /* eviction check interval */
+#define SLAB_AUTOMOVE_IDLE_CHECKS 3    /* # of checks without eviction in source class */
+#define SLAB_REASSIGN_TRIES       8    /* # of pages checked to find a movable page */
+static pthread_mutex_t slab_automove_lock;
+static pthread_cond_t  slab_automove_cond;
+static pthread_t       slab_automove_tid; /* thread id */
+
+/* small memory compactor: background relocation of collection objects */
+#define SM_COMPACT_INTERVAL_MS 1000 /* fragmentation check interval */
+#define SM_COMPACT_IDLE_CHECKS 60   /* # of checks skipped after a run freed nothing */
+static pthread_mutex_t sm_compact_lock;
+static pthread_cond_t  sm_compact_cond;
+static pthread_t       sm_compact_tid; /* thread id */
+
+/* memlimit shrinker: background release of slab pages for a smaller memlimit */
+#define MEMLIMIT_SHRINK_INTERVAL_MS 100  /* shrink interval */
+#define MEMLIMIT_SHRINK_TRIES       1000 /* # of LRU items checked per eviction run */
+static pthread_mutex_t memlimit_shrink_lock;
+static pthread_cond_t  memlimit_shrink_cond;
+static pthread_t       memlimit_shrink_tid; /* thread id */
+
+/* expiry reaper: background free of expired items found by the timing wheel */
+#define EXPIRY_REAP_INTERVAL_MS 100 /* reap interval */
+#define EXPIRY_HASH_ITEMS       16  /* max # of items of a hash value checked per entry */
+#define EXPIRY_REAP_BATCH       64  /* max # of entries reaped per lock hold */
+static pthread_mutex_t expiry_reap_lock;
+static pthread_cond_t  expiry_reap_cond;
+static pthread_t       expiry_reap_tid; /* thread id */
+
+/* LRU maintainer: background eviction for the free memory headroom */
+#define LRU_MAINT_INTERVAL_MS 10 /* headroom check interval */
+#define LRU_MAINT_HEADROOM    16 /* free slots kept per slab class, at most a page */
+#define LRU_MAINT_BATCH       64 /* max # of items evicted per lock hold */
+#define LRU_MAINT_INLINE_SSL  10 /* space shortage level to evict inline */
+static pthread_mutex_t lru_maint_lock;
+static pthread_cond_t  lru_maint_cond;
+static pthread_t       lru_maint_tid; /* thread id */
+static bool            lru_maint_sleep;
+
 static EXTENSION_LOGGER_DESCRIPTOR *logger;
 
 /* map element previous info internally used */
@@ -201,11 +267,251 @@ static inline void ITEM_REFCOUNT_DECR(hash_item *it)
     }
 }
 
+/* refcount changes of lock-free readers.
+ * They give up instead of carrying to or borrowing from the refchunk.
+ */
+static inline bool ITEM_REFCOUNT_INCR_ATOMIC(hash_item *it)
+{
+    uint16_t refcount;
+    do {
+        refcount = it->refcount;
+        if (refcount >= ITEM_REFCOUNT_FULL - 1) {
+            return false;
+        }
+    } while (!__sync_bool_compare_and_swap(&it->refcount, refcount, refcount + 1));
+    return true;
+}
+
+static inline bool ITEM_REFCOUNT_DECR_ATOMIC(hash_item *it)
+{
+    uint16_t refcount;
+    do {
+        refcount = it->refcount;
+        if (refcount == 0 || (refcount == 1 && it->refchunk > 0)) {
+            return false;
+        }
+    } while (!__sync_bool_compare_and_swap(&it->refcount, refcount, refcount - 1));
+    return true;
+}
+
+/*
+ * Cache lock
+ *
+ * If lock-free get is enabled, each thread announces its lock-free read
+ * in its own reader slot, and the exclusive lock holder waits until
+ * no reader slot is active. Lock-free readers never run with a writer.
+ *
+ * If shared collection read is enabled, the LRU repositions deferred by
+ * shared readers are applied first whenever the exclusive lock is taken.
+ * So, a deferred item cannot be freed before its LRU reposition.
+ */
+#define LOCK_CACHE()    cache_lock_exclusive(engine)
+#define TRYLOCK_CACHE() cache_trylock_exclusive(engine)
+#define UNLOCK_CACHE()  cache_unlock_exclusive(engine)
+
+static __thread uint32_t reader_slot_id = MAX_READER_SLOTS + 1; /* not assigned */
+static __thread uint32_t lru_buffer_id = MAX_READER_SLOTS + 1;  /* not assigned */
+
+static void do_lru_apply_deferred(struct default_engine *engine)
+{
+    uint32_t count = engine->lru_buffer_count;
+    if (count > MAX_READER_SLOTS) {
+        count = MAX_READER_SLOTS;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        struct lru_buffer *buffer = &engine->lru_buffers[i];
+        for (uint32_t j = 0; j < buffer->count; j++) {
+            do_item_update(engine, buffer->items[j]);
+        }
+        buffer->count = 0;
+    }
+    engine->lru_deferred = 0;
+}
+
+static void do_cache_drain_readers(struct default_engine *engine)
+{
+    uint32_t count = engine->reader_count;
+    if (count > MAX_READER_SLOTS) {
+        count = MAX_READER_SLOTS;
+    }
+    engine->readers_blocked = true;
+    __sync_synchronize();
+    for (uint32_t i = 0; i < count; i++) {
+        int spins = 0;
+        while (engine->reader_slots[i].active) {
+            if (++spins >= 1000) {
+                sched_yield();
+                spins = 0;
+            }
+        }
+    }
+}
+
+void cache_lock_exclusive(struct default_engine *engine)
+{
+    pthread_rwlock_wrlock(&engine->cache_lock);
+    if (engine->reader_slots != NULL) {
+        do_cache_drain_readers(engine);
+    }
+    if (engine->lru_deferred > 0) {
+        do_lru_apply_deferred(engine);
+    }
+}
+
+static inline int cache_trylock_exclusive(struct default_engine *engine)
+{
+    int ret = pthread_rwlock_trywrlock(&engine->cache_lock);
+    if (ret == 0 && engine->reader_slots != NULL) {
+        do_cache_drain_readers(engine);
+    }
+    if (ret == 0 && engine->lru_deferred > 0) {
+        do_lru_apply_deferred(engine);
+    }
+    return ret;
+}
+
+void cache_unlock_exclusive(struct default_engine *engine)
+{
+    if (engine->reader_slots != NULL) {
+        __sync_synchronize();
+        engine->readers_blocked = false;
+    }
+    pthread_rwlock_unlock(&engine->cache_lock);
+}
+
+static struct reader_slot *cache_reader_enter(struct default_engine *engine)
+{
+    struct reader_slot *slot;
+    int retry;
+
+    if (reader_slot_id > MAX_READER_SLOTS) {
+        reader_slot_id = __sync_fetch_and_add(&engine->reader_count, 1);
+        if (reader_slot_id > MAX_READER_SLOTS) {
+            reader_slot_id = MAX_READER_SLOTS;
+        }
+    }
+    if (reader_slot_id == MAX_READER_SLOTS) {
+        return NULL; /* no reader slot left */
+    }
+    slot = &engine->reader_slots[reader_slot_id];
+    for (retry = 0; retry < 3; retry++) {
+        slot->active = true;
+        __sync_synchronize();
+        if (!engine->readers_blocked) {
+            return slot;
+        }
+        slot->active = false;
+        sched_yield();
+    }
+    return NULL; /* writers are busy */
+}
+
+static inline void cache_reader_exit(struct reader_slot *slot)
+{
+    __sync_synchronize();
+    slot->active = false;
+}
+
+/*
+ * Collection locks
+ *
+ * If collection locks are enabled, a collection read without deletion
+ * holds the cache lock only to find and pin the collection item, and then
+ * reads the collection under the shared collection lock of its key.
+ * A collection update takes the exclusive collection lock of its key
+ * before the cache lock. So, a reader never holds both of the locks.
+ */
+static pthread_rwlock_t *coll_write_begin(struct default_engine *engine,
+                                          const char *key, const size_t nkey)
+{
+    pthread_rwlock_t *lock = NULL;
+    if (engine->coll_locks != NULL) {
+        const char *hkey = (nkey > MAX_HKEY_LEN) ? key+(nkey-MAX_HKEY_LEN) : key;
+        const size_t hnkey = (nkey > MAX_HKEY_LEN) ? MAX_HKEY_LEN : nkey;
+        uint32_t hash = engine->server.core->hash(hkey, hnkey, 0);
+        lock = &engine->coll_locks[hash & engine->coll_lock_mask];
+        pthread_rwlock_wrlock(lock);
+    }
+    return lock;
+}
+
+static inline void coll_write_end(pthread_rwlock_t *lock)
+{
+    if (lock != NULL) {
+        pthread_rwlock_unlock(lock);
+    }
+}
+
+/* Element refcounts are incremented by collection readers
+ * that hold only the shared collection lock or the shared cache lock.
+ */
+#define ELEM_REFCOUNT_INCR(elem) (void)__sync_add_and_fetch(&(elem)->refcount, 1)
+#define ELEM_REFCOUNT_DECR(elem) (void)__sync_sub_and_fetch(&(elem)->refcount, 1)
+
+/*
+ * Chunked items
+ *
+ * If item_chunk_size is set, the value of a kv item larger than the small
+ * memory limit is stored in a chain of chunks of the chunk slab class.
+ * The tail of the value shorter than a chunk is kept in the item header,
+ * after the pointer to the first chunk.
+ */
+static inline size_t do_item_chunk_dsize(struct default_engine *engine)
+{
+    return engine->slabs.slabclass[engine->slabs.chunk_clsid].size - sizeof(item_chunk);
+}
+
+static inline item_chunk *do_item_get_chunks(const hash_item *it)
+{
+    item_chunk *chunk;
+    memcpy(&chunk, item_get_data(it), sizeof(item_chunk *)); /* may be unaligned */
+    return chunk;
+}
+
+static void do_item_chunks_free(struct default_engine *engine, item_chunk *chunk)
+{
+    unsigned int clsid = engine->slabs.chunk_clsid;
+    item_chunk *next;
+
+    while (chunk != NULL) {
+        next = chunk->next;
+        slabs_free(engine, chunk, engine->slabs.slabclass[clsid].size, clsid);
+        chunk = next;
+    }
+}
+
+static void *do_item_alloc_internal(struct default_engine *engine,
+                                    const size_t ntotal, const unsigned int clsid,
+                                    const int lfu_freq, const void *cookie);
+
+static item_chunk *do_item_chunks_alloc(struct default_engine *engine,
+                                        const int nchunks, const void *cookie)
+{
+    unsigned int clsid = engine->slabs.chunk_clsid;
+    item_chunk *head = NULL;
+    item_chunk *chunk;
+
+    for (int i = 0; i < nchunks; i++) {
+        chunk = do_item_alloc_internal(engine, engine->slabs.slabclass[clsid].size,
+                                       clsid, -1, cookie);
+        if (chunk == NULL) {
+            do_item_chunks_free(engine, head);
+            return NULL;
+        }
+        chunk->next = head;
+        head = chunk;
+    }
+    return head;
+}
+
 /* warning: don't use these macros with a function, as it evals its arg twice */
 static inline size_t ITEM_ntotal(struct default_engine *engine, const hash_item *item)
 {
     size_t ret;
-    if (IS_COLL_ITEM(item)) {
+    if (item->iflag & ITEM_CHUNKED) {
+        ret = sizeof(*item) + item->nkey + sizeof(item_chunk *)
+            + item->nbytes % do_item_chunk_dsize(engine);
+    } else if (IS_COLL_ITEM(item)) {
         ret = sizeof(*item) + META_OFFSET_IN_ITEM(item->nkey, item->nbytes);
         if (IS_LIST_ITEM(item))     ret += sizeof(list_meta_info);
         else if (IS_SET_ITEM(item)) ret += sizeof(set_meta_info);
@@ -227,6 +533,9 @@ static inline size_t ITEM_stotal(struct default_engine *engine, const hash_item
     if (IS_COLL_ITEM(item)) {
         coll_meta_info *info = (coll_meta_info *)item_get_meta(item);
         stotal += info->stotal;
+    } else if (item->iflag & ITEM_CHUNKED) {
+        stotal += (item->nbytes / do_item_chunk_dsize(engine))
+                * engine->slabs.slabclass[engine->slabs.chunk_clsid].size;
     }
     return stotal;
 }
@@ -260,8 +569,9 @@ static void increase_collection_space(struct default_engine *engine, ENGINE_ITEM
         engine->stats.sticky_bytes += inc_space;
     }
 #endif
-    assoc_prefix_update_size(it->pfxptr, item_type, inc_space, true);
+    assoc_prefix_update_size(ITEM_PREFIX(it), item_type, inc_space, true);
     engine->stats.curr_bytes += inc_space;
+    engine->stats.type_bytes[item_type] += inc_space;
     //pthread_mutex_unlock(&engine->stats.lock);
 }
 
@@ -278,8 +588,9 @@ static void decrease_collection_space(struct default_engine *engine, ENGINE_ITEM
         engine->stats.sticky_bytes -= dec_space;
     }
 #endif
-    assoc_prefix_update_size(it->pfxptr, item_type, dec_space, false);
+    assoc_prefix_update_size(ITEM_PREFIX(it), item_type, dec_space, false);
     engine->stats.curr_bytes -= dec_space;
+    engine->stats.type_bytes[item_type] -= dec_space;
     //pthread_mutex_unlock(&engine->stats.lock);
 }
 
@@ -289,12 +600,12 @@ static void decrease_collection_space(struct default_engine *engine, ENGINE_ITEM
 static void push_coll_del_queue(hash_item *it)
 {
     /* push the item into the tail of delete queue */
-    it->next = NULL;
+    ITEM_SET_NEXT(it, NULL);
     pthread_mutex_lock(&coll_del_lock);
     if (coll_del_queue.tail == NULL) {
         coll_del_queue.head = it;
     } else {
-        coll_del_queue.tail->next = it;
+        ITEM_SET_NEXT(coll_del_queue.tail, it);
     }
     coll_del_queue.tail = it;
     coll_del_queue.size++;
@@ -312,7 +623,7 @@ static hash_item *pop_coll_del_queue(void)
     pthread_mutex_lock(&coll_del_lock);
     if (coll_del_queue.head != NULL) {
         it = coll_del_queue.head;
-        coll_del_queue.head = it->next;
+        coll_del_queue.head = ITEM_NEXT(it);
         if (coll_del_queue.head == NULL) {
             coll_del_queue.tail = NULL;
         }
@@ -358,7 +669,7 @@ static hash_item *do_item_reclaim(struct default_engine *engine, hash_item *it,
     /* it->refcount == 0 */
 #ifdef USE_SINGLE_LRU_LIST
 #else
-    if (lruid != LRU_CLSID_FOR_SMALL) {
+    if (lruid != LRU_CLSID_FOR_SMALL && (it->iflag & ITEM_CHUNKED) == 0) {
         it->refcount = 1;
         slabs_adjust_mem_requested(engine, it->slabs_clsid, ITEM_ntotal(engine,it), ntotal);
         do_item_unlink(engine, it, ITEM_UNLINK_INVALID);
@@ -367,7 +678,7 @@ static hash_item *do_item_reclaim(struct default_engine *engine, hash_item *it,
         it->refcount = 0;
         return it;
     }
-    /* collection item or small-sized kv item */
+    /* collection item, small-sized or chunked kv item */
 #endif
     if (IS_COLL_ITEM(it))
         do_coll_all_elem_delete(engine, it);
@@ -382,14 +693,18 @@ static void do_item_evict(struct default_engine *engine, hash_item *it,
                           const unsigned int lruid,
                           rel_time_t current_time, const void *cookie)
 {
+    size_t stotal = ITEM_stotal(engine, it);
+
     /* increment # of evicted */
     engine->items.itemstats[lruid].evicted++;
     engine->items.itemstats[lruid].evicted_time = current_time - it->time;
+    engine->items.itemstats[lruid].evicted_bytes += stotal;
     if (it->exptime != 0) {
         engine->items.itemstats[lruid].evicted_nonzero++;
     }
     pthread_mutex_lock(&engine->stats.lock);
     engine->stats.evictions++;
+    engine->stats.evicted_bytes += stotal;
     pthread_mutex_unlock(&engine->stats.lock);
     if (cookie != NULL) {
         engine->server.stat->evicting(cookie, item_get_key(it), it->nkey);
@@ -433,9 +748,13 @@ static void do_item_invalidate(struct default_engine *engine, hash_item *it,
     do_item_unlink(engine, it, ITEM_UNLINK_INVALID);
 }
 
+/* lfu_freq is the access frequency of the key of the new item,
+ * which is compared with the frequency of the victims to evict.
+ * -1 if any victim may be evicted.
+ */
 static void *do_item_alloc_internal(struct default_engine *engine,
                                     const size_t ntotal, const unsigned int clsid,
-                                    const void *cookie)
+                                    const int lfu_freq, const void *cookie)
 {
     hash_item *it = NULL;
 
@@ -472,6 +791,13 @@ static void *do_item_alloc_internal(struct default_engine *engine,
 #endif
 
     int space_shortage_level = slabs_space_shortage_level();
+    if (space_shortage_level > 0 && engine->config.lru_maintainer) {
+        /* evicted by the LRU maintainer instead of the request thread */
+        lru_maint_thread_wakeup();
+        if (space_shortage_level < LRU_MAINT_INLINE_SSL) {
+            space_shortage_level = 0;
+        }
+    }
     if (space_shortage_level > 0 && id == LRU_CLSID_FOR_SMALL
         && item_evict_to_free == true)
     {
@@ -479,12 +805,17 @@ static void *do_item_alloc_internal(struct default_engine *engine,
         search = engine->items.tails[id];
         while (search != NULL) {
             assert(search->nkey > 0);
-            previt = search->prev;
+            previt = ITEM_PREV(search);
             if (search->refcount == 0) {
                 if (do_item_isvalid(engine, search, current_time) == false) {
                     do_item_invalidate(engine, search, id, true);
-                } else {
-                    do_item_evict(engine, search, id, current_time, cookie);
+                } else if (do_item_lru_rescue(engine, search, id) == false &&
+                           do_item_lfu_admit(engine, search, id, lfu_freq)) {
+                    hash_item *victim = do_item_evict_victim(engine, search, current_time);
+                    if (victim != search) {
+                        previt = search; /* still linked */
+                    }
+                    do_item_evict(engine, victim, id, current_time, cookie);
                 }
             } else { /* search->refcount > 0 */
                 /* just unlink the item from LRU list. */
@@ -501,7 +832,7 @@ static void *do_item_alloc_internal(struct default_engine *engine,
         tries = 20;
         while (engine->items.sticky_curMK[id] != NULL) {
             search = engine->items.sticky_curMK[id];
-            engine->items.sticky_curMK[id] = search->prev;
+            engine->items.sticky_curMK[id] = ITEM_PREV(search);
             if (search->refcount == 0 &&
                 do_item_isvalid(engine, search, current_time) == false) {
                 it = do_item_reclaim(engine, search, ntotal, clsid_based_on_ntotal, id);
@@ -530,15 +861,15 @@ static void *do_item_alloc_internal(struct default_engine *engine,
         while (search != NULL && search != engine->items.curMK[id]) {
             if (search->refcount == 0 &&
                 do_item_isvalid(engine, search, current_time) == false) {
-                previt = search->prev;
+                previt = ITEM_PREV(search);
                 it = do_item_reclaim(engine, search, ntotal, clsid_based_on_ntotal, id);
                 if (it != NULL) break; /* allocated */
                 search = previt;
             } else {
                 if (search->exptime == 0 && search == engine->items.lowMK[id]) {
-                    engine->items.lowMK[id] = search->prev; /* move lowMK position upward */
+                    engine->items.lowMK[id] = ITEM_PREV(search); /* move lowMK position upward */
                 }
-                search = search->prev;
+                search = ITEM_PREV(search);
             }
             if ((--tries) == 0) break;
         }
@@ -555,7 +886,7 @@ static void *do_item_alloc_internal(struct default_engine *engine,
         tries += 20;
         while (engine->items.curMK[id] != NULL) {
             search = engine->items.curMK[id];
-            engine->items.curMK[id] = search->prev;
+            engine->items.curMK[id] = ITEM_PREV(search);
             if (search->refcount == 0 &&
                 do_item_isvalid(engine, search, current_time) == false) {
                 it = do_item_reclaim(engine, search, ntotal, clsid_based_on_ntotal, id);
@@ -592,6 +923,10 @@ static void *do_item_alloc_internal(struct default_engine *engine,
             engine->items.itemstats[clsid_based_on_ntotal].outofmemory++;
             return NULL;
         }
+        if (engine->config.lru_maintainer) {
+            /* the headroom was used up: evict inline this time */
+            lru_maint_thread_wakeup();
+        }
 
         /*
          * try to get one off the right LRU
@@ -603,12 +938,18 @@ static void *do_item_alloc_internal(struct default_engine *engine,
         search = engine->items.tails[id];
         while (search != NULL) {
             assert(search->nkey > 0);
-            previt = search->prev;
+            previt = ITEM_PREV(search);
             if (search->refcount == 0) {
                 if (do_item_isvalid(engine, search, current_time) == false) {
                     it = do_item_reclaim(engine, search, ntotal, clsid_based_on_ntotal, id);
-                } else {
-                    do_item_evict(engine, search, id, current_time, cookie);
+                } else if (tries <= 100 || /* no more rescue in the later half */
+                           (do_item_lru_rescue(engine, search, id) == false &&
+                            do_item_lfu_admit(engine, search, id, lfu_freq))) {
+                    hash_item *victim = do_item_evict_victim(engine, search, current_time);
+                    if (victim != search) {
+                        previt = search; /* still linked */
+                    }
+                    do_item_evict(engine, victim, id, current_time, cookie);
                     it = slabs_alloc(engine, ntotal, clsid_based_on_ntotal);
                 }
                 if (it != NULL) break; /* allocated */
@@ -637,13 +978,13 @@ static void *do_item_alloc_internal(struct default_engine *engine,
                 assert(search->nkey > 0);
                 if (search->refcount != 0 &&
                     search->time + TAIL_REPAIR_TIME < current_time) {
-                    previt = search->prev;
+                    previt = ITEM_PREV(search);
                     do_item_repair(engine, search, id);
                     it = slabs_alloc(engine, ntotal, clsid_based_on_ntotal);
                     if (it != NULL) break; /* allocated */
                     search = previt;
                 } else {
-                    search = search->prev;
+                    search = ITEM_PREV(search);
                 }
                 if ((--tries) == 0) break;
             }
@@ -656,6 +997,25 @@ static void *do_item_alloc_internal(struct default_engine *engine,
     return (void *)it;
 }
 
+/*
+ * Allocates the memory of a collection element or node, from the magazine
+ * of the thread if possible. Otherwise, the slab allocator is used under
+ * the cache lock, which is taken here unless the caller holds it.
+ */
+static void *do_coll_mem_alloc(struct default_engine *engine, const size_t ntotal,
+                               const void *cookie, const bool locked)
+{
+    hash_item *it = slabs_tcache_alloc(engine, ntotal);
+    if (it != NULL) {
+        it->slabs_clsid = 0;
+        return (void *)it;
+    }
+    if (!locked) LOCK_CACHE();
+    it = do_item_alloc_internal(engine, ntotal, LRU_CLSID_FOR_SMALL, -1, cookie);
+    if (!locked) UNLOCK_CACHE();
+    return (void *)it;
+}
+
 /*@null@*/
 static hash_item *do_item_alloc(struct default_engine *engine,
                                 const void *key, const size_t nkey,
@@ -681,8 +1041,35 @@ static hash_item *do_item_alloc(struct default_engine *engine,
     }
 #endif
 
-    it = do_item_alloc_internal(engine, ntotal, id, cookie);
+    item_chunk *chunks = NULL;
+    if (engine->slabs.chunk_clsid != 0 && ntotal > MAX_SM_VALUE_LEN &&
+        nbytes >= do_item_chunk_dsize(engine)) {
+        /* the header keeps the tail of the value */
+        size_t dsize = do_item_chunk_dsize(engine);
+        chunks = do_item_chunks_alloc(engine, nbytes / dsize, cookie);
+        if (chunks == NULL) {
+            return NULL;
+        }
+        ntotal = ntotal - nbytes + sizeof(item_chunk *) + nbytes % dsize;
+        id = slabs_clsid(engine, ntotal);
+    }
+    if (engine->config.slab_sizes_sample > 0 && ntotal > MAX_SM_VALUE_LEN) {
+        slabs_sample_size(engine, ntotal);
+    }
+
+    int lfu_freq = -1;
+    if (engine->items.lfu_sketch != NULL && key != NULL) {
+        int freq = do_item_lfu_access(engine, item_key_hash(engine, key, nkey));
+        if (engine->config.lfu_admission) {
+            lfu_freq = freq;
+        }
+    }
+
+    it = do_item_alloc_internal(engine, ntotal, id, lfu_freq, cookie);
     if (it == NULL)  {
+        if (chunks != NULL) {
+            do_item_chunks_free(engine, chunks);
+        }
         return NULL;
     }
     assert(it->slabs_clsid == 0);
@@ -691,20 +1078,27 @@ static hash_item *do_item_alloc(struct default_engine *engine,
     assert(it->slabs_clsid > 0);
     assert(it != engine->items.heads[it->slabs_clsid]);
 
-    it->next = it->prev = it; /* special meaning: unlinked from LRU */
+    ITEM_SET_NEXT(it, it); ITEM_SET_PREV(it, it); /* special meaning: unlinked from LRU */
+#ifndef ENABLE_BUCKET_ASSOC
     it->h_next = 0;
+#endif
     it->refcount = 1;     /* the caller will have a reference */
     it->refchunk = 0;
     DEBUG_REFCNT(it, '*');
     it->iflag = engine->config.use_cas ? ITEM_WITH_CAS : 0;
+    it->lruflag = 0;
     it->nkey = nkey;
     it->nbytes = nbytes;
     it->flags = flags;
     if (key != NULL) {
         memcpy((void*)item_get_key(it), key, nkey);
     }
+    if (chunks != NULL) {
+        it->iflag |= ITEM_CHUNKED;
+        memcpy(item_get_data(it), &chunks, sizeof(item_chunk *));
+    }
     it->exptime = exptime;
-    it->pfxptr = NULL;
+    ITEM_SET_PREFIX(it, NULL);
     return it;
 }
 
@@ -725,6 +1119,10 @@ static void do_item_free(struct default_engine *engine, hash_item *it)
         }
     }
 
+    if (it->iflag & ITEM_CHUNKED) {
+        do_item_chunks_free(engine, do_item_get_chunks(it));
+    }
+
     /* so slab size changer can tell later if item is already free or not */
     clsid = it->slabs_clsid;
     it->slabs_clsid = 0;
@@ -732,16 +1130,246 @@ static void do_item_free(struct default_engine *engine, hash_item *it)
     slabs_free(engine, it, ntotal, clsid);
 }
 
+/*
+ * Segmented LRU
+ *
+ * If lru_segmented is enabled, an LRU list is divided into the hot, warm
+ * and cold segments in the order from the head. New items are linked to
+ * the head of the hot segment, and a hit marks the item active instead
+ * of moving it to the head. The items move down to the next segment by
+ * age as the segments above exceed their share of the list. Since the
+ * segments are adjacent, it changes only the segment boundaries.
+ * An active item is given another round from the head when it leaves
+ * the warm segment or is found at the tail of the cold segment.
+ * So, a scan of cold items can't flush the hot set out of the cache.
+ */
+#define LRU_HOT_PERCENT  20
+#define LRU_WARM_PERCENT 40
+#define LRU_SEG_MOVES    5  /* max moves of a segment boundary at a time */
+
+static int  do_item_link_q(struct default_engine *engine, hash_item *it);
+
+/* moves the tail item of a segment to the head of the next segment */
+static void do_item_lru_demote(struct default_engine *engine, int lruid, int seg)
+{
+    hash_item *it = engine->items.seg_tails[seg][lruid];
+    hash_item *prev = ITEM_PREV(it);
+
+    engine->items.seg_tails[seg][lruid] =
+        (prev != NULL && (prev->lruflag & ITEM_LRU_SEG) == seg) ? prev : NULL;
+    engine->items.seg_sizes[seg][lruid]--;
+    it->lruflag = (it->lruflag & ~ITEM_LRU_SEG) | (seg + 1);
+    engine->items.seg_sizes[seg + 1][lruid]++;
+    engine->items.seg_moves[seg + 1][lruid]++;
+    if (engine->items.seg_tails[seg + 1][lruid] == NULL) {
+        engine->items.seg_tails[seg + 1][lruid] = it;
+    }
+}
+
+static void do_item_lru_balance(struct default_engine *engine, int lruid)
+{
+    unsigned int hot_limit = engine->items.sizes[lruid] * LRU_HOT_PERCENT / 100;
+    unsigned int warm_limit = engine->items.sizes[lruid] * LRU_WARM_PERCENT / 100;
+    hash_item *it;
+    int tries;
+
+    for (tries = LRU_SEG_MOVES; tries > 0; tries--) {
+        if (engine->items.seg_sizes[LRU_SEG_HOT][lruid] <= hot_limit) break;
+        do_item_lru_demote(engine, lruid, LRU_SEG_HOT);
+    }
+    for (tries = LRU_SEG_MOVES; tries > 0; tries--) {
+        if (engine->items.seg_sizes[LRU_SEG_WARM][lruid] <= warm_limit) break;
+        it = engine->items.seg_tails[LRU_SEG_WARM][lruid];
+        if ((it->lruflag & ITEM_LRU_ACTIVE) != 0) {
+            item_unlink_q(engine, it);
+            do_item_link_q(engine, it);
+            engine->items.seg_moves[LRU_SEG_HOT][lruid]++;
+        } else {
+            do_item_lru_demote(engine, lruid, LRU_SEG_WARM);
+        }
+    }
+}
+
+/* returns true if the active item is moved to the head instead of evicted */
+static bool do_item_lru_rescue(struct default_engine *engine, hash_item *it, int lruid)
+{
+    if (engine->config.lru_segmented == false ||
+        (it->lruflag & ITEM_LRU_ACTIVE) == 0) {
+        return false;
+    }
+    item_unlink_q(engine, it);
+    item_link_q(engine, it);
+    engine->items.seg_moves[LRU_SEG_HOT][lruid]++;
+    return true;
+}
+
+/*
+ * LFU admission
+ *
+ * If lfu_admission or GDSF eviction is enabled, the key accesses are
+ * counted in a count-min sketch of small saturating counters, and all
+ * the counters are halved after every LFU_SAMPLE_FACTOR accesses per
+ * counter so that the past popularity fades out. With lfu_admission,
+ * a new item may evict an LRU tail item
+ * only if its key is accessed at least as often as the key of the victim.
+ * Otherwise, the victim is moved to the head and the next one is tried.
+ * So, the one-hit-wonder keys of a scan evict each other, not the hot keys.
+ * The lock-free readers count with CAS increments saturating at
+ * LFU_COUNTER_MAX, and the counters are halved only with the exclusive
+ * cache lock.
+ */
+#define LFU_SKETCH_DEPTH  4
+#define LFU_COUNTER_MAX   15
+#define LFU_SAMPLE_FACTOR 10
+#define LFU_WIDTH_MIN     (1 << 12)
+#define LFU_WIDTH_MAX     (1 << 22)
+
+static inline uint8_t *do_item_lfu_counter(struct default_engine *engine,
+                                           uint32_t hash, int row)
+{
+    uint32_t hash2 = ((hash >> 16) | (hash << 16)) | 1;
+    uint32_t index = (hash + row * hash2) & (engine->items.lfu_width - 1);
+    return &engine->items.lfu_sketch[row * engine->items.lfu_width + index];
+}
+
+static inline void do_item_lfu_record(struct default_engine *engine, uint32_t hash)
+{
+    for (int row = 0; row < LFU_SKETCH_DEPTH; row++) {
+        uint8_t *counter = do_item_lfu_counter(engine, hash, row);
+        uint8_t count = *counter;
+        /* a CAS loop, so that concurrent increments stop at the max */
+        while (count < LFU_COUNTER_MAX) {
+            uint8_t prev = __sync_val_compare_and_swap(counter, count, count + 1);
+            if (prev == count) {
+                break;
+            }
+            count = prev;
+        }
+    }
+    __sync_fetch_and_add(&engine->items.lfu_additions, 1);
+}
+
+static int do_item_lfu_frequency(struct default_engine *engine, uint32_t hash)
+{
+    int freq = LFU_COUNTER_MAX;
+    for (int row = 0; row < LFU_SKETCH_DEPTH; row++) {
+        uint8_t count = *do_item_lfu_counter(engine, hash, row);
+        if (count < freq) {
+            freq = count;
+        }
+    }
+    return freq;
+}
+
+static void do_item_lfu_age(struct default_engine *engine)
+{
+    uint64_t *words = (uint64_t *)engine->items.lfu_sketch;
+    size_t nwords = (size_t)engine->items.lfu_width * LFU_SKETCH_DEPTH / sizeof(uint64_t);
+    for (size_t i = 0; i < nwords; i++) {
+        words[i] = (words[i] >> 1) & 0x7F7F7F7F7F7F7F7FULL;
+    }
+    engine->items.lfu_additions = 0;
+}
+
+/* counts an access of the key and returns its frequency, -1 if disabled */
+static int do_item_lfu_access(struct default_engine *engine, uint32_t hash)
+{
+    if (engine->items.lfu_sketch == NULL) {
+        return -1;
+    }
+    do_item_lfu_record(engine, hash);
+    if (engine->items.lfu_additions >= LFU_SAMPLE_FACTOR * engine->items.lfu_width) {
+        do_item_lfu_age(engine);
+    }
+    return do_item_lfu_frequency(engine, hash);
+}
+
+/* returns true if the new item of the given frequency may evict the victim */
+static bool do_item_lfu_admit(struct default_engine *engine, hash_item *victim,
+                              int lruid, int freq)
+{
+    if (freq < 0 || do_item_lfu_frequency(engine, victim->khash) <= freq) {
+        return true;
+    }
+    item_unlink_q(engine, victim);
+    item_link_q(engine, victim);
+    engine->items.itemstats[lruid].lfu_kept++;
+    return false;
+}
+
+/*
+ * GDSF eviction
+ *
+ * If eviction_policy is "gdsf", the victim is chosen among the
+ * GDSF_SAMPLES least recently used items instead of taking the tail item.
+ * The victim has the least hit value per byte, that is, the access
+ * frequency times the rebuild cost divided by the space of the item
+ * including its collection elements. The rebuild cost of a collection
+ * grows with its elements. Since the samples are the oldest items,
+ * the LRU order stands for the aging of the GDSF priority.
+ * So, a large collection read rarely is evicted before many small items.
+ */
+#define GDSF_SAMPLES    8   /* # of tail items compared to choose a victim */
+#define GDSF_COST_ELEMS 64  /* # of collection elements of a unit rebuild cost */
+
+/* the hit value per byte that is lost by evicting the item */
+static double do_item_gdsf_value(struct default_engine *engine, hash_item *it)
+{
+    double cost = 1.0;
+    if (IS_COLL_ITEM(it)) {
+        coll_meta_info *info = (coll_meta_info *)item_get_meta(it);
+        cost += (double)info->ccnt / GDSF_COST_ELEMS;
+    }
+    int freq = do_item_lfu_frequency(engine, it->khash);
+    return (freq + 1) * cost / ITEM_stotal(engine, it);
+}
+
+/* returns the item to evict instead of the search item at the tail side */
+static hash_item *do_item_evict_victim(struct default_engine *engine, hash_item *search,
+                                       rel_time_t current_time)
+{
+    if (engine->items.evict_policy != EVICT_POLICY_GDSF) {
+        return search;
+    }
+    hash_item *victim = search;
+    double victim_value = do_item_gdsf_value(engine, search);
+    hash_item *it = ITEM_PREV(search);
+    for (int i = 1; i < GDSF_SAMPLES && it != NULL; i++, it = ITEM_PREV(it)) {
+        if (it->refcount != 0 || (it->lruflag & ITEM_LRU_ACTIVE) != 0 ||
+            do_item_isvalid(engine, it, current_time) == false) {
+            continue;
+        }
+        double value = do_item_gdsf_value(engine, it);
+        if (value < victim_value) {
+            victim = it;
+            victim_value = value;
+        }
+    }
+    return victim;
+}
+
 static void item_link_q(struct default_engine *engine, hash_item *it)
+{
+    int lruid = do_item_link_q(engine, it);
+    if (lruid >= 0 && engine->config.lru_segmented) {
+        do_item_lru_balance(engine, lruid);
+    }
+}
+
+/* returns the LRU id of the linked item, -1 if it's a sticky item */
+static int do_item_link_q(struct default_engine *engine, hash_item *it)
 {
     hash_item **head, **tail;
+    int lruid = -1;
     assert(it->slabs_clsid <= POWER_LARGEST);
 
 #ifdef USE_SINGLE_LRU_LIST
     int clsid = 1;
 #else
     int clsid = it->slabs_clsid;
-    if (IS_COLL_ITEM(it) || ITEM_ntotal(engine, it) <= MAX_SM_VALUE_LEN) {
+    if (it->iflag & ITEM_CHUNKED) {
+        clsid = engine->slabs.chunk_clsid;
+    } else if (IS_COLL_ITEM(it) || ITEM_ntotal(engine, it) <= MAX_SM_VALUE_LEN) {
         clsid = LRU_CLSID_FOR_SMALL;
     }
 #endif
@@ -763,17 +1391,26 @@ static void item_link_q(struct default_engine *engine, hash_item *it)
                 engine->items.curMK[clsid] = it;
             }
         }
+        if (engine->config.lru_segmented) {
+            /* link to the head of the hot segment */
+            it->lruflag = LRU_SEG_HOT;
+            engine->items.seg_sizes[LRU_SEG_HOT][clsid]++;
+            if (engine->items.seg_tails[LRU_SEG_HOT][clsid] == NULL) {
+                engine->items.seg_tails[LRU_SEG_HOT][clsid] = it;
+            }
+        }
+        lruid = clsid;
 #ifdef ENABLE_STICKY_ITEM
     }
 #endif
     assert(it != *head);
     assert((*head && *tail) || (*head == 0 && *tail == 0));
-    it->prev = 0;
-    it->next = *head;
-    if (it->next) it->next->prev = it;
+    ITEM_SET_PREV(it, NULL);
+    ITEM_SET_NEXT(it, *head);
+    if (*head) ITEM_SET_PREV(*head, it);
     *head = it;
     if (*tail == 0) *tail = it;
-    return;
+    return lruid;
 }
 
 static void item_unlink_q(struct default_engine *engine, hash_item *it)
@@ -784,12 +1421,14 @@ static void item_unlink_q(struct default_engine *engine, hash_item *it)
     int clsid = 1;
 #else
     int clsid = it->slabs_clsid;
-    if (IS_COLL_ITEM(it) || ITEM_ntotal(engine, it) <= MAX_SM_VALUE_LEN) {
+    if (it->iflag & ITEM_CHUNKED) {
+        clsid = engine->slabs.chunk_clsid;
+    } else if (IS_COLL_ITEM(it) || ITEM_ntotal(engine, it) <= MAX_SM_VALUE_LEN) {
         clsid = LRU_CLSID_FOR_SMALL;
     }
 #endif
 
-    if (it->prev == it && it->next == it) { /* special meaning: unlinked from LRU */
+    if (ITEM_PREV(it) == it && ITEM_NEXT(it) == it) { /* special meaning: unlinked from LRU */
         return; /* Already unlinked from LRU list */
     }
 
@@ -800,7 +1439,7 @@ static void item_unlink_q(struct default_engine *engine, hash_item *it)
         engine->items.sticky_sizes[clsid]--;
         /* move curMK pointer in LRU */
         if (engine->items.sticky_curMK[clsid] == it)
-            engine->items.sticky_curMK[clsid] = it->prev;
+            engine->items.sticky_curMK[clsid] = ITEM_PREV(it);
     } else {
 #endif
         head = &engine->items.heads[clsid];
@@ -808,29 +1447,38 @@ static void item_unlink_q(struct default_engine *engine, hash_item *it)
         engine->items.sizes[clsid]--;
         /* move lowMK, curMK pointer in LRU */
         if (engine->items.lowMK[clsid] == it)
-            engine->items.lowMK[clsid] = it->prev;
+            engine->items.lowMK[clsid] = ITEM_PREV(it);
         if (engine->items.curMK[clsid] == it) {
-            engine->items.curMK[clsid] = it->prev;
+            engine->items.curMK[clsid] = ITEM_PREV(it);
             if (engine->items.curMK[clsid] == NULL)
                 engine->items.curMK[clsid] = engine->items.lowMK[clsid];
         }
+        if (engine->config.lru_segmented) {
+            int seg = it->lruflag & ITEM_LRU_SEG;
+            engine->items.seg_sizes[seg][clsid]--;
+            if (engine->items.seg_tails[seg][clsid] == it) {
+                hash_item *prev = ITEM_PREV(it);
+                engine->items.seg_tails[seg][clsid] =
+                    (prev != NULL && (prev->lruflag & ITEM_LRU_SEG) == seg) ? prev : NULL;
+            }
+        }
 #ifdef ENABLE_STICKY_ITEM
     }
 #endif
     if (*head == it) {
-        assert(it->prev == 0);
-        *head = it->next;
+        assert(ITEM_PREV(it) == 0);
+        *head = ITEM_NEXT(it);
     }
     if (*tail == it) {
-        assert(it->next == 0);
-        *tail = it->prev;
+        assert(ITEM_NEXT(it) == 0);
+        *tail = ITEM_PREV(it);
     }
-    assert(it->next != it);
-    assert(it->prev != it);
+    assert(ITEM_NEXT(it) != it);
+    assert(ITEM_PREV(it) != it);
 
-    if (it->next) it->next->prev = it->prev;
-    if (it->prev) it->prev->next = it->next;
-    it->prev = it->next = it; /* special meaning: unlinked from LRU */
+    if (ITEM_NEXT(it)) ITEM_SET_PREV(ITEM_NEXT(it), ITEM_PREV(it));
+    if (ITEM_PREV(it)) ITEM_SET_NEXT(ITEM_PREV(it), ITEM_NEXT(it));
+    ITEM_SET_NEXT(it, it); ITEM_SET_PREV(it, it); /* special meaning: unlinked from LRU */
     return;
 }
 
@@ -854,7 +1502,7 @@ static ENGINE_ERROR_CODE do_item_link(struct default_engine *engine, hash_item *
     if (ret != ENGINE_SUCCESS) {
         return ret;
     }
-    if (it->pfxptr->internal) {
+    if (ITEM_PREFIX(it)->internal) {
         /* It's an internal cache item whose prefix name is "arcus". */
         it->iflag |= ITEM_INTERNAL;
     }
@@ -863,11 +1511,21 @@ static ENGINE_ERROR_CODE do_item_link(struct default_engine *engine, hash_item *
     it->iflag |= ITEM_LINKED;
     it->time = engine->server.core->get_current_time();
     it->khash = engine->server.core->hash(hkey, hnkey, 0);
-    assoc_insert(engine, it->khash, it);
+    if (assoc_insert(engine, it->khash, it) == 0) {
+        /* no memory for an overflow bucket of the hash index */
+        it->iflag &= ~ITEM_LINKED;
+        assoc_prefix_unlink(engine, it, stotal, true);
+        return ENGINE_ENOMEM;
+    }
 
     /* link the item to LRU list */
     item_link_q(engine, it);
 
+    /* link the item to the expiry timing wheel */
+    if (engine->items.expiry_wheel != NULL) {
+        do_item_expiry_add(engine, it);
+    }
+
     /* update item statistics */
     pthread_mutex_lock(&engine->stats.lock);
 #ifdef ENABLE_STICKY_ITEM
@@ -879,6 +1537,11 @@ static ENGINE_ERROR_CODE do_item_link(struct default_engine *engine, hash_item *
     engine->stats.curr_bytes += stotal;
     engine->stats.curr_items += 1;
     engine->stats.total_items += 1;
+    engine->stats.type_items[GET_ITEM_TYPE(it)] += 1;
+    engine->stats.type_bytes[GET_ITEM_TYPE(it)] += stotal;
+    if (IS_COLL_ITEM(it)) {
+        engine->stats.coll_meta_bytes += slabs_space_size(engine, ITEM_ntotal(engine, it));
+    }
     pthread_mutex_unlock(&engine->stats.lock);
 
     return ENGINE_SUCCESS;
@@ -901,6 +1564,11 @@ static void do_item_unlink(struct default_engine *engine, hash_item *it,
         assoc_delete(engine, it->khash, key, it->nkey);
         it->iflag &= ~ITEM_LINKED;
 
+        /* unlink the item from the expiry timing wheel */
+        if (engine->items.expiry_wheel != NULL) {
+            do_item_expiry_remove(engine, it);
+        }
+
         /* unlink the item from prefix info */
         stotal = ITEM_stotal(engine, it);
         assoc_prefix_unlink(engine, it, stotal, (cause != ITEM_UNLINK_REPLACE ? true : false));
@@ -919,6 +1587,11 @@ static void do_item_unlink(struct default_engine *engine, hash_item *it,
 #endif
         engine->stats.curr_bytes -= stotal;
         engine->stats.curr_items -= 1;
+        engine->stats.type_items[GET_ITEM_TYPE(it)] -= 1;
+        engine->stats.type_bytes[GET_ITEM_TYPE(it)] -= stotal;
+        if (IS_COLL_ITEM(it)) {
+            engine->stats.coll_meta_bytes -= slabs_space_size(engine, ITEM_ntotal(engine, it));
+        }
         pthread_mutex_unlock(&engine->stats.lock);
 
         /* free the item if no one reference it */
@@ -939,7 +1612,7 @@ static void do_item_release(struct default_engine *engine, hash_item *it)
         if ((it->iflag & ITEM_LINKED) == 0) {
             do_item_free(engine, it);
         }
-        else if (it->prev == it && it->next == it) {
+        else if (ITEM_PREV(it) == it && ITEM_NEXT(it) == it) {
             /* re-link the item into the LRU list */
             rel_time_t current_time = engine->server.core->get_current_time();
             if (do_item_isvalid(engine, it, current_time)) {
@@ -956,6 +1629,16 @@ static void do_item_update(struct default_engine *engine, hash_item *it)
 {
     rel_time_t current_time = engine->server.core->get_current_time();
     MEMCACHED_ITEM_UPDATE(item_get_key(it), it->nkey, it->nbytes);
+    if (engine->config.lru_segmented && it->exptime != (rel_time_t)(-1)) {
+        /* mark the item active instead of moving it to the head */
+        if ((it->iflag & ITEM_LINKED) != 0) {
+            it->lruflag |= ITEM_LRU_ACTIVE;
+            if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
+                it->time = current_time;
+            }
+        }
+        return;
+    }
     if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
         if ((it->iflag & ITEM_LINKED) != 0) {
             item_unlink_q(engine, it);
@@ -1026,7 +1709,7 @@ static char *do_item_cachedump(struct default_engine *engine, const unsigned int
                       keybuf, it->time, (int32_t)it->exptime);
         bufcurr += len;
         shown++;
-        it = (forward ? it->next : it->prev);
+        it = (forward ? ITEM_NEXT(it) : ITEM_PREV(it));
     }
     free(keybuf);
 
@@ -1061,12 +1744,32 @@ static void do_item_stats(struct default_engine *engine, ADD_STAT add_stats, con
                        "%u", engine->items.itemstats[i].evicted_nonzero);
         add_statistics(c, add_stats, prefix, i, "evicted_time",
                        "%u", engine->items.itemstats[i].evicted_time);
+        add_statistics(c, add_stats, prefix, i, "evicted_bytes",
+                       "%"PRIu64, engine->items.itemstats[i].evicted_bytes);
         add_statistics(c, add_stats, prefix, i, "outofmemory",
                        "%u", engine->items.itemstats[i].outofmemory);
         add_statistics(c, add_stats, prefix, i, "tailrepairs",
                        "%u", engine->items.itemstats[i].tailrepairs);;
         add_statistics(c, add_stats, prefix, i, "reclaimed",
                        "%u", engine->items.itemstats[i].reclaimed);;
+        if (engine->config.lru_segmented) {
+            add_statistics(c, add_stats, prefix, i, "hot_items", "%u",
+                           engine->items.seg_sizes[LRU_SEG_HOT][i]);
+            add_statistics(c, add_stats, prefix, i, "warm_items", "%u",
+                           engine->items.seg_sizes[LRU_SEG_WARM][i]);
+            add_statistics(c, add_stats, prefix, i, "cold_items", "%u",
+                           engine->items.seg_sizes[LRU_SEG_COLD][i]);
+            add_statistics(c, add_stats, prefix, i, "moves_to_hot", "%"PRIu64,
+                           engine->items.seg_moves[LRU_SEG_HOT][i]);
+            add_statistics(c, add_stats, prefix, i, "moves_to_warm", "%"PRIu64,
+                           engine->items.seg_moves[LRU_SEG_WARM][i]);
+            add_statistics(c, add_stats, prefix, i, "moves_to_cold", "%"PRIu64,
+                           engine->items.seg_moves[LRU_SEG_COLD][i]);
+        }
+        if (engine->config.lfu_admission) {
+            add_statistics(c, add_stats, prefix, i, "lfu_kept",
+                           "%u", engine->items.itemstats[i].lfu_kept);
+        }
     }
 }
 
@@ -1097,7 +1800,7 @@ static void do_item_stats_sizes(struct default_engine *engine, ADD_STAT add_stat
                 int bucket = ntotal / 32;
                 if ((ntotal % 32) != 0) bucket++;
                 if (bucket < num_buckets) histogram[bucket]++;
-                iter = iter->next;
+                iter = ITEM_NEXT(iter);
             }
 #ifdef ENABLE_STICKY_ITEM
             iter = engine->items.sticky_heads[i];
@@ -1106,7 +1809,7 @@ static void do_item_stats_sizes(struct default_engine *engine, ADD_STAT add_stat
                 int bucket = ntotal / 32;
                 if ((ntotal % 32) != 0) bucket++;
                 if (bucket < num_buckets) histogram[bucket]++;
-                iter = iter->next;
+                iter = ITEM_NEXT(iter);
             }
 #endif
         }
@@ -1128,14 +1831,20 @@ static void do_item_stats_sizes(struct default_engine *engine, ADD_STAT add_stat
 #endif
 }
 
-/** wrapper around assoc_find which does the lazy expiration logic */
-static hash_item *do_item_get(struct default_engine *engine,
-                              const char *key, const size_t nkey, bool do_update)
+static inline uint32_t item_key_hash(struct default_engine *engine,
+                                     const char *key, const size_t nkey)
 {
-    rel_time_t current_time = engine->server.core->get_current_time();
     const char *hkey = (nkey > MAX_HKEY_LEN) ? key+(nkey-MAX_HKEY_LEN) : key;
     const size_t hnkey = (nkey > MAX_HKEY_LEN) ? MAX_HKEY_LEN : nkey;
-    hash_item *it = assoc_find(engine, engine->server.core->hash(hkey, hnkey, 0), key, nkey);
+    return engine->server.core->hash(hkey, hnkey, 0);
+}
+
+/** wrapper around assoc_find which does the lazy expiration logic */
+static hash_item *do_item_get_hashed(struct default_engine *engine, uint32_t hash,
+                                     const char *key, const size_t nkey, bool do_update)
+{
+    rel_time_t current_time = engine->server.core->get_current_time();
+    hash_item *it = assoc_find(engine, hash, key, nkey);
 
     if (it != NULL) {
         if (do_item_isvalid(engine, it, current_time)==false) {
@@ -1149,6 +1858,9 @@ static hash_item *do_item_get(struct default_engine *engine,
         if (do_update)
             do_item_update(engine, it);
     }
+    if (do_update) {
+        do_item_lfu_access(engine, hash);
+    }
 
     if (engine->config.verbose > 2) {
         if (it == NULL) {
@@ -1162,12 +1874,49 @@ static hash_item *do_item_get(struct default_engine *engine,
     return it;
 }
 
-/*
- * Stores an item in the cache according to the semantics of one of the set
- * commands. In threaded mode, this is protected by the cache lock.
- *
- * Returns the state of storage.
- */
+static hash_item *do_item_get(struct default_engine *engine,
+                              const char *key, const size_t nkey, bool do_update)
+{
+    return do_item_get_hashed(engine, item_key_hash(engine, key, nkey), key, nkey, do_update);
+}
+
+/* copies the value of src into the value of dst at the given offset */
+static void do_item_value_copy(struct default_engine *engine, hash_item *dst,
+                               size_t offset, const hash_item *src)
+{
+    struct iovec dvec[ITEM_INFO_MAX_IOVS];
+    struct iovec svec[ITEM_INFO_MAX_IOVS];
+    int dcnt = item_get_value_iovs(engine, dst, dvec, ITEM_INFO_MAX_IOVS);
+    int scnt = item_get_value_iovs(engine, src, svec, ITEM_INFO_MAX_IOVS);
+    int d = 0, s = 0;
+    size_t soff = 0, n;
+
+    while (d < dcnt && offset >= dvec[d].iov_len) {
+        offset -= dvec[d++].iov_len;
+    }
+    while (d < dcnt && s < scnt) {
+        n = dvec[d].iov_len - offset;
+        if (n > svec[s].iov_len - soff) {
+            n = svec[s].iov_len - soff;
+        }
+        memcpy((char*)dvec[d].iov_base + offset, (char*)svec[s].iov_base + soff, n);
+        offset += n;
+        soff += n;
+        if (offset == dvec[d].iov_len) {
+            d++; offset = 0;
+        }
+        if (soff == svec[s].iov_len) {
+            s++; soff = 0;
+        }
+    }
+}
+
+/*
+ * Stores an item in the cache according to the semantics of one of the set
+ * commands. In threaded mode, this is protected by the cache lock.
+ *
+ * Returns the state of storage.
+ */
 static ENGINE_ERROR_CODE do_store_item(struct default_engine *engine, hash_item *it, uint64_t *cas,
                                        ENGINE_STORE_OPERATION operation, const void *cookie)
 {
@@ -1258,12 +2007,12 @@ static ENGINE_ERROR_CODE do_store_item(struct default_engine *engine, hash_item
                 /* copy data from it and old_it to new_it */
 
                 if (operation == OPERATION_APPEND) {
-                    memcpy(item_get_data(new_it), item_get_data(old_it), old_it->nbytes);
-                    memcpy(item_get_data(new_it) + old_it->nbytes - 2 /* CRLF */, item_get_data(it), it->nbytes);
+                    do_item_value_copy(engine, new_it, 0, old_it);
+                    do_item_value_copy(engine, new_it, old_it->nbytes - 2 /* CRLF */, it);
                 } else {
                     /* OPERATION_PREPEND */
-                    memcpy(item_get_data(new_it), item_get_data(it), it->nbytes);
-                    memcpy(item_get_data(new_it) + it->nbytes - 2 /* CRLF */, item_get_data(old_it), old_it->nbytes);
+                    do_item_value_copy(engine, new_it, 0, it);
+                    do_item_value_copy(engine, new_it, it->nbytes - 2 /* CRLF */, old_it);
                 }
 
                 it = new_it;
@@ -1317,6 +2066,9 @@ static ENGINE_ERROR_CODE do_add_delta(struct default_engine *engine, hash_item *
     if (IS_COLL_ITEM(it)) {
         return ENGINE_EBADTYPE;
     }
+    if (it->iflag & ITEM_CHUNKED) {
+        return ENGINE_EINVAL; /* too long to be a number */
+    }
 
     ptr = item_get_data(it);
 
@@ -1359,6 +2111,9 @@ static void do_mem_slot_free(struct default_engine *engine, void *data, size_t n
     hash_item *it = (hash_item *)data;
     unsigned int clsid = it->slabs_clsid;;
     it->slabs_clsid = 0;
+    if (slabs_tcache_free(engine, it, ntotal)) {
+        return; /* kept in the magazine of the thread */
+    }
     slabs_free(engine, it, ntotal, clsid);
 }
 
@@ -1467,11 +2222,12 @@ static hash_item *do_list_item_alloc(struct default_engine *engine,
 }
 
 static list_elem_item *do_list_elem_alloc(struct default_engine *engine,
-                                          const int nbytes, const void *cookie)
+                                          const int nbytes, const void *cookie,
+                                          const bool locked)
 {
     size_t ntotal = sizeof(list_elem_item) + nbytes;
 
-    list_elem_item *elem = do_item_alloc_internal(engine, ntotal, LRU_CLSID_FOR_SMALL, cookie);
+    list_elem_item *elem = do_coll_mem_alloc(engine, ntotal, cookie, locked);
     if (elem != NULL) {
         assert(elem->slabs_clsid == 0);
         elem->slabs_clsid = slabs_clsid(engine, ntotal);
@@ -1494,7 +2250,7 @@ static void do_list_elem_free(struct default_engine *engine, list_elem_item *ele
 static void do_list_elem_release(struct default_engine *engine, list_elem_item *elem)
 {
     if (elem->refcount != 0) {
-        elem->refcount--;
+        ELEM_REFCOUNT_DECR(elem);
     }
     if (elem->refcount == 0 && elem->next == (list_elem_item *)ADDR_MEANS_UNLINKED) {
         do_list_elem_free(engine, elem);
@@ -1612,7 +2368,7 @@ static ENGINE_ERROR_CODE do_list_elem_get(struct default_engine *engine,
     elem = do_list_elem_find(info, index);
     while (elem != NULL) {
         tobe = (forward ? elem->next : elem->prev);
-        elem->refcount++;
+        ELEM_REFCOUNT_INCR(elem);
         elem_array[fcnt++] = elem;
         if (delete) do_list_elem_unlink(engine, info, elem, cause);
         if (count > 0 && fcnt >= count) break;
@@ -1764,7 +2520,7 @@ static set_hash_node *do_set_node_alloc(struct default_engine *engine,
 {
     size_t ntotal = sizeof(set_hash_node);
 
-    set_hash_node *node = do_item_alloc_internal(engine, ntotal, LRU_CLSID_FOR_SMALL, cookie);
+    set_hash_node *node = do_coll_mem_alloc(engine, ntotal, cookie, true);
     if (node != NULL) {
         assert(node->slabs_clsid == 0);
         node->slabs_clsid = slabs_clsid(engine, ntotal);
@@ -1773,6 +2529,7 @@ static set_hash_node *do_set_node_alloc(struct default_engine *engine,
         node->hdepth      = hash_depth;
         node->tot_hash_cnt = 0;
         node->tot_elem_cnt = 0;
+        engine->stats.coll_node_bytes[ITEM_TYPE_SET] += slabs_space_size(engine, ntotal);
         memset(node->hcnt, 0, SET_HASHTAB_SIZE*sizeof(uint16_t));
         memset(node->htab, 0, SET_HASHTAB_SIZE*sizeof(void*));
     }
@@ -1781,15 +2538,17 @@ static set_hash_node *do_set_node_alloc(struct default_engine *engine,
 
 static void do_set_node_free(struct default_engine *engine, set_hash_node *node)
 {
+    engine->stats.coll_node_bytes[ITEM_TYPE_SET] -= slabs_space_size(engine, sizeof(set_hash_node));
     do_mem_slot_free(engine, node, sizeof(set_hash_node));
 }
 
 static set_elem_item *do_set_elem_alloc(struct default_engine *engine,
-                                        const int nbytes, const void *cookie)
+                                        const int nbytes, const void *cookie,
+                                        const bool locked)
 {
     size_t ntotal = sizeof(set_elem_item) + nbytes;
 
-    set_elem_item *elem = do_item_alloc_internal(engine, ntotal, LRU_CLSID_FOR_SMALL, cookie);
+    set_elem_item *elem = do_coll_mem_alloc(engine, ntotal, cookie, locked);
     if (elem != NULL) {
         assert(elem->slabs_clsid == 0);
         elem->slabs_clsid = slabs_clsid(engine, ntotal);
@@ -1812,7 +2571,7 @@ static void do_set_elem_free(struct default_engine *engine, set_elem_item *elem)
 static void do_set_elem_release(struct default_engine *engine, set_elem_item *elem)
 {
     if (elem->refcount != 0) {
-        elem->refcount--;
+        ELEM_REFCOUNT_DECR(elem);
     }
     if (elem->refcount == 0 && elem->next == (set_elem_item *)ADDR_MEANS_UNLINKED) {
         do_set_elem_free(engine, elem);
@@ -2152,7 +2911,7 @@ static int do_set_elem_traverse_dfs(struct default_engine *engine,
             set_elem_item *elem = node->htab[hidx];
             while (elem != NULL) {
                 if (elem_array) {
-                    elem->refcount++;
+                    ELEM_REFCOUNT_INCR(elem);
                     elem_array[fcnt] = elem;
                 }
                 fcnt++;
@@ -2330,7 +3089,7 @@ static btree_indx_node *do_btree_node_alloc(struct default_engine *engine,
 {
     size_t ntotal = (node_depth > 0 ? sizeof(btree_indx_node) : sizeof(btree_leaf_node));
 
-    btree_indx_node *node = do_item_alloc_internal(engine, ntotal, LRU_CLSID_FOR_SMALL, cookie);
+    btree_indx_node *node = do_coll_mem_alloc(engine, ntotal, cookie, true);
     if (node != NULL) {
         assert(node->slabs_clsid == 0);
         node->slabs_clsid = slabs_clsid(engine, ntotal);
@@ -2339,6 +3098,7 @@ static btree_indx_node *do_btree_node_alloc(struct default_engine *engine,
         node->ndepth      = node_depth;
         node->used_count  = 0;
         node->prev = node->next = NULL;
+        engine->stats.coll_node_bytes[ITEM_TYPE_BTREE] += slabs_space_size(engine, ntotal);
         memset(node->item, 0, BTREE_ITEM_COUNT*sizeof(void*));
         if (node_depth > 0)
             memset(node->ecnt, 0, BTREE_ITEM_COUNT*sizeof(uint16_t));
@@ -2349,16 +3109,17 @@ static btree_indx_node *do_btree_node_alloc(struct default_engine *engine,
 static void do_btree_node_free(struct default_engine *engine, btree_indx_node *node)
 {
     size_t ntotal = (node->ndepth > 0 ? sizeof(btree_indx_node) : sizeof(btree_leaf_node));
+    engine->stats.coll_node_bytes[ITEM_TYPE_BTREE] -= slabs_space_size(engine, ntotal);
     do_mem_slot_free(engine, node, ntotal);
 }
 
 static btree_elem_item *do_btree_elem_alloc(struct default_engine *engine,
                                             const int nbkey, const int neflag, const int nbytes,
-                                            const void *cookie)
+                                            const void *cookie, const bool locked)
 {
     size_t ntotal = sizeof(btree_elem_item_fixed) + BTREE_REAL_NBKEY(nbkey) + neflag + nbytes;
 
-    btree_elem_item *elem = do_item_alloc_internal(engine, ntotal, LRU_CLSID_FOR_SMALL, cookie);
+    btree_elem_item *elem = do_coll_mem_alloc(engine, ntotal, cookie, locked);
     if (elem != NULL) {
         assert(elem->slabs_clsid == 0);
         elem->slabs_clsid = slabs_clsid(engine, ntotal);
@@ -2384,7 +3145,7 @@ static void do_btree_elem_release(struct default_engine *engine, btree_elem_item
 {
     /* assert(elem->status != BTREE_ITEM_STATUS_FREE); */
     if (elem->refcount != 0) {
-        elem->refcount--;
+        ELEM_REFCOUNT_DECR(elem);
     }
     if (elem->refcount == 0 && elem->status == BTREE_ITEM_STATUS_UNLINK) {
         elem->status = BTREE_ITEM_STATUS_FREE;
@@ -3829,7 +4590,7 @@ static ENGINE_ERROR_CODE do_btree_elem_update(struct default_engine *engine, btr
         }
 #endif
 
-        btree_elem_item *new_elem = do_btree_elem_alloc(engine, elem->nbkey, new_neflag, new_nbytes, cookie);
+        btree_elem_item *new_elem = do_btree_elem_alloc(engine, elem->nbkey, new_neflag, new_nbytes, cookie, true);
         if (new_elem == NULL) {
             return ENGINE_ENOMEM;
         }
@@ -4216,7 +4977,7 @@ static void do_btree_overflow_trim(struct default_engine *engine, btree_meta_inf
         }
         if (trimmed_elems != NULL) {
             btree_elem_item *edge_elem = BTREE_GET_ELEM_ITEM(delpath[0].node, delpath[0].indx);
-            edge_elem->refcount++;
+            ELEM_REFCOUNT_INCR(edge_elem);
             *trimmed_elems = edge_elem;
             *trimmed_count = 1;
         }
@@ -4373,7 +5134,7 @@ static ENGINE_ERROR_CODE do_btree_elem_get(struct default_engine *engine, btree_
             tot_access++;
             if (offset == 0) {
                 if (efilter == NULL || do_btree_elem_filter(elem, efilter)) {
-                    elem->refcount++;
+                    ELEM_REFCOUNT_INCR(elem);
                     elem_array[tot_found++] = elem;
                     if (delete) {
                         do_btree_elem_unlink(engine, info, path, ELEM_DELETE_NORMAL);
@@ -4414,7 +5175,7 @@ static ENGINE_ERROR_CODE do_btree_elem_get(struct default_engine *engine, btree_
                     if (skip_cnt < offset) {
                         skip_cnt++;
                     } else {
-                        elem->refcount++;
+                        ELEM_REFCOUNT_INCR(elem);
                         elem_array[tot_found+cur_found] = elem;
                         if (delete) {
                             stotal += slabs_space_size(engine, do_btree_elem_ntotal(elem));
@@ -4642,7 +5403,7 @@ static ENGINE_ERROR_CODE do_btree_elem_arithmetic(struct default_engine *engine,
 
         elem = do_btree_elem_alloc(engine, bkrange->from_nbkey,
                                    (eflagp == NULL || eflagp->len == EFLAG_NULL ? 0 : eflagp->len),
-                                   nlen, cookie);
+                                   nlen, cookie, true);
         if (elem == NULL) {
             return ENGINE_ENOMEM;
         }
@@ -4690,7 +5451,7 @@ static ENGINE_ERROR_CODE do_btree_elem_arithmetic(struct default_engine *engine,
              * Because, the space difference is negligible.
              */
 #endif
-            btree_elem_item *new_elem = do_btree_elem_alloc(engine, elem->nbkey, elem->neflag, nlen, cookie);
+            btree_elem_item *new_elem = do_btree_elem_alloc(engine, elem->nbkey, elem->neflag, nlen, cookie, true);
             if (new_elem == NULL) {
                 return ENGINE_ENOMEM;
             }
@@ -4756,7 +5517,7 @@ static int do_btree_elem_batch_get(btree_elem_posi posi, const int count,
         if (posi.node == NULL) break;
 
         elem = BTREE_GET_ELEM_ITEM(posi.node, posi.indx);
-        elem->refcount++;
+        ELEM_REFCOUNT_INCR(elem);
         if (reverse) elem_array[count-nfound-1] = elem;
         else         elem_array[nfound] = elem;
         nfound += 1;
@@ -4784,7 +5545,7 @@ static int do_btree_posi_find_with_get(btree_meta_info *info,
 
         ecnt = 1;                             /* elem count */
         eidx = (bpos < count) ? bpos : count; /* elem index in elem array */
-        elem->refcount++;
+        ELEM_REFCOUNT_INCR(elem);
         elem_array[eidx] = elem;
 
         if (order == BTREE_ORDER_ASC) {
@@ -4832,7 +5593,7 @@ static ENGINE_ERROR_CODE do_btree_elem_get_by_posi(btree_meta_info *info,
     posi.indx = index-tot_ecnt;
 
     elem = BTREE_GET_ELEM_ITEM(posi.node, posi.indx);
-    elem->refcount++;
+    ELEM_REFCOUNT_INCR(elem);
     elem_array[0] = elem;
     nfound = 1;
     nfound += do_btree_elem_batch_get(posi, count-1, forward, false, &elem_array[nfound]);
@@ -5008,7 +5769,7 @@ static void do_btree_smget_adjust_trim(smget_result_t *smres)
             }
             pos = left;
         }
-        trim_elem->refcount++;
+        ELEM_REFCOUNT_INCR(trim_elem);
         new_trim_elems[pos] = trim_elem;
         new_trim_kinfo[pos].kidx = trim_kidx;
         new_trim_count++;
@@ -5491,7 +6252,7 @@ static ENGINE_ERROR_CODE do_btree_smget_elem_sort_old(btree_scan_info *btree_sca
             if (*elem_count > 0 && dup_bkey_found) {
                 *bkey_duplicated = true;
             }
-            elem->refcount++;
+            ELEM_REFCOUNT_INCR(elem);
             elem_array[*elem_count] = elem;
             kfnd_array[*elem_count] = btree_scan_buf[curr_idx].kidx;
             flag_array[*elem_count] = btree_scan_buf[curr_idx].it->flags;
@@ -5622,7 +6383,7 @@ do_btree_smget_elem_sort(btree_scan_info *btree_scan_buf,
                 }
             }
 #endif
-            elem->refcount++;
+            ELEM_REFCOUNT_INCR(elem);
             if (smres->elem_count >= count) break;
         }
 
@@ -5724,20 +6485,26 @@ static int check_expired_collections(struct default_engine *engine, const int cl
     tries = space_shortage_level;
     current_time = engine->server.core->get_current_time();
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     if (item_evict_to_free == true)
     {
         search = engine->items.tails[clsid];
         while (search != NULL && tries > 0) {
             assert(search->nkey > 0);
             it = search;
-            search = search->prev; tries--;
+            search = ITEM_PREV(search); tries--;
 
             if (it->refcount == 0) {
                 if (do_item_isvalid(engine, it, current_time) == false) {
                     do_item_invalidate(engine, it, clsid, true);
+                } else if (do_item_lru_rescue(engine, it, clsid) == false) {
+                    hash_item *victim = do_item_evict_victim(engine, it, current_time);
+                    if (victim != it) {
+                        search = it; /* still linked */
+                    }
+                    do_item_evict(engine, victim, clsid, current_time, NULL);
                 } else {
-                    do_item_evict(engine, it, clsid, current_time, NULL);
+                    continue;
                 }
                 unlink_count++;
             } else { /* search->refcount > 0 */
@@ -5746,7 +6513,7 @@ static int check_expired_collections(struct default_engine *engine, const int cl
             }
         }
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 
     *ssl = space_shortage_level;
     return unlink_count;
@@ -5866,7 +6633,7 @@ static void *collection_delete_thread(void *arg)
             bool dropped = false;
             list_meta_info *info;
             while (dropped == false) {
-                pthread_mutex_lock(&engine->cache_lock);
+                LOCK_CACHE();
                 info = (list_meta_info *)item_get_meta(it);
                 (void)do_list_elem_delete(engine, info, 0, 30, ELEM_DELETE_COLL);
                 if (info->ccnt == 0) {
@@ -5874,13 +6641,13 @@ static void *collection_delete_thread(void *arg)
                     do_item_free(engine, it);
                     dropped = true;
                 }
-                pthread_mutex_unlock(&engine->cache_lock);
+                UNLOCK_CACHE();
             }
         } else if (IS_SET_ITEM(it)) {
             bool dropped = false;
             set_meta_info *info;
             while (dropped == false) {
-                pthread_mutex_lock(&engine->cache_lock);
+                LOCK_CACHE();
                 info = (set_meta_info *)item_get_meta(it);
 #ifdef SET_DELETE_NO_MERGE
                 (void)do_set_elem_delete_fast(engine, info, 30);
@@ -5892,14 +6659,14 @@ static void *collection_delete_thread(void *arg)
                     do_item_free(engine, it);
                     dropped = true;
                 }
-                pthread_mutex_unlock(&engine->cache_lock);
+                UNLOCK_CACHE();
             }
         }
         else if (IS_MAP_ITEM(it)) {
             bool dropped = false;
             map_meta_info *info;
             while (dropped == false) {
-                pthread_mutex_lock(&engine->cache_lock);
+                LOCK_CACHE();
                 info = (map_meta_info *)item_get_meta(it);
                 (void)do_map_elem_delete(engine, info, 30, ELEM_DELETE_COLL);
                 if (info->ccnt == 0) {
@@ -5907,7 +6674,7 @@ static void *collection_delete_thread(void *arg)
                     do_item_free(engine, it);
                     dropped = true;
                 }
-                pthread_mutex_unlock(&engine->cache_lock);
+                UNLOCK_CACHE();
             }
         }
         else if (IS_BTREE_ITEM(it)) {
@@ -5921,7 +6688,7 @@ static void *collection_delete_thread(void *arg)
             get_bkey_full_range(info->bktype, true, &bkrange_space);
 #endif
             while (dropped == false) {
-                pthread_mutex_lock(&engine->cache_lock);
+                LOCK_CACHE();
                 info = (btree_meta_info *)item_get_meta(it);
 #ifdef BTREE_DELETE_NO_MERGE
                 (void)do_btree_elem_delete_fast(engine, info, path, 100);
@@ -5934,62 +6701,1529 @@ static void *collection_delete_thread(void *arg)
                     do_item_free(engine, it);
                     dropped = true;
                 }
-                pthread_mutex_unlock(&engine->cache_lock);
+                UNLOCK_CACHE();
+            }
+        }
+    }
+    return NULL;
+}
+
+void coll_del_thread_wakeup(void)
+{
+    pthread_mutex_lock(&coll_del_lock);
+    if (coll_del_sleep == true) {
+        /* wake up collection delete thead */
+        pthread_cond_signal(&coll_del_cond);
+    }
+    pthread_mutex_unlock(&coll_del_lock);
+}
+
+static void assoc_maint_thread_sleep(struct default_engine *engine, long msec)
+{
+    struct timeval  tv;
+    struct timespec to;
+    pthread_mutex_lock(&assoc_maint_lock);
+    if (engine->initialized) {
+        gettimeofday(&tv, NULL);
+        tv.tv_usec += msec * 1000;
+        tv.tv_sec += tv.tv_usec / 1000000;
+        tv.tv_usec %= 1000000;
+        to.tv_sec = tv.tv_sec;
+        to.tv_nsec = tv.tv_usec * 1000;
+        pthread_cond_timedwait(&assoc_maint_cond, &assoc_maint_lock, &to);
+    }
+    pthread_mutex_unlock(&assoc_maint_lock);
+}
+
+/*
+ * The assoc maintainer expands the hash table in the background.
+ * The new hash tables are allocated outside the cache lock, and
+ * the buckets are redistributed ASSOC_EXPAND_BATCH buckets at a time
+ * so that the request threads wait for the cache lock only briefly.
+ */
+static void *assoc_maintainer_thread(void *arg)
+{
+    struct default_engine *engine = arg;
+    void *new_hashtable;
+    uint32_t pending, prev_pending;
+
+    while (engine->initialized) {
+        if (assoc_expand_needed(engine) == false) {
+            assoc_maint_thread_sleep(engine, ASSOC_MAINT_SLEEP_MS);
+            continue;
+        }
+        /* only this thread expands the hash table */
+        new_hashtable = assoc_expand_alloc(engine);
+        if (new_hashtable == NULL) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't allocate the hash table for expansion.\n");
+            assoc_maint_thread_sleep(engine, 1000);
+            continue;
+        }
+        LOCK_CACHE();
+        assoc_expand_start(engine, new_hashtable);
+        pending = engine->assoc.expand_pending;
+        UNLOCK_CACHE();
+        if (engine->config.verbose > 1) {
+            logger->log(EXTENSION_LOG_INFO, NULL, "hash table expansion: start power=%u\n",
+                        engine->assoc.hashpower + engine->assoc.rootpower);
+        }
+
+        while (pending > 0 && engine->initialized) {
+            prev_pending = pending;
+            LOCK_CACHE();
+            pending = assoc_expand_step(engine, ASSOC_EXPAND_BATCH);
+            UNLOCK_CACHE();
+            if (pending == prev_pending) {
+                /* the remaining buckets are being scanned, or
+                 * the memory for overflow buckets is short. */
+                assoc_maint_thread_sleep(engine, ASSOC_MAINT_SLEEP_MS);
+            }
+        }
+        if (engine->config.verbose > 1) {
+            logger->log(EXTENSION_LOG_INFO, NULL, "hash table expansion: end\n");
+        }
+    }
+    return NULL;
+}
+
+static void assoc_maint_thread_wakeup(void)
+{
+    pthread_mutex_lock(&assoc_maint_lock);
+    pthread_cond_signal(&assoc_maint_cond);
+    pthread_mutex_unlock(&assoc_maint_lock);
+}
+
+/*
+ * Slab page mover
+ *
+ * A page of the source slab class is emptied by unlinking its items,
+ * and is given to the destination slab class. The page is moved only if
+ * none of its items is in use, otherwise another page is tried.
+ */
+static bool do_item_chunk_busy(hash_item *it)
+{
+    if (it->slabs_clsid == 0) {
+        return false; /* free chunk */
+    }
+    if (it->refcount != 0 || (it->iflag & ITEM_LINKED) == 0) {
+        return true;
+    }
+#ifdef ENABLE_STICKY_ITEM
+    if (it->exptime == (rel_time_t)(-1)) {
+        return true; /* sticky items are never evicted */
+    }
+#endif
+    return false;
+}
+
+/* Empty a page of the slab class by unlinking its items.
+ * NULL is returned if the items of the checked pages are in use.
+ */
+static char *do_item_slabs_empty_page(struct default_engine *engine, int id, uint32_t *evicted)
+{
+    rel_time_t current_time = engine->server.core->get_current_time();
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    hash_item *it;
+    char *page = NULL;
+    uint32_t i;
+
+    for (int tries = 0; tries < SLAB_REASSIGN_TRIES; tries++) {
+        page = slabs_reassign_page(engine, id, tries);
+        if (page == NULL) break;
+        for (i = 0; i < p->perslab; i++) {
+            if (do_item_chunk_busy((hash_item *)(page + i * p->size))) break;
+        }
+        if (i == p->perslab) break; /* movable page */
+        page = NULL;
+    }
+    if (page == NULL) {
+        return NULL;
+    }
+
+    *evicted = 0;
+    for (i = 0; i < p->perslab; i++) {
+        it = (hash_item *)(page + i * p->size);
+        if (it->slabs_clsid == 0) {
+            continue;
+        }
+        if (do_item_isvalid(engine, it, current_time) == false) {
+            do_item_invalidate(engine, it, id, true);
+        } else {
+            if (IS_COLL_ITEM(it))
+                do_coll_all_elem_delete(engine, it);
+            do_item_unlink(engine, it, ITEM_UNLINK_EVICT);
+            (*evicted)++;
+        }
+    }
+    return page;
+}
+
+static ENGINE_ERROR_CODE do_item_slabs_reassign(struct default_engine *engine, int src, int dst)
+{
+    ENGINE_ERROR_CODE ret;
+    char *page;
+    uint32_t evicted;
+
+    ret = slabs_reassign_check(engine, src, dst);
+    if (ret != ENGINE_SUCCESS) {
+        return ret;
+    }
+
+    page = do_item_slabs_empty_page(engine, src, &evicted);
+    if (page == NULL) {
+        slabs_reassign_busy(engine);
+        return ENGINE_EWOULDBLOCK;
+    }
+    slabs_reassign_move(engine, src, dst, page, evicted);
+    return ENGINE_SUCCESS;
+}
+
+static void slab_automove_thread_sleep(struct default_engine *engine, long msec)
+{
+    struct timeval  tv;
+    struct timespec to;
+    pthread_mutex_lock(&slab_automove_lock);
+    if (engine->initialized) {
+        gettimeofday(&tv, NULL);
+        tv.tv_usec += msec * 1000;
+        tv.tv_sec += tv.tv_usec / 1000000;
+        tv.tv_usec %= 1000000;
+        to.tv_sec = tv.tv_sec;
+        to.tv_nsec = tv.tv_usec * 1000;
+        pthread_cond_timedwait(&slab_automove_cond, &slab_automove_lock, &to);
+    }
+    pthread_mutex_unlock(&slab_automove_lock);
+}
+
+/*
+ * The slab automover moves a slab page from a slab class that has had
+ * no eviction for a while to the slab class that has had the most
+ * evictions during the last check interval.
+ */
+static void *slab_automove_thread(void *arg)
+{
+    struct default_engine *engine = arg;
+    uint64_t last_evicted[MAX_SLAB_CLASSES];
+    uint32_t idle_checks[MAX_SLAB_CLASSES];
+    uint64_t evicted, max_evicted;
+    ENGINE_ERROR_CODE ret;
+    int i, last, src, dst;
+
+    memset(last_evicted, 0, sizeof(last_evicted));
+    memset(idle_checks, 0, sizeof(idle_checks));
+
+    while (engine->initialized) {
+        slab_automove_thread_sleep(engine, SLAB_AUTOMOVE_INTERVAL_MS);
+        if (engine->config.slab_automove == false) {
+            continue;
+        }
+        src = dst = -1;
+        max_evicted = 0;
+        ret = ENGINE_SUCCESS;
+
+        LOCK_CACHE();
+        last = engine->slabs.chunk_clsid != 0 ? engine->slabs.chunk_clsid
+                                              : engine->slabs.power_largest;
+        for (i = LRU_CLSID_FOR_SMALL; i <= last; i++) {
+            evicted = engine->items.itemstats[i].evicted;
+            if (evicted >= last_evicted[i]) {
+                evicted -= last_evicted[i];
+            } /* else, the item stats have been reset */
+            last_evicted[i] = engine->items.itemstats[i].evicted;
+
+            if (evicted > 0) {
+                idle_checks[i] = 0;
+                if (evicted > max_evicted) {
+                    max_evicted = evicted;
+                    dst = i;
+                }
+            } else if (++idle_checks[i] >= SLAB_AUTOMOVE_IDLE_CHECKS &&
+                       i >= POWER_SMALLEST && i <= engine->slabs.power_largest) {
+                /* the class with the most pages gives one */
+                if (engine->slabs.slabclass[i].slabs > 1 &&
+                    (src == -1 ||
+                     engine->slabs.slabclass[i].slabs > engine->slabs.slabclass[src].slabs)) {
+                    src = i;
+                }
+            }
+        }
+        if (src != -1 && dst != -1) {
+            ret = do_item_slabs_reassign(engine, src, dst);
+        }
+        UNLOCK_CACHE();
+
+        if (src != -1 && dst != -1 && engine->config.verbose > 1) {
+            logger->log(EXTENSION_LOG_INFO, NULL, "slab automove: %d -> %d %s\n",
+                        src, dst, ret == ENGINE_SUCCESS ? "moved" : "failed");
+        }
+    }
+    return NULL;
+}
+
+static void slab_automove_thread_wakeup(void)
+{
+    pthread_mutex_lock(&slab_automove_lock);
+    pthread_cond_signal(&slab_automove_cond);
+    pthread_mutex_unlock(&slab_automove_lock);
+}
+
+ENGINE_ERROR_CODE item_slabs_reassign(struct default_engine *engine, int src, int dst)
+{
+    ENGINE_ERROR_CODE ret;
+    LOCK_CACHE();
+    ret = do_item_slabs_reassign(engine, src, dst);
+    UNLOCK_CACHE();
+    return ret;
+}
+
+/*
+ * Small memory compactor
+ *
+ * The compactor relocates the elements, the set/map hash nodes and
+ * the b+tree nodes placed in the sparse blocks of the small memory
+ * allocator, and fixes up the pointers that own them. The objects of
+ * a collection are relocated only while its item is not referenced,
+ * so no one else can hold them. Hash items are not relocated.
+ */
+static void *do_sm_compact_move(struct default_engine *engine, void *ptr, size_t ntotal)
+{
+    void *new_ptr = slabs_sm_relocate(engine, ptr, ntotal);
+    if (new_ptr != NULL) {
+        memcpy(new_ptr, ptr, ntotal);
+        do_mem_slot_free(engine, ptr, ntotal);
+    }
+    return new_ptr;
+}
+
+static uint32_t do_list_sm_compact(struct default_engine *engine, list_meta_info *info)
+{
+    list_elem_item *elem = info->head;
+    list_elem_item *moved;
+    uint32_t count = 0;
+
+    while (elem != NULL) {
+        if (elem->refcount == 0 &&
+            (moved = do_sm_compact_move(engine, elem, do_list_elem_ntotal(elem))) != NULL) {
+            elem = moved;
+            if (elem->prev != NULL) elem->prev->next = elem;
+            else                    info->head = elem;
+            if (elem->next != NULL) elem->next->prev = elem;
+            else                    info->tail = elem;
+            count++;
+        }
+        elem = elem->next;
+    }
+    return count;
+}
+
+static set_hash_node *do_set_node_sm_compact(struct default_engine *engine,
+                                             set_hash_node *node, uint32_t *count)
+{
+    set_hash_node *moved = do_sm_compact_move(engine, node, sizeof(set_hash_node));
+    set_elem_item *elem, *prev, *melem;
+    int hidx;
+
+    if (moved != NULL) {
+        node = moved;
+        *count += 1;
+    }
+    for (hidx = 0; hidx < SET_HASHTAB_SIZE; hidx++) {
+        if (node->hcnt[hidx] == -1) { /* child hash node */
+            node->htab[hidx] = do_set_node_sm_compact(engine, node->htab[hidx], count);
+            continue;
+        }
+        prev = NULL;
+        elem = node->htab[hidx];
+        while (elem != NULL) {
+            if (elem->refcount == 0 &&
+                (melem = do_sm_compact_move(engine, elem, do_set_elem_ntotal(elem))) != NULL) {
+                elem = melem;
+                if (prev != NULL) prev->next = elem;
+                else              node->htab[hidx] = elem;
+                *count += 1;
+            }
+            prev = elem;
+            elem = elem->next;
+        }
+    }
+    return node;
+}
+
+static map_hash_node *do_map_node_sm_compact(struct default_engine *engine,
+                                             map_hash_node *node, uint32_t *count)
+{
+    map_hash_node *moved = do_sm_compact_move(engine, node, sizeof(map_hash_node));
+    map_elem_item *elem, *prev, *melem;
+    int hidx;
+
+    if (moved != NULL) {
+        node = moved;
+        *count += 1;
+    }
+    for (hidx = 0; hidx < MAP_HASHTAB_SIZE; hidx++) {
+        if (node->hcnt[hidx] == -1) { /* child hash node */
+            node->htab[hidx] = do_map_node_sm_compact(engine, node->htab[hidx], count);
+            continue;
+        }
+        prev = NULL;
+        elem = node->htab[hidx];
+        while (elem != NULL) {
+            if (elem->refcount == 0 &&
+                (melem = do_sm_compact_move(engine, elem, do_map_elem_ntotal(elem))) != NULL) {
+                elem = melem;
+                if (prev != NULL) prev->next = elem;
+                else              node->htab[hidx] = elem;
+                *count += 1;
+            }
+            prev = elem;
+            elem = elem->next;
+        }
+    }
+    return node;
+}
+
+static btree_indx_node *do_btree_node_sm_compact(struct default_engine *engine,
+                                                 btree_indx_node *node, uint32_t *count)
+{
+    size_t ntotal = (node->ndepth > 0 ? sizeof(btree_indx_node) : sizeof(btree_leaf_node));
+    btree_indx_node *moved = NULL;
+    btree_elem_item *elem, *melem;
+    int i;
+
+    if (node->refcount == 0) {
+        moved = do_sm_compact_move(engine, node, ntotal);
+    }
+    if (moved != NULL) {
+        /* the parent is fixed up by the caller */
+        node = moved;
+        if (node->prev != NULL) node->prev->next = node;
+        if (node->next != NULL) node->next->prev = node;
+        *count += 1;
+    }
+    for (i = 0; i < node->used_count; i++) {
+        if (node->ndepth > 0) {
+            node->item[i] = do_btree_node_sm_compact(engine, node->item[i], count);
+            continue;
+        }
+        elem = (btree_elem_item *)node->item[i];
+        if (elem->refcount == 0 && elem->status == BTREE_ITEM_STATUS_USED &&
+            (melem = do_sm_compact_move(engine, elem, do_btree_elem_ntotal(elem))) != NULL) {
+            node->item[i] = melem;
+            *count += 1;
+        }
+    }
+    return node;
+}
+
+static uint32_t do_coll_sm_compact(struct default_engine *engine, hash_item *it)
+{
+    uint32_t count = 0;
+
+    if (IS_LIST_ITEM(it)) {
+        count = do_list_sm_compact(engine, (list_meta_info *)item_get_meta(it));
+    } else if (IS_SET_ITEM(it)) {
+        set_meta_info *info = (set_meta_info *)item_get_meta(it);
+        if (info->root != NULL) {
+            info->root = do_set_node_sm_compact(engine, info->root, &count);
+        }
+    } else if (IS_MAP_ITEM(it)) {
+        map_meta_info *info = (map_meta_info *)item_get_meta(it);
+        if (info->root != NULL) {
+            info->root = do_map_node_sm_compact(engine, info->root, &count);
+        }
+    } else if (IS_BTREE_ITEM(it)) {
+        btree_meta_info *info = (btree_meta_info *)item_get_meta(it);
+        if (info->root != NULL) {
+            info->root = do_btree_node_sm_compact(engine, info->root, &count);
+        }
+    }
+    return count;
+}
+
+/* relocates the objects of all collections in one pass over the hash table */
+static uint64_t item_sm_compact_run(struct default_engine *engine)
+{
+    int        array_size=32;
+    int        item_count;
+    hash_item *item_array[array_size];
+    struct assoc_scan scan;
+    struct timespec sleep_time = {0, 1000};
+    uint64_t   moved = 0;
+    int        i,try_cnt = 9;
+
+    assoc_scan_init(engine, &scan);
+
+    LOCK_CACHE();
+    while (engine->initialized)
+    {
+        item_count = assoc_scan_next(&scan, item_array, array_size);
+        if (item_count <= 0) { /* reached to the end */
+            break;
+        }
+        for (i = 0; i < item_count; i++) {
+            if (IS_COLL_ITEM(item_array[i]) && item_array[i]->refcount == 0) {
+                moved += do_coll_sm_compact(engine, item_array[i]);
+            }
+        }
+        UNLOCK_CACHE();
+
+        /* LOCK_CACHE(); */
+        for (i = 0; i < try_cnt; i++) {
+            if (TRYLOCK_CACHE() == 0)
+                break;
+            nanosleep(&sleep_time, NULL);
+        }
+        if (i == try_cnt) {
+            LOCK_CACHE();
+        }
+    }
+    assoc_scan_final(&scan);
+    UNLOCK_CACHE();
+    return moved;
+}
+
+static void sm_compact_thread_sleep(struct default_engine *engine, long msec)
+{
+    struct timeval  tv;
+    struct timespec to;
+    pthread_mutex_lock(&sm_compact_lock);
+    if (engine->initialized) {
+        gettimeofday(&tv, NULL);
+        tv.tv_usec += msec * 1000;
+        tv.tv_sec += tv.tv_usec / 1000000;
+        tv.tv_usec %= 1000000;
+        to.tv_sec = tv.tv_sec;
+        to.tv_nsec = tv.tv_usec * 1000;
+        pthread_cond_timedwait(&sm_compact_cond, &sm_compact_lock, &to);
+    }
+    pthread_mutex_unlock(&sm_compact_lock);
+}
+
+/*
+ * The small memory compactor starts a compaction run when the used blocks
+ * have much free space. If a run could free no block, for example because
+ * the sparse blocks are pinned by hash items, the next run is delayed.
+ */
+static void *sm_compact_thread(void *arg)
+{
+    struct default_engine *engine = arg;
+    uint32_t skip_checks = 0;
+    uint32_t blocks, freed;
+    uint64_t moved;
+
+    while (engine->initialized) {
+        sm_compact_thread_sleep(engine, SM_COMPACT_INTERVAL_MS);
+        if (skip_checks > 0) {
+            skip_checks--;
+            continue;
+        }
+        blocks = slabs_sm_compact_start(engine);
+        if (blocks == 0) {
+            continue;
+        }
+        moved = item_sm_compact_run(engine);
+        freed = slabs_sm_compact_end(engine);
+        if (freed == 0) {
+            skip_checks = SM_COMPACT_IDLE_CHECKS;
+        }
+
+        if (engine->config.verbose > 1) {
+            logger->log(EXTENSION_LOG_INFO, NULL,
+                        "sm compaction: %u blocks evacuated, %"PRIu64" slots moved, %u blocks freed\n",
+                        blocks, moved, freed);
+        }
+    }
+    return NULL;
+}
+
+static void sm_compact_thread_wakeup(void)
+{
+    pthread_mutex_lock(&sm_compact_lock);
+    pthread_cond_signal(&sm_compact_cond);
+    pthread_mutex_unlock(&sm_compact_lock);
+}
+
+/*
+ * Memlimit shrinker
+ *
+ * A memlimit below the malloced memory is reached by freeing slab pages
+ * at memlimit_shrink_rate bytes per second, so that the request threads
+ * don't have to evict items for it. The free pages are released first.
+ * Then the slab class with the most memory gives a page emptied by
+ * evicting its items. The blocks of the small memory allocator and the
+ * value chunks are freed by evicting items from their LRU lists.
+ */
+static size_t do_item_shrink_evict(struct default_engine *engine, int lruid, size_t budget)
+{
+    rel_time_t current_time = engine->server.core->get_current_time();
+    hash_item *search = engine->items.tails[lruid];
+    hash_item *previt;
+    size_t freed = 0;
+    uint32_t evicted = 0;
+    int tries = MEMLIMIT_SHRINK_TRIES;
+
+    while (search != NULL && freed < budget && tries-- > 0) {
+        previt = ITEM_PREV(search);
+        if (search->refcount == 0) {
+            freed += ITEM_stotal(engine, search);
+            if (do_item_isvalid(engine, search, current_time) == false) {
+                do_item_invalidate(engine, search, lruid, true);
+            } else {
+                do_item_evict(engine, search, lruid, current_time, NULL);
+                evicted++;
+            }
+        }
+        search = previt;
+    }
+    slabs_shrink_evicted(engine, evicted);
+    return freed;
+}
+
+static void do_item_memlimit_shrink(struct default_engine *engine, size_t budget)
+{
+    bool stuck[MAX_SLAB_CLASSES];
+    slabclass_t *p;
+    size_t spent, space, max_space;
+    uint32_t evicted;
+    char *page;
+    int i, last, src;
+
+    memset(stuck, 0, sizeof(stuck));
+    last = engine->slabs.chunk_clsid != 0 ? engine->slabs.chunk_clsid
+                                          : engine->slabs.power_largest;
+
+    spent = slabs_shrink_release(engine, budget);
+    while (spent < budget && slabs_shrink_excess(engine) > 0) {
+        /* the slab class with the most memory gives it */
+        src = -1;
+        max_space = 0;
+        for (i = 0; i <= last; i++) {
+            p = &engine->slabs.slabclass[i];
+            space = (size_t)p->slabs * p->size * p->perslab;
+            if (stuck[i] == false && space > max_space) {
+                max_space = space;
+                src = i;
+            }
+        }
+        if (src == -1) break; /* retried in the next interval */
+
+        if (src == LRU_CLSID_FOR_SMALL || src == engine->slabs.chunk_clsid) {
+            space = do_item_shrink_evict(engine, src, budget - spent);
+        } else {
+            page = do_item_slabs_empty_page(engine, src, &evicted);
+            space = page != NULL ? slabs_shrink_page_free(engine, src, page, evicted) : 0;
+        }
+        if (space == 0) {
+            /* no evictable items, or the items of the pages are in use */
+            stuck[src] = true;
+            continue;
+        }
+        spent += space;
+        if (spent < budget) {
+            spent += slabs_shrink_release(engine, budget - spent);
+        }
+    }
+}
+
+static void memlimit_shrink_thread_sleep(struct default_engine *engine, long msec)
+{
+    struct timeval  tv;
+    struct timespec to;
+    pthread_mutex_lock(&memlimit_shrink_lock);
+    if (engine->initialized) {
+        gettimeofday(&tv, NULL);
+        tv.tv_usec += msec * 1000;
+        tv.tv_sec += tv.tv_usec / 1000000;
+        tv.tv_usec %= 1000000;
+        to.tv_sec = tv.tv_sec;
+        to.tv_nsec = tv.tv_usec * 1000;
+        pthread_cond_timedwait(&memlimit_shrink_cond, &memlimit_shrink_lock, &to);
+    }
+    pthread_mutex_unlock(&memlimit_shrink_lock);
+}
+
+static void *memlimit_shrink_thread(void *arg)
+{
+    struct default_engine *engine = arg;
+    size_t budget = engine->config.memlimit_shrink_rate
+                  / (1000 / MEMLIMIT_SHRINK_INTERVAL_MS);
+
+    if (budget == 0) {
+        budget = 1; /* a page per interval */
+    }
+
+    while (engine->initialized) {
+        memlimit_shrink_thread_sleep(engine, MEMLIMIT_SHRINK_INTERVAL_MS);
+        if (slabs_shrink_excess(engine) == 0) {
+            continue;
+        }
+        LOCK_CACHE();
+        do_item_memlimit_shrink(engine, budget);
+        UNLOCK_CACHE();
+    }
+    return NULL;
+}
+
+static void memlimit_shrink_thread_wakeup(void)
+{
+    pthread_mutex_lock(&memlimit_shrink_lock);
+    pthread_cond_signal(&memlimit_shrink_cond);
+    pthread_mutex_unlock(&memlimit_shrink_lock);
+}
+
+/*
+ * Expiry timing wheel
+ *
+ * If expiry_reap_rate is set, an entry of the key hash and the exptime
+ * is added to a hierarchical timing wheel when an item with an exptime
+ * is linked or its exptime is changed, and removed when the item is
+ * unlinked or its exptime is changed. A level 0 slot holds the entries
+ * of a second, and a slot of an upper level holds the entries of all
+ * the slots of the level below. When the time reaches the span of an
+ * upper slot, its entries are cascaded down to the lower level.
+ * So, the slot of an entry is found from its exptime: the level 0 slot
+ * being reaped if it's past, or the slot of the exptime at a level.
+ * The reaper thread frees the expired items of the level 0 slots
+ * at up to expiry_reap_rate entries per second, so that expired items
+ * don't hold memory until an access or an allocation finds them.
+ * The memory of the slots is charged to the memory limit. An entry that
+ * doesn't fit in it, or expires beyond the span of the wheel, isn't added
+ * and its item is reclaimed lazily as without the reaper.
+ */
+#define EXPIRY_SLOT_MIN_SIZE 16
+
+static void do_expiry_slot_free(struct default_engine *engine, expiry_slot *slot)
+{
+    if (slot->entries != NULL) {
+        free(slot->entries);
+        slabs_uncharge(engine, slot->size * sizeof(expiry_entry));
+        engine->items.expiry_wheel->bytes -= slot->size * sizeof(expiry_entry);
+    }
+    slot->entries = NULL;
+    slot->count = 0;
+    slot->size = 0;
+}
+
+static bool do_expiry_slot_grow(struct default_engine *engine, expiry_slot *slot)
+{
+    uint32_t size = slot->size > 0 ? slot->size * 2 : EXPIRY_SLOT_MIN_SIZE;
+    uint32_t count = slot->count;
+    expiry_entry *entries;
+    uint32_t i, j;
+
+    if (slabs_charge(engine, size * sizeof(expiry_entry)) == false) {
+        return false;
+    }
+    entries = calloc(size, sizeof(expiry_entry));
+    if (entries == NULL) {
+        slabs_uncharge(engine, size * sizeof(expiry_entry));
+        return false;
+    }
+    engine->items.expiry_wheel->bytes += size * sizeof(expiry_entry);
+
+    for (i = 0; i < slot->size; i++) {
+        if (slot->entries[i].exptime != 0) {
+            j = slot->entries[i].khash & (size - 1);
+            while (entries[j].exptime != 0) {
+                j = (j + 1) & (size - 1);
+            }
+            entries[j] = slot->entries[i];
+        }
+    }
+    do_expiry_slot_free(engine, slot);
+    slot->entries = entries;
+    slot->count = count;
+    slot->size = size;
+    return true;
+}
+
+static bool do_expiry_slot_add(struct default_engine *engine, expiry_slot *slot,
+                               const expiry_entry *entry)
+{
+    struct expiry_wheel *wheel = engine->items.expiry_wheel;
+    uint32_t i;
+
+    /* keep the load factor under 3/4 */
+    if ((slot->count + 1) * 4 > slot->size * 3 &&
+        do_expiry_slot_grow(engine, slot) == false) {
+        wheel->dropped++;
+        return false;
+    }
+    i = entry->khash & (slot->size - 1);
+    while (slot->entries[i].exptime != 0) {
+        i = (i + 1) & (slot->size - 1);
+    }
+    slot->entries[i] = *entry;
+    slot->count++;
+    wheel->entries++;
+    return true;
+}
+
+static bool do_expiry_slot_remove(struct default_engine *engine, expiry_slot *slot,
+                                  const expiry_entry *entry)
+{
+    uint32_t mask = slot->size - 1;
+    uint32_t i, j, home;
+
+    if (slot->count == 0) {
+        return false;
+    }
+    for (i = entry->khash & mask; slot->entries[i].exptime != 0; i = (i + 1) & mask) {
+        if (slot->entries[i].khash != entry->khash ||
+            slot->entries[i].exptime != entry->exptime) {
+            continue;
+        }
+        /* shift back the following entries that can't be found without it */
+        for (j = (i + 1) & mask; slot->entries[j].exptime != 0; j = (j + 1) & mask) {
+            home = slot->entries[j].khash & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                slot->entries[i] = slot->entries[j];
+                i = j;
+            }
+        }
+        slot->entries[i].exptime = 0;
+        slot->count--;
+        engine->items.expiry_wheel->entries--;
+        if (slot->count == 0) {
+            do_expiry_slot_free(engine, slot);
+        }
+        return true;
+    }
+    return false;
+}
+
+/* the lowest level whose slot of the exptime comes within a round of the level */
+static bool do_expiry_wheel_add(struct default_engine *engine, const expiry_entry *entry)
+{
+    struct expiry_wheel *wheel = engine->items.expiry_wheel;
+    rel_time_t time = entry->exptime > wheel->current ? entry->exptime : wheel->current;
+    int level, shift;
+
+    for (level = 0; level < EXPIRY_WHEEL_LEVELS; level++) {
+        shift = level * EXPIRY_WHEEL_BITS;
+        if ((time >> shift) - (wheel->current >> shift) < EXPIRY_WHEEL_SLOTS) {
+            break;
+        }
+    }
+    if (level == EXPIRY_WHEEL_LEVELS) {
+        /* beyond the wheel */
+        wheel->dropped++;
+        return false;
+    }
+    expiry_slot *slot = &wheel->slots[level][(time >> shift) & (EXPIRY_WHEEL_SLOTS - 1)];
+    return do_expiry_slot_add(engine, slot, entry);
+}
+
+static void do_item_expiry_add(struct default_engine *engine, hash_item *it)
+{
+    if (it->exptime == 0 || it->exptime == (rel_time_t)(-1)) {
+        return; /* never expires */
+    }
+    expiry_entry entry = { it->khash, it->exptime };
+    do_expiry_wheel_add(engine, &entry);
+}
+
+static void do_item_expiry_remove(struct default_engine *engine, hash_item *it)
+{
+    struct expiry_wheel *wheel = engine->items.expiry_wheel;
+    expiry_entry entry = { it->khash, it->exptime };
+    int level, shift;
+
+    if (it->exptime == 0 || it->exptime == (rel_time_t)(-1)) {
+        return; /* never expires */
+    }
+    if (entry.exptime <= wheel->current) {
+        /* added after the level 0 slot of the exptime was reaped */
+        do_expiry_slot_remove(engine, &wheel->slots[0][wheel->current & (EXPIRY_WHEEL_SLOTS - 1)],
+                              &entry);
+        return;
+    }
+    /* not cascaded down yet, if found in an upper level */
+    for (level = 0; level < EXPIRY_WHEEL_LEVELS; level++) {
+        shift = level * EXPIRY_WHEEL_BITS;
+        if ((entry.exptime >> shift) - (wheel->current >> shift) < EXPIRY_WHEEL_SLOTS &&
+            do_expiry_slot_remove(engine,
+                &wheel->slots[level][(entry.exptime >> shift) & (EXPIRY_WHEEL_SLOTS - 1)],
+                &entry)) {
+            return;
+        }
+    }
+}
+
+/* moves the entries of an upper level slot down to the lower levels */
+static void do_expiry_wheel_cascade(struct default_engine *engine, int level)
+{
+    struct expiry_wheel *wheel = engine->items.expiry_wheel;
+    int shift = level * EXPIRY_WHEEL_BITS;
+    expiry_slot *upper = &wheel->slots[level][(wheel->current >> shift) & (EXPIRY_WHEEL_SLOTS - 1)];
+    expiry_slot slot = *upper;
+
+    /* uncharged first, so that the lower slots can take its memory */
+    memset(upper, 0, sizeof(expiry_slot));
+    if (slot.entries != NULL) {
+        slabs_uncharge(engine, slot.size * sizeof(expiry_entry));
+        wheel->bytes -= slot.size * sizeof(expiry_entry);
+    }
+    wheel->entries -= slot.count;
+    for (uint32_t i = 0; i < slot.size; i++) {
+        if (slot.entries[i].exptime != 0) {
+            do_expiry_wheel_add(engine, &slot.entries[i]);
+        }
+    }
+    free(slot.entries);
+}
+
+static void do_expiry_reap_entry(struct default_engine *engine, const expiry_entry *entry,
+                                 rel_time_t current_time)
+{
+    struct expiry_wheel *wheel = engine->items.expiry_wheel;
+    hash_item *item_array[EXPIRY_HASH_ITEMS];
+    int count = assoc_find_hashed(engine, entry->khash, item_array, EXPIRY_HASH_ITEMS);
+
+    for (int i = 0; i < count; i++) {
+        if (do_item_isvalid(engine, item_array[i], current_time) == false) {
+            do_item_unlink(engine, item_array[i], ITEM_UNLINK_INVALID);
+            wheel->reaped++;
+        }
+    }
+}
+
+/* reaps the expired entries up to the budget, and returns the budget left */
+static size_t do_item_expiry_reap(struct default_engine *engine, size_t budget)
+{
+    struct expiry_wheel *wheel = engine->items.expiry_wheel;
+    rel_time_t current_time = engine->server.core->get_current_time();
+    expiry_slot *reaping = &wheel->reaping;
+    expiry_slot *slot;
+    expiry_entry entry;
+
+    while (budget > 0) {
+        while (reaping->count > 0 && budget > 0) {
+            entry = reaping->entries[wheel->reap_pos++];
+            if (entry.exptime != 0) {
+                reaping->count--;
+                wheel->entries--;
+                do_expiry_reap_entry(engine, &entry, current_time);
+                budget--;
+            }
+        }
+        if (reaping->count > 0) {
+            break;
+        }
+        do_expiry_slot_free(engine, reaping);
+        wheel->reap_pos = 0;
+
+        slot = &wheel->slots[0][wheel->current & (EXPIRY_WHEEL_SLOTS - 1)];
+        if (slot->count > 0) {
+            /* detached, so that unlinking the reaped items doesn't shift it */
+            *reaping = *slot;
+            memset(slot, 0, sizeof(expiry_slot));
+            continue;
+        }
+        if (wheel->current >= current_time) {
+            break;
+        }
+
+        /* the next second: the upper levels are cascaded from the top */
+        wheel->current++;
+        for (int level = EXPIRY_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((wheel->current & ((1 << (level * EXPIRY_WHEEL_BITS)) - 1)) == 0) {
+                do_expiry_wheel_cascade(engine, level);
+            }
+        }
+    }
+    return budget;
+}
+
+static void expiry_reap_thread_sleep(struct default_engine *engine, long msec)
+{
+    struct timeval  tv;
+    struct timespec to;
+    pthread_mutex_lock(&expiry_reap_lock);
+    if (engine->initialized) {
+        gettimeofday(&tv, NULL);
+        tv.tv_usec += msec * 1000;
+        tv.tv_sec += tv.tv_usec / 1000000;
+        tv.tv_usec %= 1000000;
+        to.tv_sec = tv.tv_sec;
+        to.tv_nsec = tv.tv_usec * 1000;
+        pthread_cond_timedwait(&expiry_reap_cond, &expiry_reap_lock, &to);
+    }
+    pthread_mutex_unlock(&expiry_reap_lock);
+}
+
+static void *expiry_reap_thread(void *arg)
+{
+    struct default_engine *engine = arg;
+    size_t budget = engine->config.expiry_reap_rate
+                  / (1000 / EXPIRY_REAP_INTERVAL_MS);
+    size_t left, batch, unused;
+
+    if (budget == 0) {
+        budget = 1; /* an entry per interval */
+    }
+
+    while (engine->initialized) {
+        expiry_reap_thread_sleep(engine, EXPIRY_REAP_INTERVAL_MS);
+        /* the budget of an interval is reaped in batches,
+         * so that the request threads get the cache lock in between.
+         */
+        left = budget;
+        while (left > 0 && engine->initialized) {
+            batch = left < EXPIRY_REAP_BATCH ? left : EXPIRY_REAP_BATCH;
+            LOCK_CACHE();
+            unused = do_item_expiry_reap(engine, batch);
+            UNLOCK_CACHE();
+            if (unused > 0) {
+                break; /* nothing left to reap */
+            }
+            left -= batch;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void expiry_reap_thread_wakeup(void)
+{
+    pthread_mutex_lock(&expiry_reap_lock);
+    pthread_cond_signal(&expiry_reap_cond);
+    pthread_mutex_unlock(&expiry_reap_lock);
+}
+
+/*
+ * LRU maintainer
+ *
+ * If lru_maintainer is enabled, a background thread keeps free memory
+ * headroom so that the request threads allocate without evicting.
+ * It evicts the small memory items while the space shortage level of
+ * the small memory allocator is above 0, and the tail items of a slab
+ * class while it has less than LRU_MAINT_HEADROOM free slots and no
+ * memory for a new page. The request threads skip the eviction for the
+ * space shortage below LRU_MAINT_INLINE_SSL and wake up the maintainer
+ * instead. They still evict inline when the maintainer falls behind,
+ * that is, the level reaches LRU_MAINT_INLINE_SSL or an allocation fails.
+ *
+ * If lru_maintainer or alloc_latency is enabled, the latency of item_alloc()
+ * is recorded to compare the allocation with and without the maintainer.
+ * The histogram is updated atomically outside the cache lock.
+ */
+static void item_alloc_latency(struct default_engine *engine, uint64_t nsec)
+{
+    int idx;
+    if (nsec < (1 << ALLOC_LAT_SUB_BITS)) {
+        idx = nsec;
+    } else {
+        int msb = 63 - __builtin_clzll(nsec);
+        int sub = (nsec >> (msb - ALLOC_LAT_SUB_BITS)) & ((1 << ALLOC_LAT_SUB_BITS) - 1);
+        idx = ((msb - ALLOC_LAT_SUB_BITS + 1) << ALLOC_LAT_SUB_BITS) | sub;
+        if (idx >= ALLOC_LAT_BUCKETS) {
+            idx = ALLOC_LAT_BUCKETS - 1;
+        }
+    }
+    __sync_fetch_and_add(&engine->items.alloc_lat_hist[idx], 1);
+}
+
+/* the upper bound of the latency bucket in nanoseconds */
+static uint64_t do_item_alloc_latency_bound(int idx)
+{
+    if (idx < (1 << ALLOC_LAT_SUB_BITS)) {
+        return idx + 1;
+    }
+    int shift = (idx >> ALLOC_LAT_SUB_BITS) - 1;
+    uint64_t sub = (1 << ALLOC_LAT_SUB_BITS) | (idx & ((1 << ALLOC_LAT_SUB_BITS) - 1));
+    return (sub + 1) << shift;
+}
+
+/* evicts up to count items from the tail of the LRU list, returns # of items freed */
+static int do_item_lru_maintain(struct default_engine *engine, int lruid, int count)
+{
+    rel_time_t current_time = engine->server.core->get_current_time();
+    hash_item *search = engine->items.tails[lruid];
+    hash_item *previt;
+    int freed = 0;
+    int tries = count * 2;
+
+    while (search != NULL && freed < count && tries-- > 0) {
+        previt = ITEM_PREV(search);
+        if (search->refcount == 0) {
+            if (do_item_isvalid(engine, search, current_time) == false) {
+                do_item_invalidate(engine, search, lruid, true);
+                freed++;
+            } else if (do_item_lru_rescue(engine, search, lruid) == false) {
+                hash_item *victim = do_item_evict_victim(engine, search, current_time);
+                if (victim != search) {
+                    previt = search; /* still linked */
+                }
+                do_item_evict(engine, victim, lruid, current_time, NULL);
+                engine->items.lru_maint_evicted++;
+                freed++;
+            }
+        } else { /* search->refcount > 0 */
+            /* just unlink the item from LRU list. */
+            item_unlink_q(engine, search);
+        }
+        search = previt;
+    }
+    engine->items.lru_maint_runs++;
+    return freed;
+}
+
+/* returns # of items freed for the headroom */
+static int item_lru_maintain(struct default_engine *engine)
+{
+    unsigned int nshort;
+    int ssl, count, freed = 0;
+
+    if (item_evict_to_free != true) {
+        return 0;
+    }
+
+    /* small memory items: as many as the inline eviction would do */
+    if ((ssl = slabs_space_shortage_check(engine)) > 0) {
+        count = ssl < LRU_MAINT_BATCH ? ssl : LRU_MAINT_BATCH;
+        LOCK_CACHE();
+        freed += do_item_lru_maintain(engine, LRU_CLSID_FOR_SMALL, count);
+        UNLOCK_CACHE();
+    }
+
+    /* large items of the slab classes */
+    for (int id = 1; id <= engine->slabs.power_largest; id++) {
+        if (engine->items.tails[id] == NULL) {
+            continue;
+        }
+        if ((nshort = slabs_headroom_short(engine, id, LRU_MAINT_HEADROOM)) > 0) {
+            count = nshort < LRU_MAINT_BATCH ? nshort : LRU_MAINT_BATCH;
+            LOCK_CACHE();
+            freed += do_item_lru_maintain(engine, id, count);
+            UNLOCK_CACHE();
+        }
+    }
+    return freed;
+}
+
+static void lru_maint_thread_sleep(struct default_engine *engine, long msec)
+{
+    struct timeval  tv;
+    struct timespec to;
+    pthread_mutex_lock(&lru_maint_lock);
+    if (engine->initialized) {
+        gettimeofday(&tv, NULL);
+        tv.tv_usec += msec * 1000;
+        tv.tv_sec += tv.tv_usec / 1000000;
+        tv.tv_usec %= 1000000;
+        to.tv_sec = tv.tv_sec;
+        to.tv_nsec = tv.tv_usec * 1000;
+        lru_maint_sleep = true;
+        pthread_cond_timedwait(&lru_maint_cond, &lru_maint_lock, &to);
+        lru_maint_sleep = false;
+    }
+    pthread_mutex_unlock(&lru_maint_lock);
+}
+
+static void *lru_maint_thread(void *arg)
+{
+    struct default_engine *engine = arg;
+
+    while (engine->initialized) {
+        if (item_lru_maintain(engine) == 0) {
+            lru_maint_thread_sleep(engine, LRU_MAINT_INTERVAL_MS);
+        }
+    }
+    return NULL;
+}
+
+static void lru_maint_thread_wakeup(void)
+{
+    pthread_mutex_lock(&lru_maint_lock);
+    if (lru_maint_sleep == true) {
+        pthread_cond_signal(&lru_maint_cond);
+    }
+    pthread_mutex_unlock(&lru_maint_lock);
+}
+
+/********************************* ITEM ACCESS *******************************/
+
+/*
+ * Allocates a new item.
+ */
+hash_item *item_alloc(struct default_engine *engine,
+                      const void *key, size_t nkey, int flags,
+                      rel_time_t exptime, int nbytes, const void *cookie)
+{
+    hash_item *it;
+    struct timespec start, end;
+    bool timed = engine->config.lru_maintainer || engine->config.alloc_latency;
+    if (timed) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+    LOCK_CACHE();
+    /* key can be NULL */
+    it = do_item_alloc(engine, key, nkey, flags, exptime, nbytes, cookie);
+    UNLOCK_CACHE();
+    if (timed) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        item_alloc_latency(engine, (end.tv_sec - start.tv_sec) * 1000000000ULL
+                                   + end.tv_nsec - start.tv_nsec);
+    }
+    return it;
+}
+
+/*
+ * Lock-free get
+ *
+ * The key-value read path runs in a reader slot without any lock.
+ * It changes only the refcount of the item with atomic operations.
+ * If the cache must be changed, it returns false so that the caller
+ * retries with the exclusive lock.
+ */
+/* returns false if the item must be read with the exclusive lock */
+static inline bool do_item_get_lockfree(struct default_engine *engine, uint32_t hash,
+                                        const void *key, const size_t nkey,
+                                        rel_time_t current_time, hash_item **item)
+{
+    hash_item *it = assoc_find(engine, hash, key, nkey);
+    if (it != NULL) {
+        if (do_item_isvalid(engine, it, current_time) == false ||
+            it->time < current_time - ITEM_UPDATE_INTERVAL ||
+            ITEM_REFCOUNT_INCR_ATOMIC(it) == false) {
+            *item = NULL;
+            return false;
+        }
+    }
+    if (engine->items.lfu_sketch != NULL) {
+        do_item_lfu_record(engine, hash);
+    }
+    *item = it;
+    return true;
+}
+
+static bool item_get_lockfree(struct default_engine *engine, uint32_t hash,
+                              const void *key, const size_t nkey, hash_item **item)
+{
+    rel_time_t current_time = engine->server.core->get_current_time();
+    struct reader_slot *slot;
+    bool done;
+
+    if (engine->config.verbose > 2) {
+        return false;
+    }
+    if ((slot = cache_reader_enter(engine)) == NULL) {
+        return false;
+    }
+    done = do_item_get_lockfree(engine, hash, key, nkey, current_time, item);
+    cache_reader_exit(slot);
+    return done;
+}
+
+static bool item_release_lockfree(struct default_engine *engine, hash_item *it)
+{
+    struct reader_slot *slot;
+    bool done = false;
+
+    if ((slot = cache_reader_enter(engine)) == NULL) {
+        return false;
+    }
+    /* A linked item placed in the LRU list needs nothing but
+     * the refcount decrement, even if the refcount becomes 0.
+     */
+    if ((it->iflag & ITEM_LINKED) != 0 && (ITEM_PREV(it) != it || ITEM_NEXT(it) != it)) {
+        if (ITEM_REFCOUNT_DECR_ATOMIC(it)) {
+            MEMCACHED_ITEM_REMOVE(item_get_key(it), it->nkey, it->nbytes);
+            done = true;
+        }
+    }
+    cache_reader_exit(slot);
+    return done;
+}
+
+/*
+ * Returns an item if it hasn't been marked as expired,
+ * lazy-expiring as needed.
+ */
+hash_item *item_get(struct default_engine *engine, const void *key, const size_t nkey)
+{
+    hash_item *it;
+    uint32_t hash = item_key_hash(engine, key, nkey);
+    if (engine->reader_slots != NULL) {
+        if (item_get_lockfree(engine, hash, key, nkey, &it)) {
+            return it;
+        }
+    }
+    LOCK_CACHE();
+    it = do_item_get_hashed(engine, hash, key, nkey, DO_UPDATE);
+    UNLOCK_CACHE();
+    return it;
+}
+
+/*
+ * Multi-key get
+ *
+ * The keys are resolved ITEM_MGET_BATCH keys at a time. The hashes of
+ * the batch are computed and their hash buckets are prefetched first.
+ * Then, the candidate items are prefetched and all the keys are resolved
+ * under a single lock acquisition (or a single reader slot).
+ * The keys that need the exclusive lock are resolved together afterwards.
+ */
+#define ITEM_MGET_BATCH 64
+
+void item_get_multi(struct default_engine *engine, token_t *karray, const int kcount,
+                    hash_item **items)
+{
+    uint32_t hashes[ITEM_MGET_BATCH];
+    int      retry[ITEM_MGET_BATCH];
+    struct reader_slot *slot;
+    rel_time_t current_time;
+    int i, k, n, nretry;
+
+    for (k = 0; k < kcount; k += n) {
+        n = (kcount - k) < ITEM_MGET_BATCH ? (kcount - k) : ITEM_MGET_BATCH;
+        for (i = 0; i < n; i++) {
+            hashes[i] = item_key_hash(engine, karray[k+i].value, karray[k+i].length);
+            assoc_prefetch_bucket(engine, hashes[i]);
+        }
+
+        current_time = engine->server.core->get_current_time();
+        nretry = 0;
+        if (engine->reader_slots != NULL) {
+            /* The lock-free readers change the refcounts with atomic operations.
+             * So, the batch falls back to the exclusive lock without a reader slot.
+             */
+            if (engine->config.verbose <= 2 && (slot = cache_reader_enter(engine)) != NULL) {
+                for (i = 0; i < n; i++) {
+                    assoc_prefetch_item(engine, hashes[i]);
+                }
+                for (i = 0; i < n; i++) {
+                    if (!do_item_get_lockfree(engine, hashes[i], karray[k+i].value,
+                                              karray[k+i].length, current_time, &items[k+i])) {
+                        retry[nretry++] = i;
+                    }
+                }
+                cache_reader_exit(slot);
+            } else {
+                for (i = 0; i < n; i++) {
+                    retry[nretry++] = i;
+                }
             }
         }
+        else {
+            for (i = 0; i < n; i++) {
+                retry[nretry++] = i;
+            }
+        }
+
+        if (nretry > 0) {
+            LOCK_CACHE();
+            for (i = 0; i < nretry; i++) {
+                assoc_prefetch_item(engine, hashes[retry[i]]);
+            }
+            for (i = 0; i < nretry; i++) {
+                int ki = k + retry[i];
+                items[ki] = do_item_get_hashed(engine, hashes[retry[i]], karray[ki].value,
+                                               karray[ki].length, DO_UPDATE);
+            }
+            UNLOCK_CACHE();
+        }
     }
-    return NULL;
 }
 
-void coll_del_thread_wakeup(void)
+/*
+ * Decrements the reference count on an item and adds it to the freelist if
+ * needed.
+ */
+void item_release(struct default_engine *engine, hash_item *item)
 {
-    pthread_mutex_lock(&coll_del_lock);
-    if (coll_del_sleep == true) {
-        /* wake up collection delete thead */
-        pthread_cond_signal(&coll_del_cond);
+    if (engine->reader_slots != NULL) {
+        if (item_release_lockfree(engine, item)) {
+            return;
+        }
     }
-    pthread_mutex_unlock(&coll_del_lock);
+    LOCK_CACHE();
+    do_item_release(engine, item);
+    UNLOCK_CACHE();
 }
 
-/********************************* ITEM ACCESS *******************************/
-
 /*
- * Allocates a new item.
+ * Collection read
+ *
+ * A collection read without deletion finds and pins the collection item,
+ * and then reads the collection in one of the following lock states.
+ *   - the shared collection lock only, if collection locks are enabled.
+ *   - the shared cache lock, if shared collection read is enabled.
+ *   - the exclusive cache lock, otherwise.
+ * With shared collection read, the item is found and pinned under the
+ * shared cache lock, and its LRU reposition is deferred to the per-thread
+ * LRU buffer. If the cache must be changed (lazy expiration, a full buffer),
+ * the read falls back to the exclusive cache lock.
  */
-hash_item *item_alloc(struct default_engine *engine,
-                      const void *key, size_t nkey, int flags,
-                      rel_time_t exptime, int nbytes, const void *cookie)
+struct coll_reader {
+    pthread_rwlock_t *coll_lock; /* shared collection lock held */
+    bool              shared;    /* shared cache lock used */
+};
+
+static bool do_lru_defer_update(struct default_engine *engine, hash_item *it)
 {
-    hash_item *it;
-    pthread_mutex_lock(&engine->cache_lock);
-    /* key can be NULL */
-    it = do_item_alloc(engine, key, nkey, flags, exptime, nbytes, cookie);
-    pthread_mutex_unlock(&engine->cache_lock);
-    return it;
+    struct lru_buffer *buffer;
+
+    if (lru_buffer_id > MAX_READER_SLOTS) {
+        lru_buffer_id = __sync_fetch_and_add(&engine->lru_buffer_count, 1);
+        if (lru_buffer_id > MAX_READER_SLOTS) {
+            lru_buffer_id = MAX_READER_SLOTS;
+        }
+    }
+    if (lru_buffer_id == MAX_READER_SLOTS) {
+        return false; /* no LRU buffer left */
+    }
+    buffer = &engine->lru_buffers[lru_buffer_id];
+    if (buffer->count >= LRU_BUFFER_SIZE) {
+        return false;
+    }
+    buffer->items[buffer->count++] = it;
+    __sync_add_and_fetch(&engine->lru_deferred, 1);
+    return true;
 }
 
-/*
- * Returns an item if it hasn't been marked as expired,
- * lazy-expiring as needed.
+/* The refcount is changed atomically, since the other shared readers
+ * and the lock-free readers change it at the same time.
  */
-hash_item *item_get(struct default_engine *engine, const void *key, const size_t nkey)
+static bool item_pin_shared(struct default_engine *engine, hash_item *it)
 {
-    hash_item *it;
-    pthread_mutex_lock(&engine->cache_lock);
-    it = do_item_get(engine, key, nkey, DO_UPDATE);
-    pthread_mutex_unlock(&engine->cache_lock);
-    return it;
+    return ITEM_REFCOUNT_INCR_ATOMIC(it);
 }
 
-/*
- * Decrements the reference count on an item and adds it to the freelist if
- * needed.
+static bool item_unpin_shared(struct default_engine *engine, hash_item *it)
+{
+    bool unpinned = false;
+    /* A linked item placed in the LRU list needs nothing but
+     * the refcount decrement, even if the refcount becomes 0.
+     */
+    if ((it->iflag & ITEM_LINKED) != 0 && (ITEM_PREV(it) != it || ITEM_NEXT(it) != it)) {
+        unpinned = ITEM_REFCOUNT_DECR_ATOMIC(it);
+        if (unpinned) {
+            MEMCACHED_ITEM_REMOVE(item_get_key(it), it->nkey, it->nbytes);
+        }
+    }
+    return unpinned;
+}
+
+/* The shared cache lock must be held.
+ * Returns false if the read must fall back to the exclusive cache lock.
  */
-void item_release(struct default_engine *engine, hash_item *item)
+static bool do_coll_item_find_shared(struct default_engine *engine,
+                                     const char *key, const size_t nkey, const uint8_t type,
+                                     hash_item **item, ENGINE_ERROR_CODE *ret)
 {
-    pthread_mutex_lock(&engine->cache_lock);
-    do_item_release(engine, item);
-    pthread_mutex_unlock(&engine->cache_lock);
+    rel_time_t current_time = engine->server.core->get_current_time();
+    const char *hkey = (nkey > MAX_HKEY_LEN) ? key+(nkey-MAX_HKEY_LEN) : key;
+    const size_t hnkey = (nkey > MAX_HKEY_LEN) ? MAX_HKEY_LEN : nkey;
+    hash_item *it = assoc_find(engine, engine->server.core->hash(hkey, hnkey, 0), key, nkey);
+
+    *item = NULL;
+    if (it == NULL) {
+        *ret = ENGINE_KEY_ENOENT;
+        return true;
+    }
+    if (do_item_isvalid(engine, it, current_time) == false) {
+        return false;
+    }
+    if (GET_ITEM_TYPE(it) != type) {
+        *ret = ENGINE_EBADTYPE;
+        return true;
+    }
+    if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
+        if (do_lru_defer_update(engine, it) == false) {
+            return false;
+        }
+    }
+    if (item_pin_shared(engine, it) == false) {
+        return false;
+    }
+    *item = it;
+    *ret = ENGINE_SUCCESS;
+    return true;
+}
+
+static ENGINE_ERROR_CODE coll_read_find(struct default_engine *engine,
+                                        const char *key, const size_t nkey, const uint8_t type,
+                                        hash_item **item, struct coll_reader *reader)
+{
+    hash_item *it = NULL;
+    ENGINE_ERROR_CODE ret = ENGINE_KEY_ENOENT;
+
+    reader->coll_lock = NULL;
+    reader->shared = false;
+    if (engine->lru_buffers != NULL && engine->config.verbose <= 2) {
+        pthread_rwlock_rdlock(&engine->cache_lock);
+        if (do_coll_item_find_shared(engine, key, nkey, type, &it, &ret)) {
+            reader->shared = true;
+        } else {
+            pthread_rwlock_unlock(&engine->cache_lock);
+        }
+    }
+    if (reader->shared == false) {
+        LOCK_CACHE();
+        it = do_item_get(engine, key, nkey, DO_UPDATE);
+        if (it == NULL) {
+            ret = ENGINE_KEY_ENOENT;
+        } else if (GET_ITEM_TYPE(it) != type) {
+            do_item_release(engine, it);
+            it = NULL;
+            ret = ENGINE_EBADTYPE;
+        } else {
+            ret = ENGINE_SUCCESS;
+        }
+    }
+    if (ret != ENGINE_SUCCESS) {
+        if (reader->shared) {
+            pthread_rwlock_unlock(&engine->cache_lock);
+        } else {
+            UNLOCK_CACHE();
+        }
+        *item = NULL;
+        return ret;
+    }
+
+    /* switch to the shared collection lock.
+     * The cache lock must be released first, since an updater
+     * takes the collection lock before the cache lock.
+     */
+    if (engine->coll_locks != NULL) {
+        if (reader->shared) {
+            pthread_rwlock_unlock(&engine->cache_lock);
+        } else {
+            UNLOCK_CACHE();
+        }
+        reader->coll_lock = &engine->coll_locks[it->khash & engine->coll_lock_mask];
+        pthread_rwlock_rdlock(reader->coll_lock);
+    }
+    *item = it;
+    return ENGINE_SUCCESS;
+}
+
+static void coll_read_release(struct default_engine *engine, hash_item *it,
+                              struct coll_reader *reader)
+{
+    if (reader->coll_lock != NULL) {
+        pthread_rwlock_unlock(reader->coll_lock);
+        if (engine->lru_buffers != NULL) {
+            pthread_rwlock_rdlock(&engine->cache_lock);
+            reader->shared = true;
+        } else {
+            LOCK_CACHE();
+            reader->shared = false;
+        }
+    }
+    if (reader->shared) {
+        bool done = item_unpin_shared(engine, it);
+        pthread_rwlock_unlock(&engine->cache_lock);
+        if (done) {
+            return;
+        }
+        LOCK_CACHE();
+    }
+    do_item_release(engine, it);
+    UNLOCK_CACHE();
 }
 
 /*
@@ -6002,9 +8236,9 @@ ENGINE_ERROR_CODE store_item(struct default_engine *engine,
 {
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     ret = do_store_item(engine, item, cas, operation, cookie);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
@@ -6067,10 +8301,10 @@ ENGINE_ERROR_CODE arithmetic(struct default_engine *engine,
 {
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     ret = do_arithmetic(engine, cookie, key, nkey, increment,
                         create, delta, initial, flags, exptime, cas, result);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
@@ -6104,9 +8338,9 @@ ENGINE_ERROR_CODE item_delete(struct default_engine *engine,
 {
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     ret = do_item_delete(engine, key, nkey, cas);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
@@ -6168,14 +8402,16 @@ static ENGINE_ERROR_CODE do_item_flush_expired(struct default_engine *engine,
              * only need to walk back until we hit an item older than the
              * oldest_live time.
              * The oldest_live checking will auto-expire the remaining items.
+             * The segmented LRU isn't sorted since a hit doesn't move
+             * the item, so the whole list is walked.
              */
             for (iter = engine->items.heads[i]; iter != NULL; iter = next) {
                 if (iter->time >= oldest_live) {
-                    next = iter->next;
+                    next = ITEM_NEXT(iter);
                     if (nprefix < 0) { /* flush all */
                         do_item_unlink(engine, iter, ITEM_UNLINK_INVALID);
                     } else if (nprefix == 0) { /* flush null prefix */
-                        if (iter->pfxptr->nprefix == 0) {
+                        if (ITEM_PREFIX(iter)->nprefix == 0) {
                             do_item_unlink(engine, iter, ITEM_UNLINK_INVALID);
                         }
                     } else { /* nprefix > 0: flush given prefix */
@@ -6185,6 +8421,8 @@ static ENGINE_ERROR_CODE do_item_flush_expired(struct default_engine *engine,
                             do_item_unlink(engine, iter, ITEM_UNLINK_INVALID);
                         }
                     }
+                } else if (engine->config.lru_segmented) {
+                    next = ITEM_NEXT(iter);
                 } else {
                     /* We've hit the first old item. Continue to the next queue. */
                     /* reset lowMK and curMK to tail pointer */
@@ -6193,14 +8431,18 @@ static ENGINE_ERROR_CODE do_item_flush_expired(struct default_engine *engine,
                     break;
                 }
             }
+            if (engine->config.lru_segmented) {
+                engine->items.lowMK[i] = engine->items.tails[i];
+                engine->items.curMK[i] = engine->items.tails[i];
+            }
 #ifdef ENABLE_STICKY_ITEM
             for (iter = engine->items.sticky_heads[i]; iter != NULL; iter = next) {
                 if (iter->time >= oldest_live) {
-                    next = iter->next;
+                    next = ITEM_NEXT(iter);
                     if (nprefix < 0) { /* flush all */
                         do_item_unlink(engine, iter, ITEM_UNLINK_INVALID);
                     } else if (nprefix == 0) { /* flush null prefix */
-                        if (iter->pfxptr->nprefix == 0) {
+                        if (ITEM_PREFIX(iter)->nprefix == 0) {
                             do_item_unlink(engine, iter, ITEM_UNLINK_INVALID);
                         }
                     } else { /* nprefix > 0: flush given prefix */
@@ -6228,9 +8470,9 @@ ENGINE_ERROR_CODE item_flush_expired(struct default_engine *engine,
                                      time_t when, const void* cookie)
 {
     ENGINE_ERROR_CODE ret;
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     ret = do_item_flush_expired(engine, prefix, nprefix, when, cookie);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
@@ -6242,33 +8484,140 @@ char *item_cachedump(struct default_engine *engine,
                      const bool sticky, unsigned int *bytes)
 {
     char *ret;
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     ret = do_item_cachedump(engine, slabs_clsid, limit, forward, sticky, bytes);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
 void item_stats(struct default_engine *engine,
                    ADD_STAT add_stat, const void *cookie)
 {
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     do_item_stats(engine, add_stat, cookie);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+}
+
+/* Memory accounting of the linked items by type, and of the collection
+ * overhead: the item headers holding the meta info, and the nodes of the
+ * set/map hash tables and b+trees. The nodes are counted until freed,
+ * also while the elements of unlinked collections are being deleted.
+ */
+void item_memory_stats(struct default_engine *engine,
+                       ADD_STAT add_stat, const void *cookie)
+{
+    static const char *type_names[ITEM_TYPE_MAX] = { "kv", "list", "set", "map", "btree" };
+    uint64_t type_items[ITEM_TYPE_MAX], type_bytes[ITEM_TYPE_MAX];
+    uint64_t node_bytes[ITEM_TYPE_MAX], meta_bytes, wheel_bytes;
+    char key[32];
+    int i;
+
+    LOCK_CACHE();
+    pthread_mutex_lock(&engine->stats.lock);
+    memcpy(type_items, engine->stats.type_items, sizeof(type_items));
+    memcpy(type_bytes, engine->stats.type_bytes, sizeof(type_bytes));
+    memcpy(node_bytes, engine->stats.coll_node_bytes, sizeof(node_bytes));
+    meta_bytes = engine->stats.coll_meta_bytes;
+    pthread_mutex_unlock(&engine->stats.lock);
+    wheel_bytes = engine->items.expiry_wheel != NULL ? engine->items.expiry_wheel->bytes : 0;
+    UNLOCK_CACHE();
+
+    for (i = 0; i < ITEM_TYPE_MAX; i++) {
+        snprintf(key, sizeof(key), "%s_items", type_names[i]);
+        add_statistics(cookie, add_stat, NULL, -1, key, "%"PRIu64, type_items[i]);
+        snprintf(key, sizeof(key), "%s_bytes", type_names[i]);
+        add_statistics(cookie, add_stat, NULL, -1, key, "%"PRIu64, type_bytes[i]);
+    }
+    add_statistics(cookie, add_stat, NULL, -1, "overhead_meta_bytes", "%"PRIu64, meta_bytes);
+    add_statistics(cookie, add_stat, NULL, -1, "overhead_set_node_bytes", "%"PRIu64,
+                   node_bytes[ITEM_TYPE_SET]);
+    add_statistics(cookie, add_stat, NULL, -1, "overhead_map_node_bytes", "%"PRIu64,
+                   node_bytes[ITEM_TYPE_MAP]);
+    add_statistics(cookie, add_stat, NULL, -1, "overhead_btree_node_bytes", "%"PRIu64,
+                   node_bytes[ITEM_TYPE_BTREE]);
+    if (engine->items.expiry_wheel != NULL) {
+        add_statistics(cookie, add_stat, NULL, -1, "overhead_expiry_wheel_bytes", "%"PRIu64,
+                       wheel_bytes);
+    }
+}
+
+void item_expiry_stats(struct default_engine *engine,
+                       ADD_STAT add_stat, const void *cookie)
+{
+    struct expiry_wheel *wheel = engine->items.expiry_wheel;
+    uint64_t entries, reaped, dropped;
+
+    if (wheel == NULL) {
+        return;
+    }
+    LOCK_CACHE();
+    entries = wheel->entries;
+    reaped = wheel->reaped;
+    dropped = wheel->dropped;
+    UNLOCK_CACHE();
+
+    add_statistics(cookie, add_stat, NULL, -1, "expiry_wheel_entries", "%"PRIu64, entries);
+    add_statistics(cookie, add_stat, NULL, -1, "expiry_reaped", "%"PRIu64, reaped);
+    add_statistics(cookie, add_stat, NULL, -1, "expiry_wheel_dropped", "%"PRIu64, dropped);
+}
+
+void item_alloc_stats(struct default_engine *engine,
+                      ADD_STAT add_stat, const void *cookie)
+{
+    static const struct {
+        const char *name;
+        double      ratio;
+    } percentiles[] = { { "alloc_latency_p50", 0.5 },
+                        { "alloc_latency_p99", 0.99 },
+                        { "alloc_latency_p999", 0.999 } };
+    uint64_t hist[ALLOC_LAT_BUCKETS];
+    uint64_t total = 0, sum;
+    uint64_t runs, evicted;
+    int i, idx;
+
+    if (!engine->config.lru_maintainer && !engine->config.alloc_latency) {
+        return;
+    }
+    LOCK_CACHE();
+    memcpy(hist, engine->items.alloc_lat_hist, sizeof(hist));
+    runs = engine->items.lru_maint_runs;
+    evicted = engine->items.lru_maint_evicted;
+    UNLOCK_CACHE();
+
+    for (idx = 0; idx < ALLOC_LAT_BUCKETS; idx++) {
+        total += hist[idx];
+    }
+    add_statistics(cookie, add_stat, NULL, -1, "alloc_latency_count", "%"PRIu64, total);
+    /* in microseconds, the upper bound of the bucket */
+    for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        sum = 0;
+        for (idx = 0; idx < ALLOC_LAT_BUCKETS - 1; idx++) {
+            sum += hist[idx];
+            if (sum > 0 && sum >= total * percentiles[i].ratio) break;
+        }
+        add_statistics(cookie, add_stat, NULL, -1, percentiles[i].name, "%.3f",
+                       total > 0 ? do_item_alloc_latency_bound(idx) / 1000.0 : 0.0);
+    }
+    if (engine->config.lru_maintainer) {
+        add_statistics(cookie, add_stat, NULL, -1, "lru_maintainer_runs", "%"PRIu64, runs);
+        add_statistics(cookie, add_stat, NULL, -1, "lru_maintainer_evicted", "%"PRIu64, evicted);
+    }
 }
 
 void item_stats_sizes(struct default_engine *engine,
                       ADD_STAT add_stat, const void *cookie)
 {
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     do_item_stats_sizes(engine, add_stat, cookie);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 }
 
 void item_stats_reset(struct default_engine *engine)
 {
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     memset(engine->items.itemstats, 0, sizeof(engine->items.itemstats));
-    pthread_mutex_unlock(&engine->cache_lock);
+    memset(engine->items.alloc_lat_hist, 0, sizeof(engine->items.alloc_lat_hist));
+    UNLOCK_CACHE();
 }
 
 
@@ -6282,6 +8631,23 @@ ENGINE_ERROR_CODE item_init(struct default_engine *engine)
     coll_del_queue.size = 0;
     coll_del_sleep = false;
 
+    pthread_mutex_init(&assoc_maint_lock, NULL);
+    pthread_cond_init(&assoc_maint_cond, NULL);
+
+    pthread_mutex_init(&slab_automove_lock, NULL);
+    pthread_cond_init(&slab_automove_cond, NULL);
+
+    pthread_mutex_init(&sm_compact_lock, NULL);
+    pthread_cond_init(&sm_compact_cond, NULL);
+
+    pthread_mutex_init(&memlimit_shrink_lock, NULL);
+    pthread_cond_init(&memlimit_shrink_cond, NULL);
+    pthread_mutex_init(&expiry_reap_lock, NULL);
+    pthread_cond_init(&expiry_reap_cond, NULL);
+    pthread_mutex_init(&lru_maint_lock, NULL);
+    pthread_cond_init(&lru_maint_cond, NULL);
+    lru_maint_sleep = false;
+
     item_evict_to_free = engine->config.evict_to_free;
 
     /* adjust maximum collection size */
@@ -6306,6 +8672,100 @@ ENGINE_ERROR_CODE item_init(struct default_engine *engine)
     logger->log(EXTENSION_LOG_INFO, NULL, "maximum map   size = %d\n", max_map_size);
     logger->log(EXTENSION_LOG_INFO, NULL, "maximum btree size = %d\n", max_btree_size);
 
+    /* collection locks: round up to a power of 2 */
+    if (engine->config.coll_lock_stripes > 0) {
+        pthread_rwlockattr_t attr;
+        uint32_t nlocks = 1;
+        if (engine->config.coll_lock_stripes > MAX_LOCK_STRIPES) {
+            engine->config.coll_lock_stripes = MAX_LOCK_STRIPES;
+        }
+        while (nlocks < engine->config.coll_lock_stripes) {
+            nlocks <<= 1;
+        }
+        engine->coll_locks = malloc(sizeof(pthread_rwlock_t) * nlocks);
+        if (engine->coll_locks == NULL) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't allocate %u collection locks.\n", nlocks);
+            return ENGINE_ENOMEM;
+        }
+        pthread_rwlockattr_init(&attr);
+#ifdef PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+        /* do not starve collection updates behind long reads */
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+        for (uint32_t i = 0; i < nlocks; i++) {
+            pthread_rwlock_init(&engine->coll_locks[i], &attr);
+        }
+        pthread_rwlockattr_destroy(&attr);
+        engine->coll_lock_mask = nlocks - 1;
+        engine->config.coll_lock_stripes = nlocks;
+        logger->log(EXTENSION_LOG_INFO, NULL, "collection locks = %u\n", nlocks);
+    }
+
+    /* shared collection read: LRU buffers */
+    if (engine->config.shared_coll_read) {
+        engine->lru_buffers = calloc(MAX_READER_SLOTS, sizeof(struct lru_buffer));
+        if (engine->lru_buffers == NULL) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't allocate LRU buffers for shared collection read.\n");
+            return ENGINE_ENOMEM;
+        }
+        logger->log(EXTENSION_LOG_INFO, NULL, "shared collection read enabled.\n");
+    }
+
+    /* eviction policy */
+    if (engine->config.eviction_policy == NULL ||
+        strcmp(engine->config.eviction_policy, "lru") == 0) {
+        engine->items.evict_policy = EVICT_POLICY_LRU;
+    } else if (strcmp(engine->config.eviction_policy, "gdsf") == 0) {
+        engine->items.evict_policy = EVICT_POLICY_GDSF;
+        logger->log(EXTENSION_LOG_INFO, NULL, "GDSF eviction enabled.\n");
+    } else {
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "eviction_policy must be lru or gdsf.\n");
+        return ENGINE_EBADVALUE;
+    }
+
+    /* LFU admission and GDSF eviction: a row of the sketch per KB of memory,
+     * rounded up to a power of 2 */
+    if (engine->config.lfu_admission || engine->items.evict_policy == EVICT_POLICY_GDSF) {
+        uint32_t width = LFU_WIDTH_MIN;
+        while (width < LFU_WIDTH_MAX && width < engine->config.maxbytes / 1024) {
+            width <<= 1;
+        }
+        engine->items.lfu_sketch = calloc(LFU_SKETCH_DEPTH, width);
+        if (engine->items.lfu_sketch == NULL) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't allocate the frequency sketch.\n");
+            return ENGINE_ENOMEM;
+        }
+        engine->items.lfu_width = width;
+        engine->items.lfu_additions = 0;
+        logger->log(EXTENSION_LOG_INFO, NULL, "frequency sketch width = %u\n", width);
+    }
+
+    /* expiry timing wheel */
+    if (engine->config.expiry_reap_rate > 0) {
+        engine->items.expiry_wheel = calloc(1, sizeof(struct expiry_wheel));
+        if (engine->items.expiry_wheel == NULL) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't allocate the expiry timing wheel.\n");
+            return ENGINE_ENOMEM;
+        }
+        engine->items.expiry_wheel->current = engine->server.core->get_current_time();
+    }
+
+    /* lock-free get: reader slots */
+    if (engine->config.lockfree_get) {
+        engine->reader_slots = calloc(MAX_READER_SLOTS, sizeof(struct reader_slot));
+        if (engine->reader_slots == NULL) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't allocate reader slots for lock-free get.\n");
+            return ENGINE_ENOMEM;
+        }
+        logger->log(EXTENSION_LOG_INFO, NULL, "lock-free get enabled.\n");
+    }
+
     int ret = pthread_create(&coll_del_tid, NULL, collection_delete_thread, engine);
     if (ret != 0) {
         logger->log(EXTENSION_LOG_WARNING, NULL,
@@ -6313,6 +8773,72 @@ ENGINE_ERROR_CODE item_init(struct default_engine *engine)
         return ENGINE_FAILED;
     }
 
+    /* hash table expansion is done by the assoc maintainer thread */
+    engine->assoc.expand_bg = true;
+    ret = pthread_create(&assoc_maint_tid, NULL, assoc_maintainer_thread, engine);
+    if (ret != 0) {
+        engine->assoc.expand_bg = false;
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Can't create thread: %s\n", strerror(ret));
+        return ENGINE_FAILED;
+    }
+
+    /* slab pages are moved by the slab automover if slab_reassign is enabled */
+    if (engine->config.slab_reassign) {
+        ret = pthread_create(&slab_automove_tid, NULL, slab_automove_thread, engine);
+        if (ret != 0) {
+            engine->config.slab_reassign = false;
+            engine->config.slab_automove = false;
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't create thread: %s\n", strerror(ret));
+            return ENGINE_FAILED;
+        }
+    }
+
+    /* sparse small memory blocks are evacuated by the sm compactor */
+    if (engine->config.sm_compact) {
+        ret = pthread_create(&sm_compact_tid, NULL, sm_compact_thread, engine);
+        if (ret != 0) {
+            engine->config.sm_compact = false;
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't create thread: %s\n", strerror(ret));
+            return ENGINE_FAILED;
+        }
+    }
+
+    /* a smaller memlimit is reached by the memlimit shrinker */
+    if (engine->config.memlimit_shrink_rate > 0) {
+        ret = pthread_create(&memlimit_shrink_tid, NULL, memlimit_shrink_thread, engine);
+        if (ret != 0) {
+            engine->config.memlimit_shrink_rate = 0;
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't create thread: %s\n", strerror(ret));
+            return ENGINE_FAILED;
+        }
+    }
+
+    /* expired items are freed by the expiry reaper */
+    if (engine->config.expiry_reap_rate > 0) {
+        ret = pthread_create(&expiry_reap_tid, NULL, expiry_reap_thread, engine);
+        if (ret != 0) {
+            engine->config.expiry_reap_rate = 0;
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't create thread: %s\n", strerror(ret));
+            return ENGINE_FAILED;
+        }
+    }
+
+    /* the free memory headroom is kept by the LRU maintainer */
+    if (engine->config.lru_maintainer) {
+        ret = pthread_create(&lru_maint_tid, NULL, lru_maint_thread, engine);
+        if (ret != 0) {
+            engine->config.lru_maintainer = false;
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Can't create thread: %s\n", strerror(ret));
+            return ENGINE_FAILED;
+        }
+    }
+
     /* remove unused function warnings */
     if (1) {
         uint64_t val1 = 10;
@@ -6329,6 +8855,28 @@ void item_final(struct default_engine *engine)
     item_stop_dump(engine);
     coll_del_thread_wakeup();
     pthread_join(coll_del_tid, NULL);
+    assoc_maint_thread_wakeup();
+    pthread_join(assoc_maint_tid, NULL);
+    if (engine->config.slab_reassign) {
+        slab_automove_thread_wakeup();
+        pthread_join(slab_automove_tid, NULL);
+    }
+    if (engine->config.sm_compact) {
+        sm_compact_thread_wakeup();
+        pthread_join(sm_compact_tid, NULL);
+    }
+    if (engine->config.memlimit_shrink_rate > 0) {
+        memlimit_shrink_thread_wakeup();
+        pthread_join(memlimit_shrink_tid, NULL);
+    }
+    if (engine->config.expiry_reap_rate > 0) {
+        expiry_reap_thread_wakeup();
+        pthread_join(expiry_reap_tid, NULL);
+    }
+    if (engine->config.lru_maintainer) {
+        lru_maint_thread_wakeup();
+        pthread_join(lru_maint_tid, NULL);
+    }
 
     /* wait until scrubber thread is finished */
     int sleep_count = 0;
@@ -6351,6 +8899,36 @@ void item_final(struct default_engine *engine)
         logger->log(EXTENSION_LOG_INFO, NULL,
                 "Waited %d ms for dumper to be stopped.\n", sleep_count);
     }
+
+    if (engine->reader_slots != NULL) {
+        free(engine->reader_slots);
+        engine->reader_slots = NULL;
+    }
+    if (engine->coll_locks != NULL) {
+        for (uint32_t i = 0; i <= engine->coll_lock_mask; i++) {
+            pthread_rwlock_destroy(&engine->coll_locks[i]);
+        }
+        free(engine->coll_locks);
+        engine->coll_locks = NULL;
+    }
+    if (engine->lru_buffers != NULL) {
+        free(engine->lru_buffers);
+        engine->lru_buffers = NULL;
+    }
+    if (engine->items.lfu_sketch != NULL) {
+        free(engine->items.lfu_sketch);
+        engine->items.lfu_sketch = NULL;
+    }
+    if (engine->items.expiry_wheel != NULL) {
+        for (int i = 0; i < EXPIRY_WHEEL_LEVELS; i++) {
+            for (int j = 0; j < EXPIRY_WHEEL_SLOTS; j++) {
+                do_expiry_slot_free(engine, &engine->items.expiry_wheel->slots[i][j]);
+            }
+        }
+        do_expiry_slot_free(engine, &engine->items.expiry_wheel->reaping);
+        free(engine->items.expiry_wheel);
+        engine->items.expiry_wheel = NULL;
+    }
     logger->log(EXTENSION_LOG_INFO, NULL, "ITEM module destroyed.\n");
 }
 
@@ -6364,7 +8942,7 @@ ENGINE_ERROR_CODE list_struct_create(struct default_engine *engine,
     ENGINE_ERROR_CODE ret;
     hash_item *it;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     it = do_item_get(engine, key, nkey, DONT_UPDATE);
     if (it != NULL) {
         do_item_release(engine, it);
@@ -6378,7 +8956,7 @@ ENGINE_ERROR_CODE list_struct_create(struct default_engine *engine,
             do_item_release(engine, it);
         }
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
@@ -6386,9 +8964,8 @@ list_elem_item *list_elem_alloc(struct default_engine *engine,
                                 const int nbytes, const void *cookie)
 {
     list_elem_item *elem;
-    pthread_mutex_lock(&engine->cache_lock);
-    elem = do_list_elem_alloc(engine, nbytes, cookie);
-    pthread_mutex_unlock(&engine->cache_lock);
+    /* the cache lock is taken only if the magazine can't give the memory */
+    elem = do_list_elem_alloc(engine, nbytes, cookie, false);
     return elem;
 }
 
@@ -6396,15 +8973,15 @@ void list_elem_release(struct default_engine *engine,
                        list_elem_item **elem_array, const int elem_count)
 {
     int cnt = 0;
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     while (cnt < elem_count) {
         do_list_elem_release(engine, elem_array[cnt++]);
         if ((cnt % 100) == 0 && cnt < elem_count) {
-            pthread_mutex_unlock(&engine->cache_lock);
-            pthread_mutex_lock(&engine->cache_lock);
+            UNLOCK_CACHE();
+            LOCK_CACHE();
         }
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 }
 
 ENGINE_ERROR_CODE list_elem_insert(struct default_engine *engine,
@@ -6414,11 +8991,13 @@ ENGINE_ERROR_CODE list_elem_insert(struct default_engine *engine,
                                    bool *created, const void *cookie)
 {
     hash_item *it = NULL;
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
     *created = false;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_list_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_KEY_ENOENT && attrp != NULL) {
         it = do_list_item_alloc(engine, key, nkey, attrp, cookie);
@@ -6440,7 +9019,8 @@ ENGINE_ERROR_CODE list_elem_insert(struct default_engine *engine,
         }
     }
     if (it != NULL) do_item_release(engine, it);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -6480,9 +9060,11 @@ ENGINE_ERROR_CODE list_elem_delete(struct default_engine *engine,
     list_meta_info *info;
     int      index;
     uint32_t count;
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_list_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_SUCCESS) {
         do {
@@ -6513,7 +9095,8 @@ ENGINE_ERROR_CODE list_elem_delete(struct default_engine *engine,
         } while(0);
         do_item_release(engine, it);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -6529,10 +9112,17 @@ ENGINE_ERROR_CODE list_elem_get(struct default_engine *engine,
     int      index;
     uint32_t count;
     bool forward;
+    struct coll_reader reader;
+    pthread_rwlock_t *coll_lock = NULL;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
-    ret = do_list_item_find(engine, key, nkey, DO_UPDATE, &it);
+    if (delete) {
+        coll_lock = coll_write_begin(engine, key, nkey);
+        LOCK_CACHE();
+        ret = do_list_item_find(engine, key, nkey, DO_UPDATE, &it);
+    } else {
+        ret = coll_read_find(engine, key, nkey, ITEM_IFLAG_LIST, &it, &reader);
+    }
     if (ret == ENGINE_SUCCESS) {
         do {
             info = (list_meta_info *)item_get_meta(it);
@@ -6566,9 +9156,16 @@ ENGINE_ERROR_CODE list_elem_get(struct default_engine *engine,
                 /* ret = ENGINE_ELEM_ENOENT */
             }
         } while(0);
-        do_item_release(engine, it);
+        if (delete) {
+            do_item_release(engine, it);
+        } else {
+            coll_read_release(engine, it, &reader);
+        }
+    }
+    if (delete) {
+        UNLOCK_CACHE();
+        coll_write_end(coll_lock);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
 
@@ -6582,7 +9179,7 @@ ENGINE_ERROR_CODE set_struct_create(struct default_engine *engine,
     ENGINE_ERROR_CODE ret;
     hash_item *it;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     it = do_item_get(engine, key, nkey, DONT_UPDATE);
     if (it != NULL) {
         do_item_release(engine, it);
@@ -6596,42 +9193,43 @@ ENGINE_ERROR_CODE set_struct_create(struct default_engine *engine,
             do_item_release(engine, it);
         }
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
 set_elem_item *set_elem_alloc(struct default_engine *engine, const int nbytes, const void *cookie)
 {
     set_elem_item *elem;
-    pthread_mutex_lock(&engine->cache_lock);
-    elem = do_set_elem_alloc(engine, nbytes, cookie);
-    pthread_mutex_unlock(&engine->cache_lock);
+    /* the cache lock is taken only if the magazine can't give the memory */
+    elem = do_set_elem_alloc(engine, nbytes, cookie, false);
     return elem;
 }
 
 void set_elem_release(struct default_engine *engine, set_elem_item **elem_array, const int elem_count)
 {
     int cnt = 0;
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     while (cnt < elem_count) {
         do_set_elem_release(engine, elem_array[cnt++]);
         if ((cnt % 100) == 0 && cnt < elem_count) {
-            pthread_mutex_unlock(&engine->cache_lock);
-            pthread_mutex_lock(&engine->cache_lock);
+            UNLOCK_CACHE();
+            LOCK_CACHE();
         }
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 }
 
 ENGINE_ERROR_CODE set_elem_insert(struct default_engine *engine, const char *key, const size_t nkey,
                                   set_elem_item *elem, item_attr *attrp, bool *created, const void *cookie)
 {
     hash_item *it = NULL;
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
     *created = false;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_set_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_KEY_ENOENT && attrp != NULL) {
         it = do_set_item_alloc(engine, key, nkey, attrp, cookie);
@@ -6653,7 +9251,8 @@ ENGINE_ERROR_CODE set_elem_insert(struct default_engine *engine, const char *key
         }
     }
     if (it != NULL) do_item_release(engine, it);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -6664,11 +9263,13 @@ ENGINE_ERROR_CODE set_elem_delete(struct default_engine *engine,
 {
     hash_item     *it;
     set_meta_info *info;
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
     *dropped = false;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_set_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_SUCCESS) { /* it != NULL */
         info = (set_meta_info *)item_get_meta(it);
@@ -6682,7 +9283,8 @@ ENGINE_ERROR_CODE set_elem_delete(struct default_engine *engine,
         }
         do_item_release(engine, it);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -6693,10 +9295,10 @@ ENGINE_ERROR_CODE set_elem_exist(struct default_engine *engine,
 {
     hash_item     *it;
     set_meta_info *info;
+    struct coll_reader reader;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
-    ret = do_set_item_find(engine, key, nkey, DO_UPDATE, &it);
+    ret = coll_read_find(engine, key, nkey, ITEM_IFLAG_SET, &it, &reader);
     if (ret == ENGINE_SUCCESS) {
         info = (set_meta_info *)item_get_meta(it);
         do {
@@ -6708,9 +9310,8 @@ ENGINE_ERROR_CODE set_elem_exist(struct default_engine *engine,
             else
                 *exist = false;
         } while (0);
-        do_item_release(engine, it);
+        coll_read_release(engine, it, &reader);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
 
@@ -6722,10 +9323,17 @@ ENGINE_ERROR_CODE set_elem_get(struct default_engine *engine,
 {
     hash_item     *it;
     set_meta_info *info;
+    struct coll_reader reader;
+    pthread_rwlock_t *coll_lock = NULL;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
-    ret = do_set_item_find(engine, key, nkey, DO_UPDATE, &it);
+    if (delete) {
+        coll_lock = coll_write_begin(engine, key, nkey);
+        LOCK_CACHE();
+        ret = do_set_item_find(engine, key, nkey, DO_UPDATE, &it);
+    } else {
+        ret = coll_read_find(engine, key, nkey, ITEM_IFLAG_SET, &it, &reader);
+    }
     if (ret == ENGINE_SUCCESS) {
         info = (set_meta_info *)item_get_meta(it);
         do {
@@ -6744,9 +9352,16 @@ ENGINE_ERROR_CODE set_elem_get(struct default_engine *engine,
                 *flags = it->flags;
             } /* ret = ENGINE_ELEM_ENOENT */
         } while (0);
-        do_item_release(engine, it);
+        if (delete) {
+            do_item_release(engine, it);
+        } else {
+            coll_read_release(engine, it, &reader);
+        }
+    }
+    if (delete) {
+        UNLOCK_CACHE();
+        coll_write_end(coll_lock);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
 
@@ -6760,7 +9375,7 @@ ENGINE_ERROR_CODE btree_struct_create(struct default_engine *engine,
     hash_item *it;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     it = do_item_get(engine, key, nkey, DONT_UPDATE);
     if (it != NULL) {
         do_item_release(engine, it);
@@ -6774,7 +9389,7 @@ ENGINE_ERROR_CODE btree_struct_create(struct default_engine *engine,
             do_item_release(engine, it);
         }
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
@@ -6783,9 +9398,8 @@ btree_elem_item *btree_elem_alloc(struct default_engine *engine,
                                   const void *cookie)
 {
     btree_elem_item *elem;
-    pthread_mutex_lock(&engine->cache_lock);
-    elem = do_btree_elem_alloc(engine, nbkey, neflag, nbytes, cookie);
-    pthread_mutex_unlock(&engine->cache_lock);
+    /* the cache lock is taken only if the magazine can't give the memory */
+    elem = do_btree_elem_alloc(engine, nbkey, neflag, nbytes, cookie, false);
     return elem;
 }
 
@@ -6793,15 +9407,15 @@ void btree_elem_release(struct default_engine *engine,
                         btree_elem_item **elem_array, const int elem_count)
 {
     int cnt = 0;
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     while (cnt < elem_count) {
         do_btree_elem_release(engine, elem_array[cnt++]);
         if ((cnt % 100) == 0 && cnt < elem_count) {
-            pthread_mutex_unlock(&engine->cache_lock);
-            pthread_mutex_lock(&engine->cache_lock);
+            UNLOCK_CACHE();
+            LOCK_CACHE();
         }
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 }
 
 ENGINE_ERROR_CODE btree_elem_insert(struct default_engine *engine,
@@ -6811,6 +9425,7 @@ ENGINE_ERROR_CODE btree_elem_insert(struct default_engine *engine,
                                     uint32_t *trimmed_count, uint32_t *trimmed_flags, const void *cookie)
 {
     hash_item *it = NULL;
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
     *created = false;
@@ -6820,7 +9435,8 @@ ENGINE_ERROR_CODE btree_elem_insert(struct default_engine *engine,
         *trimmed_count = 0;
     }
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_btree_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_KEY_ENOENT && attrp != NULL) {
         it = do_btree_item_alloc(engine, key, nkey, attrp, cookie);
@@ -6846,7 +9462,8 @@ ENGINE_ERROR_CODE btree_elem_insert(struct default_engine *engine,
         }
     }
     if (it != NULL) do_item_release(engine, it);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -6858,11 +9475,13 @@ ENGINE_ERROR_CODE btree_elem_update(struct default_engine *engine,
     hash_item       *it;
     btree_meta_info *info;
     int bkrtype = do_btree_bkey_range_type(bkrange);
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
     assert(bkrtype == BKEY_RANGE_TYPE_SIN); /* single bkey */
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_btree_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_SUCCESS) {
         info = (btree_meta_info *)item_get_meta(it);
@@ -6878,7 +9497,8 @@ ENGINE_ERROR_CODE btree_elem_update(struct default_engine *engine,
         } while(0);
         do_item_release(engine, it);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -6891,9 +9511,11 @@ ENGINE_ERROR_CODE btree_elem_delete(struct default_engine *engine,
     hash_item       *it;
     btree_meta_info *info;
     int bkrtype = do_btree_bkey_range_type(bkrange);
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_btree_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_SUCCESS) {
         info = (btree_meta_info *)item_get_meta(it);
@@ -6921,7 +9543,8 @@ ENGINE_ERROR_CODE btree_elem_delete(struct default_engine *engine,
         } while(0);
         do_item_release(engine, it);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -6936,11 +9559,13 @@ ENGINE_ERROR_CODE btree_elem_arithmetic(struct default_engine *engine,
     hash_item       *it;
     btree_meta_info *info;
     int bkrtype = do_btree_bkey_range_type(bkrange);
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
     assert(bkrtype == BKEY_RANGE_TYPE_SIN); /* single bkey */
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_btree_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_SUCCESS) {
         bool new_root_flag = false;
@@ -6972,7 +9597,8 @@ ENGINE_ERROR_CODE btree_elem_arithmetic(struct default_engine *engine,
         } while(0);
         do_item_release(engine, it);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -6989,10 +9615,17 @@ ENGINE_ERROR_CODE btree_elem_get(struct default_engine *engine,
     btree_meta_info *info;
     int bkrtype = do_btree_bkey_range_type(bkrange);
     bool potentialbkeytrim;
+    struct coll_reader reader;
+    pthread_rwlock_t *coll_lock = NULL;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
-    ret = do_btree_item_find(engine, key, nkey, DO_UPDATE, &it);
+    if (delete) {
+        coll_lock = coll_write_begin(engine, key, nkey);
+        LOCK_CACHE();
+        ret = do_btree_item_find(engine, key, nkey, DO_UPDATE, &it);
+    } else {
+        ret = coll_read_find(engine, key, nkey, ITEM_IFLAG_BTREE, &it, &reader);
+    }
     if (ret == ENGINE_SUCCESS) {
         info = (btree_meta_info *)item_get_meta(it);
         do {
@@ -7028,9 +9661,16 @@ ENGINE_ERROR_CODE btree_elem_get(struct default_engine *engine,
                 /* ret = ENGINE_ELEM_ENOENT; */
             }
         } while (0);
-        do_item_release(engine, it);
+        if (delete) {
+            do_item_release(engine, it);
+        } else {
+            coll_read_release(engine, it, &reader);
+        }
+    }
+    if (delete) {
+        UNLOCK_CACHE();
+        coll_write_end(coll_lock);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
 
@@ -7042,10 +9682,10 @@ ENGINE_ERROR_CODE btree_elem_count(struct default_engine *engine,
     hash_item       *it;
     btree_meta_info *info;
     int bkrtype = do_btree_bkey_range_type(bkrange);
+    struct coll_reader reader;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
-    ret = do_btree_item_find(engine, key, nkey, DO_UPDATE, &it);
+    ret = coll_read_find(engine, key, nkey, ITEM_IFLAG_BTREE, &it, &reader);
     if (ret == ENGINE_SUCCESS) {
         info = (btree_meta_info *)item_get_meta(it);
         do {
@@ -7059,9 +9699,8 @@ ENGINE_ERROR_CODE btree_elem_count(struct default_engine *engine,
             *elem_count = do_btree_elem_count(engine, info, bkrtype, bkrange, efilter,
                                               access_count);
         } while (0);
-        do_item_release(engine, it);
+        coll_read_release(engine, it, &reader);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
 
@@ -7071,13 +9710,13 @@ ENGINE_ERROR_CODE btree_posi_find(struct default_engine *engine,
 {
     hash_item       *it;
     btree_meta_info *info;
+    struct coll_reader reader;
     ENGINE_ERROR_CODE ret;
 
     int bkrtype = do_btree_bkey_range_type(bkrange);
     assert(bkrtype == BKEY_RANGE_TYPE_SIN);
 
-    pthread_mutex_lock(&engine->cache_lock);
-    ret = do_btree_item_find(engine, key, nkey, DO_UPDATE, &it);
+    ret = coll_read_find(engine, key, nkey, ITEM_IFLAG_BTREE, &it, &reader);
     if (ret == ENGINE_SUCCESS) {
         info = (btree_meta_info *)item_get_meta(it);
         do {
@@ -7096,9 +9735,8 @@ ENGINE_ERROR_CODE btree_posi_find(struct default_engine *engine,
                 ret = ENGINE_ELEM_ENOENT; break;
             }
         } while (0);
-        do_item_release(engine, it);
+        coll_read_release(engine, it, &reader);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
 
@@ -7111,13 +9749,13 @@ ENGINE_ERROR_CODE btree_posi_find_with_get(struct default_engine *engine,
 {
     hash_item       *it;
     btree_meta_info *info;
+    struct coll_reader reader;
     ENGINE_ERROR_CODE ret;
 
     int bkrtype = do_btree_bkey_range_type(bkrange);
     assert(bkrtype == BKEY_RANGE_TYPE_SIN);
 
-    pthread_mutex_lock(&engine->cache_lock);
-    ret = do_btree_item_find(engine, key, nkey, DO_UPDATE, &it);
+    ret = coll_read_find(engine, key, nkey, ITEM_IFLAG_BTREE, &it, &reader);
     if (ret == ENGINE_SUCCESS) {
         info = (btree_meta_info *)item_get_meta(it);
         do {
@@ -7138,9 +9776,8 @@ ENGINE_ERROR_CODE btree_posi_find_with_get(struct default_engine *engine,
             }
             *flags = it->flags;
         } while (0);
-        do_item_release(engine, it);
+        coll_read_release(engine, it, &reader);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
 
@@ -7151,14 +9788,14 @@ ENGINE_ERROR_CODE btree_elem_get_by_posi(struct default_engine *engine,
 {
     hash_item       *it;
     btree_meta_info *info;
+    struct coll_reader reader;
     ENGINE_ERROR_CODE ret;
     uint32_t rqcount;
     bool     forward;
 
     assert(from_posi >= 0 && to_posi >= 0);
 
-    pthread_mutex_lock(&engine->cache_lock);
-    ret = do_btree_item_find(engine, key, nkey, DO_UPDATE, &it);
+    ret = coll_read_find(engine, key, nkey, ITEM_IFLAG_BTREE, &it, &reader);
     if (ret == ENGINE_SUCCESS) {
         info = (btree_meta_info *)item_get_meta(it);
         do {
@@ -7190,9 +9827,8 @@ ENGINE_ERROR_CODE btree_elem_get_by_posi(struct default_engine *engine,
                 break;
             *flags = it->flags;
         } while (0);
-        do_item_release(engine, it);
+        coll_read_release(engine, it, &reader);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
 
@@ -7221,7 +9857,7 @@ ENGINE_ERROR_CODE btree_elem_smget_old(struct default_engine *engine,
     *trimmed = false;
     *duplicated = false;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
 
     /* the 1st phase: get the sorted scans */
     ret = do_btree_smget_scan_sort_old(engine, key_array, key_count,
@@ -7240,7 +9876,7 @@ ENGINE_ERROR_CODE btree_elem_smget_old(struct default_engine *engine,
         }
     }
 
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 
     return ret;
 }
@@ -7278,7 +9914,7 @@ ENGINE_ERROR_CODE btree_elem_smget(struct default_engine *engine,
     result->duplicated = false;
     result->ascending = (bkrtype != BKEY_RANGE_TYPE_DSC ? true : false);
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     do {
         /* the 1st phase: get the sorted scans */
         ret = do_btree_smget_scan_sort(engine, key_array, key_count,
@@ -7302,7 +9938,7 @@ ENGINE_ERROR_CODE btree_elem_smget(struct default_engine *engine,
                 do_item_release(engine, btree_scan_buf[i].it);
         }
     } while(0);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 
     return ret;
 }
@@ -7405,7 +10041,7 @@ ENGINE_ERROR_CODE item_getattr(struct default_engine *engine,
     hash_item *it;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     it = do_item_get(engine, key, nkey, DO_UPDATE);
     if (it == NULL) {
         ret = ENGINE_KEY_ENOENT;
@@ -7417,7 +10053,7 @@ ENGINE_ERROR_CODE item_getattr(struct default_engine *engine,
         }
         do_item_release(engine, it);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 
     return ret;
 }
@@ -7529,6 +10165,9 @@ do_item_setattr_exec(struct default_engine *engine, hash_item *it,
         if (attr_ids[i] == ATTR_EXPIRETIME) {
             if (it->exptime != attr_data->exptime) {
                 rel_time_t before_exptime = it->exptime;
+                if (engine->items.expiry_wheel != NULL) {
+                    do_item_expiry_remove(engine, it);
+                }
                 it->exptime = attr_data->exptime;
                 if (before_exptime == 0 && it->exptime != 0) {
                     /* exptime: 0 => positive value */
@@ -7541,6 +10180,9 @@ do_item_setattr_exec(struct default_engine *engine, hash_item *it,
                      */
                     do_item_lru_reposition(engine, it);
                 }
+                if (engine->items.expiry_wheel != NULL) {
+                    do_item_expiry_add(engine, it);
+                }
             }
             continue;
         }
@@ -7600,9 +10242,11 @@ ENGINE_ERROR_CODE item_setattr(struct default_engine *engine,
                                item_attr *attr_data)
 {
     hash_item *it;
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     it = do_item_get(engine, key, nkey, DONT_UPDATE);
     if (it == NULL) {
         ret = ENGINE_KEY_ENOENT;
@@ -7614,7 +10258,8 @@ ENGINE_ERROR_CODE item_setattr(struct default_engine *engine,
         }
         do_item_release(engine, it);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
 
     return ret;
 }
@@ -7627,7 +10272,7 @@ ENGINE_ERROR_CODE item_conf_set_maxcollsize(struct default_engine *engine,
 {
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     if (*maxsize < 0 || *maxsize > coll_size_limit) {
         *maxsize = coll_size_limit;
     }
@@ -7665,24 +10310,24 @@ ENGINE_ERROR_CODE item_conf_set_maxcollsize(struct default_engine *engine,
            }
            break;
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
 bool item_conf_get_evict_to_free(struct default_engine *engine)
 {
     bool value;
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     value = item_evict_to_free;
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return value;
 }
 
 void item_conf_set_evict_to_free(struct default_engine *engine, bool value)
 {
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     item_evict_to_free = value;
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 }
 
 /*
@@ -7717,6 +10362,46 @@ char* item_get_data(const hash_item* item)
     return ((char*)item_get_key(item)) + item->nkey;
 }
 
+/*
+ * Fills the value iovecs of an item, one for each chunk and one for
+ * the tail in the header of a chunked item.
+ * Returns the number of iovecs, 0 if nvalue is too small.
+ */
+int item_get_value_iovs(struct default_engine *engine, const hash_item* item,
+                        struct iovec *value, int nvalue)
+{
+    if ((item->iflag & ITEM_CHUNKED) == 0) {
+        if (nvalue < 1) {
+            return 0;
+        }
+        value[0].iov_base = item_get_data(item);
+        value[0].iov_len = item->nbytes;
+        return 1;
+    }
+
+    size_t dsize = do_item_chunk_dsize(engine);
+    size_t tail = item->nbytes % dsize;
+    int count = item->nbytes / dsize + (tail > 0 ? 1 : 0);
+    item_chunk *chunk;
+    int i = 0;
+
+    if (nvalue < count) {
+        return 0;
+    }
+    for (chunk = do_item_get_chunks(item); chunk != NULL; chunk = chunk->next) {
+        value[i].iov_base = chunk->data;
+        value[i].iov_len = dsize;
+        i++;
+    }
+    if (tail > 0) {
+        value[i].iov_base = item_get_data(item) + sizeof(item_chunk *);
+        value[i].iov_len = tail;
+        i++;
+    }
+    assert(i == count);
+    return count;
+}
+
 const void* item_get_meta(const hash_item* item)
 {
     if (IS_COLL_ITEM(item))
@@ -7810,7 +10495,7 @@ static void *item_scrubber_main(void *arg)
 
     assoc_scan_init(engine, &scan);
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     while (engine->initialized)
     {
         /* scan and scrub cache items */
@@ -7832,23 +10517,23 @@ static void *item_scrubber_main(void *arg)
             }
         }
 
-        pthread_mutex_unlock(&engine->cache_lock);
+        UNLOCK_CACHE();
         if ((++tot_execs % 50) == 0) {
             nanosleep(&sleep_time, NULL); /* 1ms sleep */
         }
 
-        /* pthread_mutex_lock(&engine->cache_lock); */
+        /* LOCK_CACHE(); */
         for (i = 0; i < try_cnt; i++) {
-            if (pthread_mutex_trylock(&engine->cache_lock) == 0)
+            if (TRYLOCK_CACHE() == 0)
                 break;
             nanosleep(&sleep_time, NULL); /* 1ms sleep */
         }
         if (i == try_cnt) {
-            pthread_mutex_lock(&engine->cache_lock);
+            LOCK_CACHE();
         }
     }
     assoc_scan_final(&scan);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 
     pthread_mutex_lock(&engine->scrubber.lock);
     engine->scrubber.stopped = time(NULL);
@@ -7975,7 +10660,7 @@ static void *item_dumper_main(void *arg)
 
     assoc_scan_init(engine, &scan);
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     while (true)
     {
         item_count = assoc_scan_next(&scan, item_array, array_size);
@@ -7992,7 +10677,7 @@ static void *item_dumper_main(void *arg)
                 item_array[i] = NULL;
             }
         }
-        pthread_mutex_unlock(&engine->cache_lock);
+        UNLOCK_CACHE();
 
         /* write key string to buffer */
         real_nowtime = time(NULL);
@@ -8002,12 +10687,12 @@ static void *item_dumper_main(void *arg)
             dumper->visited++;
             /* check prefix name */
             if (dumper->nprefix > 0) {
-                if (dumper->nprefix != it->pfxptr->nprefix ||
+                if (dumper->nprefix != ITEM_PREFIX(it)->nprefix ||
                     memcmp(item_get_key(it), dumper->prefix, dumper->nprefix) != 0) {
                     continue; /* prefix mismatch */
                 }
             } else if (dumper->nprefix == 0) {
-                if (it->pfxptr->nprefix != 0) {
+                if (ITEM_PREFIX(it)->nprefix != 0) {
                     continue; /* NOT null prefix */
                 }
             }
@@ -8058,7 +10743,7 @@ static void *item_dumper_main(void *arg)
             }
         }
 
-        pthread_mutex_lock(&engine->cache_lock);
+        LOCK_CACHE();
         for (i = 0; i < item_count; i++) {
             if (item_array[i] != NULL) {
                 do_item_release(engine, item_array[i]);
@@ -8073,7 +10758,7 @@ static void *item_dumper_main(void *arg)
     }
     assoc_scan_final(&scan);
 
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 
     if (ret == 0) {
         int summary_length = 256; /* just, enough memory space size */
@@ -8299,7 +10984,7 @@ static map_hash_node *do_map_node_alloc(struct default_engine *engine,
 {
     size_t ntotal = sizeof(map_hash_node);
 
-    map_hash_node *node = do_item_alloc_internal(engine, ntotal, LRU_CLSID_FOR_SMALL, cookie);
+    map_hash_node *node = do_coll_mem_alloc(engine, ntotal, cookie, true);
     if (node != NULL) {
         assert(node->slabs_clsid == 0);
         node->slabs_clsid = slabs_clsid(engine, ntotal);
@@ -8307,6 +10992,7 @@ static map_hash_node *do_map_node_alloc(struct default_engine *engine,
         node->hdepth      = hash_depth;
         node->tot_hash_cnt = 0;
         node->tot_elem_cnt = 0;
+        engine->stats.coll_node_bytes[ITEM_TYPE_MAP] += slabs_space_size(engine, ntotal);
         memset(node->hcnt, 0, MAP_HASHTAB_SIZE*sizeof(uint16_t));
         memset(node->htab, 0, MAP_HASHTAB_SIZE*sizeof(void*));
     }
@@ -8315,15 +11001,17 @@ static map_hash_node *do_map_node_alloc(struct default_engine *engine,
 
 static void do_map_node_free(struct default_engine *engine, map_hash_node *node)
 {
+    engine->stats.coll_node_bytes[ITEM_TYPE_MAP] -= slabs_space_size(engine, sizeof(map_hash_node));
     do_mem_slot_free(engine, node, sizeof(map_hash_node));
 }
 
 static map_elem_item *do_map_elem_alloc(struct default_engine *engine, const int nfield,
-                                        const int nbytes, const void *cookie)
+                                        const int nbytes, const void *cookie,
+                                        const bool locked)
 {
     size_t ntotal = sizeof(map_elem_item) + nfield + nbytes;
 
-    map_elem_item *elem = do_item_alloc_internal(engine, ntotal, LRU_CLSID_FOR_SMALL, cookie);
+    map_elem_item *elem = do_coll_mem_alloc(engine, ntotal, cookie, locked);
     if (elem != NULL) {
         assert(elem->slabs_clsid == 0);
         elem->slabs_clsid = slabs_clsid(engine, ntotal);
@@ -8346,7 +11034,7 @@ static void do_map_elem_free(struct default_engine *engine, map_elem_item *elem)
 static void do_map_elem_release(struct default_engine *engine, map_elem_item *elem)
 {
     if (elem->refcount != 0) {
-        elem->refcount--;
+        ELEM_REFCOUNT_DECR(elem);
     }
     if (elem->refcount == 0 && elem->next == (map_elem_item *)ADDR_MEANS_UNLINKED) {
         do_map_elem_free(engine, elem);
@@ -8615,7 +11303,7 @@ static bool do_map_elem_traverse_dfs_byfield(struct default_engine *engine,
             while (elem != NULL) {
                 if (map_hash_eq(hval, field->value, field->length, elem->hval, elem->data, elem->nfield)) {
                     if (elem_array) {
-                        elem->refcount++;
+                        ELEM_REFCOUNT_INCR(elem);
                         elem_array[0] = elem;
                     }
 
@@ -8667,7 +11355,7 @@ static int do_map_elem_traverse_dfs_bycnt(struct default_engine *engine,
             map_elem_item *elem = node->htab[hidx];
             while (elem != NULL) {
                 if (elem_array) {
-                    elem->refcount++;
+                    ELEM_REFCOUNT_INCR(elem);
                     elem_array[fcnt] = elem;
                 }
                 fcnt++;
@@ -8765,7 +11453,7 @@ static ENGINE_ERROR_CODE do_map_elem_update(struct default_engine *engine, map_m
         }
 #endif
 
-        map_elem_item *new_elem = do_map_elem_alloc(engine, elem->nfield, nbytes, cookie);
+        map_elem_item *new_elem = do_map_elem_alloc(engine, elem->nfield, nbytes, cookie, true);
         if (new_elem == NULL) {
             return ENGINE_ENOMEM;
         }
@@ -8877,7 +11565,7 @@ ENGINE_ERROR_CODE map_struct_create(struct default_engine *engine,
     ENGINE_ERROR_CODE ret;
     hash_item *it;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     it = do_item_get(engine, key, nkey, DONT_UPDATE);
     if (it != NULL) {
         do_item_release(engine, it);
@@ -8891,42 +11579,43 @@ ENGINE_ERROR_CODE map_struct_create(struct default_engine *engine,
             do_item_release(engine, it);
         }
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
     return ret;
 }
 
 map_elem_item *map_elem_alloc(struct default_engine *engine, const int nfield, const int nbytes, const void *cookie)
 {
     map_elem_item *elem;
-    pthread_mutex_lock(&engine->cache_lock);
-    elem = do_map_elem_alloc(engine, nfield, nbytes, cookie);
-    pthread_mutex_unlock(&engine->cache_lock);
+    /* the cache lock is taken only if the magazine can't give the memory */
+    elem = do_map_elem_alloc(engine, nfield, nbytes, cookie, false);
     return elem;
 }
 
 void map_elem_release(struct default_engine *engine, map_elem_item **elem_array, const int elem_count)
 {
     int cnt = 0;
-    pthread_mutex_lock(&engine->cache_lock);
+    LOCK_CACHE();
     while (cnt < elem_count) {
         do_map_elem_release(engine, elem_array[cnt++]);
         if ((cnt % 100) == 0 && cnt < elem_count) {
-            pthread_mutex_unlock(&engine->cache_lock);
-            pthread_mutex_lock(&engine->cache_lock);
+            UNLOCK_CACHE();
+            LOCK_CACHE();
         }
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
 }
 
 ENGINE_ERROR_CODE map_elem_insert(struct default_engine *engine, const char *key, const size_t nkey,
                                   map_elem_item *elem, item_attr *attrp, bool *created, const void *cookie)
 {
     hash_item *it = NULL;
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
     *created = false;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_map_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_KEY_ENOENT && attrp != NULL) {
         it = do_map_item_alloc(engine, key, nkey, attrp, cookie);
@@ -8948,7 +11637,8 @@ ENGINE_ERROR_CODE map_elem_insert(struct default_engine *engine, const char *key
         }
     }
     if (it != NULL) do_item_release(engine, it);
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -8957,16 +11647,19 @@ ENGINE_ERROR_CODE map_elem_update(struct default_engine *engine, const char *key
 {
     hash_item     *it;
     map_meta_info *info;
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_map_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_SUCCESS) { /* it != NULL */
         info = (map_meta_info *)item_get_meta(it);
         ret = do_map_elem_update(engine, info, field, value, nbytes, cookie);
         do_item_release(engine, it);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -8976,11 +11669,13 @@ ENGINE_ERROR_CODE map_elem_delete(struct default_engine *engine, const char *key
 {
     hash_item     *it;
     map_meta_info *info;
+    pthread_rwlock_t *coll_lock;
     ENGINE_ERROR_CODE ret;
 
     *dropped = false;
 
-    pthread_mutex_lock(&engine->cache_lock);
+    coll_lock = coll_write_begin(engine, key, nkey);
+    LOCK_CACHE();
     ret = do_map_item_find(engine, key, nkey, DONT_UPDATE, &it);
     if (ret == ENGINE_SUCCESS) { /* it != NULL */
         info = (map_meta_info *)item_get_meta(it);
@@ -8996,7 +11691,8 @@ ENGINE_ERROR_CODE map_elem_delete(struct default_engine *engine, const char *key
         }
         do_item_release(engine, it);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
+    UNLOCK_CACHE();
+    coll_write_end(coll_lock);
     return ret;
 }
 
@@ -9007,10 +11703,17 @@ ENGINE_ERROR_CODE map_elem_get(struct default_engine *engine, const char *key, c
 {
     hash_item     *it;
     map_meta_info *info;
+    struct coll_reader reader;
+    pthread_rwlock_t *coll_lock = NULL;
     ENGINE_ERROR_CODE ret;
 
-    pthread_mutex_lock(&engine->cache_lock);
-    ret = do_map_item_find(engine, key, nkey, DO_UPDATE, &it);
+    if (delete) {
+        coll_lock = coll_write_begin(engine, key, nkey);
+        LOCK_CACHE();
+        ret = do_map_item_find(engine, key, nkey, DO_UPDATE, &it);
+    } else {
+        ret = coll_read_find(engine, key, nkey, ITEM_IFLAG_MAP, &it, &reader);
+    }
     if (ret == ENGINE_SUCCESS) {
         info = (map_meta_info *)item_get_meta(it);
         do {
@@ -9029,8 +11732,15 @@ ENGINE_ERROR_CODE map_elem_get(struct default_engine *engine, const char *key, c
                 *flags = it->flags;
             } /* ret = ENGINE_ELEM_ENOENT */
         } while (0);
-        do_item_release(engine, it);
+        if (delete) {
+            do_item_release(engine, it);
+        } else {
+            coll_read_release(engine, it, &reader);
+        }
+    }
+    if (delete) {
+        UNLOCK_CACHE();
+        coll_write_end(coll_lock);
     }
-    pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
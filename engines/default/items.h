@@ -26,10 +26,15 @@
 #define ITEM_IFLAG_BTREE 4   /* b+tree item */
 #define ITEM_IFLAG_COLL  7   /* collection item: list/set/map/b+tree */
 /* 2) item flag: decreasing order */
+#define ITEM_CHUNKED     16  /* value stored in a chunk chain */
 #define ITEM_LINKED      32  /* linked to assoc hash table */
 #define ITEM_INTERNAL    64  /* internal cache item */
 #define ITEM_WITH_CAS    128 /* having CAS value */
 
+/* LRU flag (1 byte) of the segmented LRU : segment and activity */
+#define ITEM_LRU_SEG     3   /* mask of the segment: hot, warm or cold */
+#define ITEM_LRU_ACTIVE  8   /* accessed since it was placed in the segment */
+
 /* Macros for checking item type */
 #define GET_ITEM_TYPE(it) ((it)->iflag & ITEM_IFLAG_COLL)
 #define IS_LIST_ITEM(it)  (((it)->iflag & ITEM_IFLAG_COLL) == ITEM_IFLAG_LIST)
@@ -45,25 +50,91 @@
 
 typedef struct _prefix_t prefix_t;
 
+#ifdef ENABLE_COMPACT_ITEM
+/*
+ * Compact item header.
+ * The LRU links are 32-bit references into the slab arena (in 8-byte units,
+ * 0 means NULL) and the prefix is a 32-bit index into the prefix index.
+ * It cuts the item header from 64 to 48 bytes (56 to 40 bytes with the
+ * bucketized hash index).
+ */
+typedef uint32_t item_ref_t;
+#endif
+
 /* hash item strtucture */
 typedef struct _hash_item {
     uint16_t refcount;  /* reference count */
     uint8_t  slabs_clsid;/* which slab class we're in */
     uint8_t  refchunk;  /* reference chunk */
     uint32_t flags;     /* Flags associated with the item (in network byte order) */
+#ifdef ENABLE_COMPACT_ITEM
+    item_ref_t next;    /* LRU chain next */
+    item_ref_t prev;    /* LRU chain prev */
+#else
     struct _hash_item *next;   /* LRU chain next */
     struct _hash_item *prev;   /* LRU chain prev */
+#endif
+#ifndef ENABLE_BUCKET_ASSOC
     struct _hash_item *h_next; /* hash chain next */
+#endif
     rel_time_t time;    /* least recent access */
     rel_time_t exptime; /* When the item will expire (relative to process startup) */
     uint8_t  iflag;     /* Intermal flags: item type and flag */
+    uint8_t  lruflag;   /* LRU segment and activity of the segmented LRU */
     uint16_t nkey;      /* The total length of the key (in bytes) */
     uint32_t nbytes;    /* The total length of the data (in bytes) */
     /* Following fields are used to trade off memory space for performance */
     uint32_t khash;     /* The hash value of key string */
+#ifdef ENABLE_COMPACT_ITEM
+    uint32_t pfxid;     /* index of prefix structure in the prefix index */
+#else
     prefix_t *pfxptr;   /* pointer to prefix structure */
+#endif
 } hash_item;
 
+/* value chunk of a chunked item */
+typedef struct _item_chunk {
+    struct _item_chunk *next; /* next chunk of the value */
+    char   data[];            /* the value bytes, the rest of the chunk */
+} item_chunk;
+
+/* LRU link and prefix accessors */
+#ifdef ENABLE_COMPACT_ITEM
+extern char *item_arena;          /* base of the slab arena (slabs.c) */
+extern prefix_t **prefix_index[]; /* prefix index chunks (assoc.c) */
+
+#define PREFIX_INDEX_CHUNK_BITS 12
+#define PREFIX_INDEX_CHUNK_SIZE (1 << PREFIX_INDEX_CHUNK_BITS)
+
+static inline item_ref_t item_ref(const hash_item *it)
+{
+    if (it == NULL) return 0;
+    return (item_ref_t)((((const char *)it) - item_arena) >> 3) + 1;
+}
+
+static inline hash_item *item_ptr(const item_ref_t ref)
+{
+    if (ref == 0) return NULL;
+    return (hash_item *)(item_arena + ((size_t)(ref - 1) << 3));
+}
+
+#define ITEM_NEXT(it)           item_ptr((it)->next)
+#define ITEM_PREV(it)           item_ptr((it)->prev)
+#define ITEM_SET_NEXT(it, nxt)  ((it)->next = item_ref(nxt))
+#define ITEM_SET_PREV(it, prv)  ((it)->prev = item_ref(prv))
+#define ITEM_PREFIX(it) \
+    (prefix_index[(it)->pfxid >> PREFIX_INDEX_CHUNK_BITS][(it)->pfxid & (PREFIX_INDEX_CHUNK_SIZE - 1)])
+#define ITEM_SET_PREFIX(it, pt) \
+    ((it)->pfxid = ((pt) != NULL ? ((prefix_t *)(pt))->pfxid : 0))
+#else
+#define ITEM_NEXT(it)           ((it)->next)
+#define ITEM_PREV(it)           ((it)->prev)
+#define ITEM_SET_NEXT(it, nxt)  ((it)->next = (nxt))
+#define ITEM_SET_PREV(it, prv)  ((it)->prev = (prv))
+#define ITEM_PREFIX(it)         ((it)->pfxptr)
+#define ITEM_SET_PREFIX(it, pt) ((it)->pfxptr = (pt))
+#endif
+
 /* list element */
 typedef struct _list_elem_item {
     uint16_t refcount;
@@ -254,8 +325,55 @@ typedef struct {
     unsigned int outofmemory;
     unsigned int tailrepairs;
     unsigned int reclaimed;
+    unsigned int lfu_kept;
+    uint64_t     evicted_bytes;
 } itemstats_t;
 
+/* eviction policy */
+enum evict_policy {
+    EVICT_POLICY_LRU = 0, /* the LRU tail item */
+    EVICT_POLICY_GDSF     /* the least hit value per byte among the tail items */
+};
+
+/* timing wheel of item expiration: a slot of a level spans
+ * all the slots of the level below */
+#define EXPIRY_WHEEL_LEVELS 3
+#define EXPIRY_WHEEL_BITS   8
+#define EXPIRY_WHEEL_SLOTS  (1 << EXPIRY_WHEEL_BITS)
+
+typedef struct {
+    uint32_t   khash;   /* hash value of the item key */
+    rel_time_t exptime; /* 0 if the entry is empty */
+} expiry_entry;
+
+/* open addressing table of the entries hashed by khash */
+typedef struct {
+    expiry_entry *entries;
+    uint32_t      count;
+    uint32_t      size;  /* 0 or a power of 2 */
+} expiry_slot;
+
+/* allocation latency histogram: 4 buckets per power of 2 nanoseconds */
+#define ALLOC_LAT_SUB_BITS 2
+#define ALLOC_LAT_BUCKETS  (32 << ALLOC_LAT_SUB_BITS)
+
+struct expiry_wheel {
+    expiry_slot slots[EXPIRY_WHEEL_LEVELS][EXPIRY_WHEEL_SLOTS];
+    expiry_slot reaping;   /* level 0 slot detached to be reaped */
+    uint32_t    reap_pos;  /* next entry of the reaping slot */
+    rel_time_t  current;   /* time of the level 0 slot being reaped */
+    uint64_t    entries;   /* # of entries in the wheel */
+    uint64_t    bytes;     /* memory of the slots, charged to the memory limit */
+    uint64_t    reaped;    /* # of expired items freed by the reaper */
+    uint64_t    dropped;   /* # of entries left to lazy reclaim */
+};
+
+/* segmented LRU */
+#define LRU_SEG_HOT   0
+#define LRU_SEG_WARM  1
+#define LRU_SEG_COLD  2
+#define LRU_SEGMENTS  3
+
 /* item global */
 struct items {
    hash_item   *heads[MAX_SLAB_CLASSES];
@@ -267,6 +385,17 @@ struct items {
    hash_item   *sticky_curMK[MAX_SLAB_CLASSES]; /* cur mark for invalidation(expire/flush) check */
    unsigned int sizes[MAX_SLAB_CLASSES];
    unsigned int sticky_sizes[MAX_SLAB_CLASSES];
+   hash_item   *seg_tails[LRU_SEGMENTS][MAX_SLAB_CLASSES]; /* last item of each segment */
+   unsigned int seg_sizes[LRU_SEGMENTS][MAX_SLAB_CLASSES];
+   uint64_t     seg_moves[LRU_SEGMENTS][MAX_SLAB_CLASSES]; /* # of items moved into each segment */
+   uint8_t     *lfu_sketch;    /* count-min sketch of the key access frequency */
+   uint32_t     lfu_width;     /* # of counters in a row of the sketch */
+   uint32_t     lfu_additions; /* # of accesses counted since the last aging */
+   enum evict_policy evict_policy;
+   struct expiry_wheel *expiry_wheel; /* NULL if expiry_reap_rate is 0 */
+   uint64_t     alloc_lat_hist[ALLOC_LAT_BUCKETS]; /* latency of item allocations */
+   uint64_t     lru_maint_runs;    /* # of eviction runs of the LRU maintainer */
+   uint64_t     lru_maint_evicted; /* # of items evicted by the LRU maintainer */
    itemstats_t  itemstats[MAX_SLAB_CLASSES];
 };
 
@@ -282,6 +411,15 @@ typedef struct {
  * functions.
  */
 
+/**
+ * Take and release the cache lock exclusively. Use these instead of
+ * locking engine->cache_lock directly, so that the lock-free readers
+ * are drained and the deferred LRU repositions are applied first.
+ * @param engine handle to the storage engine
+ */
+void cache_lock_exclusive(struct default_engine *engine);
+void cache_unlock_exclusive(struct default_engine *engine);
+
 /**
  * Allocate and initialize a new item structure
  * @param engine handle to the storage engine
@@ -306,6 +444,16 @@ hash_item *item_alloc(struct default_engine *engine,
  */
 hash_item *item_get(struct default_engine *engine, const void *key, const size_t nkey);
 
+/**
+ * Get multiple items from the cache at once.
+ * @param engine handle to the storage engine
+ * @param karray the keys of the items to get
+ * @param kcount the number of the keys
+ * @param items the array to store the items: NULL if an item doesn't exist
+ */
+void item_get_multi(struct default_engine *engine, token_t *karray, const int kcount,
+                    hash_item **items);
+
 /**
  * Reset the item statistics
  * @param engine handle to the storage engine
@@ -330,6 +478,34 @@ void item_stats(struct default_engine *engine, ADD_STAT add_stat, const void *co
  */
 void item_stats_sizes(struct default_engine *engine, ADD_STAT add_stat, const void *cookie);
 
+/**
+ * Get memory accounting of the items by item type and collection overhead
+ * @param engine handle to the storage engine
+ * @param add_stat callback provided by the core used to
+ *                 push statistics into the response
+ * @param cookie cookie provided by the core to identify the client
+ */
+void item_memory_stats(struct default_engine *engine, ADD_STAT add_stat, const void *cookie);
+
+/**
+ * Get statistics of the expiry timing wheel and its reaper
+ * @param engine handle to the storage engine
+ * @param add_stat callback provided by the core used to
+ *                 push statistics into the response
+ * @param cookie cookie provided by the core to identify the client
+ */
+void item_expiry_stats(struct default_engine *engine, ADD_STAT add_stat, const void *cookie);
+
+/**
+ * Get the allocation latency percentiles and the LRU maintainer statistics.
+ * The latency is measured if lru_maintainer or alloc_latency is enabled.
+ * @param engine handle to the storage engine
+ * @param add_stat callback provided by the core used to
+ *                 push statistics into the response
+ * @param cookie cookie provided by the core to identify the client
+ */
+void item_alloc_stats(struct default_engine *engine, ADD_STAT add_stat, const void *cookie);
+
 /**
  * Dump items from the cache
  * @param engine handle to the storage engine
@@ -610,6 +786,8 @@ void        item_set_cas(const hash_item* item, uint64_t val);
 const void* item_get_key(const hash_item* item);
 char*       item_get_data(const hash_item* item);
 const void* item_get_meta(const hash_item* item);
+int         item_get_value_iovs(struct default_engine *engine, const hash_item* item,
+                                struct iovec *value, int nvalue);
 
 /*
  * Check item validity
@@ -650,4 +828,9 @@ void item_stop_dump(struct default_engine *engine);
 void item_stats_dump(struct default_engine *engine,
                      ADD_STAT add_stat, const void *cookie);
 
+/**
+ * Slab page mover
+ */
+ENGINE_ERROR_CODE item_slabs_reassign(struct default_engine *engine, int src, int dst);
+
 #endif
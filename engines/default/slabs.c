@@ -35,12 +35,34 @@
 #include <pthread.h>
 #include <inttypes.h>
 #include <stdarg.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_LINUX_MEMPOLICY_H
+#include <linux/mempolicy.h>
+#endif
 
 #include "default_engine.h"
 
 #define CHUNK_ALIGN_BYTES 8
 #define DONT_PREALLOC_SLABS
 
+#ifdef ENABLE_COMPACT_ITEM
+#if SIZE_MAX <= UINT32_MAX
+#error "The compact item header needs a 64-bit address space"
+#endif
+#ifdef USE_SYSTEM_MALLOC
+#error "The compact item header can't be used with the system malloc"
+#endif
+/* the address space reserved for the slab arena: 32-bit item references
+ * in 8-byte units can address up to 32GB */
+#define ITEM_ARENA_SIZE ((size_t)UINT32_MAX * CHUNK_ALIGN_BYTES)
+
+char *item_arena = NULL;
+#endif
+
 #define MAX_SPACE_SHORTAGE_LEVEL 100
 #define SSL_FOR_BACKGROUND_EVICT 10  /* space shortage level for background evict */
 #define SSL_CHECK_BY_MEM_REQUEST 100 /* space shortage level check tick by slab*/
@@ -68,8 +90,8 @@ typedef struct _sm_tail {
 typedef struct _sm_blck {
     struct _sm_blck *prev;
     struct _sm_blck *next;
-    uint32_t    frspc; /* (NOT USED) free slot space in each block */
-    uint32_t    frcnt; /* (NOT USED) free slot count in each block */
+    uint32_t    frspc; /* free slot space in each block */
+    uint32_t    cgen;  /* compaction generation that evacuates the block */
     /* The size of sm block strcture must be a multiple of
      * the size of the smallest slot unit. (ex, 16 or 32).
      * For that purpose, following dummy field was added.
@@ -83,6 +105,7 @@ typedef struct _sm_slist {
     sm_slot_t   *tail;
     uint64_t    space;
     uint64_t    count;
+    uint64_t    requested; /* requested bytes of the used slots */
 } sm_slist_t;
 
 /* sm block list */
@@ -100,6 +123,14 @@ typedef struct _sm_class {
     uint32_t tocnt; /* total slot unit count */
 } sm_class_t;
 
+/* sm compaction: block usage is bucketed by 1/16 of the block body.
+ * The blocks used less than the chosen bucket boundary are evacuated.
+ */
+#define SM_COMPACT_MIN_FRAG   25 /* min % of free space in used blocks */
+#define SM_COMPACT_BUCKETS    16
+#define SM_COMPACT_MAX_CUT    8  /* evacuate the blocks used less than 8/16 */
+#define SM_COMPACT_SLOT_PROBES 8 /* # of free slots checked in each free slot list */
+
 typedef struct _sm_anchor {
     int         space_shortage_level; /* 0, 1 ~ 100 */
     int         num_smmgr_request;  /* the number that do_smmgr_alloc/do_smmgr_free are invoked */
@@ -121,6 +152,15 @@ typedef struct _sm_anchor {
     uint64_t    free_limit_space;   /* the amount of minimum free space that must be maintained */
     sm_class_t  class_info[SM_MAX_CLASS_INFO]; /* class meta info */
     uint32_t    class_info_count;   /* class meta info count */
+    uint64_t    blck_usage[SM_COMPACT_BUCKETS+1]; /* # of used blocks by usage bucket */
+    /* compaction */
+    bool        compacting;         /* the blocks of compact_gen are evacuated */
+    uint32_t    compact_gen;        /* compaction generation */
+    uint64_t    compact_runs;       /* # of compaction runs */
+    uint64_t    compact_blocks;     /* # of blocks chosen to be evacuated */
+    uint64_t    compact_moved;      /* # of slots relocated */
+    uint64_t    compact_freed;      /* # of evacuated blocks freed */
+    uint64_t    compact_freed_run;  /* compact_freed at the start of the run */
 } sm_anchor_t;
 
 /* sm slab class id */
@@ -172,6 +212,16 @@ typedef struct _sm_anchor {
 #define SM_FREE_TAIL(tail) ((tail)->length <= 8)
 ****/
 
+/* huge page size that the slab arena is aligned to */
+#define SLABS_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/* per-thread magazines: free small memory slots up to SLABS_TCACHE_MAX_SLEN
+ * bytes are cached by slot length, up to SLABS_TCACHE_MAX_BYTES per thread.
+ */
+#define SLABS_TCACHE_MAX_SLEN  1024
+#define SLABS_TCACHE_CLASSES   (SLABS_TCACHE_MAX_SLEN / 8 + 1)
+#define SLABS_TCACHE_MAX_BYTES (256 * 1024)
+
 /* Number of sm slot classes */
 static int SM_NUM_CLASSES = 0; /* computed in do_smmgr_init */
 
@@ -181,6 +231,30 @@ static int SM_BBODY_SIZE = SM_BLOCK_SIZE - sizeof(sm_blck_t);
 
 static sm_anchor_t sm_anchor;
 
+/* The magazines of a thread.
+ * A slot cached in a magazine stays a used slot of the small memory
+ * allocator, so that its neighbors are not merged with it. It is linked
+ * through the next field of its slot head, and keeps the used status.
+ * The lock of a thread cache is uncontended except while it is flushed.
+ */
+struct slabs_tcache {
+    struct slabs_tcache *next;  /* all thread caches of the engine */
+    pthread_spinlock_t lock;    /* taken by the owner, and by flushes */
+    struct {
+        sm_slot_t *head;        /* cached slots */
+        uint32_t   count;
+    } mags[SLABS_TCACHE_CLASSES];
+    size_t   bytes;             /* cached bytes */
+    uint64_t hits;              /* # of allocations from the magazines */
+    uint64_t misses;            /* # of allocations from empty magazines */
+    uint64_t refills;           /* # of bulk refills */
+    uint64_t drains;            /* # of bulk drains */
+};
+
+static __thread struct slabs_tcache *thread_tcache = NULL;
+static __thread uint32_t thread_tcache_gen = 0;
+static uint32_t tcache_gen = 0; /* thread caches of old engines are ignored */
+
 static EXTENSION_LOGGER_DESCRIPTOR *logger;
 
 
@@ -194,6 +268,7 @@ static void *do_slabs_alloc(struct default_engine *engine, const size_t size, un
 static void  do_slabs_free(struct default_engine *engine, void *ptr, const size_t size, unsigned int id);
 static int   do_slabs_newslab(struct default_engine *engine, const unsigned int id);
 static void *memory_allocate(struct default_engine *engine, size_t size);
+static void  slabs_size_hist_init(struct default_engine *engine);
 
 #ifndef DONT_PREALLOC_SLABS
 /* Preallocate as many slab pages as possible (called from slabs_init)
@@ -520,18 +595,30 @@ static void do_smmgr_free_slot_link(sm_slot_t *slot, int offset, int length)
     smid = do_smmgr_memid(slen, false);
     list = &sm_anchor.free_slist[smid];
 
-    /* link the slot to the tail of the list */
-    slot->next = NULL;
     if (list->tail == NULL) {
         assert(list->head == NULL && list->count == 0 && list->space == 0);
         slot->prev = NULL;
+        slot->next = NULL;
+        list->head = slot;
+        list->tail = slot;
+    } else if (sm_anchor.compacting &&
+               ((sm_blck_t*)((char*)slot - offset))->cgen != sm_anchor.compact_gen) {
+        /* While compacting, the free slots out of the evacuated blocks
+         * are linked to the head of the list to be allocated first.
+         */
+        assert(list->head != NULL && list->count > 0 && list->space > 0);
+        slot->prev = NULL;
+        slot->next = list->head;
+        slot->next->prev = slot;
         list->head = slot;
     } else {
+        /* link the slot to the tail of the list */
         assert(list->head != NULL && list->count > 0 && list->space > 0);
         slot->prev = list->tail;
+        slot->next = NULL;
         slot->prev->next = slot;
+        list->tail = slot;
     }
-    list->tail = slot;
     list->space += slen;
     list->count += 1;
     if (list->count == 1) {
@@ -618,10 +705,21 @@ static void do_smmgr_used_blck_check(void)
 }
 #endif
 
+/* the usage bucket of a block, in 1/SM_COMPACT_BUCKETS of the block body */
+#define SM_BLCK_USAGE(blck) (((SM_BBODY_SIZE - (blck)->frspc) * SM_COMPACT_BUCKETS) / SM_BBODY_SIZE)
+
+static inline void do_smmgr_blck_frspc_adjust(sm_blck_t *blck, int space)
+{
+    sm_anchor.blck_usage[SM_BLCK_USAGE(blck)] -= 1;
+    blck->frspc += space;
+    sm_anchor.blck_usage[SM_BLCK_USAGE(blck)] += 1;
+}
+
 static void do_smmgr_used_blck_link(sm_blck_t *blck)
 {
-    blck->frspc = 0;
-    blck->frcnt = 0;
+    blck->frspc = SM_BBODY_SIZE;
+    blck->cgen = 0;
+    sm_anchor.blck_usage[0] += 1;
 
     blck->prev = sm_anchor.used_blist.tail;
     blck->next = NULL;
@@ -637,6 +735,7 @@ static void do_smmgr_used_blck_link(sm_blck_t *blck)
 
 static void do_smmgr_used_blck_unlink(sm_blck_t *blck)
 {
+    sm_anchor.blck_usage[SM_BLCK_USAGE(blck)] -= 1;
     if (blck->prev != NULL) blck->prev->next = blck->next;
     if (blck->next != NULL) blck->next->prev = blck->prev;
     if (sm_anchor.used_blist.head == blck) sm_anchor.used_blist.head = blck->next;
@@ -660,6 +759,9 @@ static sm_blck_t *do_smmgr_blck_alloc(struct default_engine *engine)
 
 static void do_smmgr_blck_free(struct default_engine *engine, sm_blck_t *blck)
 {
+    if (sm_anchor.compacting && blck->cgen == sm_anchor.compact_gen) {
+        sm_anchor.compact_freed += 1;
+    }
     do_smmgr_used_blck_unlink(blck);
     do_slabs_free(engine, blck, SM_BLOCK_SIZE, SM_SLAB_CLSID);
     if (sm_anchor.free_limit_space > 0) {
@@ -807,6 +909,36 @@ static void do_smmgr_adjust_01pct_slot(int slen, int targ, bool alloc)
     }
 }
 
+static void do_smmgr_free_slot_split(sm_slot_t *cur_slot, int slen)
+{
+    sm_slot_t *nxt_slot;
+    int cur_offset = SM_REAL_OFFSET(cur_slot->offset);
+    int cur_length = SM_REAL_LENGTH(cur_slot->length);
+    assert(cur_length >= slen);
+
+    do_smmgr_free_slot_unlink(cur_slot);
+    do_smmgr_used_slot_init(cur_slot, cur_offset, slen);
+    do_smmgr_blck_frspc_adjust((sm_blck_t*)((char*)cur_slot - cur_offset), -slen);
+    if (cur_length > slen) {
+        nxt_slot = (sm_slot_t*)((char*)cur_slot + slen);
+        do_smmgr_free_slot_link(nxt_slot, cur_offset+slen, cur_length-slen);
+    }
+}
+
+static void do_smmgr_used_slot_stats(int slen, int targ, const size_t size)
+{
+    /* used slot stats */
+    sm_anchor.used_total_space += slen;
+    sm_anchor.used_slist[targ].space += slen;
+    sm_anchor.used_slist[targ].count += 1;
+    sm_anchor.used_slist[targ].requested += size;
+    if (sm_anchor.used_slist[targ].count == 1) {
+        do_smmgr_used_slot_list_add(targ);
+    }
+
+    do_smmgr_adjust_01pct_slot(slen, targ, true);
+}
+
 static void *do_smmgr_alloc(struct default_engine *engine, const size_t size)
 {
     sm_slot_t *cur_slot = NULL;
@@ -867,31 +999,14 @@ static void *do_smmgr_alloc(struct default_engine *engine, const size_t size)
 
         cur_slot = (sm_slot_t*)((char*)blck + SM_BHEAD_SIZE);
         do_smmgr_used_slot_init(cur_slot, SM_BHEAD_SIZE, slen);
+        do_smmgr_blck_frspc_adjust(blck, -slen);
 
         nxt_slot = (sm_slot_t*)((char*)cur_slot + slen);
         do_smmgr_free_slot_link(nxt_slot, SM_BHEAD_SIZE+slen, SM_BBODY_SIZE-slen);
     } else {
-        int cur_offset = SM_REAL_OFFSET(cur_slot->offset);
-        int cur_length = SM_REAL_LENGTH(cur_slot->length);
-        assert(cur_length >= slen);
-
-        do_smmgr_free_slot_unlink(cur_slot);
-        do_smmgr_used_slot_init(cur_slot, cur_offset, slen);
-        if (cur_length > slen) {
-            nxt_slot = (sm_slot_t*)((char*)cur_slot + slen);
-            do_smmgr_free_slot_link(nxt_slot, cur_offset+slen, cur_length-slen);
-        }
-    }
-
-    /* used slot stats */
-    sm_anchor.used_total_space += slen;
-    sm_anchor.used_slist[targ].space += slen;
-    sm_anchor.used_slist[targ].count += 1;
-    if (sm_anchor.used_slist[targ].count == 1) {
-        do_smmgr_used_slot_list_add(targ);
+        do_smmgr_free_slot_split(cur_slot, slen);
     }
-
-    do_smmgr_adjust_01pct_slot(slen, targ, true);
+    do_smmgr_used_slot_stats(slen, targ, size);
     return (void*)cur_slot;
 }
 
@@ -952,6 +1067,7 @@ static void do_smmgr_free(struct default_engine *engine, void *ptr, const size_t
     assert(cur_length == slen);
 
     cur_blck = (sm_blck_t*)((char*)cur_slot - cur_offset);
+    do_smmgr_blck_frspc_adjust(cur_blck, slen);
 
     /* check and merge the prev slot if it exists as freed state. */
     if (cur_offset > SM_BHEAD_SIZE) {
@@ -983,6 +1099,7 @@ static void do_smmgr_free(struct default_engine *engine, void *ptr, const size_t
     sm_anchor.used_total_space -= slen;
     sm_anchor.used_slist[targ].space -= slen;
     sm_anchor.used_slist[targ].count -= 1;
+    sm_anchor.used_slist[targ].requested -= size;
     if (sm_anchor.used_slist[targ].count == 0) {
         do_smmgr_used_slot_list_del(targ);
     }
@@ -991,6 +1108,164 @@ static void do_smmgr_free(struct default_engine *engine, void *ptr, const size_t
     //do_smmgr_used_blck_check();
 }
 
+/*
+ * SM compaction
+ *
+ * Collection elements are freed one by one, so used blocks can be left
+ * sparsely filled. A compaction run chooses the sparse blocks to evacuate,
+ * and the item module relocates their slots to the free slots of the other
+ * blocks. The emptied blocks are returned to slab class 0.
+ */
+static inline uint64_t do_smmgr_free_block_space(void)
+{
+    /* free space in the used blocks */
+    return sm_anchor.used_blist.count * SM_BBODY_SIZE - sm_anchor.used_total_space;
+}
+
+/* moves the free slots of evacuated blocks to the tail of the list */
+static void do_smmgr_compact_order_free_slist(sm_slist_t *list)
+{
+    sm_slot_t *slot = list->head;
+    sm_slot_t *evac_head = NULL;
+    sm_slot_t *evac_tail = NULL;
+    sm_slot_t *next;
+
+    while (slot != NULL) {
+        next = slot->next;
+        if (((sm_blck_t*)((char*)slot - SM_REAL_OFFSET(slot->offset)))->cgen == sm_anchor.compact_gen) {
+            if (slot->prev != NULL) slot->prev->next = slot->next;
+            else                    list->head = slot->next;
+            if (slot->next != NULL) slot->next->prev = slot->prev;
+            else                    list->tail = slot->prev;
+            slot->prev = evac_tail;
+            slot->next = NULL;
+            if (evac_tail != NULL) evac_tail->next = slot;
+            else                   evac_head = slot;
+            evac_tail = slot;
+        }
+        slot = next;
+    }
+    if (evac_head != NULL) {
+        evac_head->prev = list->tail;
+        if (list->tail != NULL) list->tail->next = evac_head;
+        else                    list->head = evac_head;
+        list->tail = evac_tail;
+    }
+}
+
+static uint32_t do_smmgr_compact_start(void)
+{
+    uint64_t blck_count[SM_COMPACT_BUCKETS+1];
+    uint64_t used_space[SM_COMPACT_BUCKETS+1];
+    uint64_t free_space = do_smmgr_free_block_space();
+    uint64_t evac_used = 0, evac_free = 0;
+    uint64_t part_count = 0;
+    uint32_t evac_count = 0;
+    sm_blck_t *blck;
+    int bucket, cut;
+
+    if (sm_anchor.used_blist.count < 2 ||
+        free_space * 100 < sm_anchor.used_blist.count * SM_BBODY_SIZE * SM_COMPACT_MIN_FRAG) {
+        return 0;
+    }
+
+    memset(blck_count, 0, sizeof(blck_count));
+    memset(used_space, 0, sizeof(used_space));
+    for (blck = sm_anchor.used_blist.head; blck != NULL; blck = blck->next) {
+        bucket = SM_BLCK_USAGE(blck);
+        blck_count[bucket] += 1;
+        used_space[bucket] += (SM_BBODY_SIZE - blck->frspc);
+    }
+
+    /* Evacuate the least used blocks as long as the free space of
+     * the other blocks can hold their slots with some room to spare.
+     */
+    for (cut = 0; cut < SM_COMPACT_MAX_CUT; cut++) {
+        uint64_t next_used = evac_used + used_space[cut];
+        uint64_t next_free = evac_free + (blck_count[cut] * SM_BBODY_SIZE - used_space[cut]);
+        if (next_used > ((free_space - next_free) / 10) * 9) {
+            break;
+        }
+        evac_used = next_used;
+        evac_free = next_free;
+        evac_count += blck_count[cut];
+    }
+    /* Some blocks of the boundary bucket can be evacuated, too.
+     * For example, all blocks can be used alike after many deletions.
+     */
+    if (cut < SM_COMPACT_MAX_CUT && blck_count[cut] > 0) {
+        uint64_t avail = ((free_space - evac_free) / 10) * 9;
+        uint64_t blck_used = used_space[cut] / blck_count[cut];
+        uint64_t blck_cost = blck_used + ((SM_BBODY_SIZE - blck_used) / 10) * 9;
+        if (avail > evac_used) {
+            part_count = (avail - evac_used) / blck_cost;
+            evac_count += part_count;
+        }
+    }
+    if (evac_count == 0) {
+        return 0;
+    }
+
+    sm_anchor.compact_gen += 1;
+    for (blck = sm_anchor.used_blist.head; blck != NULL; blck = blck->next) {
+        bucket = SM_BLCK_USAGE(blck);
+        if (bucket < cut || (bucket == cut && part_count > 0)) {
+            if (bucket == cut) part_count--;
+            blck->cgen = sm_anchor.compact_gen;
+        }
+    }
+    for (int smid = sm_anchor.free_minid; smid <= sm_anchor.free_maxid; smid++) {
+        do_smmgr_compact_order_free_slist(&sm_anchor.free_slist[smid]);
+    }
+    do_smmgr_compact_order_free_slist(&sm_anchor.free_slist[SM_NUM_CLASSES-1]);
+    sm_anchor.compacting = true;
+    sm_anchor.compact_freed_run = sm_anchor.compact_freed;
+    sm_anchor.compact_runs += 1;
+    sm_anchor.compact_blocks += evac_count;
+    return evac_count;
+}
+
+static void *do_smmgr_relocate(void *ptr, const size_t size)
+{
+    sm_slot_t *slot = NULL;
+    sm_tail_t *tail;
+    int slen, targ, smid, probes;
+
+    slen = do_smmgr_slen(size);
+    tail = (sm_tail_t*)((char*)ptr + slen - sizeof(sm_tail_t));
+    assert(SM_REAL_LENGTH(tail->length) == slen);
+    if (((sm_blck_t*)((char*)ptr - SM_REAL_OFFSET(tail->offset)))->cgen != sm_anchor.compact_gen) {
+        return NULL; /* the slot is not in an evacuated block */
+    }
+
+    /* find a free slot out of the evacuated blocks */
+    targ = do_smmgr_memid(slen, true);
+    smid = (targ > sm_anchor.free_minid) ? targ : sm_anchor.free_minid;
+    for ( ; smid < SM_NUM_CLASSES && slot == NULL; smid++) {
+        if (smid > sm_anchor.free_maxid) {
+            smid = SM_NUM_CLASSES-1;
+        }
+        probes = 0;
+        for (slot = sm_anchor.free_slist[smid].head; slot != NULL; slot = slot->next) {
+            sm_blck_t *blck = (sm_blck_t*)((char*)slot - SM_REAL_OFFSET(slot->offset));
+            if (blck->cgen != sm_anchor.compact_gen) {
+                break;
+            }
+            if (++probes >= SM_COMPACT_SLOT_PROBES) {
+                slot = NULL; break;
+            }
+        }
+    }
+    if (slot == NULL) {
+        return NULL;
+    }
+
+    do_smmgr_free_slot_split(slot, slen);
+    do_smmgr_used_slot_stats(slen, targ, size);
+    sm_anchor.compact_moved += 1;
+    return (void*)slot;
+}
+
 unsigned int slabs_space_size(struct default_engine *engine, const size_t size)
 {
     if (size <= MAX_SM_VALUE_LEN) {
@@ -1008,16 +1283,248 @@ int slabs_space_shortage_level(void)
     return sm_anchor.space_shortage_level;
 }
 
+int slabs_space_shortage_check(struct default_engine *engine)
+{
+    int ssl;
+    pthread_mutex_lock(&engine->slabs.lock);
+    do_slabs_check_space_shortage_level(engine);
+    ssl = sm_anchor.space_shortage_level;
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return ssl;
+}
+
+unsigned int slabs_headroom_short(struct default_engine *engine, unsigned int id,
+                                  unsigned int headroom)
+{
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    unsigned int nfree, nshort = 0;
+    size_t len;
+
+    pthread_mutex_lock(&engine->slabs.lock);
+    if (headroom > p->perslab) {
+        headroom = p->perslab; /* at most a page */
+    }
+    nfree = p->sl_curr + p->end_page_free;
+    if (nfree < headroom && engine->slabs.mem_limit != 0 && p->slabs >= p->rsvd_slabs) {
+        len = engine->config.slab_reassign ? engine->config.item_size_max
+                                           : (size_t)p->size * p->perslab;
+        if (engine->slabs.mem_malloced + len > engine->slabs.mem_limit) {
+            nshort = headroom - nfree;
+        }
+    }
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return nshort;
+}
+
+bool slabs_charge(struct default_engine *engine, size_t size)
+{
+    bool charged = true;
+    pthread_mutex_lock(&engine->slabs.lock);
+    if (engine->slabs.mem_limit != 0 &&
+        engine->slabs.mem_malloced + size > engine->slabs.mem_limit) {
+        charged = false;
+    } else {
+        engine->slabs.mem_malloced += size;
+    }
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return charged;
+}
+
+void slabs_uncharge(struct default_engine *engine, size_t size)
+{
+    pthread_mutex_lock(&engine->slabs.lock);
+    engine->slabs.mem_malloced -= size;
+    pthread_mutex_unlock(&engine->slabs.lock);
+}
+
+/*
+ * Slab arena
+ *
+ * If the cache memory is preallocated with large_pages or numa, the whole
+ * memory is mapped up front, and slab pages including the small memory
+ * blocks of slab class 0 are carved out of it by memory_allocate().
+ * With large_pages, explicit huge pages (MAP_HUGETLB) are used if the
+ * system has reserved enough of them, transparent huge pages
+ * (MADV_HUGEPAGE) otherwise.
+ */
+#ifndef ENABLE_COMPACT_ITEM
+static void *slabs_arena_map(struct default_engine *engine, const size_t size,
+                             const bool huge)
+{
+    size_t map_size = ((size - 1) / SLABS_HUGEPAGE_SIZE + 1) * SLABS_HUGEPAGE_SIZE;
+    size_t head;
+    char *base;
+
+#ifdef MAP_HUGETLB
+    base = huge ? mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)
+                : MAP_FAILED;
+    if (base != MAP_FAILED) {
+        engine->slabs.mem_arena = "hugetlb";
+        engine->slabs.mem_mapped = map_size;
+        return base;
+    }
+#endif
+
+    /* map one more huge page to align the arena to huge pages */
+    base = mmap(NULL, map_size + SLABS_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Failed to map the slab arena: %s\n", strerror(errno));
+        return NULL;
+    }
+    head = (SLABS_HUGEPAGE_SIZE - ((uintptr_t)base % SLABS_HUGEPAGE_SIZE)) % SLABS_HUGEPAGE_SIZE;
+    if (head > 0) {
+        munmap(base, head);
+    }
+    munmap(base + head + map_size, SLABS_HUGEPAGE_SIZE - head);
+    base += head;
+
+    engine->slabs.mem_arena = "mmap";
+#ifdef MADV_HUGEPAGE
+    if (!huge) {
+        /* small pages */
+    } else if (madvise(base, map_size, MADV_HUGEPAGE) == 0) {
+        engine->slabs.mem_arena = "thp";
+    } else {
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Failed to use transparent huge pages: %s\n", strerror(errno));
+    }
+#endif
+    engine->slabs.mem_mapped = map_size;
+    return base;
+}
+#endif
+
+/*
+ * NUMA node arenas
+ *
+ * With numa, the free part of the slab arena is split into one arena per
+ * NUMA node, and the pages of each node arena are placed on its node.
+ * Slab pages are allocated from the arena of the node that the allocating
+ * worker thread runs on (the server pins the worker threads to the nodes),
+ * and from the other nodes only if the local arena is exhausted.
+ */
+static void slabs_arena_numa_split(struct default_engine *engine)
+{
+    int nodes = mc_numa_nodes();
+    size_t slice = (engine->slabs.mem_avail / nodes) / SLABS_HUGEPAGE_SIZE * SLABS_HUGEPAGE_SIZE;
+    char *start = engine->slabs.mem_current;
+    int node;
+
+    if (slice == 0) {
+        nodes = 1;
+        slice = engine->slabs.mem_avail;
+    }
+    for (node = 0; node < nodes; node++) {
+        size_t len = (node < nodes - 1) ? slice
+                   : engine->slabs.mem_avail - slice * (nodes - 1);
+        engine->slabs.numa_arena[node].current = start;
+        engine->slabs.numa_arena[node].avail = len;
+#if defined(HAVE_LINUX_MEMPOLICY_H) && defined(SYS_mbind)
+        if (nodes > 1) {
+            /* preferred rather than bound, a full node falls back to the others */
+            unsigned long mask = 1UL << node;
+            if (syscall(SYS_mbind, start, len, MPOL_PREFERRED, &mask,
+                        sizeof(mask) * 8, 0) != 0) {
+                logger->log(EXTENSION_LOG_WARNING, NULL,
+                            "Failed to place the arena of NUMA node %d: %s\n",
+                            node, strerror(errno));
+            }
+        }
+#endif
+        start += len;
+    }
+    engine->slabs.numa_nodes = nodes;
+    engine->slabs.mem_current = start;
+    engine->slabs.mem_avail = 0;
+}
+
+static void *slabs_arena_numa_allocate(struct default_engine *engine, size_t size)
+{
+    int local = mc_numa_current_node() % engine->slabs.numa_nodes;
+    int i, node;
+    void *ret;
+
+    /* node arenas _must_ stay aligned!!! */
+    if (size % CHUNK_ALIGN_BYTES) {
+        size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
+    }
+    for (i = 0; i < engine->slabs.numa_nodes; i++) {
+        node = (local + i) % engine->slabs.numa_nodes;
+        if (size <= engine->slabs.numa_arena[node].avail) {
+            ret = engine->slabs.numa_arena[node].current;
+            engine->slabs.numa_arena[node].current = (char *)ret + size;
+            engine->slabs.numa_arena[node].avail -= size;
+            engine->slabs.numa_arena[node].pages++;
+            if (node != local) {
+                engine->slabs.numa_remote++;
+            }
+            return ret;
+        }
+    }
+    return NULL;
+}
+
+/* touches all pages of the arena so that page faults occur at startup */
+static void slabs_arena_prefault(void *base, const size_t size)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+    size_t offset;
+
+    if (pagesize <= 0) {
+        pagesize = 4096;
+    }
+    for (offset = 0; offset < size; offset += pagesize) {
+        ((volatile char *)base)[offset] = 0;
+    }
+}
+
 /**
  * Determines the chunk sizes and initializes the slab class descriptors
  * accordingly.
  */
+/* Parses the dash separated class sizes of slab_sizes. Returns the number
+ * of sizes, or -1 if they are not ascending sizes below item_size_max.
+ */
+static int slabs_parse_sizes(struct default_engine *engine, const char *str,
+                             unsigned int *sizes, const int max)
+{
+    int nsizes = 0;
+    char *end;
+
+    while (*str != '\0') {
+        unsigned long size;
+        if (*str < '0' || *str > '9') {
+            return -1;
+        }
+        size = strtoul(str, &end, 10);
+        if (size % CHUNK_ALIGN_BYTES)
+            size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
+        if (nsizes == max || size == 0 || size >= engine->config.item_size_max ||
+            (nsizes > 0 && size <= sizes[nsizes - 1])) {
+            return -1;
+        }
+        sizes[nsizes++] = size;
+        if (*end == '-' && end[1] != '\0') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        str = end;
+    }
+    return nsizes;
+}
+
 ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
                              const size_t limit, const double factor, const bool prealloc)
 {
     slabclass_t *p;
     int i = POWER_SMALLEST - 1;
     unsigned int size = sizeof(hash_item) + engine->config.chunk_size;
+    unsigned int sizes[POWER_LARGEST];
+    int nsizes = 0;
 
     logger = engine->server.log->get_logger();
 
@@ -1029,10 +1536,85 @@ ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
     if (engine->slabs.mem_reserved < (RSVD_SLAB_COUNT*engine->config.item_size_max))
         engine->slabs.mem_reserved = (RSVD_SLAB_COUNT*engine->config.item_size_max);
 
-    if (prealloc) {
+    if (engine->config.item_chunk_size > 0) {
+        /* the value of an item must fit in the value iovecs of its item info */
+        size_t csize = engine->config.item_chunk_size
+                     - engine->config.item_chunk_size % CHUNK_ALIGN_BYTES;
+        if (csize <= MAX_SM_VALUE_LEN || csize > engine->config.item_size_max / 2 ||
+            engine->config.item_size_max / (csize - sizeof(item_chunk)) >= ITEM_INFO_MAX_IOVS) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "item_chunk_size must be larger than %d bytes, at most half of "
+                        "item_size_max, and large enough to store an item in at most %d chunks.\n",
+                        MAX_SM_VALUE_LEN, ITEM_INFO_MAX_IOVS - 1);
+            return ENGINE_EBADVALUE;
+        }
+    }
+
+    if (engine->config.slab_sizes != NULL) {
+        /* leave room for the largest class and the chunk class */
+        nsizes = slabs_parse_sizes(engine, engine->config.slab_sizes, sizes, POWER_LARGEST - 2);
+        if (nsizes <= 0) {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "slab_sizes must be at most %d ascending sizes below item_size_max, "
+                        "separated by dashes.\n", POWER_LARGEST - 2);
+            return ENGINE_EBADVALUE;
+        }
+    }
+
+#ifdef ENABLE_COMPACT_ITEM
+    /* Compact items refer to each other by offsets in one slab arena.
+     * Reserve the address space of the arena up front, the memory is
+     * committed as slab pages are allocated from it.
+     */
+    (void)prealloc;
+    if (limit > ITEM_ARENA_SIZE) {
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "The compact item header supports up to %llu bytes of cache memory.\n",
+                    (unsigned long long)ITEM_ARENA_SIZE);
+        return ENGINE_EBADVALUE;
+    }
+    engine->slabs.mem_base = mmap(NULL, ITEM_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (engine->slabs.mem_base == MAP_FAILED) {
+        engine->slabs.mem_base = NULL;
+        return ENGINE_ENOMEM;
+    }
+    engine->slabs.mem_arena = "mmap";
+#ifdef MADV_HUGEPAGE
+    if (engine->config.large_pages) {
+        if (madvise(engine->slabs.mem_base, ITEM_ARENA_SIZE, MADV_HUGEPAGE) == 0) {
+            engine->slabs.mem_arena = "thp";
+        } else {
+            logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Failed to use transparent huge pages: %s\n", strerror(errno));
+        }
+    }
+#endif
+    engine->slabs.mem_current = engine->slabs.mem_base;
+    engine->slabs.mem_avail = ITEM_ARENA_SIZE;
+    if (engine->config.numa) {
+        slabs_arena_numa_split(engine);
+    }
+    if (engine->config.prefault) {
+        slabs_arena_prefault(engine->slabs.mem_base, limit);
+    }
+    item_arena = engine->slabs.mem_base;
+#else
+    if (prealloc && (engine->config.large_pages || engine->config.numa)) {
+        /* Map everything in a big chunk, backed by huge pages with large_pages */
+        engine->slabs.mem_base = slabs_arena_map(engine, engine->slabs.mem_limit,
+                                                 engine->config.large_pages);
+        if (engine->slabs.mem_base != NULL) {
+            engine->slabs.mem_current = engine->slabs.mem_base;
+            engine->slabs.mem_avail = engine->slabs.mem_limit;
+        } else {
+            return ENGINE_ENOMEM;
+        }
+    } else if (prealloc) {
         /* Allocate everything in a big chunk with malloc */
         engine->slabs.mem_base = malloc(engine->slabs.mem_limit);
         if (engine->slabs.mem_base != NULL) {
+            engine->slabs.mem_arena = "malloc";
             engine->slabs.mem_current = engine->slabs.mem_base;
             engine->slabs.mem_avail = engine->slabs.mem_limit;
         } else {
@@ -1043,10 +1625,22 @@ ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
         engine->slabs.mem_current = NULL;
         engine->slabs.mem_avail = 0;
     }
+    if (engine->slabs.mem_base != NULL && engine->config.numa) {
+        slabs_arena_numa_split(engine);
+    }
+    if (engine->slabs.mem_base != NULL && engine->config.prefault) {
+        slabs_arena_prefault(engine->slabs.mem_base, engine->slabs.mem_limit);
+    }
+#endif
 
     memset(engine->slabs.slabclass, 0, sizeof(engine->slabs.slabclass));
 
-    while (++i < POWER_LARGEST && size <= engine->config.item_size_max / factor) {
+    /* The class sizes grow by the factor, unless they are given by slab_sizes */
+    while (++i < POWER_LARGEST && (nsizes > 0 ? i <= nsizes
+                                              : size <= engine->config.item_size_max / factor)) {
+        if (nsizes > 0) {
+            size = sizes[i - POWER_SMALLEST];
+        }
         /* Make sure items are always n-byte aligned */
         if (size % CHUNK_ALIGN_BYTES)
             size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
@@ -1074,6 +1668,24 @@ ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
                 i, p->size, p->perslab);
     }
 
+    /* The chunk class follows the largest class. Large items are stored
+     * in its chunks, except the tail of the value kept in the item header.
+     */
+    engine->slabs.chunk_clsid = 0;
+    if (engine->config.item_chunk_size > 0 && i < POWER_LARGEST) {
+        engine->slabs.chunk_clsid = ++i;
+        p = &engine->slabs.slabclass[i];
+        p->size = engine->config.item_chunk_size
+                - engine->config.item_chunk_size % CHUNK_ALIGN_BYTES;
+        p->perslab = engine->config.item_size_max / p->size;
+        p->rsvd_slabs = RSVD_SLAB_COUNT;
+
+        if (engine->config.verbose > 1) {
+            fprintf(stderr, "slab class %3d: chunk size %9u perslab %7u (value chunks)\n",
+                    i, p->size, p->perslab);
+        }
+    }
+
     /* for the test suite:  faking of how much we've already malloc'd */
     {
         char *t_initial_malloc = getenv("T_MEMD_INITIAL_MALLOC");
@@ -1091,22 +1703,51 @@ ENGINE_ERROR_CODE slabs_init(struct default_engine *engine,
     }
 #endif
 
+    engine->slabs.tcaches = NULL;
+    tcache_gen++;
+
     if (do_smmgr_init(engine) != 0) {
         if (engine->slabs.mem_base != NULL) {
-            free(engine->slabs.mem_base);
+#ifdef ENABLE_COMPACT_ITEM
+            munmap(engine->slabs.mem_base, ITEM_ARENA_SIZE);
+            item_arena = NULL;
+#else
+            if (engine->slabs.mem_mapped > 0) {
+                munmap(engine->slabs.mem_base, engine->slabs.mem_mapped);
+                engine->slabs.mem_mapped = 0;
+            } else {
+                free(engine->slabs.mem_base);
+            }
+#endif
             engine->slabs.mem_base = NULL;
         }
         return ENGINE_ENOMEM;
     }
 
+    engine->slabs.size_hist = NULL;
+    engine->slabs.size_samples = 0;
+    engine->slabs.size_sample_tick = 0;
+    if (engine->config.slab_sizes_sample > 0) {
+        slabs_size_hist_init(engine);
+    }
+
     logger->log(EXTENSION_LOG_INFO, NULL, "SLABS module initialized.\n");
     return ENGINE_SUCCESS;
 }
 
 void slabs_final(struct default_engine *engine)
 {
+    struct slabs_tcache *tc;
+
     /* Free memory allocated. */
+    while ((tc = engine->slabs.tcaches) != NULL) {
+        engine->slabs.tcaches = tc->next;
+        pthread_spin_destroy(&tc->lock);
+        free(tc);
+    }
     do_smmgr_final(engine);
+    free(engine->slabs.size_hist);
+    engine->slabs.size_hist = NULL;
     logger->log(EXTENSION_LOG_INFO, NULL, "SLABS module destroyed.\n");
 }
 
@@ -1146,45 +1787,80 @@ static int grow_slab_list (struct default_engine *engine, const unsigned int id)
     return 1;
 }
 
-static int do_slabs_newslab(struct default_engine *engine, const unsigned int id)
+static int grow_slab_slots(slabclass_t *p, const unsigned int count)
+{
+    if (p->sl_total < count) {
+        unsigned int new_size = (p->sl_total != 0) ? p->sl_total : 16;
+        while (new_size < count) {
+            new_size *= 2;
+        }
+        void **new_slots = realloc(p->slots, new_size * sizeof(void *));
+        if (new_slots == 0) return 0;
+        p->slots = new_slots;
+        p->sl_total = new_size;
+    }
+    return 1;
+}
+
+/* The zeroed page becomes the end page of the slab class.
+ * The slab list must have room for the page.
+ */
+static void do_slabs_page_link(struct default_engine *engine, const unsigned int id, void *ptr)
 {
     slabclass_t *p = &engine->slabs.slabclass[id];
-    int len = p->size * p->perslab;
-    char *ptr;
 
-    if ((engine->slabs.mem_limit && engine->slabs.mem_malloced + len > engine->slabs.mem_limit && p->slabs >= p->rsvd_slabs) ||
-        (grow_slab_list(engine, id) == 0) ||
-        ((ptr = memory_allocate(engine, (size_t)len)) == 0)) {
-
-        MEMCACHED_SLABS_SLABCLASS_ALLOCATE_FAILED(id);
-        return 0;
-    }
-
-    memset(ptr, 0, (size_t)len);
-    p->end_page_ptr = ptr;
-    p->end_page_free = p->perslab;
+    p->end_page_ptr = ptr;
+    p->end_page_free = p->perslab;
 
     p->slab_list[p->slabs++] = ptr;
-    engine->slabs.mem_malloced += len;
 
     if (id == SM_SLAB_CLSID && p->rsvd_slabs > 0 && p->slabs > p->rsvd_slabs) {
         sm_anchor.free_limit_space += (p->perslab * p->size);
         sm_anchor.free_chunk_space += (p->perslab * p->size);
     }
+}
+
+/* define the reserved slab count of slab class 0 */
+static void do_slabs_rsvd_slabs_define(struct default_engine *engine)
+{
+    slabclass_t *z = &engine->slabs.slabclass[SM_SLAB_CLSID];
+    unsigned int additional_slabs = (z->slabs/100) * RSVD_SLAB_RATIO;
+    if (additional_slabs < RSVD_SLAB_COUNT)
+        additional_slabs = RSVD_SLAB_COUNT;
+    z->rsvd_slabs = z->slabs + additional_slabs;
+    sm_anchor.free_limit_space = (additional_slabs * z->perslab) * SM_BLOCK_SIZE;
+    sm_anchor.free_chunk_space = sm_anchor.free_limit_space
+                               + (z->sl_curr + z->end_page_free) * SM_BLOCK_SIZE;
+}
+
+static int do_slabs_newslab(struct default_engine *engine, const unsigned int id)
+{
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    int len = p->size * p->perslab;
+    char *ptr;
+
+    if (engine->config.slab_reassign) {
+        /* pages of the same size can be moved between slab classes */
+        len = engine->config.item_size_max;
+    }
+
+    if ((engine->slabs.mem_limit && engine->slabs.mem_malloced + len > engine->slabs.mem_limit && p->slabs >= p->rsvd_slabs) ||
+        (grow_slab_list(engine, id) == 0) ||
+        ((ptr = memory_allocate(engine, (size_t)len)) == 0)) {
+
+        MEMCACHED_SLABS_SLABCLASS_ALLOCATE_FAILED(id);
+        return 0;
+    }
+
+    memset(ptr, 0, (size_t)len);
+    do_slabs_page_link(engine, id, ptr);
+    engine->slabs.mem_malloced += len;
 
     if ((engine->slabs.mem_limit <= engine->slabs.mem_malloced) ||
         ((engine->slabs.mem_limit - engine->slabs.mem_malloced) < engine->slabs.mem_reserved))
     {
         if (engine->slabs.slabclass[SM_SLAB_CLSID].rsvd_slabs == 0) { /* undefined */
-            /* define the reserved slab count of slab class 0 */
-            slabclass_t *z = &engine->slabs.slabclass[SM_SLAB_CLSID];
-            unsigned int additional_slabs = (z->slabs/100) * RSVD_SLAB_RATIO;
-            if (additional_slabs < RSVD_SLAB_COUNT)
-                additional_slabs = RSVD_SLAB_COUNT;
-            z->rsvd_slabs = z->slabs + additional_slabs;
-            sm_anchor.free_limit_space = (additional_slabs * z->perslab) * SM_BLOCK_SIZE;
-            sm_anchor.free_chunk_space = sm_anchor.free_limit_space
-                                       + (z->sl_curr + z->end_page_free) * SM_BLOCK_SIZE;
+            do_slabs_rsvd_slabs_define(engine);
         }
     }
     MEMCACHED_SLABS_SLABCLASS_ALLOCATE(id);
@@ -1304,6 +1980,214 @@ void add_statistics(const void *cookie, ADD_STAT add_stats,
     add_stats(name, klen, val, vlen, cookie);
 }
 
+/*
+ * Per-thread magazines
+ *
+ * With magazine_size, the memory of collection elements and nodes freed
+ * by a thread is kept in the magazine of its slot length, and is reused
+ * by the allocations of the thread without the cache lock and the slabs
+ * lock. Empty magazines are refilled with half of magazine_size slots,
+ * and full ones are drained by half, under one slabs lock acquisition.
+ * The magazines are bypassed while the small memory space is short, so
+ * that the allocations go through the eviction path, and are flushed
+ * when a compaction run starts.
+ */
+static inline void slabs_lock(struct default_engine *engine)
+{
+    if (pthread_mutex_trylock(&engine->slabs.lock) != 0) {
+        pthread_mutex_lock(&engine->slabs.lock);
+        engine->slabs.lock_contended++;
+    }
+    engine->slabs.lock_acquired++;
+}
+
+static struct slabs_tcache *slabs_tcache_get(struct default_engine *engine)
+{
+    struct slabs_tcache *tc = thread_tcache;
+
+    if (tc == NULL || thread_tcache_gen != tcache_gen) {
+        tc = calloc(1, sizeof(struct slabs_tcache));
+        if (tc == NULL) {
+            return NULL;
+        }
+        pthread_spin_init(&tc->lock, PTHREAD_PROCESS_PRIVATE);
+        slabs_lock(engine);
+        tc->next = engine->slabs.tcaches;
+        engine->slabs.tcaches = tc;
+        pthread_mutex_unlock(&engine->slabs.lock);
+        thread_tcache = tc;
+        thread_tcache_gen = tcache_gen;
+    }
+    return tc;
+}
+
+void *slabs_tcache_alloc(struct default_engine *engine, const size_t size)
+{
+    struct slabs_tcache *tc;
+    sm_slot_t *slot;
+    int slen, cls;
+    uint32_t count;
+
+    if (engine->config.magazine_size == 0 || size > SLABS_TCACHE_MAX_SLEN) {
+        return NULL;
+    }
+    slen = do_smmgr_slen(size);
+    if (slen > SLABS_TCACHE_MAX_SLEN || (tc = slabs_tcache_get(engine)) == NULL) {
+        return NULL;
+    }
+    cls = slen / 8;
+
+    pthread_spin_lock(&tc->lock);
+    if (tc->mags[cls].count == 0) {
+        tc->misses++;
+        if (sm_anchor.space_shortage_level > 0) {
+            pthread_spin_unlock(&tc->lock);
+            return NULL;
+        }
+        count = (engine->config.magazine_size + 1) / 2;
+        slabs_lock(engine);
+        while (tc->mags[cls].count < count) {
+            slot = do_smmgr_alloc(engine, slen - sizeof(sm_tail_t));
+            if (slot == NULL) {
+                break;
+            }
+            slot->next = tc->mags[cls].head;
+            tc->mags[cls].head = slot;
+            tc->mags[cls].count++;
+            tc->bytes += slen;
+        }
+        pthread_mutex_unlock(&engine->slabs.lock);
+        if (tc->mags[cls].count == 0) {
+            pthread_spin_unlock(&tc->lock);
+            return NULL;
+        }
+        tc->refills++;
+    }
+
+    slot = tc->mags[cls].head;
+    tc->mags[cls].head = slot->next;
+    tc->mags[cls].count--;
+    tc->bytes -= slen;
+    tc->hits++;
+    pthread_spin_unlock(&tc->lock);
+    return slot;
+}
+
+bool slabs_tcache_free(struct default_engine *engine, void *ptr, const size_t size)
+{
+    struct slabs_tcache *tc;
+    sm_slot_t *slot = ptr;
+    int slen, cls;
+    uint32_t count;
+
+    if (engine->config.magazine_size == 0 || size > SLABS_TCACHE_MAX_SLEN ||
+        sm_anchor.space_shortage_level > 0) {
+        return false;
+    }
+    slen = do_smmgr_slen(size);
+    if (slen > SLABS_TCACHE_MAX_SLEN) {
+        return false;
+    }
+    if (sm_anchor.compacting) {
+        sm_tail_t *tail = (sm_tail_t*)((char*)ptr + slen - sizeof(sm_tail_t));
+        if (((sm_blck_t*)((char*)ptr - SM_REAL_OFFSET(tail->offset)))->cgen == sm_anchor.compact_gen) {
+            return false; /* the block is being evacuated */
+        }
+    }
+    if ((tc = slabs_tcache_get(engine)) == NULL) {
+        return false;
+    }
+    cls = slen / 8;
+
+    pthread_spin_lock(&tc->lock);
+    slot->status = (uint32_t)-1; /* used slot */
+    slot->next = tc->mags[cls].head;
+    tc->mags[cls].head = slot;
+    tc->mags[cls].count++;
+    tc->bytes += slen;
+
+    if (tc->mags[cls].count > engine->config.magazine_size ||
+        tc->bytes > SLABS_TCACHE_MAX_BYTES) {
+        count = (tc->mags[cls].count + 1) / 2;
+        slabs_lock(engine);
+        while (count-- > 0) {
+            slot = tc->mags[cls].head;
+            tc->mags[cls].head = slot->next;
+            tc->mags[cls].count--;
+            tc->bytes -= slen;
+            do_smmgr_free(engine, slot, slen - sizeof(sm_tail_t));
+        }
+        pthread_mutex_unlock(&engine->slabs.lock);
+        tc->drains++;
+    }
+    pthread_spin_unlock(&tc->lock);
+    return true;
+}
+
+/* Returns the slots of all magazines to the small memory allocator,
+ * so that the compaction can free the blocks holding them.
+ * The thread caches are only added to the head of the list.
+ */
+static void slabs_tcache_flush(struct default_engine *engine)
+{
+    struct slabs_tcache *tc;
+    sm_slot_t *slot;
+    int cls;
+
+    pthread_mutex_lock(&engine->slabs.lock);
+    tc = engine->slabs.tcaches;
+    pthread_mutex_unlock(&engine->slabs.lock);
+
+    for ( ; tc != NULL; tc = tc->next) {
+        pthread_spin_lock(&tc->lock);
+        if (tc->bytes > 0) {
+            slabs_lock(engine);
+            for (cls = 0; cls < SLABS_TCACHE_CLASSES; cls++) {
+                while ((slot = tc->mags[cls].head) != NULL) {
+                    tc->mags[cls].head = slot->next;
+                    do_smmgr_free(engine, slot, cls * 8 - sizeof(sm_tail_t));
+                }
+                tc->mags[cls].count = 0;
+            }
+            tc->bytes = 0;
+            pthread_mutex_unlock(&engine->slabs.lock);
+            tc->drains++;
+        }
+        pthread_spin_unlock(&tc->lock);
+    }
+}
+
+static void do_slabs_tcache_stats(struct default_engine *engine, ADD_STAT add_stats, const void *cookie)
+{
+    struct slabs_tcache *tc;
+    uint64_t threads = 0, bytes = 0, hits = 0, misses = 0, refills = 0, drains = 0;
+
+    for (tc = engine->slabs.tcaches; tc != NULL; tc = tc->next) {
+        threads++;
+        bytes += tc->bytes;
+        hits += tc->hits;
+        misses += tc->misses;
+        refills += tc->refills;
+        drains += tc->drains;
+    }
+    add_statistics(cookie, add_stats, NULL, -1, "magazine_size", "%zu", engine->config.magazine_size);
+    add_statistics(cookie, add_stats, NULL, -1, "magazine_threads", "%"PRIu64, threads);
+    add_statistics(cookie, add_stats, NULL, -1, "magazine_bytes", "%"PRIu64, bytes);
+    add_statistics(cookie, add_stats, NULL, -1, "magazine_hits", "%"PRIu64, hits);
+    add_statistics(cookie, add_stats, NULL, -1, "magazine_misses", "%"PRIu64, misses);
+    add_statistics(cookie, add_stats, NULL, -1, "magazine_refills", "%"PRIu64, refills);
+    add_statistics(cookie, add_stats, NULL, -1, "magazine_drains", "%"PRIu64, drains);
+    add_statistics(cookie, add_stats, NULL, -1, "slabs_lock_acquired", "%"PRIu64, engine->slabs.lock_acquired);
+    add_statistics(cookie, add_stats, NULL, -1, "slabs_lock_contended", "%"PRIu64, engine->slabs.lock_contended);
+}
+
+/* the last slab class, which is the chunk class if large items are chunked */
+static inline int do_slabs_last_clsid(struct default_engine *engine)
+{
+    return engine->slabs.chunk_clsid != 0 ? engine->slabs.chunk_clsid
+                                          : engine->slabs.power_largest;
+}
+
 /*@null@*/
 static void do_slabs_stats(struct default_engine *engine, ADD_STAT add_stats, const void *cookie)
 {
@@ -1331,16 +2215,29 @@ static void do_slabs_stats(struct default_engine *engine, ADD_STAT add_stats, co
     add_statistics(cookie, add_stats, "SM", -1, "free_chunk_space", "%"PRIu64, sm_anchor.free_chunk_space);
     add_statistics(cookie, add_stats, "SM", -1, "free_limit_space", "%"PRIu64, sm_anchor.free_limit_space);
     add_statistics(cookie, add_stats, "SM", -1, "space_shortage_level", "%d", sm_anchor.space_shortage_level);
+    add_statistics(cookie, add_stats, "SM", -1, "used_block_count", "%"PRIu64, sm_anchor.used_blist.count);
+    add_statistics(cookie, add_stats, "SM", -1, "free_block_space", "%"PRIu64, do_smmgr_free_block_space());
+    add_statistics(cookie, add_stats, "SM", -1, "fragmentation", "%.2f",
+                   sm_anchor.used_blist.count == 0 ? 0.0 :
+                   (double)do_smmgr_free_block_space() / (sm_anchor.used_blist.count * SM_BBODY_SIZE));
+    add_statistics(cookie, add_stats, "SM", -1, "compact_runs", "%"PRIu64, sm_anchor.compact_runs);
+    add_statistics(cookie, add_stats, "SM", -1, "compact_blocks", "%"PRIu64, sm_anchor.compact_blocks);
+    add_statistics(cookie, add_stats, "SM", -1, "compact_moved_slots", "%"PRIu64, sm_anchor.compact_moved);
+    add_statistics(cookie, add_stats, "SM", -1, "compact_freed_blocks", "%"PRIu64, sm_anchor.compact_freed);
+    do_slabs_tcache_stats(engine, add_stats, cookie);
 
     total = 0;
+    uint64_t used_bytes = 0, wasted_bytes = 0;
     int min_slab_id = POWER_SMALLEST;
     min_slab_id = SM_SLAB_CLSID;
-    for (i = min_slab_id; i <= engine->slabs.power_largest; i++) {
+    for (i = min_slab_id; i <= do_slabs_last_clsid(engine); i++) {
         slabclass_t *p = &engine->slabs.slabclass[i];
         if (p->slabs != 0) {
             uint32_t perslab, slabs;
+            uint64_t used;
             slabs = p->slabs;
             perslab = p->perslab;
+            used = (uint64_t)((slabs*perslab)-p->sl_curr-p->end_page_free) * p->size;
 
             add_statistics(cookie, add_stats, NULL, i, "chunk_size", "%u", p->size);
             add_statistics(cookie, add_stats, NULL, i, "chunks_per_page", "%u", perslab);
@@ -1351,6 +2248,16 @@ static void do_slabs_stats(struct default_engine *engine, ADD_STAT add_stats, co
             add_statistics(cookie, add_stats, NULL, i, "free_chunks", "%u", p->sl_curr);
             add_statistics(cookie, add_stats, NULL, i, "free_chunks_end", "%u", p->end_page_free);
             add_statistics(cookie, add_stats, NULL, i, "mem_requested", "%llu", (unsigned long long)p->requested);
+            if (i != SM_SLAB_CLSID) {
+                /* the slots of class 0 are split from its pages by the small memory allocator */
+                add_statistics(cookie, add_stats, NULL, i, "mem_wasted", "%"PRIu64,
+                               used > p->requested ? used - p->requested : 0);
+                used_bytes += used;
+                wasted_bytes += (used > p->requested ? used - p->requested : 0);
+            }
+            add_statistics(cookie, add_stats, NULL, i, "pages_moved_in", "%"PRIu64, p->pages_moved_in);
+            add_statistics(cookie, add_stats, NULL, i, "pages_moved_out", "%"PRIu64, p->pages_moved_out);
+            add_statistics(cookie, add_stats, NULL, i, "reassign_evicted", "%"PRIu64, p->reassign_evicted);
 #ifdef FUTURE
             add_statistics(cookie, add_stats, NULL, i, "get_hits", "%"PRIu64, thread_stats.slab_stats[i].get_hits);
             add_statistics(cookie, add_stats, NULL, i, "cmd_set", "%"PRIu64, thread_stats.slab_stats[i].set_cmds);
@@ -1364,8 +2271,320 @@ static void do_slabs_stats(struct default_engine *engine, ADD_STAT add_stats, co
 
     /* add overall slab stats and append terminator */
     add_statistics(cookie, add_stats, NULL, -1, "active_slabs", "%d", total);
+    add_statistics(cookie, add_stats, NULL, -1, "item_chunk_size", "%u",
+                   engine->slabs.chunk_clsid != 0 ? engine->slabs.slabclass[engine->slabs.chunk_clsid].size : 0);
+    add_statistics(cookie, add_stats, NULL, -1, "wasted_bytes", "%"PRIu64, wasted_bytes);
+    add_statistics(cookie, add_stats, NULL, -1, "wasted_ratio", "%.4f",
+                   used_bytes == 0 ? 0.0 : (double)wasted_bytes / used_bytes);
+    add_statistics(cookie, add_stats, NULL, -1, "memory_limit", "%llu", (unsigned long long)engine->slabs.mem_limit);
+    add_statistics(cookie, add_stats, NULL, -1, "total_malloced", "%llu", (unsigned long long)engine->slabs.mem_malloced);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_arena", "%s",
+                   engine->slabs.mem_arena != NULL ? engine->slabs.mem_arena : "none");
+    add_statistics(cookie, add_stats, NULL, -1, "numa_nodes", "%d", engine->slabs.numa_nodes);
+    for (i = 0; i < engine->slabs.numa_nodes; i++) {
+        add_statistics(cookie, add_stats, "numa", i, "slab_pages", "%"PRIu64,
+                       engine->slabs.numa_arena[i].pages);
+    }
+    if (engine->slabs.numa_nodes > 0) {
+        add_statistics(cookie, add_stats, NULL, -1, "numa_remote_pages", "%"PRIu64,
+                       engine->slabs.numa_remote);
+    }
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign", "%s", engine->config.slab_reassign ? "on" : "off");
+    add_statistics(cookie, add_stats, NULL, -1, "slab_automove", "%s", engine->config.slab_automove ? "on" : "off");
+    add_statistics(cookie, add_stats, NULL, -1, "slabs_moved", "%"PRIu64, engine->slabs.slabs_moved);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_reassign_busy", "%"PRIu64, engine->slabs.reassign_busy);
+}
+
+/*
+ * Slab class size tuning
+ *
+ * With slab_sizes_sample, one of every slab_sizes_sample allocations from
+ * the slab classes is sampled into a histogram of the allocation sizes.
+ * "stats slabs" shows the class sizes that minimize the internal
+ * fragmentation of the sampled sizes, with as many classes as the current
+ * layout has above the small memory sizes, and the estimated waste ratio of
+ * both layouts. The class sizes can't change while items are stored in
+ * them, so the tuned sizes are applied with slab_sizes at the next restart,
+ * and the slab pages are then shared among the classes by the page mover.
+ */
+#define SIZE_HIST_BUCKETS 4096  /* buckets of the size histogram */
+#define SIZE_TUNE_POINTS  512   /* at most as many sizes are tuned for */
+
+static void slabs_size_hist_init(struct default_engine *engine)
+{
+    uint32_t unit = (engine->config.item_size_max + SIZE_HIST_BUCKETS - 1) / SIZE_HIST_BUCKETS;
+    if (unit % CHUNK_ALIGN_BYTES)
+        unit += CHUNK_ALIGN_BYTES - (unit % CHUNK_ALIGN_BYTES);
+
+    engine->slabs.size_hist_unit = unit;
+    engine->slabs.size_hist_buckets = (engine->config.item_size_max + unit - 1) / unit;
+    engine->slabs.size_hist = calloc(engine->slabs.size_hist_buckets, sizeof(uint32_t));
+    if (engine->slabs.size_hist == NULL) {
+        logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Can't allocate the size histogram, slab_sizes_sample is ignored.\n");
+    }
+}
+
+void slabs_sample_size(struct default_engine *engine, const size_t size)
+{
+    if (engine->slabs.size_hist == NULL || size > engine->config.item_size_max) {
+        return;
+    }
+    /* the tick is protected by the cache lock */
+    if (++engine->slabs.size_sample_tick < engine->config.slab_sizes_sample) {
+        return;
+    }
+    engine->slabs.size_sample_tick = 0;
+
+    pthread_mutex_lock(&engine->slabs.lock);
+    engine->slabs.size_hist[(size - 1) / engine->slabs.size_hist_unit]++;
+    engine->slabs.size_samples++;
+    pthread_mutex_unlock(&engine->slabs.lock);
+}
+
+/* the upper bound of the sizes of a histogram bucket */
+static inline uint32_t do_slabs_size_hist_bound(struct default_engine *engine, int b)
+{
+    uint32_t bound = (b + 1) * engine->slabs.size_hist_unit;
+    return bound < engine->config.item_size_max ? bound : engine->config.item_size_max;
+}
+
+/* The waste of the sampled sizes of the first..last points, stored in
+ * chunks of the given size. pc and ps are the prefix sums of the counts
+ * and the sizes of the points.
+ */
+static inline double do_slabs_tune_waste(const double *pc, const double *ps,
+                                         const double size, int first, int last)
+{
+    return size * (pc[last + 1] - pc[first]) - (ps[last + 1] - ps[first]);
+}
+
+/* Chooses at most maxsizes class sizes below item_size_max among the
+ * sampled sizes, minimizing the waste of the samples with the largest
+ * class of item_size_max. This is a dynamic programming over the points:
+ * the least waste of the points 0..j with k classes, the last of which
+ * is the size of the point j. Returns the number of chosen sizes.
+ */
+static int do_slabs_tune_sizes(struct default_engine *engine, const uint32_t *pu,
+                               const double *pc, const double *ps, int npoints,
+                               unsigned int *sizes, int maxsizes)
+{
+    double max = engine->config.item_size_max;
+    double *prev, *cur, best;
+    int *from;
+    int ncands = npoints, nsizes = 0;
+    int i, j, k, bestk = 0, bestj = -1;
+
+    /* a point of item_size_max is always stored in the largest class */
+    if (ncands > 0 && pu[ncands - 1] >= engine->config.item_size_max) {
+        ncands--;
+    }
+    if (maxsizes > ncands) {
+        maxsizes = ncands;
+    }
+    if (maxsizes == 0) {
+        return 0;
+    }
+    prev = malloc(sizeof(double) * ncands * 2);
+    from = malloc(sizeof(int) * ncands * maxsizes);
+    if (prev == NULL || from == NULL) {
+        free(prev);
+        free(from);
+        return 0;
+    }
+    cur = prev + ncands;
+
+    best = do_slabs_tune_waste(pc, ps, max, 0, npoints - 1);
+    for (k = 1; k <= maxsizes; k++) {
+        for (j = k - 1; j < ncands; j++) {
+            if (k == 1) {
+                cur[j] = do_slabs_tune_waste(pc, ps, pu[j], 0, j);
+                from[j] = -1;
+            } else {
+                cur[j] = -1;
+                for (i = k - 2; i < j; i++) {
+                    double waste = prev[i] + do_slabs_tune_waste(pc, ps, pu[j], i + 1, j);
+                    if (cur[j] < 0 || waste < cur[j]) {
+                        cur[j] = waste;
+                        from[(k - 1) * ncands + j] = i;
+                    }
+                }
+            }
+            /* the points above j are stored in the largest class */
+            double waste = cur[j] + (j + 1 < npoints
+                                     ? do_slabs_tune_waste(pc, ps, max, j + 1, npoints - 1) : 0);
+            if (waste < best) {
+                best = waste;
+                bestk = k;
+                bestj = j;
+            }
+        }
+        memcpy(prev, cur, sizeof(double) * ncands);
+    }
+
+    for (k = bestk, j = bestj; k > 0; k--) {
+        sizes[k - 1] = pu[j];
+        j = from[(k - 1) * ncands + j];
+    }
+    nsizes = bestk;
+
+    free(prev);
+    free(from);
+    return nsizes;
+}
+
+/* estimated waste ratio of the sampled sizes with the given class sizes */
+static double do_slabs_tune_ratio(struct default_engine *engine, const uint32_t *hist,
+                                  const unsigned int *sizes, int nsizes)
+{
+    double used = 0, wasted = 0;
+    int b, n = 0;
+
+    for (b = 0; b < engine->slabs.size_hist_buckets; b++) {
+        uint32_t bound = do_slabs_size_hist_bound(engine, b);
+        uint32_t csize;
+        if (hist[b] == 0) {
+            continue;
+        }
+        while (n < nsizes && sizes[n] < bound) {
+            n++;
+        }
+        csize = n < nsizes ? sizes[n] : engine->config.item_size_max;
+        used += (double)hist[b] * csize;
+        wasted += (double)hist[b] * (csize - bound);
+    }
+    return used == 0 ? 0.0 : wasted / used;
+}
+
+static void slabs_tune_stats(struct default_engine *engine, const uint32_t *hist,
+                             ADD_STAT add_stats, const void *cookie)
+{
+    unsigned int cur_sizes[POWER_LARGEST], sizes[POWER_LARGEST] = { 0 };
+    uint32_t pu[SIZE_TUNE_POINTS];
+    double pc[SIZE_TUNE_POINTS + 1], ps[SIZE_TUNE_POINTS + 1];
+    int ncur = 0, nsizes, npoints = 0, nfilled = 0, group;
+    int b, i;
+
+    /* the current class sizes above the small memory sizes */
+    for (i = POWER_SMALLEST; i < engine->slabs.power_largest; i++) {
+        if (engine->slabs.slabclass[i].size > MAX_SM_VALUE_LEN) {
+            cur_sizes[ncur++] = engine->slabs.slabclass[i].size;
+        }
+    }
+
+    /* the sampled buckets as points of their upper bound sizes,
+     * merged into groups of adjacent buckets if there are many of them.
+     */
+    for (b = 0; b < engine->slabs.size_hist_buckets; b++) {
+        if (hist[b] != 0) nfilled++;
+    }
+    group = (nfilled + SIZE_TUNE_POINTS - 1) / SIZE_TUNE_POINTS;
+    pc[0] = ps[0] = 0;
+    for (b = 0, i = 0; b < engine->slabs.size_hist_buckets; b++) {
+        if (hist[b] == 0) {
+            continue;
+        }
+        if (i == 0) {
+            pc[npoints + 1] = pc[npoints];
+            ps[npoints + 1] = ps[npoints];
+        }
+        /* the sizes merged into a point are counted as its size */
+        pu[npoints] = do_slabs_size_hist_bound(engine, b);
+        pc[npoints + 1] += hist[b];
+        if (++i == group) {
+            ps[npoints + 1] = ps[npoints] + (double)pu[npoints] * (pc[npoints + 1] - pc[npoints]);
+            npoints++;
+            i = 0;
+        }
+    }
+    if (i > 0) {
+        ps[npoints + 1] = ps[npoints] + (double)pu[npoints] * (pc[npoints + 1] - pc[npoints]);
+        npoints++;
+    }
+
+    nsizes = do_slabs_tune_sizes(engine, pu, pc, ps, npoints, sizes, ncur > 0 ? ncur : 1);
+
+    add_statistics(cookie, add_stats, NULL, -1, "slab_sizes_waste_ratio", "%.4f",
+                   do_slabs_tune_ratio(engine, hist, cur_sizes, ncur));
+    add_statistics(cookie, add_stats, NULL, -1, "slab_sizes_tuned_waste_ratio", "%.4f",
+                   do_slabs_tune_ratio(engine, hist, sizes, nsizes));
+    if (nsizes > 0) {
+        /* longer than the value buffer of add_statistics */
+        char *val = malloc(nsizes * 11);
+        if (val != NULL) {
+            int vlen = 0;
+            for (i = 0; i < nsizes; i++) {
+                vlen += sprintf(val + vlen, i == 0 ? "%u" : "-%u", sizes[i]);
+            }
+            add_stats("slab_sizes_tuned", strlen("slab_sizes_tuned"), val, vlen, cookie);
+            free(val);
+        }
+    }
+}
+
+/* the largest slot length of a small memory slot class */
+static int do_smmgr_class_slen(int smid)
+{
+    sm_class_t *cls = &sm_anchor.class_info[0];
+
+    if (smid >= SM_NUM_CLASSES-1) {
+        return SM_MAX_SLOT_SIZE;
+    }
+    while (smid >= (cls+1)->tocnt) {
+        cls++;
+    }
+    return cls->tolen + (smid - cls->tocnt) * cls->sulen;
+}
+
+/* Memory accounting of the allocators for "stats memory", from the
+ * counters kept by the slab classes and the small memory allocator.
+ * The slots cached in the magazines are used slots requested as a whole.
+ */
+static void do_slabs_memory_stats(struct default_engine *engine, ADD_STAT add_stats, const void *cookie)
+{
+    uint64_t slab_used = 0, slab_free = 0, slab_requested = 0, sm_requested = 0;
+    char key[32];
+    int i;
+
+    /* the slab classes of large items */
+    for (i = POWER_SMALLEST; i <= do_slabs_last_clsid(engine); i++) {
+        slabclass_t *p = &engine->slabs.slabclass[i];
+        uint32_t free_chunks = p->sl_curr + p->end_page_free;
+        slab_used += (uint64_t)(p->slabs * p->perslab - free_chunks) * p->size;
+        slab_free += (uint64_t)free_chunks * p->size;
+        slab_requested += p->requested;
+    }
+    for (i = 0; i < SM_NUM_CLASSES; i++) {
+        sm_requested += sm_anchor.used_slist[i].requested;
+    }
+
     add_statistics(cookie, add_stats, NULL, -1, "memory_limit", "%llu", (unsigned long long)engine->slabs.mem_limit);
     add_statistics(cookie, add_stats, NULL, -1, "total_malloced", "%llu", (unsigned long long)engine->slabs.mem_malloced);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_used_bytes", "%"PRIu64, slab_used);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_requested_bytes", "%"PRIu64, slab_requested);
+    add_statistics(cookie, add_stats, NULL, -1, "slab_free_bytes", "%"PRIu64, slab_free);
+
+    /* small memory blocks, and their usage in 1/16 of the block body */
+    add_statistics(cookie, add_stats, "SM", -1, "block_count", "%"PRIu64, sm_anchor.used_blist.count);
+    add_statistics(cookie, add_stats, "SM", -1, "used_bytes", "%"PRIu64, sm_anchor.used_total_space);
+    add_statistics(cookie, add_stats, "SM", -1, "requested_bytes", "%"PRIu64, sm_requested);
+    add_statistics(cookie, add_stats, "SM", -1, "free_bytes", "%"PRIu64, do_smmgr_free_block_space());
+    for (i = 0; i <= SM_COMPACT_BUCKETS; i++) {
+        snprintf(key, sizeof(key), "block_usage_%d", i);
+        add_statistics(cookie, add_stats, "SM", -1, key, "%"PRIu64, sm_anchor.blck_usage[i]);
+    }
+
+    /* small memory slot classes in use */
+    for (i = 0; i < SM_NUM_CLASSES; i++) {
+        sm_slist_t *list = &sm_anchor.used_slist[i];
+        if (list->count == 0) {
+            continue;
+        }
+        add_statistics(cookie, add_stats, "SM", i, "slot_size", "%d", do_smmgr_class_slen(i));
+        add_statistics(cookie, add_stats, "SM", i, "used_slots", "%"PRIu64, list->count);
+        add_statistics(cookie, add_stats, "SM", i, "used_bytes", "%"PRIu64, list->space);
+        add_statistics(cookie, add_stats, "SM", i, "requested_bytes", "%"PRIu64, list->requested);
+    }
 }
 
 static void *memory_allocate(struct default_engine *engine, size_t size)
@@ -1375,6 +2594,8 @@ static void *memory_allocate(struct default_engine *engine, size_t size)
     if (engine->slabs.mem_base == NULL) {
         /* We are not using a preallocated large memory chunk */
         ret = malloc(size);
+    } else if (engine->slabs.numa_nodes > 0) {
+        ret = slabs_arena_numa_allocate(engine, size);
     } else {
         ret = engine->slabs.mem_current;
 
@@ -1399,19 +2620,50 @@ static void *memory_allocate(struct default_engine *engine, size_t size)
 
 static ENGINE_ERROR_CODE do_slabs_set_memlimit(struct default_engine *engine, size_t memlimit)
 {
-    if (engine->slabs.mem_base != NULL) {
-        /* We are using a preallocated large memory chunk */
+#ifdef ENABLE_COMPACT_ITEM
+    if (memlimit > ITEM_ARENA_SIZE) {
+        /* The slab arena can't grow beyond its reserved address space */
         return ENGINE_EBADVALUE;
     }
-    if (memlimit < (engine->slabs.mem_malloced + (engine->slabs.mem_malloced/10))) {
-        /* We cannot set mem_limit smaller than (mem_malloced * 1.1) */
+#else
+    if (engine->slabs.mem_base != NULL) {
+        /* We are using a preallocated large memory chunk */
         return ENGINE_EBADVALUE;
     }
-
+#endif
     size_t new_mem_reserved = (memlimit / 100) * RSVD_SLAB_RATIO;
     if (new_mem_reserved < (RSVD_SLAB_COUNT*engine->config.item_size_max))
         new_mem_reserved = (RSVD_SLAB_COUNT*engine->config.item_size_max);
 
+    if (memlimit < (engine->slabs.mem_malloced + (engine->slabs.mem_malloced/10))) {
+        /* We cannot set mem_limit smaller than (mem_malloced * 1.1) at once,
+         * but the malloced memory can be shrunk to it gradually.
+         */
+#if defined(USE_SYSTEM_MALLOC) || defined(ENABLE_COMPACT_ITEM)
+        return ENGINE_EBADVALUE;
+#else
+        if (engine->config.memlimit_shrink_rate == 0 || memlimit < 2 * new_mem_reserved) {
+            return ENGINE_EBADVALUE;
+        }
+        /* The slab classes stop growing, and the memlimit shrinker frees
+         * slab pages until the malloced memory is within the new memlimit.
+         * Slab class 0 keeps its reserved slabs as with a full memlimit.
+         */
+        if (memlimit < engine->slabs.mem_malloced) {
+            engine->slabs.shrink_target = memlimit;
+            engine->slabs.mem_limit = engine->slabs.mem_malloced;
+        } else {
+            engine->slabs.shrink_target = 0;
+            engine->slabs.mem_limit = memlimit;
+        }
+        engine->slabs.mem_reserved = new_mem_reserved;
+        if (engine->slabs.slabclass[SM_SLAB_CLSID].rsvd_slabs == 0) { /* undefined */
+            do_slabs_rsvd_slabs_define(engine);
+        }
+        return ENGINE_SUCCESS;
+#endif
+    }
+
     if (engine->slabs.slabclass[SM_SLAB_CLSID].rsvd_slabs != 0) {
         /* memlimit > engine->slabs.mem_malloced */
         if ((memlimit - engine->slabs.mem_malloced) < new_mem_reserved) {
@@ -1420,6 +2672,7 @@ static ENGINE_ERROR_CODE do_slabs_set_memlimit(struct default_engine *engine, si
     }
     engine->slabs.mem_limit = memlimit;
     engine->slabs.mem_reserved = new_mem_reserved;
+    engine->slabs.shrink_target = 0; /* the ongoing shrink is canceled */
     engine->slabs.slabclass[SM_SLAB_CLSID].rsvd_slabs = 0; /* undefined */
     sm_anchor.free_limit_space = 0;
     sm_anchor.free_chunk_space = 0;
@@ -1431,9 +2684,9 @@ void *slabs_alloc(struct default_engine *engine, size_t size, unsigned int id)
 {
     void *ret;
 
-    if (id < POWER_SMALLEST || id > engine->slabs.power_largest)
+    if (id < POWER_SMALLEST || id > do_slabs_last_clsid(engine))
         return NULL;
-    pthread_mutex_lock(&engine->slabs.lock);
+    slabs_lock(engine);
     ret = do_slabs_alloc(engine, size, id);
     pthread_mutex_unlock(&engine->slabs.lock);
     return ret;
@@ -1441,17 +2694,39 @@ void *slabs_alloc(struct default_engine *engine, size_t size, unsigned int id)
 
 void slabs_free(struct default_engine *engine, void *ptr, size_t size, unsigned int id)
 {
-    if (id < POWER_SMALLEST || id > engine->slabs.power_largest)
+    if (id < POWER_SMALLEST || id > do_slabs_last_clsid(engine))
         return;
-    pthread_mutex_lock(&engine->slabs.lock);
+    slabs_lock(engine);
     do_slabs_free(engine, ptr, size, id);
     pthread_mutex_unlock(&engine->slabs.lock);
 }
 
 void slabs_stats(struct default_engine *engine, ADD_STAT add_stats, const void *c)
 {
+    uint32_t *hist = NULL;
+
     pthread_mutex_lock(&engine->slabs.lock);
     do_slabs_stats(engine, add_stats, c);
+    add_statistics(c, add_stats, NULL, -1, "slab_sizes_samples", "%"PRIu64, engine->slabs.size_samples);
+    if (engine->slabs.size_hist != NULL && engine->slabs.size_samples > 0) {
+        /* the tuning runs on a copy of the histogram, out of the slabs lock */
+        hist = malloc(sizeof(uint32_t) * engine->slabs.size_hist_buckets);
+        if (hist != NULL) {
+            memcpy(hist, engine->slabs.size_hist, sizeof(uint32_t) * engine->slabs.size_hist_buckets);
+        }
+    }
+    pthread_mutex_unlock(&engine->slabs.lock);
+
+    if (hist != NULL) {
+        slabs_tune_stats(engine, hist, add_stats, c);
+        free(hist);
+    }
+}
+
+void slabs_memory_stats(struct default_engine *engine, ADD_STAT add_stats, const void *c)
+{
+    pthread_mutex_lock(&engine->slabs.lock);
+    do_slabs_memory_stats(engine, add_stats, c);
     pthread_mutex_unlock(&engine->slabs.lock);
 }
 
@@ -1459,7 +2734,7 @@ void slabs_adjust_mem_requested(struct default_engine *engine, unsigned int id,
 {
     slabclass_t *p;
 
-    if (id < POWER_SMALLEST || id > engine->slabs.power_largest)
+    if (id < POWER_SMALLEST || id > do_slabs_last_clsid(engine))
         return;
     pthread_mutex_lock(&engine->slabs.lock);
     p = &engine->slabs.slabclass[id];
@@ -1475,3 +2750,294 @@ ENGINE_ERROR_CODE slabs_set_memlimit(struct default_engine *engine, size_t memli
     pthread_mutex_unlock(&engine->slabs.lock);
     return ret;
 }
+
+/*
+ * Slab page mover
+ *
+ * If slab_reassign is enabled, all slab pages have item_size_max bytes.
+ * So, a page emptied in one slab class can be reused by another class
+ * whose items are evicted more often. Slab class 0 of the small memory
+ * allocator can receive pages, but it never gives its pages away.
+ */
+static void do_slabs_page_unlink(struct default_engine *engine, const unsigned int id, void *page)
+{
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    char *start = (char *)page;
+    char *end = start + p->size * p->perslab;
+    unsigned int i, j;
+
+    /* all chunks of the page are free: drop them from the free list */
+    for (i = 0, j = 0; i < p->sl_curr; i++) {
+        if ((char *)p->slots[i] < start || (char *)p->slots[i] >= end) {
+            p->slots[j++] = p->slots[i];
+        }
+    }
+    p->sl_curr = j;
+    if ((char *)p->end_page_ptr >= start && (char *)p->end_page_ptr < end) {
+        p->end_page_ptr = 0;
+        p->end_page_free = 0;
+    }
+    for (i = 0; i < p->slabs; i++) {
+        if (p->slab_list[i] == page) {
+            p->slab_list[i] = p->slab_list[--p->slabs];
+            break;
+        }
+    }
+}
+
+ENGINE_ERROR_CODE slabs_reassign_check(struct default_engine *engine, int src, int dst)
+{
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+
+#ifdef USE_SYSTEM_MALLOC
+    return ENGINE_ENOTSUP;
+#endif
+    if (engine->config.slab_reassign == false) {
+        return ENGINE_ENOTSUP;
+    }
+    /* the chunks of the chunk class are not items, so its pages can't be
+     * emptied by evicting items. It can only receive pages.
+     */
+    if (src < POWER_SMALLEST || src > engine->slabs.power_largest ||
+        dst < SM_SLAB_CLSID || dst > do_slabs_last_clsid(engine) || src == dst) {
+        return ENGINE_EINVAL;
+    }
+
+    pthread_mutex_lock(&engine->slabs.lock);
+    slabclass_t *d = &engine->slabs.slabclass[dst];
+    if (engine->slabs.slabclass[src].slabs < 2) {
+        /* the source class keeps at least one page */
+        ret = ENGINE_ENOMEM;
+    } else if (grow_slab_list(engine, dst) == 0 ||
+               grow_slab_slots(d, d->sl_curr + d->end_page_free) == 0) {
+        ret = ENGINE_FAILED;
+    }
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return ret;
+}
+
+void *slabs_reassign_page(struct default_engine *engine, unsigned int id, unsigned int index)
+{
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    void *page = NULL;
+
+    pthread_mutex_lock(&engine->slabs.lock);
+    if (index < p->slabs) {
+        page = p->slab_list[index];
+    }
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return page;
+}
+
+void slabs_reassign_move(struct default_engine *engine, unsigned int src, unsigned int dst,
+                         void *page, uint32_t evicted)
+{
+    slabclass_t *s = &engine->slabs.slabclass[src];
+    slabclass_t *d = &engine->slabs.slabclass[dst];
+
+    pthread_mutex_lock(&engine->slabs.lock);
+    do_slabs_page_unlink(engine, src, page);
+    s->pages_moved_out++;
+    s->reassign_evicted += evicted;
+
+    /* the rest of the current end page goes to the free list,
+     * the room was made by slabs_reassign_check().
+     */
+    while (d->end_page_free > 0) {
+        d->slots[d->sl_curr++] = d->end_page_ptr;
+        d->end_page_ptr = ((caddr_t)d->end_page_ptr) + d->size;
+        d->end_page_free--;
+    }
+    d->end_page_ptr = 0;
+    memset(page, 0, engine->config.item_size_max);
+    do_slabs_page_link(engine, dst, page);
+    d->pages_moved_in++;
+    engine->slabs.slabs_moved++;
+    pthread_mutex_unlock(&engine->slabs.lock);
+}
+
+void slabs_reassign_busy(struct default_engine *engine)
+{
+    pthread_mutex_lock(&engine->slabs.lock);
+    engine->slabs.reassign_busy++;
+    pthread_mutex_unlock(&engine->slabs.lock);
+}
+
+/*
+ * Memlimit shrink
+ *
+ * While the malloced memory is above the shrink target, the memlimit
+ * is kept at the malloced memory so that no slab class grows, and the
+ * memlimit shrinker frees slab pages at memlimit_shrink_rate. The pages
+ * whose chunks are all free are freed first.
+ */
+static int slab_addr_cmp(const void *a, const void *b)
+{
+    const char *pa = *(char * const *)a;
+    const char *pb = *(char * const *)b;
+    return pa < pb ? -1 : (pa > pb ? 1 : 0);
+}
+
+static size_t do_slabs_page_size(struct default_engine *engine, const unsigned int id)
+{
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    /* see do_slabs_newslab() */
+    return engine->config.slab_reassign ? engine->config.item_size_max
+                                        : (size_t)p->size * p->perslab;
+}
+
+/* Find a page whose chunks are all free. The free chunks of each page
+ * are counted by walking the sorted page list and the sorted free list.
+ */
+static void *do_slabs_free_page_find(struct default_engine *engine, const unsigned int id)
+{
+    slabclass_t *p = &engine->slabs.slabclass[id];
+    unsigned int i, s, nfree;
+    char *start, *end;
+
+    if (p->slabs == 0 || p->sl_curr + p->end_page_free < p->perslab) {
+        return NULL;
+    }
+    qsort(p->slab_list, p->slabs, sizeof(void *), slab_addr_cmp);
+    qsort(p->slots, p->sl_curr, sizeof(void *), slab_addr_cmp);
+    for (i = 0, s = 0; i < p->slabs; i++) {
+        start = p->slab_list[i];
+        end = start + p->size * p->perslab;
+        while (s < p->sl_curr && (char *)p->slots[s] < start) {
+            s++;
+        }
+        for (nfree = 0; s + nfree < p->sl_curr && (char *)p->slots[s + nfree] < end; nfree++);
+        if ((char *)p->end_page_ptr >= start && (char *)p->end_page_ptr < end) {
+            nfree += p->end_page_free;
+        }
+        if (nfree == p->perslab) {
+            return start;
+        }
+    }
+    return NULL;
+}
+
+static void do_slabs_shrink_page_free(struct default_engine *engine, const unsigned int id,
+                                      void *page)
+{
+    slabclass_t *p = &engine->slabs.slabclass[id];
+
+    do_slabs_page_unlink(engine, id, page);
+    free(page);
+    if (id == SM_SLAB_CLSID && p->rsvd_slabs > 0) {
+        /* the reserved slabs are kept beyond the released page */
+        p->rsvd_slabs--;
+        sm_anchor.free_chunk_space -= (p->perslab * p->size);
+    }
+    engine->slabs.mem_malloced -= do_slabs_page_size(engine, id);
+    engine->slabs.shrink_released += do_slabs_page_size(engine, id);
+    if (engine->slabs.mem_malloced > engine->slabs.shrink_target) {
+        engine->slabs.mem_limit = engine->slabs.mem_malloced;
+    } else {
+        /* the shrink is done */
+        engine->slabs.mem_limit = engine->slabs.shrink_target;
+        engine->slabs.shrink_target = 0;
+    }
+}
+
+size_t slabs_shrink_excess(struct default_engine *engine)
+{
+    size_t excess = 0;
+    pthread_mutex_lock(&engine->slabs.lock);
+    if (engine->slabs.shrink_target != 0) {
+        excess = engine->slabs.mem_malloced - engine->slabs.shrink_target;
+    }
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return excess;
+}
+
+size_t slabs_shrink_release(struct default_engine *engine, size_t budget)
+{
+    size_t released = 0;
+    void *page;
+    int id;
+
+    pthread_mutex_lock(&engine->slabs.lock);
+    for (id = SM_SLAB_CLSID; id <= do_slabs_last_clsid(engine); id++) {
+        while (engine->slabs.shrink_target != 0 && released < budget &&
+               (page = do_slabs_free_page_find(engine, id)) != NULL) {
+            released += do_slabs_page_size(engine, id);
+            do_slabs_shrink_page_free(engine, id, page);
+        }
+    }
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return released;
+}
+
+size_t slabs_shrink_page_free(struct default_engine *engine, unsigned int id,
+                              void *page, uint32_t evicted)
+{
+    size_t released = 0;
+
+    pthread_mutex_lock(&engine->slabs.lock);
+    engine->slabs.shrink_evicted += evicted;
+    if (engine->slabs.shrink_target != 0) {
+        released = do_slabs_page_size(engine, id);
+        do_slabs_shrink_page_free(engine, id, page);
+    }
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return released;
+}
+
+void slabs_shrink_evicted(struct default_engine *engine, uint32_t evicted)
+{
+    pthread_mutex_lock(&engine->slabs.lock);
+    engine->slabs.shrink_evicted += evicted;
+    pthread_mutex_unlock(&engine->slabs.lock);
+}
+
+void slabs_shrink_stats(struct default_engine *engine, ADD_STAT add_stats, const void *cookie)
+{
+    pthread_mutex_lock(&engine->slabs.lock);
+    add_statistics(cookie, add_stats, NULL, -1, "memlimit_shrinking", "%d",
+                   engine->slabs.shrink_target != 0 ? 1 : 0);
+    add_statistics(cookie, add_stats, NULL, -1, "memlimit_shrink_target", "%llu",
+                   (unsigned long long)engine->slabs.shrink_target);
+    add_statistics(cookie, add_stats, NULL, -1, "memlimit_shrink_released", "%"PRIu64,
+                   engine->slabs.shrink_released);
+    add_statistics(cookie, add_stats, NULL, -1, "memlimit_shrink_evicted", "%"PRIu64,
+                   engine->slabs.shrink_evicted);
+    pthread_mutex_unlock(&engine->slabs.lock);
+}
+
+uint32_t slabs_sm_compact_start(struct default_engine *engine)
+{
+    uint32_t count;
+    pthread_mutex_lock(&engine->slabs.lock);
+    count = do_smmgr_compact_start();
+    pthread_mutex_unlock(&engine->slabs.lock);
+    if (count > 0) {
+        /* the cached slots of the evacuated blocks are freed to them */
+        slabs_tcache_flush(engine);
+    }
+    return count;
+}
+
+uint32_t slabs_sm_compact_end(struct default_engine *engine)
+{
+    uint32_t freed;
+    pthread_mutex_lock(&engine->slabs.lock);
+    sm_anchor.compacting = false;
+    freed = (uint32_t)(sm_anchor.compact_freed - sm_anchor.compact_freed_run);
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return freed;
+}
+
+void *slabs_sm_relocate(struct default_engine *engine, void *ptr, const size_t size)
+{
+    void *new_ptr = NULL;
+    if (size > MAX_SM_VALUE_LEN) {
+        return NULL;
+    }
+    pthread_mutex_lock(&engine->slabs.lock);
+    if (sm_anchor.compacting) {
+        new_ptr = do_smmgr_relocate(ptr, size);
+    }
+    pthread_mutex_unlock(&engine->slabs.lock);
+    return new_ptr;
+}
@@ -42,6 +42,10 @@ typedef struct {
 
     unsigned int killing;   /* index+1 of dying slab, or zero if none */
     size_t       requested; /* The number of requested bytes */
+
+    uint64_t     pages_moved_in;   /* # of pages reassigned from other classes */
+    uint64_t     pages_moved_out;  /* # of pages reassigned to other classes */
+    uint64_t     reassign_evicted; /* # of items evicted to reassign pages */
 } slabclass_t;
 
 struct slabs {
@@ -50,10 +54,37 @@ struct slabs {
    size_t mem_malloced;
    size_t mem_reserved; // Arcus Added it
    int    power_largest;
+   int    chunk_clsid;      /* slab class of the value chunks of large items, 0 if none */
 
    void  *mem_base;
    void  *mem_current;
    size_t mem_avail;
+   size_t mem_mapped;       /* size of the mapped arena, 0 if allocated with malloc */
+   const char *mem_arena;   /* kind of the preallocated arena, NULL if none */
+   int    numa_nodes;       /* # of NUMA node arenas, 0 if not NUMA aware */
+   struct {
+       void    *current;
+       size_t   avail;
+       uint64_t pages;      /* # of slab pages allocated from the node */
+   } numa_arena[MC_MAX_NUMA_NODES];
+   uint64_t numa_remote;    /* # of slab pages allocated from a remote node */
+
+   struct slabs_tcache *tcaches; /* per-thread magazines */
+   uint64_t lock_acquired;  /* # of slabs lock acquisitions for allocations */
+   uint64_t lock_contended; /* # of them that waited for another thread */
+
+   uint32_t *size_hist;     /* sampled allocation sizes of the slab classes */
+   uint32_t size_hist_unit; /* size range of a histogram bucket */
+   uint32_t size_hist_buckets;
+   uint64_t size_samples;   /* # of sampled allocations */
+   uint64_t size_sample_tick;
+
+   uint64_t slabs_moved;   /* # of reassigned pages */
+   uint64_t reassign_busy; /* # of reassigns failed by items in use */
+
+   size_t   shrink_target;   /* memlimit being reached by the shrinker, 0 if none */
+   uint64_t shrink_released; /* # of bytes of the pages released by the shrinker */
+   uint64_t shrink_evicted;  /* # of items evicted by the shrinker */
 
    /**
     * Access to the slab allocator is protected by this lock
@@ -87,15 +118,43 @@ unsigned int slabs_space_size(struct default_engine *engine, const size_t size);
 
 int   slabs_space_shortage_level(void);
 
+/** Background LRU maintenance: slabs_space_shortage_check() recomputes
+    the space shortage level of the small memory allocator and returns it.
+    slabs_headroom_short() returns the # of free slots that the slab class
+    lacks for the headroom, 0 if it has them or can still get a new page. */
+int          slabs_space_shortage_check(struct default_engine *engine);
+unsigned int slabs_headroom_short(struct default_engine *engine, unsigned int id,
+                                  unsigned int headroom);
+
+/** Memory allocated out of the slabs, such as the expiry timing wheel,
+    is charged to the memory limit. slabs_charge() returns false if the
+    size doesn't fit within the limit. */
+bool slabs_charge(struct default_engine *engine, size_t size);
+void slabs_uncharge(struct default_engine *engine, size_t size);
+
 /** Allocate object of given length. 0 on error */ /*@null@*/
 void *slabs_alloc(struct default_engine *engine, const size_t size, unsigned int id);
 
 /** Free previously allocated object */
 void  slabs_free(struct default_engine *engine, void *ptr, size_t size, unsigned int id);
 
+/** Per-thread magazines of small memory slots. slabs_tcache_alloc()
+    returns NULL if the magazine is empty and can't be refilled, and
+    slabs_tcache_free() returns false if the slot is not cached. Neither
+    needs the cache lock. */
+void *slabs_tcache_alloc(struct default_engine *engine, const size_t size);
+bool  slabs_tcache_free(struct default_engine *engine, void *ptr, const size_t size);
+
+/** Sample the size of an allocation from the slab classes for the class
+    size tuning of "stats slabs". The caller holds the cache lock. */
+void  slabs_sample_size(struct default_engine *engine, const size_t size);
+
 /** Fill buffer with stats */ /*@null@*/
 void  slabs_stats(struct default_engine *engine, ADD_STAT add_stats, const void *c);
 
+/** Fill buffer with the memory accounting of the allocators */
+void  slabs_memory_stats(struct default_engine *engine, ADD_STAT add_stats, const void *c);
+
 /** Adjust the stats for memory requested */
 void  slabs_adjust_mem_requested(struct default_engine *engine, unsigned int id, size_t old, size_t ntotal);
 
@@ -104,4 +163,41 @@ void  add_statistics(const void *cookie, ADD_STAT add_stats,
                      const char *fmt, ...);
 
 ENGINE_ERROR_CODE slabs_set_memlimit(struct default_engine *engine, size_t memlimit);
+
+/* Slab page mover: a page of the src class is reassigned to the dst class.
+ * The caller holds the cache lock, and frees all items of the page
+ * between slabs_reassign_page() and slabs_reassign_move().
+ */
+ENGINE_ERROR_CODE slabs_reassign_check(struct default_engine *engine, int src, int dst);
+void *slabs_reassign_page(struct default_engine *engine, unsigned int id, unsigned int index);
+void  slabs_reassign_move(struct default_engine *engine, unsigned int src, unsigned int dst,
+                          void *page, uint32_t evicted);
+void  slabs_reassign_busy(struct default_engine *engine);
+
+/* Memlimit shrink: a memlimit below the malloced memory is reached
+ * gradually. slabs_shrink_excess() returns the malloced bytes above the
+ * target, 0 if not shrinking. While the caller holds the cache lock,
+ * slabs_shrink_release() frees up to budget bytes of free slab pages
+ * and returns the bytes freed, and slabs_shrink_page_free() frees a page
+ * of slabs_reassign_page() emptied by evicting its items. The items
+ * evicted from the LRU lists for the shrink are counted by
+ * slabs_shrink_evicted().
+ */
+size_t slabs_shrink_excess(struct default_engine *engine);
+size_t slabs_shrink_release(struct default_engine *engine, size_t budget);
+size_t slabs_shrink_page_free(struct default_engine *engine, unsigned int id,
+                              void *page, uint32_t evicted);
+void   slabs_shrink_evicted(struct default_engine *engine, uint32_t evicted);
+void   slabs_shrink_stats(struct default_engine *engine, ADD_STAT add_stats, const void *c);
+
+/* Small memory compaction: slabs_sm_compact_start() chooses the sparse
+ * blocks to evacuate and returns their count. While the caller holds the
+ * cache lock, slabs_sm_relocate() allocates a new slot for an object of
+ * an evacuated block, or returns NULL. The caller copies the object and
+ * frees the old slot. slabs_sm_compact_end() returns the number of blocks
+ * freed during the run.
+ */
+uint32_t slabs_sm_compact_start(struct default_engine *engine);
+uint32_t slabs_sm_compact_end(struct default_engine *engine);
+void    *slabs_sm_relocate(struct default_engine *engine, void *ptr, const size_t size);
 #endif
@@ -2,12 +2,15 @@
 /*
  * Hash table
  *
- * The hash function used here is by Bob Jenkins, 1996:
+ * The default hash function used here is by Bob Jenkins, 1996:
  *    <http://burtleburtle.net/bob/hash/doobs.html>
  *       "By Bob Jenkins, 1996.  bob_jenkins@burtleburtle.net.
  *       You may use this code any way you wish, private, educational,
  *       or commercial.  It's free."
  *
+ * The alternative wyhash function is by Wang Yi, released to the public domain:
+ *    <https://github.com/wangyi-fudan/wyhash>
+ *
  */
 #include "config.h"
 #include "memcached.h"
@@ -422,3 +425,131 @@ uint32_t mc_hash(const void *key, size_t length, const uint32_t initval)
 #else /* HASH_XXX_ENDIAN == 1 */
 #error Must define HASH_BIG_ENDIAN or HASH_LITTLE_ENDIAN
 #endif /* HASH_XXX_ENDIAN == 1 */
+
+/*
+ * wyhash (final version 4), folded to 32 bits.
+ * It reads the key 8 bytes at a time and mixes them with a 64x64->128 bit
+ * multiplication, so it is much faster than lookup3 on longer keys.
+ */
+static const uint64_t _wyp[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+static inline void _wymum(uint64_t *A, uint64_t *B)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = *A;
+    r *= *B;
+    *A = (uint64_t)r;
+    *B = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *A >> 32, hb = *B >> 32, la = (uint32_t)*A, lb = (uint32_t)*B;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl, lo, hi;
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *A = lo;
+    *B = hi;
+#endif
+}
+
+static inline uint64_t _wymix(uint64_t A, uint64_t B)
+{
+    _wymum(&A, &B);
+    return A ^ B;
+}
+
+static inline uint64_t _wyr8(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if HASH_BIG_ENDIAN == 1
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t _wyr4(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+#if HASH_BIG_ENDIAN == 1
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t _wyr3(const uint8_t *p, size_t k)
+{
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+uint32_t mc_hash_wyhash(const void *key, size_t length, const uint32_t initval)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t seed = initval;
+    uint64_t a, b, h;
+
+    seed ^= _wymix(seed ^ _wyp[0], _wyp[1]);
+    if (length <= 16) {
+        if (length >= 4) {
+            a = (_wyr4(p) << 32) | _wyr4(p + ((length >> 3) << 2));
+            b = (_wyr4(p + length - 4) << 32) | _wyr4(p + length - 4 - ((length >> 3) << 2));
+        } else if (length > 0) {
+            a = _wyr3(p, length);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = length;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = _wymix(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ seed);
+                see1 = _wymix(_wyr8(p + 16) ^ _wyp[2], _wyr8(p + 24) ^ see1);
+                see2 = _wymix(_wyr8(p + 32) ^ _wyp[3], _wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = _wymix(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = _wyr8(p + i - 16);
+        b = _wyr8(p + i - 8);
+    }
+    a ^= _wyp[1];
+    b ^= seed;
+    _wymum(&a, &b);
+    h = _wymix(a ^ _wyp[0] ^ length, b ^ _wyp[1]);
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+/*
+ * Key hash functions selectable at startup.
+ * The first one is the default.
+ */
+static struct {
+    const char *name;
+    hash_func func;
+} hash_funcs[] = {
+    { "jenkins", mc_hash },
+    { "wyhash",  mc_hash_wyhash },
+    { NULL, NULL }
+};
+
+hash_func mc_hash_lookup(const char *name)
+{
+    for (int i = 0; hash_funcs[i].name != NULL; i++) {
+        if (strcmp(hash_funcs[i].name, name) == 0) {
+            return hash_funcs[i].func;
+        }
+    }
+    return NULL;
+}
@@ -5,7 +5,13 @@
 extern "C" {
 #endif
 
+typedef uint32_t (*hash_func)(const void *key, size_t length, const uint32_t initval);
+
 uint32_t mc_hash(const void *key, size_t length, const uint32_t initval);
+uint32_t mc_hash_wyhash(const void *key, size_t length, const uint32_t initval);
+
+/* find a key hash function by name: "jenkins" or "wyhash" */
+hash_func mc_hash_lookup(const char *name);
 
 #ifdef    __cplusplus
 }
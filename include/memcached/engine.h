@@ -282,6 +282,28 @@ extern "C" {
                                  const void* key, const int nkey,
                                  uint16_t vbucket);
 
+        /**
+         * Retrieve multiple items at once.
+         *
+         * This is an optional interface. The engine resolves all the keys
+         * with fewer lock acquisitions than calling get() for each key.
+         *
+         * @param handle the engine handle
+         * @param cookie The cookie provided by the frontend
+         * @param items output array of kcount items: NULL for the keys not
+         *              found and for the keys of collection items
+         * @param karray the keys to retrieve
+         * @param kcount the number of the keys
+         * @param vbucket the virtual bucket id
+         *
+         * @return ENGINE_SUCCESS if all goes well. On any other return,
+         *         no item is returned.
+         */
+        ENGINE_ERROR_CODE (*get_multi)(ENGINE_HANDLE* handle, const void* cookie,
+                                       item** items,
+                                       token_t *karray, const int kcount,
+                                       uint16_t vbucket);
+
         /**
          * Store an item.
          *
@@ -683,6 +705,23 @@ extern "C" {
                                   const char *prefix, const int nprefix,
                                   const char *filepath);
 
+        /**
+         * Reassign a slab page from one slab class to another.
+         *
+         * @param handle the engine handle
+         * @param cookie The cookie provided by the frontend
+         * @param src the slab class giving a page
+         * @param dst the slab class receiving the page
+         *
+         * @return ENGINE_SUCCESS if a page has been moved.
+         *         ENGINE_EINVAL if the slab class ids are not valid.
+         *         ENGINE_ENOMEM if the src class has no spare page.
+         *         ENGINE_EWOULDBLOCK if the items of the pages are in use.
+         *         ENGINE_ENOTSUP if slab page reassignment is not enabled.
+         */
+        ENGINE_ERROR_CODE (*slabs_reassign)(ENGINE_HANDLE* handle, const void *cookie,
+                                            const int src, const int dst);
+
         /**
          * Any unknown command will be considered engine specific.
          *
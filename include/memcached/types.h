@@ -224,6 +224,10 @@ extern "C" {
         struct iovec value[1];
     } item_info;
 
+    /* the most value iovecs of an item, the value of a chunked item
+     * is returned in one iovec per chunk */
+#define ITEM_INFO_MAX_IOVS 64
+
     /* collection element info */
     typedef struct {
         const char          *value;
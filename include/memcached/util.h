@@ -41,6 +41,19 @@ MEMCACHED_PUBLIC_API bool safe_strtohexa(const char *str, unsigned char *bin, co
 MEMCACHED_PUBLIC_API void safe_hexatostr(const unsigned char *bin, const int size, char *str);
 MEMCACHED_PUBLIC_API bool mc_isvalidname(const char *str, int len);
 
+/*
+ * NUMA topology of the host, read from sysfs on Linux.
+ *
+ * mc_numa_nodes() returns the number of memory nodes (1 if unknown),
+ * mc_numa_cpu_node() the node of a cpu (-1 if there is no such cpu), and
+ * mc_numa_current_node() the node that the calling thread runs on.
+ */
+#define MC_MAX_NUMA_NODES 16
+
+MEMCACHED_PUBLIC_API int mc_numa_nodes(void);
+MEMCACHED_PUBLIC_API int mc_numa_cpu_node(int cpu);
+MEMCACHED_PUBLIC_API int mc_numa_current_node(void);
+
 #ifndef HAVE_HTONLL
 #define htonll mc_htonll
 #define ntohll mc_ntohll
@@ -69,7 +69,7 @@ static int MAX_BTREE_SIZE = 50000;
 
 /* The item must always be called "it" */
 #define SLAB_GUTS(conn, thread_stats, slab_op, thread_op) \
-    thread_stats->slab_stats[info.clsid].slab_op++;
+    thread_stats->slab_stats[info->clsid].slab_op++;
 
 #define THREAD_GUTS(conn, thread_stats, slab_op, thread_op) \
     thread_stats->thread_op++;
@@ -197,6 +197,12 @@ static bool cmdlog_in_use = false;
 static bool lqdetect_in_use = false;
 #endif
 
+/* item info with room for the value iovecs of a chunked item */
+typedef union {
+    item_info info;
+    char bytes[sizeof(item_info) + ((ITEM_INFO_MAX_IOVS - 1) * sizeof(struct iovec))];
+} item_info_holder;
+
 /*
  * forward declarations
  */
@@ -332,6 +338,7 @@ static void settings_init(void) {
     settings.factor = 1.25;
     settings.chunk_size = 48;         /* space for a modest key and value */
     settings.num_threads = 4;         /* N workers */
+    settings.numa_nodes = 0;          /* workers are not pinned */
     settings.prefix_delimiter = ':';
     settings.detail_enabled = 0;
     settings.allow_detailed = true;
@@ -344,6 +351,7 @@ static void settings_init(void) {
     settings.max_map_size = MAX_MAP_SIZE;
     settings.max_btree_size = MAX_BTREE_SIZE;
     settings.topkeys = 0;
+    settings.hash_algorithm = "jenkins";
     settings.require_sasl = false;
     settings.extensions.logger = get_stderr_logger();
 }
@@ -457,6 +465,99 @@ static void perform_callbacks(ENGINE_EVENT_TYPE type,
  */
 cache_t *conn_cache;      /* suffix cache */
 
+/*
+ * Collection response arena.
+ * The element arrays and the response strings of collection reads are
+ * allocated from a per-connection arena, and released together by
+ * resp_arena_reset() in between requests instead of a malloc and free
+ * for each of them. The blocks grown by a request are merged into one
+ * block of their total size, so the next requests of the similar size
+ * are served without malloc. An arena above RESP_ARENA_HIGHWAT is shrunk
+ * back to a block of RESP_ARENA_BLCK_SIZE by conn_shrink().
+ */
+static void *resp_arena_alloc(conn *c, size_t size)
+{
+    resp_arena_t *arena = &c->resp_arena;
+    void *ptr;
+
+    size = GET_8ALIGN_SIZE(size);
+    if (arena->head == NULL || arena->used + size > arena->head->size) {
+        arena_blck_t *blck;
+        size_t blen = size > RESP_ARENA_BLCK_SIZE ? size : RESP_ARENA_BLCK_SIZE;
+        blck = (arena_blck_t *)malloc(offsetof(arena_blck_t, data) + blen);
+        if (blck == NULL) {
+            return NULL;
+        }
+        blck->next = arena->head;
+        blck->size = blen;
+        arena->head = blck;
+        arena->used = 0;
+        arena->total += blen;
+        arena->nmalloc++;
+    }
+    ptr = arena->head->data + arena->used;
+    arena->used += size;
+    arena->nalloc++;
+    return ptr;
+}
+
+static void resp_arena_release(resp_arena_t *arena)
+{
+    arena_blck_t *blck;
+
+    while ((blck = arena->head) != NULL) {
+        arena->head = blck->next;
+        free(blck);
+    }
+    arena->used = 0;
+    arena->total = 0;
+}
+
+static void resp_arena_shrink(resp_arena_t *arena)
+{
+    arena_blck_t *blck;
+
+    resp_arena_release(arena);
+    blck = (arena_blck_t *)malloc(offsetof(arena_blck_t, data) + RESP_ARENA_BLCK_SIZE);
+    if (blck != NULL) {
+        blck->next = NULL;
+        blck->size = RESP_ARENA_BLCK_SIZE;
+        arena->head = blck;
+        arena->total = RESP_ARENA_BLCK_SIZE;
+        arena->nmalloc = 1;
+    }
+}
+
+static void resp_arena_reset(conn *c)
+{
+    resp_arena_t *arena = &c->resp_arena;
+    size_t total = arena->total;
+
+    if (arena->nalloc == 0) {
+        return;
+    }
+    STATS_ADD(c, resp_arena_allocs, arena->nalloc);
+    if (arena->nmalloc > 0) {
+        STATS_ADD(c, resp_arena_mallocs, arena->nmalloc);
+    }
+    arena->nalloc = 0;
+    arena->nmalloc = 0;
+    arena->used = 0;
+
+    if (arena->head->next != NULL && total <= RESP_ARENA_HIGHWAT) {
+        arena_blck_t *blck;
+        resp_arena_release(arena);
+        blck = (arena_blck_t *)malloc(offsetof(arena_blck_t, data) + total);
+        if (blck != NULL) {
+            blck->next = NULL;
+            blck->size = total;
+            arena->head = blck;
+            arena->total = total;
+            arena->nmalloc = 1;
+        }
+    }
+}
+
 /**
  * Reset all of the dynamic buffers used by a connection back to their
  * default sizes. The strategy for resizing the buffers is to allocate a
@@ -591,6 +692,8 @@ static void conn_destructor(void *buffer, void *unused) {
     free(c->suffixlist);
     free(c->iov);
     free(c->msglist);
+    free(c->riov);
+    resp_arena_release(&c->resp_arena);
 
     STATS_LOCK();
     mc_stats.conn_structs--;
@@ -666,6 +769,8 @@ conn *conn_new(const int sfd, STATE_FUNC init_state,
     c->rcurr = c->rbuf;
     c->ritem = 0;
     c->rlbytes = 0;
+    c->riovcurr = 0;
+    c->rvleft = 0;
 #ifdef USE_STRING_MBLOCK
     c->rltotal = 0;
 #endif
@@ -745,10 +850,7 @@ static void conn_coll_eitem_free(conn *c) {
         break;
       case OPERATION_LOP_GET:
         mc_engine.v1->list_elem_release(mc_engine.v0, c, c->coll_eitem, c->coll_ecount);
-        free(c->coll_eitem);
-        if (c->coll_resps != NULL) {
-            free(c->coll_resps); c->coll_resps = NULL;
-        }
+        c->coll_resps = NULL;
         break;
       /* sop */
       case OPERATION_SOP_INSERT:
@@ -760,10 +862,7 @@ static void conn_coll_eitem_free(conn *c) {
         break;
       case OPERATION_SOP_GET:
         mc_engine.v1->set_elem_release(mc_engine.v0, c, c->coll_eitem, c->coll_ecount);
-        free(c->coll_eitem);
-        if (c->coll_resps != NULL) {
-            free(c->coll_resps); c->coll_resps = NULL;
-        }
+        c->coll_resps = NULL;
         break;
       /* mop */
       case OPERATION_MOP_INSERT:
@@ -775,10 +874,7 @@ static void conn_coll_eitem_free(conn *c) {
         break;
       case OPERATION_MOP_GET:
         mc_engine.v1->map_elem_release(mc_engine.v0, c, c->coll_eitem, c->coll_ecount);
-        free(c->coll_eitem);
-        if (c->coll_resps != NULL) {
-            free(c->coll_resps); c->coll_resps = NULL;
-        }
+        c->coll_resps = NULL;
         break;
       /* bop */
       case OPERATION_BOP_INSERT:
@@ -793,10 +889,7 @@ static void conn_coll_eitem_free(conn *c) {
       case OPERATION_BOP_PWG: /* position with get */
       case OPERATION_BOP_GBP: /* get by position */
         mc_engine.v1->btree_elem_release(mc_engine.v0, c, c->coll_eitem, c->coll_ecount);
-        free(c->coll_eitem);
-        if (c->coll_resps != NULL) {
-            free(c->coll_resps); c->coll_resps = NULL;
-        }
+        c->coll_resps = NULL;
         break;
 #if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
 #ifdef SUPPORT_BOP_MGET
@@ -806,7 +899,6 @@ static void conn_coll_eitem_free(conn *c) {
       case OPERATION_BOP_SMGET:
 #endif
         mc_engine.v1->btree_elem_release(mc_engine.v0, c, c->coll_eitem, c->coll_ecount);
-        free(c->coll_eitem);
         break;
 #endif
       default:
@@ -847,6 +939,7 @@ static void conn_cleanup(conn *c) {
 #endif
         c->coll_strkeys = NULL;
     }
+    resp_arena_reset(c);
 
     if (c->ileft != 0) {
         for (; c->ileft > 0; c->ileft--,c->icurr++) {
@@ -946,6 +1039,10 @@ void conn_close(conn *c) {
 static void conn_shrink(conn *c) {
     assert(c != NULL);
 
+    if (c->resp_arena.total > RESP_ARENA_HIGHWAT) {
+        resp_arena_shrink(&c->resp_arena);
+    }
+
     if (IS_UDP(c->transport))
         return;
 
@@ -1130,6 +1227,83 @@ static int add_iov(conn *c, const void *buf, int len) {
 }
 
 
+/*
+ * Sets up reading vlen bytes into an item value.
+ * The value of a chunked item is read into its iovecs one by one.
+ *
+ * Returns 0 on success, -1 on out-of-memory.
+ */
+static int conn_set_ritem(conn *c, item_info *info, uint32_t vlen) {
+    c->ritem = info->value[0].iov_base;
+    c->rlbytes = vlen;
+    c->rvleft = 0;
+    if (info->nvalue > 1 && vlen > info->value[0].iov_len) {
+        if (c->riov == NULL) {
+            c->riov = malloc(sizeof(struct iovec) * ITEM_INFO_MAX_IOVS);
+            if (c->riov == NULL) {
+                return -1;
+            }
+        }
+        memcpy(c->riov, info->value, sizeof(struct iovec) * info->nvalue);
+        c->riovcurr = 0;
+        c->rlbytes = info->value[0].iov_len;
+        c->rvleft = vlen - c->rlbytes;
+    }
+    return 0;
+}
+
+/* Moves to the next value iovec if the current one has been read. */
+static inline void conn_next_ritem(conn *c) {
+    if (c->rlbytes == 0 && c->rvleft > 0) {
+        c->riovcurr++;
+        c->ritem = c->riov[c->riovcurr].iov_base;
+        c->rlbytes = c->riov[c->riovcurr].iov_len < c->rvleft
+                   ? c->riov[c->riovcurr].iov_len : c->rvleft;
+        c->rvleft -= c->rlbytes;
+    }
+}
+
+/*
+ * Adds the first nbytes of an item value to the list of data to be sent.
+ * The value of a chunked item spans several iovecs.
+ *
+ * Returns 0 on success, -1 on out-of-memory.
+ */
+static int add_item_value_iov(conn *c, item_info *info, uint32_t nbytes) {
+    uint32_t len;
+    int i;
+
+    for (i = 0; i < info->nvalue && nbytes > 0; i++) {
+        len = info->value[i].iov_len < nbytes ? info->value[i].iov_len : nbytes;
+        if (add_iov(c, info->value[i].iov_base, len) != 0) {
+            return -1;
+        }
+        nbytes -= len;
+    }
+    return 0;
+}
+
+/* Returns the byte at the offset of an item value. */
+static char *item_info_value_byte(item_info *info, uint32_t offset) {
+    int i;
+
+    for (i = 0; i < info->nvalue - 1 && offset >= info->value[i].iov_len; i++) {
+        offset -= info->value[i].iov_len;
+    }
+    return (char*)info->value[i].iov_base + offset;
+}
+
+/* Checks if an item value ends with "\r\n", which may span two iovecs. */
+static bool item_info_value_has_crlf(item_info *info) {
+    return *item_info_value_byte(info, info->nbytes - 2) == '\r' &&
+           *item_info_value_byte(info, info->nbytes - 1) == '\n';
+}
+
+static void item_info_value_set_crlf(item_info *info) {
+    *item_info_value_byte(info, info->nbytes - 2) = '\r';
+    *item_info_value_byte(info, info->nbytes - 1) = '\n';
+}
+
 /*
  * Constructs a set of UDP headers and attaches them to the outgoing messages.
  */
@@ -2087,7 +2261,7 @@ static void process_mop_get_complete(conn *c)
         need_size = c->coll_numkeys * sizeof(eitem*);
     }
 
-    if ((c->coll_eitem = (eitem *)malloc(need_size)) == NULL) {
+    if ((c->coll_eitem = (eitem *)resp_arena_alloc(c, need_size)) == NULL) {
         ret = ENGINE_ENOMEM;
     } else {
         elem_array = (eitem **)c->coll_eitem;
@@ -2161,7 +2335,7 @@ static void process_mop_get_complete(conn *c)
         do {
             need_size = ((2*lenstr_size) + 30) /* response head and tail size */
                       + (elem_count * ((MAX_FIELD_LENG+2) + (lenstr_size+2))); /* response body size */
-            if ((respbuf = (char*)malloc(need_size)) == NULL) {
+            if ((respbuf = (char*)resp_arena_alloc(c, need_size)) == NULL) {
                 ret = ENGINE_ENOMEM; break;
             }
             respptr = respbuf;
@@ -2202,7 +2376,6 @@ static void process_mop_get_complete(conn *c)
         } else { /* ENGINE_ENOMEM */
             STATS_NOKEY(c, cmd_mop_get);
             mc_engine.v1->map_elem_release(mc_engine.v0, c, elem_array, elem_count);
-            free(respbuf);
             if (c->ewouldblock)
                 c->ewouldblock = false;
             out_string(c, "SERVER_ERROR out of memory writing get response");
@@ -2250,10 +2423,7 @@ static void process_mop_get_complete(conn *c)
     }
 
     if (ret != ENGINE_SUCCESS) {
-        if (c->coll_eitem != NULL) {
-           free((void *)c->coll_eitem);
-           c->coll_eitem = NULL;
-        }
+        c->coll_eitem = NULL;
     }
 }
 
@@ -2657,10 +2827,7 @@ static void process_bop_mget_complete(conn *c) {
 #endif
             c->coll_strkeys = NULL;
         }
-        if (c->coll_eitem != NULL) {
-            free((void *)c->coll_eitem);
-            c->coll_eitem = NULL;
-        }
+        c->coll_eitem = NULL;
     }
 }
 #endif
@@ -2878,10 +3045,7 @@ static void process_bop_smget_complete_old(conn *c) {
 #endif
             c->coll_strkeys = NULL;
         }
-        if (c->coll_eitem != NULL) {
-            free((void *)c->coll_eitem);
-            c->coll_eitem = NULL;
-        }
+        c->coll_eitem = NULL;
     }
 }
 #endif
@@ -3098,10 +3262,7 @@ static void process_bop_smget_complete(conn *c) {
 #endif
             c->coll_strkeys = NULL;
         }
-        if (c->coll_eitem != NULL) {
-            free((void *)c->coll_eitem);
-            c->coll_eitem = NULL;
-        }
+        c->coll_eitem = NULL;
     }
 }
 #endif
@@ -3138,6 +3299,40 @@ static char *get_suffix_buffer(conn *c)
     return suffix;
 }
 
+/*
+ * Gets the items of the keys at once if the engine supports it.
+ * items[i] is NULL if the key isn't found.
+ */
+#define MGET_BATCH_SIZE 64
+
+static void get_item_batch(conn *c, token_t *karray, int kcount, item **items)
+{
+    int i;
+    if (mc_engine.v1->get_multi != NULL) {
+        if (mc_engine.v1->get_multi(mc_engine.v0, c, items, karray, kcount, 0) != ENGINE_SUCCESS) {
+            for (i = 0; i < kcount; i++) {
+                items[i] = NULL;
+            }
+        }
+        return;
+    }
+    for (i = 0; i < kcount; i++) {
+        if (mc_engine.v1->get(mc_engine.v0, c, &items[i],
+                              karray[i].value, karray[i].length, 0) != ENGINE_SUCCESS) {
+            items[i] = NULL;
+        }
+    }
+}
+
+static void release_item_batch(conn *c, item **items, int from, int to)
+{
+    for (int i = from; i < to; i++) {
+        if (items[i] != NULL) {
+            mc_engine.v1->release(mc_engine.v0, c, items[i]);
+        }
+    }
+}
+
 static void process_mget_complete(conn *c)
 {
     assert(c->coll_op == OPERATION_MGET);
@@ -3156,6 +3351,8 @@ static void process_mget_complete(conn *c)
 #endif
     char     delimiter = ' ';
     uint32_t k, nhit;
+    item    *items[MGET_BATCH_SIZE];
+    uint32_t bidx = 0, bcnt = 0;
 
     do {
 #ifdef USE_STRING_MBLOCK
@@ -3185,23 +3382,28 @@ static void process_mget_complete(conn *c)
         if (k < kcnt) { /* too long key */
             ret = ENGINE_EBADVALUE; break;
         }
-        /* do get operation for each key */
+        /* do get operation for each batch of keys */
         nhit = 0;
         for (k = 0; k < kcnt; k++) {
             key = key_tokens[k].value;
             nkey = key_tokens[k].length;
 
-            if (mc_engine.v1->get(mc_engine.v0, c, &it, key, nkey, 0) != ENGINE_SUCCESS) {
-                it = NULL;
+            bidx = k % MGET_BATCH_SIZE;
+            if (bidx == 0) {
+                bcnt = (kcnt - k) < MGET_BATCH_SIZE ? (kcnt - k) : MGET_BATCH_SIZE;
+                get_item_batch(c, &key_tokens[k], bcnt, items);
             }
+            it = items[bidx];
             if (settings.detail_enabled) {
                 stats_prefix_record_get(key, nkey, NULL != it);
             }
             if (it) {
-                item_info info = { .nvalue = 1 };
+                item_info_holder holder;
+                item_info *info = &holder.info;
+                info->nvalue = ITEM_INFO_MAX_IOVS;
                 /* get_item_info() always returns true. */
-                (void)mc_engine.v1->get_item_info(mc_engine.v0, c, it, &info);
-                assert(memcmp((char*)info.value[0].iov_base + info.nbytes - 2, "\r\n", 2) == 0);
+                (void)mc_engine.v1->get_item_info(mc_engine.v0, c, it, info);
+                assert(item_info_value_has_crlf(info));
 
                 /* prepare item array */
                 if (nhit >= c->isize) {
@@ -3222,13 +3424,13 @@ static void process_mget_complete(conn *c)
                     break; /* out of memory */
                 }
                 int suffix_len = snprintf(suffix, SUFFIX_SIZE, " %u %u\r\n",
-                                          htonl(info.flags), info.nbytes - 2);
+                                          htonl(info->flags), info->nbytes - 2);
 
-                MEMCACHED_COMMAND_GET(c->sfd, info.key, info.nkey, info.nbytes, info.cas);
+                MEMCACHED_COMMAND_GET(c->sfd, info->key, info->nkey, info->nbytes, info->cas);
                 if (add_iov(c, "VALUE ", 6) != 0 ||
-                    add_iov(c, info.key, info.nkey) != 0 ||
+                    add_iov(c, info->key, info->nkey) != 0 ||
                     add_iov(c, suffix, suffix_len) != 0 ||
-                    add_iov(c, info.value[0].iov_base, info.value[0].iov_len) != 0)
+                    add_item_value_iov(c, info, info->nbytes) != 0)
                 {
                     mc_engine.v1->release(mc_engine.v0, c, it);
                     break; /* out of memory */
@@ -3236,7 +3438,7 @@ static void process_mget_complete(conn *c)
 
                 if (settings.verbose > 1) {
                     mc_logger->log(EXTENSION_LOG_DEBUG, c,
-                            ">%d sending key %s\n", c->sfd, (char*)info.key);
+                            ">%d sending key %s\n", c->sfd, (char*)info->key);
                 }
 
                 /* item_get() has incremented it->refcount for us */
@@ -3248,6 +3450,9 @@ static void process_mget_complete(conn *c)
                 STATS_MISS(c, get, key, nkey);
             }
         }
+        if (k < kcnt) { /* out of memory: release the rest of the batch */
+            release_item_batch(c, items, bidx + 1, bcnt);
+        }
 
         c->icurr = c->ilist;
         c->ileft = nhit;
@@ -3330,8 +3535,10 @@ static void complete_update_ascii(conn *c) {
     }
 
     item *it = c->item;
-    item_info info = { .nvalue = 1 };
-    if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &info)) {
+    item_info_holder holder;
+    item_info *info = &holder.info;
+    info->nvalue = ITEM_INFO_MAX_IOVS;
+    if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, info)) {
         mc_engine.v1->release(mc_engine.v0, c, it);
         mc_logger->log(EXTENSION_LOG_WARNING, c,
                        "%d: Failed to get item info\n", c->sfd);
@@ -3339,7 +3546,7 @@ static void complete_update_ascii(conn *c) {
         return;
     }
 
-    if (memcmp((char*)info.value[0].iov_base + info.nbytes - 2, "\r\n", 2) != 0) {
+    if (!item_info_value_has_crlf(info)) {
         out_string(c, "CLIENT_ERROR bad data chunk");
     } else {
         ENGINE_ERROR_CODE ret;
@@ -3348,27 +3555,27 @@ static void complete_update_ascii(conn *c) {
 #ifdef ENABLE_DTRACE
         switch (c->store_op) {
         case OPERATION_ADD:
-            MEMCACHED_COMMAND_ADD(c->sfd, info.key, info.nkey,
-                                  (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+            MEMCACHED_COMMAND_ADD(c->sfd, info->key, info->nkey,
+                                  (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
             break;
         case OPERATION_REPLACE:
-            MEMCACHED_COMMAND_REPLACE(c->sfd, info.key, info.nkey,
-                                      (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+            MEMCACHED_COMMAND_REPLACE(c->sfd, info->key, info->nkey,
+                                      (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
             break;
         case OPERATION_APPEND:
-            MEMCACHED_COMMAND_APPEND(c->sfd, info.key, info.nkey,
-                                     (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+            MEMCACHED_COMMAND_APPEND(c->sfd, info->key, info->nkey,
+                                     (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
             break;
         case OPERATION_PREPEND:
-            MEMCACHED_COMMAND_PREPEND(c->sfd, info.key, info.nkey,
-                                      (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+            MEMCACHED_COMMAND_PREPEND(c->sfd, info->key, info->nkey,
+                                      (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
             break;
         case OPERATION_SET:
-            MEMCACHED_COMMAND_SET(c->sfd, info.key, info.nkey,
-                                  (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+            MEMCACHED_COMMAND_SET(c->sfd, info->key, info->nkey,
+                                  (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
             break;
         case OPERATION_CAS:
-            MEMCACHED_COMMAND_CAS(c->sfd, info.key, info.nkey, info.nbytes, c->cas);
+            MEMCACHED_COMMAND_CAS(c->sfd, info->key, info->nkey, info->nbytes, c->cas);
             break;
         }
 #endif
@@ -3425,7 +3632,7 @@ static void complete_update_ascii(conn *c) {
             handle_unexpected_errorcode_ascii(c, ret);
         }
     }
-    SLAB_INCR(c, cmd_set, info.key, info.nkey);
+    SLAB_INCR(c, cmd_set, info->key, info->nkey);
 
     /* release the c->item reference */
     mc_engine.v1->release(mc_engine.v0, c, c->item);
@@ -3828,8 +4035,10 @@ static void complete_update_bin(conn *c) {
     assert(c != NULL);
 
     item *it = c->item;
-    item_info info = { .nvalue = 1 };
-    if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &info)) {
+    item_info_holder holder;
+    item_info *info = &holder.info;
+    info->nvalue = ITEM_INFO_MAX_IOVS;
+    if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, info)) {
         mc_engine.v1->release(mc_engine.v0, c, it);
         mc_logger->log(EXTENSION_LOG_WARNING, c,
                        "%d: Failed to get item info\n", c->sfd);
@@ -3838,7 +4047,7 @@ static void complete_update_bin(conn *c) {
     }
     /* We don't actually receive the trailing two characters in the bin
      * protocol, so we're going to just set them here */
-    memcpy((char*)info.value[0].iov_base + info.value[0].iov_len - 2, "\r\n", 2);
+    item_info_value_set_crlf(info);
 
     ENGINE_ERROR_CODE ret;
     ret = mc_engine.v1->store(mc_engine.v0, c, it, &c->cas, c->store_op,
@@ -3851,24 +4060,24 @@ static void complete_update_bin(conn *c) {
 #ifdef ENABLE_DTRACE
     switch (c->cmd) {
     case OPERATION_ADD:
-        MEMCACHED_COMMAND_ADD(c->sfd, info.key, info.nkey,
-                              (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+        MEMCACHED_COMMAND_ADD(c->sfd, info->key, info->nkey,
+                              (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
         break;
     case OPERATION_REPLACE:
-        MEMCACHED_COMMAND_REPLACE(c->sfd, info.key, info.nkey,
-                                  (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+        MEMCACHED_COMMAND_REPLACE(c->sfd, info->key, info->nkey,
+                                  (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
         break;
     case OPERATION_APPEND:
-        MEMCACHED_COMMAND_APPEND(c->sfd, info.key, info.nkey,
-                                 (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+        MEMCACHED_COMMAND_APPEND(c->sfd, info->key, info->nkey,
+                                 (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
         break;
     case OPERATION_PREPEND:
-        MEMCACHED_COMMAND_PREPEND(c->sfd, info.key, info.nkey,
-                                  (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+        MEMCACHED_COMMAND_PREPEND(c->sfd, info->key, info->nkey,
+                                  (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
         break;
     case OPERATION_SET:
-        MEMCACHED_COMMAND_SET(c->sfd, info.key, info.nkey,
-                              (ret == ENGINE_SUCCESS) ? info.nbytes : -1, c->cas);
+        MEMCACHED_COMMAND_SET(c->sfd, info->key, info->nkey,
+                              (ret == ENGINE_SUCCESS) ? info->nbytes : -1, c->cas);
         break;
     }
 #endif
@@ -3912,7 +4121,7 @@ static void complete_update_bin(conn *c) {
         }
         write_bin_packet(c, eno, 0);
     }
-    SLAB_INCR(c, cmd_set, info.key, info.nkey);
+    SLAB_INCR(c, cmd_set, info->key, info->nkey);
 
     /* release the c->item reference */
     mc_engine.v1->release(mc_engine.v0, c, c->item);
@@ -3940,11 +4149,13 @@ static void process_bin_get(conn *c) {
 
     uint16_t keylen;
     uint32_t bodylen;
-    item_info info = { .nvalue = 1 };
+    item_info_holder holder;
+    item_info *info = &holder.info;
+    info->nvalue = ITEM_INFO_MAX_IOVS;
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &info)) {
+        if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, info)) {
             mc_engine.v1->release(mc_engine.v0, c, it);
             mc_logger->log(EXTENSION_LOG_WARNING, c,
                            "%d: Failed to get item info\n", c->sfd);
@@ -3954,7 +4165,7 @@ static void process_bin_get(conn *c) {
 
         /* the length has two unnecessary bytes ("\r\n") */
         keylen = 0;
-        bodylen = sizeof(rsp->message.body) + (info.nbytes - 2);
+        bodylen = sizeof(rsp->message.body) + (info->nbytes - 2);
 
         STATS_HIT(c, get, key, nkey);
 
@@ -3963,18 +4174,18 @@ static void process_bin_get(conn *c) {
             keylen = nkey;
         }
         add_bin_header(c, 0, sizeof(rsp->message.body), keylen, bodylen);
-        rsp->message.header.response.cas = htonll(info.cas);
+        rsp->message.header.response.cas = htonll(info->cas);
 
         // add the flags
-        rsp->message.body.flags = info.flags;
+        rsp->message.body.flags = info->flags;
         add_iov(c, &rsp->message.body, sizeof(rsp->message.body));
 
         if (c->cmd == PROTOCOL_BINARY_CMD_GETK) {
-            add_iov(c, info.key, nkey);
+            add_iov(c, info->key, nkey);
         }
 
         /* Add the data minus the CRLF */
-        add_iov(c, info.value[0].iov_base, info.value[0].iov_len - 2);
+        add_item_value_iov(c, info, info->nbytes - 2);
         conn_set_state(c, conn_mwrite);
         /* Remember this command so we can garbage collect it later */
         c->item = it;
@@ -4887,7 +5098,7 @@ static void process_bin_lop_get(conn *c) {
         if (est_count > MAX_LIST_SIZE) est_count = MAX_LIST_SIZE;
     }
     need_size = est_count * (sizeof(eitem*)+sizeof(uint32_t));
-    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+    if ((elem_array = (eitem **)resp_arena_alloc(c, need_size)) == NULL) {
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
         return;
     }
@@ -4982,10 +5193,6 @@ static void process_bin_lop_get(conn *c) {
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
-
-    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
-        free((void *)elem_array);
-    }
 }
 
 static void process_bin_sop_create(conn *c) {
@@ -5381,7 +5588,7 @@ static void process_bin_sop_get(conn *c) {
 
     if (req_count <= 0 || req_count > MAX_SET_SIZE) req_count = MAX_SET_SIZE;
     need_size = req_count * (sizeof(eitem*)+sizeof(uint32_t));
-    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+    if ((elem_array = (eitem **)resp_arena_alloc(c, need_size)) == NULL) {
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
         return;
     }
@@ -5476,10 +5683,6 @@ static void process_bin_sop_get(conn *c) {
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
-
-    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
-        free((void *)elem_array);
-    }
 }
 
 static void process_bin_bop_create(conn *c) {
@@ -6044,7 +6247,7 @@ static void process_bin_bop_get(conn *c) {
         if (est_count % 2) est_count += 1;
     }
     need_size = est_count * (sizeof(eitem*)+MAX_BKEY_LENG+MAX_EFLAG_LENG+sizeof(uint32_t));
-    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+    if ((elem_array = (eitem **)resp_arena_alloc(c, need_size)) == NULL) {
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
         return;
     }
@@ -6153,10 +6356,6 @@ static void process_bin_bop_get(conn *c) {
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
-
-    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
-        free((void *)elem_array);
-    }
 }
 
 static void process_bin_bop_count(conn *c) {
@@ -6352,7 +6551,7 @@ static void process_bin_bop_prepare_nread_keys(conn *c) {
 #endif
         assert(need_size > 0);
 
-        if ((elem = (eitem *)malloc(need_size)) == NULL) {
+        if ((elem = (eitem *)resp_arena_alloc(c, need_size)) == NULL) {
             ret = ENGINE_ENOMEM;
         } else {
 #ifdef USE_STRING_MBLOCK_COLL
@@ -6363,7 +6562,6 @@ static void process_bin_bop_prepare_nread_keys(conn *c) {
                           + (sizeof(token_t) * req->message.body.key_count);
             if ((c->coll_strkeys = malloc(kmem_size)) == NULL) {
 #endif
-                free((void*)elem);
                 ret = ENGINE_ENOMEM;
             } else {
                 c->coll_bkrange = req->message.body.bkrange;
@@ -6427,10 +6625,7 @@ static void process_bin_bop_mget_complete(conn *c) {
 #endif
             c->coll_strkeys = NULL;
         }
-        if (c->coll_eitem != NULL) {
-            free((void *)c->coll_eitem);
-            c->coll_eitem = NULL;
-        }
+        c->coll_eitem = NULL;
     }
 }
 #endif
@@ -6657,10 +6852,7 @@ static void process_bin_bop_smget_complete_old(conn *c) {
 #endif
             c->coll_strkeys = NULL;
         }
-        if (c->coll_eitem != NULL) {
-            free((void *)c->coll_eitem);
-            c->coll_eitem = NULL;
-        }
+        c->coll_eitem = NULL;
     }
 }
 #endif
@@ -6905,10 +7097,7 @@ static void process_bin_bop_smget_complete(conn *c) {
 #endif
             c->coll_strkeys = NULL;
         }
-        if (c->coll_eitem != NULL) {
-            free((void *)c->coll_eitem);
-            c->coll_eitem = NULL;
-        }
+        c->coll_eitem = NULL;
     }
 }
 #endif
@@ -7576,14 +7765,17 @@ static void process_bin_update(conn *c) {
     }
 
     ENGINE_ERROR_CODE ret;
-    item_info info = { .nvalue = 1 };
+    item_info_holder holder;
+    item_info *info = &holder.info;
+    info->nvalue = ITEM_INFO_MAX_IOVS;
 
     ret = mc_engine.v1->allocate(mc_engine.v0, c, &it, key, nkey, vlen+2,
                                  req->message.body.flags,
                                  realtime(req->message.body.expiration),
                                  c->binary_header.request.cas);
-    if (ret == ENGINE_SUCCESS && !mc_engine.v1->get_item_info(mc_engine.v0,
-                                                              c, it, &info)) {
+    if (ret == ENGINE_SUCCESS &&
+        (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, info) ||
+         conn_set_ritem(c, info, vlen) != 0)) {
         mc_engine.v1->release(mc_engine.v0, c, it);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
         return;
@@ -7610,8 +7802,6 @@ static void process_bin_update(conn *c) {
         }
 
         c->item = it;
-        c->ritem = info.value[0].iov_base;
-        c->rlbytes = vlen;
         conn_set_state(c, conn_nread);
         c->substate = bin_read_set_value;
         break;
@@ -7664,12 +7854,15 @@ static void process_bin_append_prepend(conn *c) {
     }
 
     ENGINE_ERROR_CODE ret;
-    item_info info = { .nvalue = 1 };
+    item_info_holder holder;
+    item_info *info = &holder.info;
+    info->nvalue = ITEM_INFO_MAX_IOVS;
 
     ret = mc_engine.v1->allocate(mc_engine.v0, c, &it, key, nkey, vlen+2,
                                  0, 0, c->binary_header.request.cas);
-    if (ret == ENGINE_SUCCESS && !mc_engine.v1->get_item_info(mc_engine.v0,
-                                                              c, it, &info)) {
+    if (ret == ENGINE_SUCCESS &&
+        (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, info) ||
+         conn_set_ritem(c, info, vlen) != 0)) {
         mc_engine.v1->release(mc_engine.v0, c, it);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
         return;
@@ -7689,8 +7882,6 @@ static void process_bin_append_prepend(conn *c) {
         }
 
         c->item = it;
-        c->ritem = info.value[0].iov_base;
-        c->rlbytes = vlen;
         conn_set_state(c, conn_nread);
         c->substate = bin_read_set_value;
         break;
@@ -7993,6 +8184,7 @@ static void reset_cmd_handler(conn *c) {
 #endif
         c->coll_strkeys = NULL;
     }
+    resp_arena_reset(c);
     conn_shrink(c);
     if (c->rbytes > 0) {
         conn_set_state(c, conn_parse_cmd);
@@ -8602,6 +8794,8 @@ static void server_stats(ADD_STAT add_stats, conn *c, bool aggregate) {
     APPEND_STAT("limit_maxbytes", "%"PRIu64, settings.maxbytes);
     APPEND_STAT("threads", "%d", settings.num_threads);
     APPEND_STAT("conn_yields", "%"PRIu64, thread_stats.conn_yields);
+    APPEND_STAT("resp_arena_allocs", "%"PRIu64, thread_stats.resp_arena_allocs);
+    APPEND_STAT("resp_arena_mallocs", "%"PRIu64, thread_stats.resp_arena_mallocs);
     STATS_UNLOCK();
 }
 
@@ -8622,6 +8816,7 @@ static void process_stat_settings(ADD_STAT add_stats, void *c) {
     APPEND_STAT("growth_factor", "%.2f", settings.factor);
     APPEND_STAT("chunk_size", "%d", settings.chunk_size);
     APPEND_STAT("num_threads", "%d", settings.num_threads);
+    APPEND_STAT("numa_nodes", "%d", settings.numa_nodes);
     APPEND_STAT("stat_key_prefix", "%c", settings.prefix_delimiter);
     APPEND_STAT("detail_enabled", "%s",
                 settings.detail_enabled ? "yes" : "no");
@@ -8652,6 +8847,7 @@ static void process_stat_settings(ADD_STAT add_stats, void *c) {
     APPEND_STAT("max_map_size", "%d", settings.max_map_size);
     APPEND_STAT("max_btree_size", "%d", settings.max_btree_size);
     APPEND_STAT("topkeys", "%d", settings.topkeys);
+    APPEND_STAT("hash_algorithm", "%s", settings.hash_algorithm);
 
     for (EXTENSION_DAEMON_DESCRIPTOR *ptr = settings.extensions.daemons;
          ptr != NULL;
@@ -8814,43 +9010,46 @@ static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
 /* ntokens is overwritten here... shrug.. */
 static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens, bool return_cas)
 {
-    ENGINE_ERROR_CODE ret;
     char *key;
     size_t nkey;
     int i = 0;
     item *it;
+    item *items[MAX_TOKENS];
+    int kidx, kcnt;
     token_t *key_token = &tokens[KEY_TOKEN];
     assert(c != NULL);
 
     do {
-        while(key_token->length != 0) {
-
-            key = key_token->value;
-            nkey = key_token->length;
-
-            if(nkey > KEY_MAX_LENGTH) {
+        /* check the key lengths, and get the items of the keys at once */
+        for (kcnt = 0; key_token[kcnt].length != 0; kcnt++) {
+            if (key_token[kcnt].length > KEY_MAX_LENGTH) {
                 out_string(c, "CLIENT_ERROR bad command line format");
                 return;
             }
+        }
+        get_item_batch(c, key_token, kcnt, items);
 
-            ret = mc_engine.v1->get(mc_engine.v0, c, &it, key, nkey, 0);
-            if (ret != ENGINE_SUCCESS) {
-                it = NULL;
-            }
+        for (kidx = 0; kidx < kcnt; kidx++) {
+
+            key = key_token->value;
+            nkey = key_token->length;
+            it = items[kidx];
 
             if (settings.detail_enabled) {
                 stats_prefix_record_get(key, nkey, NULL != it);
             }
 
             if (it) {
-                item_info info = { .nvalue = 1 };
-                if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &info)) {
+                item_info_holder holder;
+                item_info *info = &holder.info;
+                info->nvalue = ITEM_INFO_MAX_IOVS;
+                if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, info)) {
                     mc_engine.v1->release(mc_engine.v0, c, it);
                     out_string(c, "SERVER_ERROR error getting item data");
                     break;
                 }
 
-                assert(memcmp((char*)info.value[0].iov_base + info.nbytes - 2, "\r\n", 2) == 0);
+                assert(item_info_value_has_crlf(info));
 
                 if (i >= c->isize) {
                     item **new_list = realloc(c->ilist, sizeof(item *) * c->isize * 2);
@@ -8868,11 +9067,12 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                 if (suffix == NULL) {
                     out_string(c, "SERVER_ERROR out of memory rebuilding suffix");
                     mc_engine.v1->release(mc_engine.v0, c, it);
+                    release_item_batch(c, items, kidx + 1, kcnt);
                     return;
                 }
                 int suffix_len = snprintf(suffix, SUFFIX_SIZE,
-                                          " %u %u\r\n", htonl(info.flags),
-                                          info.nbytes - 2);
+                                          " %u %u\r\n", htonl(info->flags),
+                                          info->nbytes - 2);
 
                 /*
                  * Construct the response. Each hit adds three elements to the
@@ -8882,8 +9082,8 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                  *   " " + flags + " " + data length + "\r\n" + data (with \r\n)
                  */
 
-                MEMCACHED_COMMAND_GET(c->sfd, info.key, info.nkey,
-                                      info.nbytes, info.cas);
+                MEMCACHED_COMMAND_GET(c->sfd, info->key, info->nkey,
+                                      info->nbytes, info->cas);
                 if (return_cas)
                 {
 
@@ -8891,15 +9091,16 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                   if (cas == NULL) {
                     out_string(c, "SERVER_ERROR out of memory making CAS suffix");
                     mc_engine.v1->release(mc_engine.v0, c, it);
+                    release_item_batch(c, items, kidx + 1, kcnt);
                     return;
                   }
                   int cas_len = snprintf(cas, SUFFIX_SIZE, " %"PRIu64"\r\n",
-                                         info.cas);
+                                         info->cas);
                   if (add_iov(c, "VALUE ", 6) != 0 ||
-                      add_iov(c, info.key, info.nkey) != 0 ||
+                      add_iov(c, info->key, info->nkey) != 0 ||
                       add_iov(c, suffix, suffix_len - 2) != 0 ||
                       add_iov(c, cas, cas_len) != 0 ||
-                      add_iov(c, info.value[0].iov_base, info.value[0].iov_len) != 0)
+                      add_item_value_iov(c, info, info->nbytes) != 0)
                       {
                           mc_engine.v1->release(mc_engine.v0, c, it);
                           break;
@@ -8908,9 +9109,9 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                 else
                 {
                   if (add_iov(c, "VALUE ", 6) != 0 ||
-                      add_iov(c, info.key, info.nkey) != 0 ||
+                      add_iov(c, info->key, info->nkey) != 0 ||
                       add_iov(c, suffix, suffix_len) != 0 ||
-                      add_iov(c, info.value[0].iov_base, info.value[0].iov_len) != 0)
+                      add_item_value_iov(c, info, info->nbytes) != 0)
                       {
                           mc_engine.v1->release(mc_engine.v0, c, it);
                           break;
@@ -8920,7 +9121,7 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
 
                 if (settings.verbose > 1) {
                     mc_logger->log(EXTENSION_LOG_DEBUG, c,
-                            ">%d sending key %s\n", c->sfd, (char*)info.key);
+                            ">%d sending key %s\n", c->sfd, (char*)info->key);
                 }
 
                 /* item_get() has incremented it->refcount for us */
@@ -8935,6 +9136,9 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
 
             key_token++;
         }
+        if (kidx < kcnt) { /* stopped by an error: release the rest of the batch */
+            release_item_batch(c, items, kidx + 1, kcnt);
+        }
 
         /*
          * If the command string hasn't been fully processed, get the next set
@@ -9093,17 +9297,18 @@ static void process_update_command(conn *c, token_t *tokens, const size_t ntoken
     ret = mc_engine.v1->allocate(mc_engine.v0, c, &it, key, nkey, vlen,
                                  htonl(flags), realtime(exptime), req_cas_id);
 
-    item_info info = { .nvalue = 1 };
+    item_info_holder holder;
+    item_info *info = &holder.info;
+    info->nvalue = ITEM_INFO_MAX_IOVS;
     switch (ret) {
     case ENGINE_SUCCESS:
-        if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &info)) {
+        if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, info) ||
+            conn_set_ritem(c, info, vlen) != 0) {
             mc_engine.v1->release(mc_engine.v0, c, it);
             out_string(c, "SERVER_ERROR error getting item data");
             break;
         }
         c->item = it;
-        c->ritem = info.value[0].iov_base;
-        c->rlbytes = vlen;
         c->store_op = store_op;
         conn_set_state(c, conn_nread);
         break;
@@ -9283,7 +9488,8 @@ static void process_delete_command(conn *c, token_t *tokens, const size_t ntoken
     }
 
     /* For some reason the SLAB_INCR tries to access this... */
-    item_info info = { .nvalue = 1 };
+    item_info dummy_info = { .nvalue = 1 };
+    item_info *info = &dummy_info;
     if (ret == ENGINE_SUCCESS) {
         out_string(c, "DELETED");
         //SLAB_INCR(c, delete_hits, key, nkey);
@@ -9832,6 +10038,63 @@ static void process_dump_command(conn *c, token_t *tokens, const size_t ntokens)
     }
 }
 
+static void process_slabs_command(conn *c, token_t *tokens, const size_t ntokens)
+{
+    ENGINE_ERROR_CODE ret;
+
+    /* slabs ascii command
+     * slabs reassign <source class> <dest class>\r\n
+     * slabs automove <0|1>\r\n
+     */
+    if (ntokens == 5 && strcmp(tokens[SUBCOMMAND_TOKEN].value, "reassign") == 0) {
+        int32_t src, dst;
+        if (! safe_strtol(tokens[2].value, &src) || ! safe_strtol(tokens[3].value, &dst)) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+        if (mc_engine.v1->slabs_reassign == NULL) {
+            out_string(c, "NOT_SUPPORTED");
+            return;
+        }
+        ret = mc_engine.v1->slabs_reassign(mc_engine.v0, c, src, dst);
+        if (ret == ENGINE_SUCCESS) {
+            out_string(c, "OK");
+        } else if (ret == ENGINE_EINVAL) {
+            out_string(c, "BADCLASS invalid source or destination class id");
+        } else if (ret == ENGINE_ENOMEM) {
+            out_string(c, "NOSPARE source class has no spare pages");
+        } else if (ret == ENGINE_EWOULDBLOCK) {
+            out_string(c, "BUSY items of the source class are in use");
+        } else if (ret == ENGINE_ENOTSUP) {
+            out_string(c, "NOT_SUPPORTED");
+        } else if (ret == ENGINE_FAILED) {
+            out_string(c, "SERVER_ERROR out of memory");
+        } else {
+            handle_unexpected_errorcode_ascii(c, ret);
+        }
+    } else if (ntokens == 4 && strcmp(tokens[SUBCOMMAND_TOKEN].value, "automove") == 0) {
+        uint32_t level;
+        bool automove;
+        if (! safe_strtoul(tokens[2].value, &level) || level > 1) {
+            out_string(c, "CLIENT_ERROR bad value");
+            return;
+        }
+        automove = (level == 1);
+        SETTING_LOCK();
+        ret = mc_engine.v1->set_config(mc_engine.v0, c, "slab_automove", (void*)&automove);
+        SETTING_UNLOCK();
+        if (ret == ENGINE_SUCCESS) {
+            out_string(c, "OK");
+        } else { /* ENGINE_ENOTSUP */
+            out_string(c, "NOT_SUPPORTED");
+        }
+    } else {
+        print_invalid_command(c, tokens, ntokens);
+        out_string(c, "CLIENT_ERROR bad command line format");
+    }
+}
+
 static void process_help_command(conn *c, token_t *tokens, const size_t ntokens)
 {
     char *type = tokens[COMMAND_TOKEN+1].value;
@@ -9914,6 +10177,7 @@ static void process_help_command(conn *c, token_t *tokens, const size_t ntokens)
         "\t" "stats settings\\r\\n" "\n"
         "\t" "stats items\\r\\n" "\n"
         "\t" "stats slabs\\r\\n" "\n"
+        "\t" "stats memory\\r\\n" "\n"
         "\t" "stats prefixes\\r\\n" "\n"
         "\t" "stats detail [on|off|dump]\\r\\n" "\n"
         "\t" "stats scrub\\r\\n" "\n"
@@ -9936,6 +10200,9 @@ static void process_help_command(conn *c, token_t *tokens, const size_t ntokens)
         "\n"
         "\t" "dump start key [<prefix>] <filepath>\\r\\n" "\n"
         "\t" "dump stop\\r\\n" "\n"
+        "\n"
+        "\t" "slabs reassign <source class> <dest class>\\r\\n" "\n"
+        "\t" "slabs automove <0|1>\\r\\n" "\n"
 #ifdef ENABLE_ZK_INTEGRATION
         "\n"
         "\t" "zkensemble set <ensemble_list>\\r\\n" "\n"
@@ -10335,7 +10602,7 @@ static void process_lop_get(conn *c, char *key, size_t nkey,
         if (est_count > MAX_LIST_SIZE) est_count = MAX_LIST_SIZE;
     }
     need_size = est_count * sizeof(eitem*);
-    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+    if ((elem_array = (eitem **)resp_arena_alloc(c, need_size)) == NULL) {
         out_string(c, "SERVER_ERROR out of memory");
         return;
     }
@@ -10386,7 +10653,7 @@ static void process_lop_get(conn *c, char *key, size_t nkey,
         do {
             need_size = ((2*lenstr_size) + 30) /* response head and tail size */
                       + (elem_count * (lenstr_size+2)); /* response body size */
-            if ((respbuf = (char*)malloc(need_size)) == NULL) {
+            if ((respbuf = (char*)resp_arena_alloc(c, need_size)) == NULL) {
                 ret = ENGINE_ENOMEM; break;
             }
             respptr = respbuf;
@@ -10428,7 +10695,6 @@ static void process_lop_get(conn *c, char *key, size_t nkey,
         } else { /* ENGINE_ENOMEM */
             STATS_NOKEY(c, cmd_lop_get);
             mc_engine.v1->list_elem_release(mc_engine.v0, c, elem_array, elem_count);
-            free(respbuf);
             if (c->ewouldblock)
                 c->ewouldblock = false;
             out_string(c, "SERVER_ERROR out of memory writing get response");
@@ -10454,10 +10720,6 @@ static void process_lop_get(conn *c, char *key, size_t nkey,
         else if (ret == ENGINE_ENOTSUP) out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
     }
-
-    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
-        free((void *)elem_array);
-    }
 }
 
 static void process_lop_prepare_nread(conn *c, int cmd, size_t vlen,
@@ -10784,7 +11046,7 @@ static void process_sop_get(conn *c, char *key, size_t nkey, uint32_t count,
 
     if (req_count <= 0 || req_count > MAX_SET_SIZE) req_count = MAX_SET_SIZE;
     need_size = req_count * sizeof(eitem*);
-    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+    if ((elem_array = (eitem **)resp_arena_alloc(c, need_size)) == NULL) {
         out_string(c, "SERVER_ERROR out of memory");
         return;
     }
@@ -10835,7 +11097,7 @@ static void process_sop_get(conn *c, char *key, size_t nkey, uint32_t count,
         do {
             need_size = ((2*lenstr_size) + 30) /* response head and tail size */
                       + (elem_count * (lenstr_size+2)); /* response body size */
-            if ((respbuf = (char*)malloc(need_size)) == NULL) {
+            if ((respbuf = (char*)resp_arena_alloc(c, need_size)) == NULL) {
                 ret = ENGINE_ENOMEM; break;
             }
             respptr = respbuf;
@@ -10877,7 +11139,6 @@ static void process_sop_get(conn *c, char *key, size_t nkey, uint32_t count,
         } else { /* ENGINE_ENOMEM */
             STATS_NOKEY(c, cmd_sop_get);
             mc_engine.v1->set_elem_release(mc_engine.v0, c, elem_array, elem_count);
-            free(respbuf);
             if (c->ewouldblock)
                 c->ewouldblock = false;
             out_string(c, "SERVER_ERROR out of memory writing get response");
@@ -10903,10 +11164,6 @@ static void process_sop_get(conn *c, char *key, size_t nkey, uint32_t count,
         else if (ret == ENGINE_ENOTSUP) out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
     }
-
-    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
-        free((void *)elem_array);
-    }
 }
 
 static void process_sop_prepare_nread(conn *c, int cmd, size_t vlen, char *key, size_t nkey) {
@@ -11189,7 +11446,7 @@ static void process_bop_get(conn *c, char *key, size_t nkey,
         est_count = count;
     }
     need_size = est_count * sizeof(eitem*);
-    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+    if ((elem_array = (eitem **)resp_arena_alloc(c, need_size)) == NULL) {
         out_string(c, "SERVER_ERROR out of memory");
         return;
     }
@@ -11246,7 +11503,7 @@ static void process_bop_get(conn *c, char *key, size_t nkey,
         do {
             need_size = ((2*lenstr_size) + 30) /* response head and tail size */
                       + (elem_count * ((MAX_BKEY_LENG*2+2) + (MAX_EFLAG_LENG*2+2) + lenstr_size+3)); /* response body size */
-            if ((respbuf = (char*)malloc(need_size)) == NULL) {
+            if ((respbuf = (char*)resp_arena_alloc(c, need_size)) == NULL) {
                 ret = ENGINE_ENOMEM; break;
             }
             respptr = respbuf;
@@ -11291,7 +11548,6 @@ static void process_bop_get(conn *c, char *key, size_t nkey,
         } else { /* ENGINE_ENOMEM */
             STATS_NOKEY(c, cmd_bop_get);
             mc_engine.v1->btree_elem_release(mc_engine.v0, c, elem_array, elem_count);
-            free(respbuf);
             if (c->ewouldblock)
                 c->ewouldblock = false;
             out_string(c, "SERVER_ERROR out of memory writing get response");
@@ -11320,10 +11576,6 @@ static void process_bop_get(conn *c, char *key, size_t nkey,
         else if (ret == ENGINE_ENOTSUP)  out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
     }
-
-    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
-        free((void *)elem_array);
-    }
 }
 
 static void process_bop_count(conn *c, char *key, size_t nkey,
@@ -11446,7 +11698,7 @@ static void process_bop_pwg(conn *c, char *key, size_t nkey, const bkey_range *b
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
 
     need_size = ((count*2) + 1) * sizeof(eitem*);
-    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+    if ((elem_array = (eitem **)resp_arena_alloc(c, need_size)) == NULL) {
         out_string(c, "SERVER_ERROR out of memory");
         return;
     }
@@ -11471,7 +11723,7 @@ static void process_bop_pwg(conn *c, char *key, size_t nkey, const bkey_range *b
         do {
             need_size = ((4*lenstr_size) + 30) /* response head and tail size */
                       + (elem_count * ((MAX_BKEY_LENG*2+2) + (MAX_EFLAG_LENG*2+2) + lenstr_size+3)); /* result body size */
-            if ((respbuf = (char*)malloc(need_size)) == NULL) {
+            if ((respbuf = (char*)resp_arena_alloc(c, need_size)) == NULL) {
                 ret = ENGINE_ENOMEM; break;
             }
             respptr = respbuf;
@@ -11512,7 +11764,6 @@ static void process_bop_pwg(conn *c, char *key, size_t nkey, const bkey_range *b
         } else { /* ENGINE_ENOMEM */
             STATS_NOKEY(c, cmd_bop_pwg);
             mc_engine.v1->btree_elem_release(mc_engine.v0, c, elem_array, elem_count);
-            free(respbuf);
             out_string(c, "SERVER_ERROR out of memory writing get response");
         }
         }
@@ -11537,10 +11788,6 @@ static void process_bop_pwg(conn *c, char *key, size_t nkey, const bkey_range *b
         else if (ret == ENGINE_ENOTSUP)  out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
     }
-
-    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
-        free((void *)elem_array);
-    }
 }
 
 static void process_bop_gbp(conn *c, char *key, size_t nkey, ENGINE_BTREE_ORDER order,
@@ -11560,7 +11807,7 @@ static void process_bop_gbp(conn *c, char *key, size_t nkey, ENGINE_BTREE_ORDER
     est_count = (from_posi <= to_posi ? (to_posi - from_posi + 1)
                                       : (from_posi - to_posi + 1));
     need_size = est_count * sizeof(eitem*);
-    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+    if ((elem_array = (eitem **)resp_arena_alloc(c, need_size)) == NULL) {
         out_string(c, "SERVER_ERROR out of memory");
         return;
     }
@@ -11602,7 +11849,7 @@ static void process_bop_gbp(conn *c, char *key, size_t nkey, ENGINE_BTREE_ORDER
         do {
             need_size = ((2*lenstr_size) + 30) /* response head and tail size */
                       + (elem_count * ((MAX_BKEY_LENG*2+2) + (MAX_EFLAG_LENG*2+2) + lenstr_size+3)); /* result body size */
-            if ((respbuf = (char*)malloc(need_size)) == NULL) {
+            if ((respbuf = (char*)resp_arena_alloc(c, need_size)) == NULL) {
                 ret = ENGINE_ENOMEM; break;
             }
             respptr = respbuf;
@@ -11643,7 +11890,6 @@ static void process_bop_gbp(conn *c, char *key, size_t nkey, ENGINE_BTREE_ORDER
         } else { /* ENGINE_ENOMEM */
             STATS_NOKEY(c, cmd_bop_gbp);
             mc_engine.v1->btree_elem_release(mc_engine.v0, c, elem_array, elem_count);
-            free(respbuf);
             out_string(c, "SERVER_ERROR out of memory writing get response");
         }
         }
@@ -11667,10 +11913,6 @@ static void process_bop_gbp(conn *c, char *key, size_t nkey, ENGINE_BTREE_ORDER
         else if (ret == ENGINE_ENOTSUP)  out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
     }
-
-    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
-        free((void *)elem_array);
-    }
 }
 
 static void process_bop_update_prepare_nread(conn *c, int cmd, char *key, size_t nkey, const int vlen)
@@ -11824,20 +12066,18 @@ static void process_bop_prepare_nread_keys(conn *c, int cmd, uint32_t vlen, uint
 #endif
     assert(need_size > 0);
 
-    if ((elem = (eitem *)malloc(need_size)) == NULL) {
+    if ((elem = (eitem *)resp_arena_alloc(c, need_size)) == NULL) {
         ret = ENGINE_ENOMEM;
     } else {
 #ifdef USE_STRING_MBLOCK_COLL
         /* allocate memory blocks needed */
         if (mblck_list_alloc(&c->thread->mblck_pool, 1, vlen, &c->str_blcks) < 0) {
-            free((void*)elem);
             ret = ENGINE_ENOMEM;
         }
 #else
         int kmem_size = GET_8ALIGN_SIZE(vlen)
                       + (sizeof(token_t) * c->coll_numkeys);
         if ((c->coll_strkeys = malloc(kmem_size)) == NULL) {
-            free((void*)elem);
             ret = ENGINE_ENOMEM;
         }
 #endif
@@ -13676,6 +13916,10 @@ static void process_command(conn *c, char *command, int cmdlen)
     {
         process_dump_command(c, tokens, ntokens);
     }
+    else if ((ntokens >= 4 && ntokens <= 5) && (strcmp(tokens[COMMAND_TOKEN].value, "slabs") == 0))
+    {
+        process_slabs_command(c, tokens, ntokens);
+    }
     else if ((ntokens == 2) && (strcmp(tokens[COMMAND_TOKEN].value, "quit") == 0))
     {
         STATS_LOCK();
@@ -14345,12 +14589,13 @@ bool conn_nread(conn *c) {
                 continue;
             }
         }
+        conn_next_ritem(c);
         if (c->rlbytes == 0) {
             return true;
         }
     }
 #else
-    if (c->rbytes > 0) {
+    while (c->rbytes > 0) {
         int tocopy = c->rbytes > c->rlbytes ? c->rlbytes : c->rbytes;
         if (c->ritem != c->rcurr) {
             memmove(c->ritem, c->rcurr, tocopy);
@@ -14359,6 +14604,7 @@ bool conn_nread(conn *c) {
         c->rlbytes -= tocopy;
         c->rcurr += tocopy;
         c->rbytes -= tocopy;
+        conn_next_ritem(c);
         if (c->rlbytes == 0) {
             return true;
         }
@@ -14385,6 +14631,7 @@ bool conn_nread(conn *c) {
             }
         }
 #endif
+        conn_next_ritem(c);
         return true;
     }
     if (res == 0) { /* end of stream */
@@ -14945,13 +15192,16 @@ static void usage(void) {
            "              the memory page size could reduce the number of TLB misses\n"
            "              and improve the performance. In order to get large pages\n"
            "              from the OS, memcached will allocate the total item-cache\n"
-           "              in one large chunk.\n");
+           "              in one large chunk. On Linux, the chunk is mapped with\n"
+           "              huge pages (MAP_HUGETLB, or transparent huge pages).\n");
     printf("-D <char>     Use <char> as the delimiter between key prefixes and IDs.\n"
            "              This is used for per-prefix stats reporting. The default is\n"
            "              \":\" (colon). If this option is specified, stats collection\n"
            "              is turned on automatically; if not, then it may be turned on\n"
            "              by sending the \"stats detail on\" command to the server.\n");
     printf("-t <num>      number of threads to use (default: 4)\n");
+    printf("-N            Pin the worker threads to NUMA nodes round-robin, and give\n"
+           "              each node its own arena of slab pages (Linux only).\n");
     printf("-R            Maximum number of requests per event, limits the number of\n"
            "              requests process for a given connection to prevent \n"
            "              starvation (default: 20)\n");
@@ -14960,6 +15210,8 @@ static void usage(void) {
     printf("-B            Binding protocol - one of ascii, binary, or auto (default)\n");
     printf("-I            Override the size of each slab page. Adjusts max item size\n"
            "              (default: 1mb, min: 1k, max: 128m)\n");
+    printf("-H <name>     Key hash function of the engine hash table,\n"
+           "              one of jenkins (default) or wyhash\n");
     printf("-E <engine>   Engine to load, must be given (for example, -E .libs/default_engine.so)\n");
     printf("-q            Disable detailed stats commands\n");
 #ifdef SASL_ENABLED
@@ -15522,6 +15774,7 @@ static SERVER_HANDLE_V1 *get_server_api(void)
     if (rv.engine == NULL) {
         rv.engine = mc_engine.v0;
     }
+    core_api.hash = mc_hash_lookup(settings.hash_algorithm);
 
     return &rv;
 }
@@ -15683,6 +15936,7 @@ int main (int argc, char **argv) {
           "f:"  /* factor? */
           "n:"  /* minimum space allocated for key+value+flags */
           "t:"  /* threads */
+          "N"   /* NUMA aware threads and memory */
           "D:"  /* prefix delimiter? */
           "L"   /* Large memory pages */
           "R:"  /* max requests per event */
@@ -15691,6 +15945,7 @@ int main (int argc, char **argv) {
           "B:"  /* Binding protocol */
           "I:"  /* Max item size */
           "S"   /* Sasl ON */
+          "H:"  /* Key hash function */
           "E:"  /* Engine to load */
           "e:"  /* Engine options */
           "q"   /* Disallow detailed stats */
@@ -15823,6 +16078,10 @@ int main (int argc, char **argv) {
                         " your machine or less.\n");
             }
             break;
+        case 'N':
+            settings.numa_nodes = mc_numa_nodes();
+            old_opts += sprintf(old_opts, "numa=true;");
+            break;
         case 'D':
             settings.prefix_delimiter = optarg[0];
             old_opts += sprintf(old_opts, "prefix_delimiter=%c;", settings.prefix_delimiter);
@@ -15830,8 +16089,13 @@ int main (int argc, char **argv) {
             break;
         case 'L' :
             if (enable_large_pages() == 0) {
+#ifdef __linux__
+                /* the engine maps the item cache with huge pages */
+                old_opts += sprintf(old_opts, "large_pages=true;");
+#else
                 //preallocate = true;
                 old_opts += sprintf(old_opts, "preallocate=true;");
+#endif
             }
             break;
         case 'C' :
@@ -15893,6 +16157,14 @@ int main (int argc, char **argv) {
             old_opts += sprintf(old_opts, "item_size_max=%llu;", (unsigned long long)
                                 settings.item_size_max);
             break;
+        case 'H':
+            if (mc_hash_lookup(optarg) == NULL) {
+                fprintf(stderr, "Unknown hash function \"%s\". "
+                        "Use jenkins or wyhash.\n", optarg);
+                return 1;
+            }
+            settings.hash_algorithm = optarg;
+            break;
         case 'E':
             engine = optarg;
             break;
@@ -80,6 +80,10 @@
 #define ITEM_LIST_HIGHWAT 400
 #define IOV_LIST_HIGHWAT 600
 #define MSG_LIST_HIGHWAT 100
+#define RESP_ARENA_HIGHWAT (64*1024)
+
+/** Initial block size of the collection response arena. */
+#define RESP_ARENA_BLCK_SIZE 4096
 
 /* Binary protocol stuff */
 #define MIN_BIN_PKT_LENGTH 16
@@ -220,6 +224,8 @@ struct thread_stats {
     uint64_t          cmd_flush;
     uint64_t          cmd_flush_prefix;
     uint64_t          conn_yields; /* # of yields for connections (-R option)*/
+    uint64_t          resp_arena_allocs;  /* # of collection response arena allocations */
+    uint64_t          resp_arena_mallocs; /* # of arena blocks malloced for them */
     uint64_t          auth_cmds;
     uint64_t          auth_errors;
     /* list command stats */
@@ -398,6 +404,8 @@ struct settings {
     int max_map_size;       /* Maximum elements in map collection */
     int max_btree_size;     /* Maximum elements in b+tree collection */
     int topkeys;            /* Number of top keys to track */
+    char *hash_algorithm;   /* key hash function of the engine hash table */
+    int numa_nodes;         /* NUMA nodes the worker threads are pinned to, 0 if not pinned */
     struct {
         EXTENSION_DAEMON_DESCRIPTOR *daemons;
         EXTENSION_LOGGER_DESCRIPTOR *logger;
@@ -419,6 +427,23 @@ enum thread_type {
     GENERAL = 11
 };
 
+/*
+ * collection response arena structure
+ */
+typedef struct _arena_blck {
+    struct _arena_blck *next;
+    size_t size;
+    char data[1];
+} arena_blck_t;
+
+typedef struct _resp_arena {
+    arena_blck_t *head;   /* current block */
+    size_t   used;        /* used bytes of the current block */
+    size_t   total;       /* total size of the blocks */
+    uint32_t nalloc;      /* # of allocations since the last reset */
+    uint32_t nmalloc;     /* # of blocks malloced since the last reset */
+} resp_arena_t;
+
 #define USE_STRING_MBLOCK 1
 #define USE_STRING_MBLOCK_COLL 1
 
@@ -485,6 +510,7 @@ typedef struct {
     struct conn *conn_list;     /* connection list managed by this thread */
     int index;                  /* index of this thread in the threads array */
     enum thread_type type;      /* Type of IO this thread processes */
+    int numa_node;              /* NUMA node this thread is pinned to, -1 if not pinned */
 #ifdef USE_STRING_MBLOCK
     token_buff_t token_buff;    /* token buffer */
     mblck_pool_t mblck_pool;    /* memory block pool */
@@ -548,6 +574,9 @@ struct conn {
 
     char   *ritem;  /** when we read in an item's value, it goes here */
     uint32_t    rlbytes;
+    struct iovec *riov; /* value iovecs of a chunked item being read */
+    int    riovcurr;    /* index of the value iovec being read */
+    uint32_t    rvleft; /* value bytes left after the current iovec */
 #ifdef USE_STRING_MBLOCK
     uint32_t    rltotal;    /* Used when read data with memory block */
     mblck_node_t *mblck;    /* current memory block pointer */
@@ -557,6 +586,7 @@ struct conn {
     /* collection processing fields */
     void        *coll_eitem;
     char        *coll_resps;
+    resp_arena_t resp_arena;   /* element arrays and response strings */
     int          coll_ecount;
     int          coll_op;      /* (collection) operation type */
     char        *coll_key;
@@ -2,6 +2,7 @@
 #include <stdio.h>
 
 #include "memcached.h"
+#include "engines/default/default_engine.h"
 
 static void display(const char *name, size_t size) {
     printf("%s\t%d\n", name, (int)size);
@@ -24,5 +25,14 @@ int main(int argc, char **argv) {
     display("libevent thread cumulative", sizeof(LIBEVENT_THREAD));
     display("Thread stats cumulative\t", sizeof(struct thread_stats));
 
+    printf("----------------------------------------\n");
+
+#ifdef ENABLE_COMPACT_ITEM
+    display("Item header (compact)", sizeof(hash_item));
+#else
+    display("Item header\t", sizeof(hash_item));
+#endif
+    display("Item header with CAS", sizeof(hash_item) + sizeof(uint64_t));
+
     return 0;
 }
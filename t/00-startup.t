@@ -1,7 +1,7 @@
 #!/usr/bin/perl
 
 use strict;
-use Test::More tests => 18;
+use Test::More tests => 24;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -80,3 +80,15 @@ eval {
     my $server = new_memcached("-t 0");
 };
 ok($@, "Died with illegal 0 thread count");
+
+foreach my $val ('jenkins', 'wyhash') {
+    eval {
+        my $server = new_memcached("-H $val");
+        my $sock = $server->sock;
+        my $stats = mem_stats($sock, 'settings');
+        is($stats->{'hash_algorithm'}, $val, "hash algorithm is $val");
+        print $sock "set foo:bar 0 0 6\r\nfooval\r\n";
+        is(scalar <$sock>, "STORED\r\n", "stored foo:bar with $val");
+    };
+    is($@, '', "-H $val works");
+}
@@ -0,0 +1,48 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 7;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# the hash table is expanded by the assoc maintainer thread
+my $server = new_memcached("-e hashpower=12");
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock);
+my $power = $stats->{'hash_power_level'};
+is($stats->{'hash_is_expanding'}, 0, "not expanding at startup");
+is($stats->{'hash_expand_pending'}, 0, "no pending buckets at startup");
+
+my $count = 20000;
+for (my $i = 0; $i < $count; $i++) {
+    my $val = "val$i";
+    print $sock "set key$i 0 0 " . length($val) . " noreply\r\n$val\r\n";
+}
+mem_get_is($sock, "key0", "val0");
+
+# wait until the expansion is done
+my $tries = 0;
+do {
+    select(undef, undef, undef, 0.1) if $tries > 0;
+    $stats = mem_stats($sock);
+} while ($stats->{'hash_is_expanding'} != 0 && ++$tries < 100);
+
+is($stats->{'hash_is_expanding'}, 0, "expansion done");
+ok($stats->{'hash_power_level'} > $power, "hash table expanded");
+is($stats->{'curr_items'}, $count, "all items linked");
+
+my $missing = 0;
+for (my $i = 0; $i < $count; $i += 7) {
+    print $sock "get key$i\r\n";
+    my $line = scalar <$sock>;
+    if ($line =~ /^VALUE key$i /) {
+        $line = scalar <$sock>;
+        $missing++ if $line ne "val$i\r\n";
+        $line = scalar <$sock>;
+    } else {
+        $missing++;
+    }
+}
+is($missing, 0, "all items found after expansion");
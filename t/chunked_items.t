@@ -0,0 +1,92 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 25;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock, "slabs");
+is($stats->{"item_chunk_size"}, 0, "no chunked items by default");
+
+# waste of slab classes with a large item workload
+sub store_large_items {
+    my ($sock, $prefix) = @_;
+    for (my $i = 0; $i < 20; $i++) {
+        my $len = 100000 + $i * 37000;
+        print $sock "set $prefix$i 0 0 $len\r\n" . ("w" x $len) . "\r\n";
+        return 0 if scalar <$sock> ne "STORED\r\n";
+    }
+    return 1;
+}
+ok(store_large_items($sock, "plain"), "stored large items without chunks");
+my $plain_ratio = mem_stats($sock, "slabs")->{"wasted_ratio"};
+
+$server = new_memcached("-e item_chunk_size=65536");
+$sock = $server->sock;
+
+$stats = mem_stats($sock, "slabs");
+is($stats->{"item_chunk_size"}, 65536, "item chunk size");
+
+# chunk data size: chunk size minus the next chunk pointer
+my $dsize = 65536 - 8;
+
+sub large_value {
+    my ($len, $seed) = @_;
+    my $value = "";
+    for (my $i = 0; length($value) < $len; $i++) {
+        $value .= sprintf("%s%07d", $seed, $i);
+    }
+    return substr($value, 0, $len);
+}
+
+# values of several chunks, with and without a tail in the item header
+foreach my $len (60000, $dsize * 2 - 2, $dsize * 2 - 1, 300000, 1000000) {
+    my $val = large_value($len, "k");
+    print $sock "set key$len 0 0 $len\r\n$val\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored $len bytes");
+    mem_get_is($sock, "key$len", $val, "got $len bytes");
+}
+
+# the data terminator is checked across chunks
+my $len = $dsize * 2 - 1;
+print $sock "set badkey 0 0 $len\r\n" . large_value($len, "b") . "\r?";
+like(scalar <$sock>, qr/^CLIENT_ERROR bad data chunk/, "bad data terminator");
+print $sock "get badkey\r\n";
+is(scalar <$sock>, "END\r\n", "not stored");
+
+# append and prepend copy through the chunks
+my $val = large_value(200000, "a");
+print $sock "set apkey 0 0 200000\r\n$val\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored apkey");
+my $ext = large_value(70000, "e");
+print $sock "append apkey 0 0 70000\r\n$ext\r\n";
+is(scalar <$sock>, "STORED\r\n", "appended apkey");
+print $sock "prepend apkey 0 0 70000\r\n$ext\r\n";
+is(scalar <$sock>, "STORED\r\n", "prepended apkey");
+mem_get_is($sock, "apkey", $ext . $val . $ext, "appended and prepended value");
+
+print $sock "incr apkey 1\r\n";
+like(scalar <$sock>, qr/^CLIENT_ERROR /, "chunked item isn't a number");
+
+# multi-get of chunked and small items
+print $sock "set small 0 0 5\r\nsmall\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored small");
+$val = large_value(300000, "k");
+print $sock "get small key300000 small\r\n";
+my $ok = (scalar <$sock>) eq "VALUE small 0 5\r\n" && (scalar <$sock>) eq "small\r\n"
+      && (scalar <$sock>) eq "VALUE key300000 0 300000\r\n" && (scalar <$sock>) eq "$val\r\n"
+      && (scalar <$sock>) eq "VALUE small 0 5\r\n" && (scalar <$sock>) eq "small\r\n"
+      && (scalar <$sock>) eq "END\r\n";
+ok($ok, "multi-get of chunked items");
+
+# the chunks are freed with their items
+print $sock "delete key1000000\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted key1000000");
+
+ok(store_large_items($sock, "chunked"), "stored large items in chunks");
+$stats = mem_stats($sock, "slabs");
+ok($stats->{"wasted_ratio"} < $plain_ratio, "less memory wasted with chunks");
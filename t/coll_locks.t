@@ -0,0 +1,72 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 48;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $cmd;
+my $val;
+my $rst;
+
+# collection reads under the shared collection lock or the shared cache lock,
+# collection updates under the exclusive collection lock and cache lock.
+foreach my $opt ("coll_lock_stripes=16", "shared_coll_read=true") {
+    my $server = new_memcached("-e $opt");
+    my $sock = $server->sock;
+    my $sock2 = $server->new_sock;
+
+    # list
+    $cmd = "lop insert lkey 0 6 create 11 0 0"; $val = "datum0"; $rst = "CREATED_STORED";
+    print $sock "$cmd\r\n$val\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd $val: $rst");
+    $cmd = "lop insert lkey -1 6"; $val = "datum1"; $rst = "STORED";
+    print $sock "$cmd\r\n$val\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd $val: $rst");
+    lop_get_is($sock, "lkey 0..-1", 11, 2, "datum0,datum1");
+    lop_get_is($sock2, "lkey 0 delete", 11, 1, "datum0");
+    lop_get_is($sock, "lkey 0..-1", 11, 1, "datum1");
+
+    # set
+    $cmd = "sop insert skey 6 create 11 0 0"; $val = "datum0"; $rst = "CREATED_STORED";
+    print $sock "$cmd\r\n$val\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd $val: $rst");
+    $cmd = "sop exist skey 6"; $val = "datum0"; $rst = "EXIST";
+    print $sock "$cmd\r\n$val\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd $val: $rst");
+    $cmd = "sop delete skey 6"; $val = "datum0"; $rst = "DELETED";
+    print $sock2 "$cmd\r\n$val\r\n"; is(scalar <$sock2>, "$rst\r\n", "$cmd $val: $rst");
+    $cmd = "sop exist skey 6"; $val = "datum0"; $rst = "NOT_EXIST";
+    print $sock "$cmd\r\n$val\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd $val: $rst");
+
+    # map
+    $cmd = "mop insert mkey f1 6 create 11 0 0"; $val = "datum1"; $rst = "CREATED_STORED";
+    print $sock "$cmd\r\n$val\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd $val: $rst");
+    $cmd = "mop update mkey f1 6"; $val = "datum2"; $rst = "UPDATED";
+    print $sock2 "$cmd\r\n$val\r\n"; is(scalar <$sock2>, "$rst\r\n", "$cmd $val: $rst");
+    mop_get_is($sock, "mkey 2 1", 11, 1, 1, "f1", "f1", "datum2", "END");
+
+    # b+tree
+    $cmd = "bop insert bkey 1 6 create 11 0 0"; $val = "datum1"; $rst = "CREATED_STORED";
+    print $sock "$cmd\r\n$val\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd $val: $rst");
+    $cmd = "bop insert bkey 2 6"; $val = "datum2"; $rst = "STORED";
+    print $sock "$cmd\r\n$val\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd $val: $rst");
+    $cmd = "bop incr bkey 2 1"; $rst = "CLIENT_ERROR cannot increment or decrement non-numeric value";
+    print $sock2 "$cmd\r\n"; is(scalar <$sock2>, "$rst\r\n", "$cmd: $rst");
+    bop_get_is($sock, "bkey 0..10", 11, 2, "1,2", "datum1,datum2", "END");
+    $cmd = "bop count bkey 0..10"; $rst = "COUNT=2";
+    print $sock "$cmd\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd: $rst");
+    $cmd = "bop position bkey 2 asc"; $rst = "POSITION=1";
+    print $sock "$cmd\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd: $rst");
+    bop_get_is($sock2, "bkey 1 delete", 11, 1, "1", "datum1", "DELETED");
+    bop_get_is($sock, "bkey 0..10", 11, 1, "2", "datum2", "END");
+
+    # type mismatch and missing key
+    $cmd = "bop count lkey 0..10"; $rst = "TYPE_MISMATCH";
+    print $sock "$cmd\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd: $rst");
+    $cmd = "bop count nokey 0..10"; $rst = "NOT_FOUND";
+    print $sock "$cmd\r\n"; is(scalar <$sock>, "$rst\r\n", "$cmd: $rst");
+
+    # attributes and item deletion
+    $cmd = "setattr bkey maxcount=100"; $rst = "OK";
+    print $sock2 "$cmd\r\n"; is(scalar <$sock2>, "$rst\r\n", "$cmd: $rst");
+    $cmd = "delete bkey"; $rst = "DELETED";
+    print $sock2 "$cmd\r\n"; is(scalar <$sock2>, "$rst\r\n", "$cmd: $rst");
+}
@@ -0,0 +1,75 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 10;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+print $sock "bop create bkey 0 0 1000\r\n";
+is(scalar <$sock>, "CREATED\r\n", "created bkey");
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "bop insert bkey $i 6 noreply\r\n" . sprintf("data%02d", $i) . "\r\n";
+}
+print $sock "lop create lkey 0 0 1000\r\n";
+is(scalar <$sock>, "CREATED\r\n", "created lkey");
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "lop insert lkey -1 6 noreply\r\n" . sprintf("data%02d", $i) . "\r\n";
+}
+
+my $stats = mem_stats($sock);
+my $allocs = $stats->{"resp_arena_allocs"};
+my $mallocs = $stats->{"resp_arena_mallocs"};
+
+# repeated collection reads reuse the arena of the connection,
+# the reads of a bounded count stay below the high water mark.
+my $ok = 1;
+for (my $i = 0; $i < 200; $i++) {
+    print $sock "bop get bkey 10..12 3\r\n";
+    $ok = 0 if scalar <$sock> ne "VALUE 0 3\r\n";
+    $ok = 0 if scalar <$sock> ne "10 6 data10\r\n";
+    $ok = 0 if scalar <$sock> ne "11 6 data11\r\n";
+    $ok = 0 if scalar <$sock> ne "12 6 data12\r\n";
+    $ok = 0 if scalar <$sock> ne "END\r\n";
+    print $sock "lop get lkey 0..99\r\n";
+    $ok = 0 if scalar <$sock> ne "VALUE 0 100\r\n";
+    for (my $j = 0; $j < 100; $j++) {
+        $ok = 0 if scalar <$sock> ne sprintf("6 data%02d\r\n", $j);
+    }
+    $ok = 0 if scalar <$sock> ne "END\r\n";
+}
+ok($ok, "collection responses");
+
+$stats = mem_stats($sock);
+ok($stats->{"resp_arena_allocs"} - $allocs >= 800, "arena allocations");
+ok($stats->{"resp_arena_mallocs"} - $mallocs <= 10, "arena blocks malloced");
+
+# an arena grown above the high water mark is shrunk for the next reads
+$ok = 1;
+for (my $i = 0; $i < 2; $i++) {
+    print $sock "lop get lkey 0..-1\r\n";
+    $ok = 0 if scalar <$sock> ne "VALUE 0 100\r\n";
+    for (my $j = 0; $j < 100; $j++) {
+        $ok = 0 if scalar <$sock> ne sprintf("6 data%02d\r\n", $j);
+    }
+    $ok = 0 if scalar <$sock> ne "END\r\n";
+    print $sock "bop get bkey 10..12 3\r\n";
+    $ok = 0 if scalar <$sock> ne "VALUE 0 3\r\n";
+    $ok = 0 if scalar <$sock> ne "10 6 data10\r\n";
+    $ok = 0 if scalar <$sock> ne "11 6 data11\r\n";
+    $ok = 0 if scalar <$sock> ne "12 6 data12\r\n";
+    $ok = 0 if scalar <$sock> ne "END\r\n";
+}
+ok($ok, "collection responses after a large read");
+
+# the arena is reset after error responses
+print $sock "bop get nokey 0..10\r\n";
+is(scalar <$sock>, "NOT_FOUND\r\n", "bop get of no key");
+print $sock "lop get bkey 0..10\r\n";
+is(scalar <$sock>, "TYPE_MISMATCH\r\n", "lop get of btree");
+print $sock "bop get bkey 1000..2000\r\n";
+is(scalar <$sock>, "NOT_FOUND_ELEMENT\r\n", "bop get of no element");
+mem_get_is($sock, "bkey", undef);
@@ -0,0 +1,71 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 19;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-e expiry_reap_rate=100000");
+my $sock = $server->sock;
+my $value = "v" x 100;
+
+for (my $i = 0; $i < 1000; $i++) {
+    print $sock "set short$i 0 2 100 noreply\r\n$value\r\n";
+}
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "set forever$i 0 0 100 noreply\r\n$value\r\n";
+    print $sock "set long$i 0 1000 100 noreply\r\n$value\r\n";
+}
+print $sock "bop create bkey 0 2 1000\r\n";
+is(scalar <$sock>, "CREATED\r\n", "created bkey");
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "bop insert bkey $i 100 noreply\r\n$value\r\n";
+}
+print $sock "set attr 0 0 100\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored attr");
+print $sock "setattr attr expiretime=2\r\n";
+is(scalar <$sock>, "OK\r\n", "exptime of attr set");
+
+my $stats = mem_stats($sock);
+is($stats->{"curr_items"}, 1202, "curr_items");
+is($stats->{"expiry_wheel_entries"}, 1102, "entries added");
+
+# the entries are removed on replace, delete and exptime change
+for (my $n = 0; $n < 10; $n++) {
+    for (my $i = 0; $i < 100; $i++) {
+        print $sock "set long$i 0 1000 100 noreply\r\n$value\r\n";
+        print $sock "set temp$i 0 1000 100 noreply\r\n$value\r\n";
+        print $sock "delete temp$i noreply\r\n";
+    }
+}
+print $sock "setattr attr expiretime=1000\r\n";
+is(scalar <$sock>, "OK\r\n", "exptime of attr changed");
+print $sock "setattr attr expiretime=2\r\n";
+is(scalar <$sock>, "OK\r\n", "exptime of attr restored");
+$stats = mem_stats($sock);
+is($stats->{"curr_items"}, 1202, "curr_items after replace");
+is($stats->{"expiry_wheel_entries"}, 1102, "no stale entries");
+$stats = mem_stats($sock, "memory");
+ok($stats->{"overhead_expiry_wheel_bytes"} >= 1102 * 8, "memory of the wheel");
+
+# the expired items are freed without any access
+sleep(3.5);
+$stats = mem_stats($sock);
+is($stats->{"curr_items"}, 200, "curr_items of live items");
+is($stats->{"expiry_reaped"}, 1002, "expired items reaped");
+is($stats->{"expiry_wheel_entries"}, 100, "entries left");
+ok($stats->{"bytes"} < 200 * 1024, "bytes of live items");
+mem_get_is($sock, "forever0", $value);
+mem_get_is($sock, "long99", $value);
+
+# expired items are kept until accessed without the reaper
+$server = new_memcached();
+$sock = $server->sock;
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "set short$i 0 1 100 noreply\r\n$value\r\n";
+}
+mem_get_is($sock, "short0", $value);
+sleep(2.5);
+is(mem_stats($sock)->{"curr_items"}, 100, "expired items kept");
+ok(!exists mem_stats($sock, "memory")->{"overhead_expiry_wheel_bytes"}, "no wheel");
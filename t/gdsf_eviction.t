@@ -0,0 +1,64 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 9;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $value = "v" x 100;
+
+# loads small items until the first eviction and
+# returns the number of bulk items stored
+sub load_until_eviction {
+    my $sock = shift;
+    my $n = 0;
+    while ($n < 200000) {
+        for (my $i = 0; $i < 100; $i++, $n++) {
+            print $sock "set bulk$n 0 0 100 noreply\r\n$value\r\n";
+        }
+        last if mem_stats($sock)->{"evictions"} > 0;
+    }
+    return $n;
+}
+
+# the small items are older than a large collection
+sub load_items {
+    my $sock = shift;
+    for (my $i = 0; $i < 5; $i++) {
+        print $sock "set small$i 0 0 100 noreply\r\n$value\r\n";
+    }
+    print $sock "bop create big 0 0 50000\r\n";
+    is(scalar <$sock>, "CREATED\r\n", "created big");
+    for (my $i = 0; $i < 20000; $i++) {
+        print $sock "bop insert big $i 100 noreply\r\n$value\r\n";
+    }
+    print $sock "bop count big 0..20000\r\n";
+    is(scalar <$sock>, "COUNT=20000\r\n", "big loaded");
+}
+
+# with LRU, the oldest small items are evicted first
+my $server = new_memcached("-m 10");
+my $sock = $server->sock;
+load_items($sock);
+load_until_eviction($sock);
+mem_get_is($sock, "small0", undef);
+my $stats = mem_stats($sock);
+my $lru_bytes = $stats->{"evicted_bytes"} / $stats->{"evictions"};
+
+# with GDSF, the large collection frees the most memory per hit value
+$server = new_memcached("-m 10 -e eviction_policy=gdsf");
+$sock = $server->sock;
+load_items($sock);
+load_until_eviction($sock);
+mem_get_is($sock, "small0", $value);
+print $sock "bop count big 0..20000\r\n";
+is(scalar <$sock>, "NOT_FOUND\r\n", "big evicted with GDSF");
+
+$stats = mem_stats($sock);
+ok($stats->{"evicted_bytes"} / $stats->{"evictions"} > $lru_bytes,
+   "more bytes freed per eviction");
+
+# unknown policy
+$server = eval { new_memcached("-e eviction_policy=lfu") };
+ok(!defined $server, "unknown eviction policy rejected");
@@ -0,0 +1,55 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 10;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+sub multi_get {
+    my ($sock, $cmd) = @_;
+    my %values;
+    print $sock "$cmd\r\n";
+    while (my $line = <$sock>) {
+        last if $line =~ /^END\r\n$/;
+        if ($line =~ /^VALUE (\S+) \d+ (\d+)/) {
+            my ($key, $len) = ($1, $2);
+            my $data;
+            read($sock, $data, $len + 2);
+            $values{$key} = substr($data, 0, $len);
+        } else {
+            return undef;
+        }
+    }
+    return \%values;
+}
+
+# multi-key get and mget resolve the keys in batches
+foreach my $opt ("", "-e lockfree_get=true") {
+    my $server = new_memcached($opt);
+    my $sock = $server->sock;
+    my $count = 150;
+
+    for (my $i = 0; $i < $count; $i++) {
+        print $sock "set key$i 0 0 " . length("val$i") . " noreply\r\nval$i\r\n";
+    }
+    print $sock "lop create lkey 0 0 10\r\n";
+    is(scalar <$sock>, "CREATED\r\n", "created list");
+
+    # get: hits, misses and a collection key
+    my $values = multi_get($sock, "get key0 nokey1 key1 lkey key2 nokey2 key3");
+    is(join(",", map { "$_=$values->{$_}" } sort keys %$values),
+       "key0=val0,key1=val1,key2=val2,key3=val3", "get with misses");
+
+    # mget: more keys than a batch
+    my @keys = map { ($_ % 10 == 9) ? "nokey$_" : "key$_" } (0 .. $count - 1);
+    my $keystr = join(" ", @keys);
+    $values = multi_get($sock, "mget " . length($keystr) . " " . scalar(@keys) . "\r\n$keystr");
+    my @found = grep { defined $values->{$_} && $values->{$_} eq "val" . substr($_, 3) } @keys;
+    is(scalar(@found), $count - $count / 10, "mget over batches");
+
+    # the items can be updated and deleted after the batched get
+    print $sock "delete key0\r\n";
+    is(scalar <$sock>, "DELETED\r\n", "deleted key0");
+    mem_get_is($sock, "key0", undef, "key0 is gone");
+}
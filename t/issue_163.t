@@ -18,8 +18,12 @@ my $value2 = "B"x77330;
 print $sock "set key 0 1 77320\r\n$value1\r\n";
 is (scalar <$sock>, "STORED\r\n", "stored key");
 
-my $stats  = mem_stats($sock, "slabs");
-my $requested = $stats->{"31:mem_requested"};
+# the slab class of the item depends on the item header size
+my $stats  = mem_stats($sock, "items");
+my ($clsid) = grep { $stats->{"items:$_:number"} } (1 .. 200);
+
+$stats  = mem_stats($sock, "slabs");
+my $requested = $stats->{"$clsid:mem_requested"};
 isnt ($requested, "0", "We should have requested some memory");
 
 sleep(3);
@@ -27,7 +31,7 @@ print $sock "set key 0 0 77330\r\n$value2\r\n";
 is (scalar <$sock>, "STORED\r\n", "stored key");
 
 my $stats  = mem_stats($sock, "items");
-my $reclaimed = $stats->{"items:31:reclaimed"};
+my $reclaimed = $stats->{"items:$clsid:reclaimed"};
 is ($reclaimed, "1", "Objects should be reclaimed");
 
 print $sock "delete key\r\n";
@@ -37,5 +41,5 @@ print $sock "set key 0 0 77320\r\n$value1\r\n";
 is (scalar <$sock>, "STORED\r\n", "stored key");
 
 my $stats  = mem_stats($sock, "slabs");
-my $requested2 = $stats->{"31:mem_requested"};
+my $requested2 = $stats->{"$clsid:mem_requested"};
 is ($requested2, $requested, "we've not allocated and freed the same amont");
@@ -29,7 +29,9 @@ for ($key = 0; $key < 60; $key++) {
 }
 
 my $first_stats  = mem_stats($sock, "items");
-my $first_evicted = $first_stats->{"items:31:evicted"};
+# the slab class of the items depends on the item header size
+my ($clsid) = grep { $first_stats->{"items:$_:number"} } (1 .. 200);
+my $first_evicted = $first_stats->{"items:$clsid:evicted"};
 # I get 1 eviction on a 32 bit binary, but 4 on a 64 binary..
 # Just check that I have evictions...
 isnt ($first_evicted, "0", "check evicted");
@@ -38,7 +40,7 @@ print $sock "stats reset\r\n";
 is (scalar <$sock>, "RESET\r\n", "Stats reset");
 
 my $second_stats  = mem_stats($sock, "items");
-my $second_evicted = $second_stats->{"items:31:evicted"};
+my $second_evicted = $second_stats->{"items:$clsid:evicted"};
 is ($second_evicted, "0", "check evicted");
 
 ### [ARCUS] CHANGED FOLLOWING TEST ###
@@ -51,5 +53,5 @@ for ($key = 60; $key < 100; $key++) {
 }
 
 my $last_stats  = mem_stats($sock, "items");
-my $last_evicted = $last_stats->{"items:31:evicted"};
+my $last_evicted = $last_stats->{"items:$clsid:evicted"};
 is ($last_evicted, "40", "check evicted");
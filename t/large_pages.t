@@ -0,0 +1,37 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 8;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# the cache memory is mapped with huge pages
+my $server = new_memcached("-m 64 -e 'large_pages=true;prefault=true'");
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock, "slabs");
+like($stats->{"slab_arena"}, qr/^(hugetlb|thp)$/, "arena backed by huge pages");
+
+my $value = "L" x 100000;
+print $sock "set big 0 0 100000\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored big");
+mem_get_is($sock, "big", $value);
+print $sock "set small 0 0 5\r\nvalue\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored small");
+mem_get_is($sock, "small", "value");
+
+# the small memory blocks of collections come from the arena too
+print $sock "bop insert bkey 1 5 create 0 0 0\r\ndatum\r\n";
+is(scalar <$sock>, "CREATED_STORED\r\n", "b+tree created");
+
+# -L enables the huge page arena on Linux
+SKIP: {
+    skip "large pages of -L are Linux only", 2 unless $^O eq "linux";
+    $server = new_memcached("-m 64 -L");
+    $sock = $server->sock;
+    $stats = mem_stats($sock, "slabs");
+    like($stats->{"slab_arena"}, qr/^(hugetlb|thp)$/, "-L maps huge pages");
+    print $sock "set key 0 0 5\r\nvalue\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored with -L");
+}
@@ -0,0 +1,58 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 6;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-m 10 -e lfu_admission=true");
+my $sock = $server->sock;
+my $value = "v" x 1000;
+
+# the hot keys are accessed many times
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "set key$i 0 0 1000 noreply\r\n$value\r\n";
+}
+for (my $n = 0; $n < 10; $n++) {
+    for (my $i = 0; $i < 100; $i++) {
+        print $sock "get key$i\r\n";
+        scalar <$sock>; scalar <$sock>; scalar <$sock>;
+    }
+}
+mem_get_is($sock, "key99", $value);
+
+# the hot set survives a bulk load of keys accessed only once,
+# even if the hot keys aren't accessed during the load
+for (my $i = 0; $i < 30000; $i++) {
+    print $sock "set bulk$i 0 0 1000 noreply\r\n$value\r\n";
+}
+my $hits = 0;
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "get key$i\r\n";
+    if (scalar <$sock> eq "VALUE key$i 0 1000\r\n") {
+        scalar <$sock>; scalar <$sock>;
+        $hits++;
+    }
+}
+is($hits, 100, "hot items kept");
+mem_get_is($sock, "bulk0", undef);
+mem_get_is($sock, "bulk29999", $value);
+
+my $stats = mem_stats($sock, "items");
+my $kept = 0;
+foreach my $key (keys %$stats) {
+    $kept += $stats->{$key} if $key =~ /^items:\d+:lfu_kept$/;
+}
+ok($kept > 0, "victims kept by the admission filter");
+
+# without the admission filter, the bulk load evicts the hot set
+$server = new_memcached("-m 10");
+$sock = $server->sock;
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "set key$i 0 0 1000 noreply\r\n$value\r\n";
+}
+for (my $i = 0; $i < 30000; $i++) {
+    print $sock "set bulk$i 0 0 1000 noreply\r\n$value\r\n";
+}
+mem_get_is($sock, "key0", undef);
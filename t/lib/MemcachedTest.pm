@@ -968,7 +968,9 @@ sub new_memcached {
     croak("memcached binary not executable\n") unless -x _;
 
     unless ($childpid) {
-        exec "$builddir/timedrun 600 $exe $args";
+        # exec in the shell, so that $childpid is timedrun even if
+        # the args are quoted, e.g. -e 'key1=value1;key2=value2'
+        exec "/bin/sh", "-c", "exec $builddir/timedrun 600 $exe $args";
         exit; # never gets here.
     }
 
@@ -1036,7 +1038,9 @@ sub new_memcached_engine {
     croak("memcached binary not executable\n") unless -x _;
 
     unless ($childpid) {
-        exec "$builddir/timedrun 600 $exe $args";
+        # exec in the shell, so that $childpid is timedrun even if
+        # the args are quoted, e.g. -e 'key1=value1;key2=value2'
+        exec "/bin/sh", "-c", "exec $builddir/timedrun 600 $exe $args";
         exit; # never gets here.
     }
 
@@ -0,0 +1,41 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 13;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# lock-free read path
+{
+    my $server = new_memcached("-e lockfree_get=true");
+    my $sock = $server->sock;
+
+    # get/set through the lock-free read path
+    print $sock "set foo 0 0 6\r\nfooval\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored foo");
+    mem_get_is($sock, "foo", "fooval");
+    mem_get_is($sock, "foo", "fooval", "got foo again");
+    mem_get_is($sock, "nokey", undef, "miss");
+
+    # replace and delete while the item is referenced
+    print $sock "set foo 0 0 7\r\nfooval2\r\n";
+    is(scalar <$sock>, "STORED\r\n", "replaced foo");
+    mem_get_is($sock, "foo", "fooval2");
+    print $sock "delete foo\r\n";
+    is(scalar <$sock>, "DELETED\r\n", "deleted foo");
+    mem_get_is($sock, "foo", undef, "foo is gone");
+
+    # lazy expiration falls back to the exclusive path
+    print $sock "set bar 0 1 6\r\nbarval\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored bar");
+    sleep(2.1);
+    mem_get_is($sock, "bar", undef, "bar expired");
+
+    # flush_all invalidates items seen by the lock-free read path
+    print $sock "set baz 0 0 6\r\nbazval\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored baz");
+    print $sock "flush_all\r\n";
+    is(scalar <$sock>, "OK\r\n", "flushed");
+    mem_get_is($sock, "baz", undef, "baz flushed");
+}
@@ -0,0 +1,51 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-m 10 -e lru_maintainer=true");
+my $sock = $server->sock;
+my $value = "v" x 100;
+my $large = "v" x 10000;
+
+# a bulk load over the memory limit succeeds
+for (my $i = 0; $i < 100000; $i++) {
+    print $sock "set bulk$i 0 0 100 noreply\r\n$value\r\n";
+}
+mem_get_is($sock, "bulk0", undef);
+mem_get_is($sock, "bulk99999", $value);
+for (my $i = 0; $i < 2000; $i++) {
+    print $sock "set large$i 0 0 10000 noreply\r\n$large\r\n";
+}
+mem_get_is($sock, "large0", undef);
+mem_get_is($sock, "large1999", $large);
+
+# the items are evicted by the LRU maintainer
+my $stats = mem_stats($sock);
+ok($stats->{"lru_maintainer_evicted"} > 0, "evicted by the LRU maintainer");
+ok($stats->{"lru_maintainer_runs"} > 0, "LRU maintainer runs");
+is($stats->{"alloc_latency_count"}, 102000, "allocations measured");
+ok($stats->{"alloc_latency_p50"} <= $stats->{"alloc_latency_p99"} &&
+   $stats->{"alloc_latency_p99"} <= $stats->{"alloc_latency_p999"},
+   "allocation latency percentiles");
+
+# the latency is measured without the LRU maintainer if alloc_latency is set
+$server = new_memcached("-m 10 -e alloc_latency=true");
+$sock = $server->sock;
+print $sock "set key 0 0 100\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored key");
+$stats = mem_stats($sock);
+ok($stats->{"alloc_latency_count"} == 1 && !exists $stats->{"lru_maintainer_runs"},
+   "allocation latency without the LRU maintainer");
+
+# neither is enabled, the latency is not measured
+$server = new_memcached("-m 10");
+$sock = $server->sock;
+print $sock "set key 0 0 100\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored key");
+$stats = mem_stats($sock);
+ok(!exists $stats->{"alloc_latency_count"} && !exists $stats->{"lru_maintainer_runs"},
+   "allocation latency not measured");
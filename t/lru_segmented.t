@@ -0,0 +1,74 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 9;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-m 10 -e lru_segmented=true");
+my $sock = $server->sock;
+my $value = "v" x 1000;
+
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "set key$i 0 0 1000 noreply\r\n$value\r\n";
+}
+mem_get_is($sock, "key99", $value);
+
+my $stats = mem_stats($sock, "items");
+my ($number, $hot, $warm, $cold) = (0, 0, 0, 0);
+foreach my $key (keys %$stats) {
+    $number += $stats->{$key} if $key =~ /^items:\d+:number$/;
+    $hot += $stats->{$key} if $key =~ /^items:\d+:hot_items$/;
+    $warm += $stats->{$key} if $key =~ /^items:\d+:warm_items$/;
+    $cold += $stats->{$key} if $key =~ /^items:\d+:cold_items$/;
+}
+is($hot + $warm + $cold, $number, "segment sizes add up");
+ok($hot <= 20 && $warm <= 40 && $cold >= 40, "items moved down by age");
+
+# a scan of the items doesn't move them
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "get key$i\r\n";
+    scalar <$sock>; scalar <$sock>; scalar <$sock>;
+}
+my $hot_after = 0;
+$stats = mem_stats($sock, "items");
+foreach my $key (keys %$stats) {
+    $hot_after += $stats->{$key} if $key =~ /^items:\d+:hot_items$/;
+}
+is($hot_after, $hot, "hot segment kept after a scan");
+
+# the hot set survives a bulk load of items accessed only once
+for (my $i = 0; $i < 30000; $i++) {
+    print $sock "set bulk$i 0 0 1000 noreply\r\n$value\r\n";
+    if ($i % 1000 == 0) {
+        for (my $j = 0; $j < 10; $j++) {
+            print $sock "get key$j\r\n";
+            scalar <$sock>; scalar <$sock>; scalar <$sock>;
+        }
+    }
+}
+my $hits = 0;
+for (my $j = 0; $j < 10; $j++) {
+    print $sock "get key$j\r\n";
+    if (scalar <$sock> eq "VALUE key$j 0 1000\r\n") {
+        scalar <$sock>; scalar <$sock>;
+        $hits++;
+    }
+}
+is($hits, 10, "hot items kept");
+mem_get_is($sock, "key99", undef);
+mem_get_is($sock, "bulk0", undef);
+
+$stats = mem_stats($sock, "items");
+my ($to_hot, $to_warm, $to_cold) = (0, 0, 0);
+foreach my $key (keys %$stats) {
+    $to_hot += $stats->{$key} if $key =~ /^items:\d+:moves_to_hot$/;
+    $to_warm += $stats->{$key} if $key =~ /^items:\d+:moves_to_warm$/;
+    $to_cold += $stats->{$key} if $key =~ /^items:\d+:moves_to_cold$/;
+}
+ok($to_hot > 0 && $to_warm > 0 && $to_cold > 0, "segment moves");
+
+# flush_all walks the whole list
+print $sock "flush_all\r\n";
+is(scalar <$sock>, "OK\r\n", "flushed");
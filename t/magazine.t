@@ -0,0 +1,55 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 11;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock, "slabs");
+is($stats->{"magazine_size"}, 0, "no magazines by default");
+is($stats->{"magazine_hits"}, 0, "no magazine hits");
+
+$server = new_memcached("-e magazine_size=32");
+$sock = $server->sock;
+
+my $ecnt = 500;
+my $value = "m" x 100;
+
+# elements freed by a thread are reused by its next allocations
+print $sock "bop create bkey 0 0 10000\r\n";
+is(scalar <$sock>, "CREATED\r\n", "created bkey");
+for (my $round = 0; $round < 3; $round++) {
+    for (my $i = 0; $i < $ecnt; $i++) {
+        print $sock "bop insert bkey $i 100 noreply\r\n$value\r\n";
+    }
+    print $sock "bop delete bkey 0..100000\r\n";
+    is(scalar <$sock>, "DELETED\r\n", "deleted elements of round $round");
+}
+
+$stats = mem_stats($sock, "slabs");
+is($stats->{"magazine_size"}, 32, "magazine size");
+ok($stats->{"magazine_hits"} > $ecnt, "allocations from the magazines");
+ok($stats->{"magazine_refills"} > 0 && $stats->{"magazine_drains"} > 0,
+   "magazines refilled and drained in bulk");
+ok($stats->{"slabs_lock_acquired"} > 0 && $stats->{"slabs_lock_contended"} >= 0,
+   "slabs lock stats");
+
+# the elements allocated from the magazines are kept intact
+for (my $i = 0; $i < $ecnt; $i++) {
+    print $sock "bop insert bkey $i 100 noreply\r\n" . sprintf("%s%05d", "v" x 95, $i) . "\r\n";
+}
+my $ok = 1;
+print $sock "bop get bkey 0..100000\r\n";
+my $line = scalar <$sock>;
+$ok = 0 if $line ne "VALUE 0 $ecnt\r\n";
+for (my $i = 0; $i < $ecnt && $ok; $i++) {
+    $line = scalar <$sock>;
+    $ok = 0 if $line ne "$i 100 " . sprintf("%s%05d", "v" x 95, $i) . "\r\n";
+}
+$line = scalar <$sock>;
+$ok = 0 if $line ne "END\r\n";
+ok($ok, "elements kept");
@@ -0,0 +1,71 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached("-m 64 -e memlimit_shrink_rate=8388608");
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock);
+is($stats->{"memlimit_shrinking"}, 0, "not shrinking");
+
+my $value = "v" x 100000;
+
+# the pages of a preallocated slab arena are never freed
+SKIP: {
+    skip "slab arena", 10 if mem_stats($sock, "slabs")->{"slab_arena"} ne "none";
+
+    my $stored = 1;
+    for (my $i = 0; $i < 400; $i++) {
+        print $sock "set large$i 0 0 100000\r\n$value\r\n";
+        $stored = 0 if scalar <$sock> ne "STORED\r\n";
+    }
+    for (my $i = 0; $i < 20000; $i++) {
+        print $sock "set small$i 0 0 100 noreply\r\n" . ("s" x 100) . "\r\n";
+    }
+    ok($stored, "stored large items");
+    my $malloced = mem_stats($sock, "slabs")->{"total_malloced"};
+    ok($malloced > 40 * 1024 * 1024, "malloced memory");
+
+    # a memlimit below the malloced memory is reached gradually
+    print $sock "config memlimit 20\r\n";
+    is(scalar <$sock>, "END\r\n", "memlimit shrink started");
+    $stats = mem_stats($sock);
+    is($stats->{"memlimit_shrinking"}, 1, "shrinking");
+    is($stats->{"memlimit_shrink_target"}, 20 * 1024 * 1024, "shrink target");
+
+    # client allocations keep succeeding during the shrink
+    $stored = 1;
+    for (my $i = 0; $i < 50; $i++) {
+        print $sock "set new$i 0 0 100000\r\n$value\r\n";
+        $stored = 0 if scalar <$sock> ne "STORED\r\n";
+        print $sock "set newsmall$i 0 0 100\r\n" . ("n" x 100) . "\r\n";
+        $stored = 0 if scalar <$sock> ne "STORED\r\n";
+    }
+    ok($stored, "stored items while shrinking");
+
+    for (my $i = 0; $i < 100; $i++) {
+        $stats = mem_stats($sock);
+        last if $stats->{"memlimit_shrinking"} == 0;
+        select undef, undef, undef, 0.2;
+    }
+    is($stats->{"memlimit_shrinking"}, 0, "shrink done");
+    ok($stats->{"memlimit_shrink_released"} > 0 && $stats->{"memlimit_shrink_evicted"} > 0,
+       "pages released and items evicted");
+    $stats = mem_stats($sock, "slabs");
+    ok($stats->{"total_malloced"} <= 20 * 1024 * 1024 &&
+       $stats->{"memory_limit"} == 20 * 1024 * 1024, "memory within the new memlimit");
+    mem_get_is($sock, "newsmall49", "n" x 100);
+}
+
+# without a shrink rate, the memlimit can't go below the malloced memory
+$server = new_memcached("-m 64 -e memlimit_shrink_rate=0");
+$sock = $server->sock;
+for (my $i = 0; $i < 400; $i++) {
+    print $sock "set large$i 0 0 100000 noreply\r\n$value\r\n";
+}
+print $sock "config memlimit 20\r\n";
+is(scalar <$sock>, "CLIENT_ERROR bad value\r\n", "memlimit shrink rejected");
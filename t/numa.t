@@ -0,0 +1,44 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 8;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock, "slabs");
+is($stats->{"numa_nodes"}, 0, "no node arenas by default");
+
+# the worker threads are pinned to the nodes, each node has a slab arena
+$server = new_memcached("-m 64 -N");
+$sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+ok($settings->{"numa_nodes"} >= 1, "worker threads pinned");
+$stats = mem_stats($sock, "slabs");
+is($stats->{"numa_nodes"}, $settings->{"numa_nodes"}, "one arena per node");
+
+my $value = "N" x 50000;
+for (my $i = 0; $i < 50; $i++) {
+    print $sock "set key$i 0 0 50000 noreply\r\n$value\r\n";
+}
+print $sock "bop insert bkey 1 5 create 0 0 0\r\ndatum\r\n";
+is(scalar <$sock>, "CREATED_STORED\r\n", "b+tree created");
+mem_get_is($sock, "key49", $value);
+
+$stats = mem_stats($sock, "slabs");
+my $pages = 0;
+for (my $node = 0; $node < $stats->{"numa_nodes"}; $node++) {
+    $pages += $stats->{"numa:$node:slab_pages"};
+}
+ok($pages >= 2, "slab pages from the node arenas");
+ok($stats->{"numa_remote_pages"} <= $pages, "remote pages counted");
+
+# the node arenas can be used without pinning the worker threads
+$server = new_memcached("-m 64 -e numa=true");
+$sock = $server->sock;
+$stats = mem_stats($sock, "slabs");
+ok($stats->{"numa_nodes"} >= 1, "node arenas without -N");
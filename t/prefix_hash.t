@@ -0,0 +1,54 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 11;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+sub hash_stats {
+    my %stats;
+    print $sock "stats hash\r\n";
+    while (my $line = <$sock>) {
+        last if $line =~ /^(END|ERROR)/;
+        $stats{$1} = $2 if $line =~ /^STAT (\S+) (\S+)/;
+    }
+    return \%stats;
+}
+
+my $stats = hash_stats();
+is($stats->{'prefix_hash:power_level'}, 10, "initial prefix hash power");
+is($stats->{'prefix_hash:prefixes'}, 0, "no prefixes");
+
+# the prefix hash table expands with many distinct prefixes
+my $count = 5000;
+for (my $i = 0; $i < $count; $i++) {
+    print $sock "set pfx$i:foo 0 0 6 noreply\r\nfooval\r\n";
+}
+mem_get_is($sock, "pfx0:foo", "fooval");
+mem_get_is($sock, "pfx4999:foo", "fooval");
+
+$stats = hash_stats();
+is($stats->{'prefix_hash:power_level'}, 12, "prefix hash table expanded");
+is($stats->{'prefix_hash:is_expanding'}, 0, "prefix hash expansion done");
+is($stats->{'prefix_hash:prefixes'}, $count, "all prefixes linked");
+ok($stats->{'prefix_hash:max_depth'} < 16, "short prefix hash chains");
+
+my $found = 0;
+print $sock "stats prefixes\r\n";
+while (my $line = <$sock>) {
+    last if $line =~ /^END/;
+    $found++ if $line =~ /^PREFIX pfx\d+ /;
+}
+is($found, $count, "stats prefixes lists all prefixes");
+
+# prefixes are dropped with their last items
+for (my $i = 0; $i < $count; $i++) {
+    print $sock "delete pfx$i:foo noreply\r\n";
+}
+mem_get_is($sock, "pfx0:foo", undef);
+$stats = hash_stats();
+is($stats->{'prefix_hash:prefixes'}, 0, "all prefixes dropped");
@@ -0,0 +1,50 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 10;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock, "slabs");
+is($stats->{"slab_sizes_samples"}, 0, "no size samples by default");
+ok(!defined $stats->{"slab_sizes_tuned"}, "no tuned sizes by default");
+
+# large items clustered around a few sizes, replayed on each layout
+sub store_clustered_items {
+    my ($sock) = @_;
+    my $seed = 1;
+    for (my $i = 0; $i < 300; $i++) {
+        $seed = ($seed * 1103515245 + 12345) % 2147483648;
+        my $len = (70000, 150000, 400000)[$i % 3] + $seed % 2000;
+        print $sock "set key$i 0 0 $len\r\n" . ("s" x $len) . "\r\n";
+        return 0 if scalar <$sock> ne "STORED\r\n";
+    }
+    return 1;
+}
+
+$server = new_memcached("-e slab_sizes_sample=1");
+$sock = $server->sock;
+ok(store_clustered_items($sock), "stored items with the factor layout");
+
+$stats = mem_stats($sock, "slabs");
+is($stats->{"slab_sizes_samples"}, 300, "sampled sizes");
+my $tuned = $stats->{"slab_sizes_tuned"};
+like($tuned, qr/^\d+(-\d+)*$/, "tuned sizes");
+ok($stats->{"slab_sizes_tuned_waste_ratio"} < $stats->{"slab_sizes_waste_ratio"},
+   "less waste estimated with the tuned sizes");
+my $factor_ratio = $stats->{"wasted_ratio"};
+
+# the tuned sizes are applied at restart
+$server = new_memcached("-e slab_sizes=$tuned");
+$sock = $server->sock;
+ok(store_clustered_items($sock), "stored items with the tuned layout");
+$stats = mem_stats($sock, "slabs");
+is($stats->{"1:chunk_size"}, (split(/-/, $tuned))[0], "first class of the tuned sizes");
+ok($stats->{"wasted_ratio"} < $factor_ratio / 10, "less memory wasted with the tuned sizes");
+
+eval { new_memcached("-e slab_sizes=200000-100000"); };
+ok($@, "descending sizes are rejected");
@@ -0,0 +1,88 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 22;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+# slab page reassignment must be enabled at startup
+print $sock "slabs reassign 1 2\r\n";
+is(scalar <$sock>, "NOT_SUPPORTED\r\n", "reassign not enabled");
+print $sock "slabs automove 1\r\n";
+is(scalar <$sock>, "NOT_SUPPORTED\r\n", "automove not enabled");
+
+$server = new_memcached("-m 32 -e slab_reassign=true");
+$sock = $server->sock;
+
+my $value_a = "A" x 60000;
+my $value_b = "B" x 200000;
+my $count_a = 100;
+for (my $i = 0; $i < $count_a; $i++) {
+    print $sock "set akey$i 0 0 60000 noreply\r\n$value_a\r\n";
+}
+print $sock "set bkey 0 0 200000\r\n$value_b\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored bkey");
+
+# the slab classes of the items depend on the item header size
+my $stats = mem_stats($sock, "items");
+my ($clsid_a, $clsid_b) = grep { $stats->{"items:$_:number"} } (1 .. 200);
+is($stats->{"items:$clsid_a:number"}, $count_a, "class of akeys");
+is($stats->{"items:$clsid_b:number"}, 1, "class of bkey");
+
+my $before = mem_stats($sock, "slabs");
+is($before->{"slab_reassign"}, "on", "reassign enabled");
+ok($before->{"$clsid_a:total_pages"} > 2, "akeys use several pages");
+
+print $sock "slabs reassign $clsid_a $clsid_b\r\n";
+is(scalar <$sock>, "OK\r\n", "reassigned a page");
+
+my $after = mem_stats($sock, "slabs");
+is($after->{"$clsid_a:total_pages"}, $before->{"$clsid_a:total_pages"} - 1, "source class lost a page");
+is($after->{"$clsid_b:total_pages"}, $before->{"$clsid_b:total_pages"} + 1, "destination class got a page");
+is($after->{"$clsid_a:pages_moved_out"}, 1, "pages moved out");
+is($after->{"$clsid_b:pages_moved_in"}, 1, "pages moved in");
+is($after->{"slabs_moved"}, 1, "slabs moved");
+is($after->{"total_malloced"}, $before->{"total_malloced"}, "no memory allocated");
+
+# the items of the moved page are evicted, the others are kept
+my $evicted = $after->{"$clsid_a:reassign_evicted"};
+ok($evicted > 0, "items of the moved page evicted");
+my $found = 0;
+for (my $i = 0; $i < $count_a; $i++) {
+    print $sock "get akey$i\r\n";
+    my $line = scalar <$sock>;
+    if ($line =~ /^VALUE /) {
+        my $data;
+        read($sock, $data, 60000 + 2);
+        $line = scalar <$sock>;
+        $found++;
+    }
+}
+is($found, $count_a - $evicted, "other items kept");
+
+print $sock "slabs reassign $clsid_a $clsid_a\r\n";
+like(scalar <$sock>, qr/^BADCLASS /, "same class");
+print $sock "slabs reassign 0 $clsid_a\r\n";
+like(scalar <$sock>, qr/^BADCLASS /, "small memory class gives no page");
+print $sock "slabs reassign $clsid_a 255\r\n";
+like(scalar <$sock>, qr/^BADCLASS /, "no such class");
+print $sock "slabs reassign " . ($clsid_b + 1) . " $clsid_a\r\n";
+like(scalar <$sock>, qr/^NOSPARE /, "class without pages");
+
+# the automover moves pages to the class evicting items
+print $sock "slabs automove 1\r\n";
+is(scalar <$sock>, "OK\r\n", "automove enabled");
+my $moved = 0;
+for (my $tries = 0; $tries < 50 && $moved == 0; $tries++) {
+    for (my $i = 0; $i < 20; $i++) {
+        print $sock "set bkey$tries:$i 0 0 200000 noreply\r\n$value_b\r\n";
+    }
+    select(undef, undef, undef, 0.2);
+    $stats = mem_stats($sock, "slabs");
+    $moved = 1 if $stats->{"$clsid_a:pages_moved_out"} > 1;
+}
+ok($moved, "automover moved a page");
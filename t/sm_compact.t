@@ -0,0 +1,108 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 15;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock, "slabs");
+is($stats->{"SM:compact_runs"}, 0, "no compaction by default");
+
+$server = new_memcached("-e sm_compact=true");
+$sock = $server->sock;
+
+my $kcnt = 40; # collections of each type
+my $ecnt = 300; # elements of each collection
+my @types = ("lop", "sop", "mop", "bop");
+
+sub elem_value {
+    my ($type, $i, $j) = @_;
+    return sprintf("%s%03d%03d", "x" x 94, $i, $j);
+}
+
+# sorted element lines of a collection, as returned by its get command
+sub coll_elements {
+    my ($cmd) = @_;
+    my @lines = ();
+    print $sock "$cmd\r\n";
+    my $line = scalar <$sock>;
+    return "$line" if $line !~ /^VALUE /;
+    while (($line = scalar <$sock>) !~ /^END/) {
+        push(@lines, $line);
+    }
+    return join("", sort(@lines));
+}
+
+sub expected_elements {
+    my ($type, $i) = @_;
+    my @lines = ();
+    for (my $j = 0; $j < $ecnt; $j++) {
+        my $val = elem_value($type, $i, $j);
+        if ($type eq "mop") {
+            push(@lines, "f$j 100 $val\r\n");
+        } elsif ($type eq "bop") {
+            push(@lines, "$j 100 $val\r\n");
+        } else {
+            push(@lines, "100 $val\r\n");
+        }
+    }
+    return join("", sort(@lines));
+}
+
+# the elements of all collections are mixed in the small memory blocks
+foreach my $type (@types) {
+    for (my $i = 0; $i < $kcnt; $i++) {
+        print $sock "$type create $type$i 0 0 1000 noreply\r\n";
+    }
+}
+for (my $j = 0; $j < $ecnt; $j++) {
+    for (my $i = 0; $i < $kcnt; $i++) {
+        print $sock "lop insert lop$i -1 100 noreply\r\n" . elem_value("lop", $i, $j) . "\r\n";
+        print $sock "sop insert sop$i 100 noreply\r\n" . elem_value("sop", $i, $j) . "\r\n";
+        print $sock "mop insert mop$i f$j 100 noreply\r\n" . elem_value("mop", $i, $j) . "\r\n";
+        print $sock "bop insert bop$i $j 100 noreply\r\n" . elem_value("bop", $i, $j) . "\r\n";
+    }
+}
+my $filled = mem_stats($sock, "slabs");
+ok($filled->{"SM:used_block_count"} > 10, "elements use many blocks");
+ok($filled->{"SM:fragmentation"} < 0.25, "blocks are filled");
+
+# keep one of ten collections
+foreach my $type (@types) {
+    for (my $i = 0; $i < $kcnt; $i++) {
+        next if $i % 10 == 0;
+        print $sock "delete $type$i\r\n";
+        is(scalar <$sock>, "DELETED\r\n", "deleted $type$i") if $i == 1;
+    }
+}
+
+# the compactor evacuates the sparse blocks
+my $done = 0;
+for (my $tries = 0; $tries < 100 && !$done; $tries++) {
+    select(undef, undef, undef, 0.1);
+    $stats = mem_stats($sock, "slabs");
+    $done = 1 if $stats->{"SM:compact_freed_blocks"} > 0
+              && $stats->{"SM:fragmentation"} < 0.5;
+}
+ok($done, "sparse blocks evacuated");
+ok($stats->{"SM:compact_moved_slots"} > 0, "slots moved");
+ok($stats->{"SM:used_block_count"} < $filled->{"SM:used_block_count"} / 2, "blocks freed");
+
+# the elements are kept in their collections
+my %get_cmds = ("lop" => "0..-1", "sop" => "0", "mop" => "0 0", "bop" => "0..1000");
+foreach my $type (@types) {
+    my $ok = 1;
+    for (my $i = 0; $i < $kcnt; $i += 10) {
+        if (coll_elements("$type get $type$i $get_cmds{$type}")
+            ne expected_elements($type, $i)) {
+            $ok = 0;
+        }
+    }
+    ok($ok, "$type elements kept");
+}
+print $sock "bop insert bop0 1000 5\r\ndatum\r\n";
+is(scalar <$sock>, "STORED\r\n", "b+tree updated after compaction");
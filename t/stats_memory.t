@@ -0,0 +1,71 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 16;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached();
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock, "memory");
+is($stats->{"kv_items"}, 0, "no kv items");
+is($stats->{"btree_bytes"}, 0, "no btree bytes");
+is($stats->{"overhead_meta_bytes"}, 0, "no meta info");
+
+print $sock "set kv 0 0 5\r\nhello\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored kv");
+my $len = 100000;
+print $sock "set large 0 0 $len\r\n" . ("l" x $len) . "\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored large");
+
+print $sock "bop create bkey 0 0 10000\r\n";
+is(scalar <$sock>, "CREATED\r\n", "created bkey");
+for (my $i = 0; $i < 1000; $i++) {
+    print $sock "bop insert bkey $i 10 noreply\r\n0123456789\r\n";
+}
+print $sock "sop create skey 0 0 10000\r\n";
+is(scalar <$sock>, "CREATED\r\n", "created skey");
+for (my $i = 0; $i < 200; $i++) {
+    print $sock "sop insert skey 10 noreply\r\n" . sprintf("%010d", $i) . "\r\n";
+}
+print $sock "mop create mkey 0 0 10000\r\n";
+is(scalar <$sock>, "CREATED\r\n", "created mkey");
+for (my $i = 0; $i < 100; $i++) {
+    print $sock "mop insert mkey f$i 10 noreply\r\n" . sprintf("%010d", $i) . "\r\n";
+}
+
+$stats = mem_stats($sock, "memory");
+ok($stats->{"kv_items"} == 2 && $stats->{"btree_items"} == 1 &&
+   $stats->{"set_items"} == 1 && $stats->{"map_items"} == 1, "items of each type");
+my $bytes = 0;
+$bytes += $stats->{"${_}_bytes"} for ("kv", "list", "set", "map", "btree");
+is($bytes, mem_stats($sock)->{"bytes"}, "bytes of the item types add up");
+ok($stats->{"overhead_meta_bytes"} > 0 && $stats->{"overhead_btree_node_bytes"} > 0 &&
+   $stats->{"overhead_set_node_bytes"} > 0 && $stats->{"overhead_map_node_bytes"} > 0,
+   "collection overhead");
+ok($stats->{"slab_used_bytes"} >= $len &&
+   $stats->{"slab_requested_bytes"} <= $stats->{"slab_used_bytes"}, "slab classes");
+
+# the slot classes and the block usage buckets add up to the totals
+my ($used, $requested, $blocks) = (0, 0, 0);
+foreach my $key (keys %$stats) {
+    $used += $stats->{$key} if $key =~ /^SM:\d+:used_bytes$/;
+    $requested += $stats->{$key} if $key =~ /^SM:\d+:requested_bytes$/;
+    $blocks += $stats->{$key} if $key =~ /^SM:block_usage_\d+$/;
+}
+ok($used == $stats->{"SM:used_bytes"} && $requested == $stats->{"SM:requested_bytes"} &&
+   $requested <= $used, "small memory slot classes");
+is($blocks, $stats->{"SM:block_count"}, "small memory block usage");
+
+# the nodes are freed with the elements
+print $sock "delete bkey\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted bkey");
+for (my $i = 0; $i < 20; $i++) {
+    $stats = mem_stats($sock, "memory");
+    last if $stats->{"overhead_btree_node_bytes"} == 0;
+    select undef, undef, undef, 0.1;
+}
+ok($stats->{"btree_items"} == 0 && $stats->{"btree_bytes"} == 0 &&
+   $stats->{"overhead_btree_node_bytes"} == 0, "btree memory released");
@@ -391,6 +391,38 @@ static void create_worker(void *(*func)(void *), void *arg, pthread_t *id) {
     }
 }
 
+/*
+ * Pins the calling worker thread to the cpus of a NUMA node, so that
+ * the memory it touches first is allocated from the node.
+ */
+static void pin_worker_to_node(int node) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    long cpu, ncpus = sysconf(_SC_NPROCESSORS_CONF);
+    int count = 0;
+    int ret;
+
+    CPU_ZERO(&cpus);
+    for (cpu = 0; cpu < ncpus && cpu < CPU_SETSIZE; cpu++) {
+        if (mc_numa_cpu_node(cpu) == node) {
+            CPU_SET(cpu, &cpus);
+            count++;
+        }
+    }
+    if (count == 0) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                "NUMA node %d has no cpus, worker thread not pinned\n", node);
+        return;
+    }
+    if ((ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) != 0) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                "Can't pin worker thread to NUMA node %d: %s\n", node, strerror(ret));
+    }
+#else
+    (void)node;
+#endif
+}
+
 /****************************** LIBEVENT THREADS *****************************/
 
 /*
@@ -467,6 +499,9 @@ static void *worker_libevent(void *arg) {
     /* Any per-thread setup can happen here; thread_init() will block until
      * all threads have finished initializing.
      */
+    if (me->numa_node >= 0) {
+        pin_worker_to_node(me->numa_node);
+    }
 
     pthread_mutex_lock(&init_lock);
     init_count++;
@@ -752,6 +787,8 @@ void threadlocal_stats_clear(struct thread_stats *stats) {
     stats->cmd_flush = 0;
     stats->cmd_flush_prefix = 0;
     stats->conn_yields = 0;
+    stats->resp_arena_allocs = 0;
+    stats->resp_arena_mallocs = 0;
     stats->auth_cmds = 0;
     stats->auth_errors = 0;
     stats->cmd_lop_create = 0;
@@ -891,6 +928,8 @@ void threadlocal_stats_aggregate(struct thread_stats *thread_stats, struct threa
         stats->cmd_flush += thread_stats[ii].cmd_flush;
         stats->cmd_flush_prefix += thread_stats[ii].cmd_flush_prefix;
         stats->conn_yields += thread_stats[ii].conn_yields;
+        stats->resp_arena_allocs += thread_stats[ii].resp_arena_allocs;
+        stats->resp_arena_mallocs += thread_stats[ii].resp_arena_mallocs;
         stats->auth_cmds += thread_stats[ii].auth_cmds;
         stats->auth_errors += thread_stats[ii].auth_errors;
         stats->cmd_lop_create += thread_stats[ii].cmd_lop_create;
@@ -1101,6 +1140,7 @@ void thread_init(int nthr, struct event_base *main_base) {
         threads[i].notify_receive_fd = fds[0];
         threads[i].notify_send_fd = fds[1];
         threads[i].index = i;
+        threads[i].numa_node = settings.numa_nodes > 0 ? i % settings.numa_nodes : -1;
 
         setup_thread(&threads[i]);
 #ifdef __WIN32__
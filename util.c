@@ -23,6 +23,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include <memcached/util.h>
 
@@ -201,6 +205,56 @@ void vperror(const char *fmt, ...) {
     perror(buf);
 }
 
+int mc_numa_nodes(void) {
+    char buf[256];
+    char *last;
+    int nodes = 1;
+    FILE *fp = fopen("/sys/devices/system/node/online", "r");
+
+    if (fp == NULL) {
+        return 1;
+    }
+    /* a node list such as "0-1" or "0,2", the last node has the largest id */
+    if (fgets(buf, sizeof(buf), fp) != NULL) {
+        last = buf + strcspn(buf, "\n");
+        while (last > buf && isdigit((unsigned char)last[-1])) {
+            last--;
+        }
+        if (isdigit((unsigned char)*last)) {
+            nodes = atoi(last) + 1;
+        }
+    }
+    fclose(fp);
+    return nodes < MC_MAX_NUMA_NODES ? nodes : MC_MAX_NUMA_NODES;
+}
+
+int mc_numa_cpu_node(int cpu) {
+    char path[128];
+    int node;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    if (access(path, F_OK) != 0) {
+        return -1;
+    }
+    for (node = 0; node < MC_MAX_NUMA_NODES; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0) {
+            return node;
+        }
+    }
+    return 0;
+}
+
+int mc_numa_current_node(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned int cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0 && node < MC_MAX_NUMA_NODES) {
+        return (int)node;
+    }
+#endif
+    return 0;
+}
+
 #ifndef HAVE_HTONLL
 static uint64_t mc_swap64(uint64_t in) {
 #ifndef WORDS_BIGENDIAN